@@ -0,0 +1,268 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - adaptive per-metric baselines
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "baseline.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cmath>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+State file layout, native byte order (the file never leaves the host that wrote it):
+
+    "CGPB" u32 version u32 entry_count u32 names_size
+    BaselineEntry[entry_count] char names[names_size]
+*/
+static const char           BASELINE_MAGIC[4]   = {'C', 'G', 'P', 'B'};
+static const std::uint32_t  BASELINE_VERSION    = 1;
+
+struct BaselineHeader {
+    char            magic[4];
+    std::uint32_t   version;
+    std::uint32_t   entry_count;
+    std::uint32_t   names_size;
+};
+
+struct BaselineEntry {
+    std::uint32_t   name_offset; // in names
+    std::uint32_t   name_length;
+    std::uint32_t   name_hash;   // NameInterner::hash(), names aren't hashed again when loading
+    std::uint32_t   samples;
+    double          mean;
+    double          variance;
+    double          pending;
+    std::int64_t    pending_mtime;
+};
+
+static_assert(sizeof(BaselineHeader) == 16 && sizeof(BaselineEntry) == 48, "the state file layout depends on these having no padding");
+
+/*
+A metric this close to constant has no spread to measure deviations with: the standard deviation
+is taken as at least this fraction of the mean, so a latency stuck at 100us doesn't turn CRITICAL
+at 100.1us.
+*/
+static const double MIN_RELATIVE_DEVIATION = 0.01;
+
+MetricBaselines::MetricBaselines(const std::string& state_file, double alpha) throw (std::runtime_error)
+    : m_state_file(state_file),
+      m_alpha(alpha),
+      m_changed(false),
+      m_baselines(1),
+      m_cursor(0),
+      m_lock_fd(open_locked(state_file)) // this throws; held until saved, concurrent checks update the baselines in turn
+{
+    struct stat attrib;
+
+    if (fstat(m_lock_fd, &attrib) == -1 || attrib.st_size == 0)
+    {
+        return; // first run for this volume, open_locked() just created the file
+    }
+
+    MappedFile      state(state_file); // this throws
+    BaselineHeader  header;
+
+    try
+    {
+        if (state.size() < sizeof(header))
+        {
+            throw std::runtime_error("truncated");
+        }
+
+        std::memcpy(&header, state.data(), sizeof(header));
+
+        if (std::memcmp(header.magic, BASELINE_MAGIC, sizeof(header.magic)) != 0 || header.version != BASELINE_VERSION)
+        {
+            throw std::runtime_error("unknown format");
+        }
+
+        if (state.size() != sizeof(header) + (std::size_t) header.entry_count * sizeof(BaselineEntry) + header.names_size)
+        {
+            throw std::runtime_error("truncated");
+        }
+
+        const char* entries = state.data() + sizeof(header);
+        const char* names   = entries + (std::size_t) header.entry_count * sizeof(BaselineEntry);
+
+        m_names.reserve(header.entry_count, header.names_size);
+        m_baselines.reserve(header.entry_count + 1);
+
+        for (std::uint32_t i = 0; i < header.entry_count; i++)
+        {
+            BaselineEntry entry;
+
+            std::memcpy(&entry, entries + (std::size_t) i * sizeof(entry), sizeof(entry));
+
+            if (entry.name_length == 0 || (std::uint64_t) entry.name_offset + entry.name_length > header.names_size)
+            {
+                throw std::runtime_error("bad name");
+            }
+
+            // the names were unique when written, they get the IDs 1, 2, ... in file order
+            if (m_names.intern({names + entry.name_offset, names + entry.name_offset + entry.name_length}, entry.name_hash) != i + 1)
+            {
+                throw std::runtime_error("duplicate name");
+            }
+
+            m_baselines.push_back({entry.mean, entry.variance, entry.samples, entry.pending, entry.pending_mtime});
+        }
+    }
+    catch (const std::runtime_error& e)
+    {
+        // written by another version or damaged, the baselines are learned again
+        if (g_verbose) std::cout << "Ignoring baseline state " << state_file << ": " << e.what() << std::endl;
+
+        m_names = NameInterner();
+        m_cursor = 0;
+        m_baselines.assign(1, Baseline());
+        m_changed = true;
+    }
+}
+
+MetricBaselines::~MetricBaselines()
+{
+    close(m_lock_fd);
+}
+
+void MetricBaselines::fold(Baseline& baseline, double value) const
+{
+    if (baseline.samples == 0)
+    {
+        baseline.mean     = value;
+        baseline.variance = 0;
+    }
+    else
+    {
+        // West's incremental form of the exponentially weighted mean and variance
+        double difference = value - baseline.mean;
+        double increment  = m_alpha * difference;
+
+        baseline.mean     += increment;
+        baseline.variance  = (1 - m_alpha) * (baseline.variance + difference * increment);
+    }
+
+    baseline.samples++;
+}
+
+ReturnCode MetricBaselines::apply_thresholds(MetricTable& metrics, const CheckOptions& options, std::time_t dump_mtime)
+{
+    std::vector<std::pair<std::string, Metric> >    exceeding;
+    std::vector<double>                             severities;
+    ReturnCode                                      check_code = ReturnCode::OK;
+
+    for (MetricTable::Index index : metrics.metrics())
+    {
+        DumpView        name   = metrics.name(index);
+        const Metric&   metric = metrics.value(index);
+        std::uint32_t   id     = m_cursor + 1;
+
+        // the metrics come in name order, as they were saved: the common case is the baseline following the last one
+        if (id >= m_baselines.size() || m_names.name(id).size() != name.size() || std::memcmp(m_names.name(id).begin, name.begin, name.size()) != 0)
+        {
+            id = m_names.intern(name);
+        }
+
+        m_cursor = id;
+
+        if (id == m_baselines.size())
+        {
+            m_baselines.push_back({0, 0, 0, 0, 0});
+        }
+
+        Baseline& baseline = m_baselines[id];
+
+        if (baseline.pending_mtime != dump_mtime)
+        {
+            // a new dump: the previous one's value becomes part of the baseline, this one's waits for the next dump
+            if (baseline.pending_mtime != 0) fold(baseline, baseline.pending);
+
+            baseline.pending       = metric.value;
+            baseline.pending_mtime = dump_mtime;
+            m_changed              = true;
+        }
+
+        if (baseline.samples < (std::uint32_t) options.baseline_warmup) continue;
+
+        double deviation = std::max(std::sqrt(baseline.variance), MIN_RELATIVE_DEVIATION * std::fabs(baseline.mean));
+
+        if (deviation == 0) continue;
+
+        double sigmas = (metric.value - baseline.mean) / deviation;
+
+        if (g_verbose) std::cout.write(name.begin, name.size()) << ": " << metric.value << " against a baseline of " << baseline.mean << " +- " << deviation << ", " << sigmas << " sigma" << std::endl;
+
+        if (sigmas >= options.warning_threshold.value || sigmas >= options.critical_threshold.value)
+        {
+            // listed after the loop, adding to the table moves its names
+            exceeding.push_back({std::string(name.begin, name.end), metric});
+            severities.push_back(severity_ratio(sigmas, options.warning_threshold.value));
+
+            if (sigmas >= options.critical_threshold.value)
+                check_code = ReturnCode::Critical;
+            else if (check_code != ReturnCode::Critical)
+                check_code = ReturnCode::Warning;
+        }
+    }
+
+    for (std::size_t i = 0; i < exceeding.size(); i++)
+    {
+        metrics.set_exceeding(exceeding[i].first, exceeding[i].second, severities[i]);
+    }
+
+    return check_code;
+}
+
+void MetricBaselines::save() const throw (std::runtime_error)
+{
+    if (! m_changed) return;
+
+    BaselineHeader  header;
+    std::string     names;
+    std::string     contents;
+
+    std::memcpy(header.magic, BASELINE_MAGIC, sizeof(header.magic));
+    header.version     = BASELINE_VERSION;
+    header.entry_count = m_baselines.size() - 1;
+
+    contents.resize(sizeof(header) + (std::size_t) header.entry_count * sizeof(BaselineEntry));
+
+    for (std::uint32_t id = 1; id < m_baselines.size(); id++)
+    {
+        const Baseline& baseline = m_baselines[id];
+        DumpView        name     = m_names.name(id);
+        BaselineEntry   entry    = {(std::uint32_t) names.size(), (std::uint32_t) name.size(), m_names.hash(id), baseline.samples,
+                                    baseline.mean, baseline.variance, baseline.pending, baseline.pending_mtime};
+
+        std::memcpy(&contents[sizeof(header) + (std::size_t) (id - 1) * sizeof(entry)], &entry, sizeof(entry));
+        names.append(name.begin, name.end);
+    }
+
+    header.names_size = names.size();
+
+    std::memcpy(&contents[0], &header, sizeof(header));
+    contents += names;
+
+    replace_file(m_state_file, contents); // concurrent checks never see half a file
+}
+
+std::string baseline_state_file(const std::string& state_dir, const std::string& volume, const CheckOptions& options)
+{
+    std::ostringstream key, path;
+
+    // the baselines are of the values as evaluated, in the output unit
+    key << (int) options.unit_type_output << '\t' << (int) options.gluster_unit_type << '\t' << (int) options.interval_mode << '\t' << options.filter_regex;
+
+    path << state_dir << "/check_gluster_perf_" << volume << "_" << std::hex << std::setw(16) << std::setfill('0') << hash_text(key.str()) << ".baseline";
+
+    return path.str();
+}
@@ -0,0 +1,82 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - adaptive per-metric baselines
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_BASELINE_HPP
+#define CHECK_GLUSTER_PERF_BASELINE_HPP
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <ctime>
+#include <cstdint>
+
+#include "check_gluster_perf.hpp"
+#include "dump_reader.hpp"
+#include "metric_table.hpp"
+#include "metric_groups.hpp"
+
+/*
+The exponentially weighted moving mean and variance of every metric of a volume, kept in a
+state file under -state-dir. With -apply-on-baseline, a metric is compared with its own
+baseline: -w and -c are how many standard deviations above its mean it may be.
+
+Updating a metric's baseline is O(1). The file is loaded by interning every name once, with the
+hash stored along with it, the baselines are then an array indexed by the name's ID. The metrics
+are looked up in the order they were saved in, so a lookup is usually one comparison.
+
+A dump's value is only folded into the baseline when the next dump comes, so that checks run
+again on the same dump compare it with the same baseline.
+
+The state file is locked with open_locked() from loading until the object is destroyed: checks
+of the same volume at the same time update the baselines one after the other, none of them
+overwrites the others' updates.
+*/
+class MetricBaselines
+{
+    public:
+        MetricBaselines(const std::string& state_file, double alpha) throw (std::runtime_error);
+        ~MetricBaselines();
+
+        /*
+        Compares every metric with its baseline, lists those deviating by -w/-c standard
+        deviations or more in 'metrics' and returns the resulting check code. Metrics with fewer
+        than 'warmup' dumps in their baseline are only recorded.
+        */
+        ReturnCode  apply_thresholds(MetricTable& metrics, const CheckOptions& options, std::time_t dump_mtime);
+
+        /* Persists the baselines, unless the dump was already recorded */
+        void        save() const throw (std::runtime_error);
+
+        std::size_t size() const { return m_baselines.size() - 1; }
+
+    private:
+        MetricBaselines(const MetricBaselines&);
+        MetricBaselines& operator=(const MetricBaselines&);
+
+        struct Baseline {
+            double          mean;
+            double          variance;
+            std::uint32_t   samples;        // the dumps folded into mean and variance
+            double          pending;        // the value of the last dump, not folded in yet
+            std::int64_t    pending_mtime;  // that dump's mtime, 0 if there is none
+        };
+
+        void        fold(Baseline& baseline, double value) const;
+
+        std::string             m_state_file;
+        double                  m_alpha;
+        bool                    m_changed;
+        NameInterner            m_names;
+        std::vector<Baseline>   m_baselines; // indexed by the interned name's ID, 0 is unused
+        std::uint32_t           m_cursor;    // the ID of the last metric looked up
+        int                     m_lock_fd;   // of the state file, locked
+};
+
+/* The state file -apply-on-baseline uses for a volume, one per volume, filter and output unit */
+std::string baseline_state_file(const std::string& state_dir, const std::string& volume, const CheckOptions& options);
+
+#endif
@@ -0,0 +1,258 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - multi volume (batch) checks
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "batch.hpp"
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <algorithm>
+#include <sstream>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <glob.h>
+#include <errno.h>
+#include <string.h>
+
+void run_parallel(std::size_t count, unsigned threads, const std::function<void(std::size_t)>& task)
+{
+    std::atomic<std::size_t>    next_index(0);
+    std::exception_ptr          first_error;
+    std::mutex                  error_mutex;
+    std::vector<std::thread>    workers;
+
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    threads = std::min<std::size_t>(threads, count);
+
+    auto worker = [&]()
+    {
+        for (std::size_t index = next_index++; index < count; index = next_index++)
+        {
+            try
+            {
+                task(index);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+
+                if (! first_error) first_error = std::current_exception();
+            }
+        }
+    };
+
+    if (threads <= 1)
+    {
+        worker(); // no point in spawning a thread to wait for it
+    }
+    else
+    {
+        workers.reserve(threads);
+
+        for (unsigned i = 0; i < threads; i++)
+        {
+            workers.emplace_back(worker);
+        }
+
+        for (std::thread& thread : workers)
+        {
+            thread.join();
+        }
+    }
+
+    if (first_error)
+    {
+        std::rethrow_exception(first_error);
+    }
+}
+
+bool is_volume_list(const std::string& volumes)
+{
+    return volumes == "*" || volumes.find(',') != std::string::npos;
+}
+
+std::vector<std::string> expand_volume_list(const std::string& volumes, const std::string& stats_dir) throw (std::runtime_error)
+{
+    std::vector<std::string> result;
+
+    if (volumes != "*")
+    {
+        std::istringstream  list(volumes);
+        std::string         volume;
+
+        while (std::getline(list, volume, ','))
+        {
+            if (! volume.empty()) result.push_back(volume);
+        }
+
+        return result;
+    }
+
+    const std::string   prefix = "glusterfs_",
+                        suffix = ".dump";
+    DIR*                directory = opendir(stats_dir.c_str());
+
+    if (directory == nullptr)
+    {
+        std::ostringstream error;
+        error << strerror(errno) << " While trying to list: " << stats_dir;
+
+        throw std::runtime_error(error.str());
+    }
+
+    while (struct dirent* entry = readdir(directory))
+    {
+        std::string name = entry->d_name;
+
+        if (name.size() > prefix.size() + suffix.size() &&
+            name.compare(0, prefix.size(), prefix) == 0 &&
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+        {
+            result.push_back(name.substr(prefix.size(), name.size() - prefix.size() - suffix.size()));
+        }
+    }
+
+    closedir(directory);
+
+    std::sort(result.begin(), result.end());
+
+    return result;
+}
+
+std::vector<std::string> expand_dump_files(const std::string& pattern) throw (std::runtime_error)
+{
+    std::vector<std::string>    files;
+    struct stat                 attrib;
+
+    if (stat(pattern.c_str(), &attrib) == 0 && S_ISDIR(attrib.st_mode))
+    {
+        DIR* directory = opendir(pattern.c_str());
+
+        if (directory == nullptr)
+        {
+            std::ostringstream error;
+            error << strerror(errno) << " While trying to list: " << pattern;
+
+            throw std::runtime_error(error.str());
+        }
+
+        while (struct dirent* entry = readdir(directory))
+        {
+            std::string path = pattern + "/" + entry->d_name;
+
+            if (stat(path.c_str(), &attrib) == 0 && S_ISREG(attrib.st_mode)) files.push_back(path);
+        }
+
+        closedir(directory);
+    }
+    else
+    {
+        glob_t  matches;
+        int     result = glob(pattern.c_str(), 0, nullptr, &matches);
+
+        if (result != 0 && result != GLOB_NOMATCH)
+        {
+            throw std::runtime_error("Couldn't expand the pattern: " + pattern);
+        }
+
+        for (std::size_t i = 0; result == 0 && i < matches.gl_pathc; i++)
+        {
+            if (stat(matches.gl_pathv[i], &attrib) == 0 && S_ISREG(attrib.st_mode)) files.push_back(matches.gl_pathv[i]);
+        }
+
+        globfree(&matches);
+    }
+
+    std::sort(files.begin(), files.end());
+
+    return files;
+}
+
+ReturnCode worst_state(ReturnCode a, ReturnCode b)
+{
+    static const int severity[] = {0, 2, 3, 1}; // indexed by ReturnCode: OK, Warning, Critical, Unknown
+
+    return severity[(int) a] >= severity[(int) b] ? a : b;
+}
+
+const char* state_name(ReturnCode code)
+{
+    switch (code)
+    {
+        case ReturnCode::OK:        return "OK";
+        case ReturnCode::Warning:   return "WARNING";
+        case ReturnCode::Critical:  return "CRITICAL";
+        case ReturnCode::Unknown:   return "UNKNOWN";
+    }
+
+    return "UNKNOWN";
+}
+
+ReturnCode output_batch_per_volume(std::ostream& output, const std::vector<CheckResult>& results)
+{
+    ReturnCode worst = ReturnCode::OK;
+
+    for (const CheckResult& result : results)
+    {
+        std::string line = result.output;
+
+        // single checks may or may not end with a new line, batch output always has exactly one
+        while (! line.empty() && line[line.size() - 1] == '\n') line.erase(line.size() - 1);
+
+        output << result.volume << ": " << line << "\n";
+
+        worst = worst_state(worst, result.code);
+    }
+
+    return worst;
+}
+
+ReturnCode output_batch_combined(std::ostream& output, const std::vector<CheckResult>& results, const CheckOptions& options)
+{
+    ReturnCode          worst = ReturnCode::OK;
+    std::ostringstream  not_ok, perfdata;
+    int                 not_ok_count = 0;
+
+    for (const CheckResult& result : results)
+    {
+        worst = worst_state(worst, result.code);
+
+        if (result.code != ReturnCode::OK)
+        {
+            not_ok << (not_ok_count++ ? ", " : "") << result.volume << " " << state_name(result.code);
+        }
+
+        if (result.has_average)
+        {
+            Metric warn_t = convert(options.warning_threshold, result.total_average.unit);
+            Metric crit_t = convert(options.critical_threshold, result.total_average.unit);
+
+            perfdata << '\'' << result.volume << "_total_average'=" << result.total_average.value << unit_name(result.total_average.unit) << ";" << warn_t.value << ";" << crit_t.value << " ";
+        }
+    }
+
+    output << "GlusterFS Latency " << state_name(worst) << " - ";
+
+    if (not_ok_count == 0)
+    {
+        output << "All " << results.size() << " volume(s) within thresholds.";
+    } else
+    {
+        output << not_ok_count << " of " << results.size() << " volume(s) not OK: " << not_ok.str();
+    }
+
+    output << "|" << perfdata.str();
+
+    return worst;
+}
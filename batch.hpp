@@ -0,0 +1,53 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - multi volume (batch) checks
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_BATCH_HPP
+#define CHECK_GLUSTER_PERF_BATCH_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <ostream>
+#include <stdexcept>
+
+#include "check_gluster_perf.hpp"
+
+/*
+Runs task(0) ... task(count - 1) on a bounded pool of at most 'threads' workers (0 means one per
+core) and returns once all of them are done. Workers pull the next index as soon as they're free,
+so slow items don't hold up the rest. The first exception thrown by a task is rethrown here.
+*/
+void        run_parallel(std::size_t count, unsigned threads, const std::function<void(std::size_t)>& task);
+
+/*
+Turns the -vol argument into a list of volumes: a comma separated list of names, or "*" for
+every glusterfs_<volume>.dump found in 'stats_dir'.
+*/
+std::vector<std::string> expand_volume_list(const std::string& volumes, const std::string& stats_dir) throw (std::runtime_error);
+
+/*
+The dump files given to -replay or -nodes: every file in a directory, or the files matching a
+glob pattern, in name order.
+*/
+std::vector<std::string> expand_dump_files(const std::string& pattern) throw (std::runtime_error);
+
+/* True if -vol names more than a single volume, in which case batch output is used */
+bool        is_volume_list(const std::string& volumes);
+
+/* Nagios severity order: OK < UNKNOWN < WARNING < CRITICAL */
+ReturnCode  worst_state(ReturnCode a, ReturnCode b);
+
+/* "OK", "WARNING", "CRITICAL" or "UNKNOWN" */
+const char* state_name(ReturnCode code);
+
+/* Writes one "<volume>: <check output>" line per volume, returns the worst state of all */
+ReturnCode  output_batch_per_volume(std::ostream& output, const std::vector<CheckResult>& results);
+
+/* Writes a single line with the worst state and every volume's total average as perfdata */
+ReturnCode  output_batch_combined(std::ostream& output, const std::vector<CheckResult>& results, const CheckOptions& options);
+
+#endif
@@ -0,0 +1,448 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - benchmarks
+
+Microbenchmarks of the pieces a check is made of, on a generated dump, followed by end-to-end
+checks of generated dumps from kilobytes up to the size given on the command line:
+
+    bench [max_megabytes]
+
+Every end-to-end check runs in a child process of its own, so the peak RSS reported is the
+check's and not the one of whatever ran before it.
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <regex>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <cstdio>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "json/src/json.hpp"
+#include "check_gluster_perf.hpp"
+#include "dump_reader.hpp"
+#include "dump_stream.hpp"
+#include "structural_index.hpp"
+#include "metric_filter.hpp"
+#include "metric_table.hpp"
+#include "metric_aggregate.hpp"
+#include "metric_evaluator.hpp"
+#include "units.hpp"
+#include "baseline.hpp"
+#include "bench/dump_generator.hpp"
+
+using json = nlohmann::json;
+
+// defined in main.cpp, which is built with CHECK_GLUSTER_PERF_NO_MAIN for the benchmarks
+int         parse_json_dump(const DumpView& dump, const std::string& file_path, std::vector<json>& results, const MetricFilter* filter = nullptr) throw (std::runtime_error);
+std::string nagios_output_metrics(const MetricTable& metrics, const Metric& warn, const Metric& crit);
+ReturnCode  process_metrics(MetricTable& metrics,
+                            Metric& total_average,
+                            const std::vector<json>& dump_data,
+                            const Metric& warning_threshold,
+                            const Metric& critical_threshold,
+                            const UnitType& unit_type_output,
+                            const UnitType& gluster_unit_type,
+                            const MetricFilter& metric_filter,
+                            bool disable_threshold_comparison,
+                            IntervalState* interval_state = nullptr,
+                            MetricGroups* groups = nullptr,
+                            AverageWeight average_weight = AverageWeight::None,
+                            const MetricRules* rules = nullptr) throw(std::exception, std::runtime_error);
+
+static const double MIN_BENCH_SECONDS = 0.5;
+
+/* Runs 'task' until at least MIN_BENCH_SECONDS went by, returns the seconds one run took */
+static double seconds_per_run(const std::function<void()>& task)
+{
+    typedef std::chrono::steady_clock clock;
+
+    std::size_t         runs  = 0;
+    clock::time_point   start = clock::now();
+    double              elapsed;
+
+    do
+    {
+        task();
+        runs++;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    } while (elapsed < MIN_BENCH_SECONDS);
+
+    return elapsed / runs;
+}
+
+static void report(const std::string& name, double seconds, double bytes, double items, const char* item_name)
+{
+    std::cout << std::left << std::setw(48) << name << std::right << std::fixed
+              << std::setw(12) << std::setprecision(3) << seconds * 1e6 << " us/run";
+
+    if (bytes > 0) std::cout << std::setw(12) << std::setprecision(1) << bytes / seconds / (1024 * 1024) << " MB/s";
+
+    if (items > 0) std::cout << std::setw(14) << std::setprecision(2) << items / seconds / 1e6 << " M " << item_name << "/s";
+
+    std::cout << std::endl;
+}
+
+static std::string write_dump(const std::string& directory, const DumpShape& shape, std::size_t& size)
+{
+    std::string     path = directory + "/glusterfs_" + shape.volume + ".dump";
+    std::ofstream   file(path, std::ios::binary);
+
+    generate_dump(shape, file);
+    size = file.tellp();
+
+    return path;
+}
+
+static CheckOptions bench_options(bool stream)
+{
+    CheckOptions options;
+
+    options.warning_threshold   = {400, UnitType::Microseconds};
+    options.critical_threshold  = {450, UnitType::Microseconds};
+    options.unit_type_output    = UnitType::Microseconds;
+    options.gluster_unit_type   = UnitType::Microseconds;
+    options.filter_regex        = ".*usec";
+    options.max_file_age        = 3600;
+    options.max_report_metrics  = 1000;
+    options.apply_on_total      = false;
+    options.stream              = stream;
+    options.interval_mode       = IntervalMode::Off;
+    options.group_by            = 0;
+    options.group_target        = GroupTarget::Off;
+    options.average_weight      = AverageWeight::None;
+    options.output_format       = OutputFormat::Nagios;
+    options.window_stat         = WindowStat::Off;
+    options.window_percentile   = 0;
+    options.window_seconds      = 3600;
+    options.history_size        = 288;
+    options.apply_on_baseline   = false;
+    options.baseline_alpha      = 0.1;
+    options.baseline_warmup     = 10;
+    options.self_profile        = false;
+    options.rules_file          = "";
+    options.rule_match          = RuleMatch::First;
+    options.dump_format         = DumpFormat::Json;
+    options.read_attempts       = 5;
+
+    return options;
+}
+
+static void microbenchmarks(const std::string& directory)
+{
+    DumpShape                       shape = {"micro", 8, GENERATOR_FOP_COUNT, 2, 7};
+    std::size_t                     size;
+    std::string                     path = write_dump(directory, shape, size);
+    double                          metrics = generated_metric_count(shape);
+    std::vector<json>               dump_json;
+    MetricTable                     metrics_table;
+    Metric                          total_average;
+    Metric                          warning = {400, UnitType::Microseconds}, critical = {450, UnitType::Microseconds};
+    MetricFilter                    filter(".*usec");
+    double                          seconds;
+
+    std::cout << "Microbenchmarks, " << size / 1024 << " KB dump with " << metrics << " metrics" << std::endl;
+
+    seconds = seconds_per_run([&]()
+    {
+        DumpSnapshot snapshot(path, 1);
+
+        dump_json.clear();
+        parse_json_dump(snapshot.view(), path, dump_json);
+    });
+    report("DumpSnapshot + parse_json_dump", seconds, size, metrics, "metrics");
+
+    seconds = seconds_per_run([&]()
+    {
+        metrics_table.clear();
+        process_metrics(metrics_table, total_average, dump_json, warning, critical,
+                        UnitType::Microseconds, UnitType::Microseconds, filter, false);
+    });
+    report("process_metrics", seconds, 0, metrics, "metrics");
+
+    seconds = seconds_per_run([&]()
+    {
+        MappedFile mapped(path);
+    });
+    report("MappedFile", seconds, size, 0, "");
+
+    seconds = seconds_per_run([&]()
+    {
+        DumpSnapshot snapshot(path, 1);
+    });
+    report("DumpSnapshot", seconds, size, 0, "");
+
+    MappedFile dump_file(path);
+
+    std::vector<DumpView>   reference_split;
+    auto                    best = StructuralIndexer::implementation();
+
+    split_root_objects(dump_file.view(), reference_split);
+
+    for (auto implementation : {StructuralIndexer::Implementation::Scalar, StructuralIndexer::Implementation::Sse2, StructuralIndexer::Implementation::Avx2})
+    {
+        if (! StructuralIndexer::force_implementation(implementation)) continue;
+
+        std::vector<DumpView> objects;
+
+        seconds = seconds_per_run([&]()
+        {
+            objects.clear();
+            split_root_objects(dump_file.view(), objects);
+        });
+        report(std::string("split_root_objects (") + StructuralIndexer::implementation_name(implementation) + ")", seconds, size, 0, "");
+
+        for (std::size_t i = 0; i < objects.size() || i < reference_split.size(); i++)
+        {
+            if (objects.size() != reference_split.size() || objects[i].begin != reference_split[i].begin || objects[i].end != reference_split[i].end)
+            {
+                std::cerr << StructuralIndexer::implementation_name(implementation) << " split the dump differently" << std::endl;
+                std::exit(1);
+            }
+        }
+    }
+
+    StructuralIndexer::force_implementation(best);
+
+    seconds = seconds_per_run([&]()
+    {
+        MetricTable table;
+        Metric      average;
+        int         root_objects;
+
+        process_metrics_stream(table, average, root_objects, dump_file.view(), warning, critical,
+                               UnitType::Microseconds, UnitType::Microseconds, filter, false);
+    });
+    report("process_metrics_stream", seconds, size, metrics, "metrics");
+
+    MetricFilter inter_filter("storage\\.gluster\\.brick[0-9]+\\.micro\\.inter\\..*usec"); // rules out the "aggr" root object
+
+    seconds = seconds_per_run([&]()
+    {
+        dump_json.clear();
+        parse_json_dump(dump_file.view(), path, dump_json);
+    });
+    report("parse_json_dump", seconds, size, metrics, "metrics");
+
+    seconds = seconds_per_run([&]()
+    {
+        dump_json.clear();
+        parse_json_dump(dump_file.view(), path, dump_json, &inter_filter);
+    });
+    report("parse_json_dump, aggr skipped", seconds, size, metrics, "metrics");
+
+    dump_json.clear();
+    parse_json_dump(dump_file.view(), path, dump_json);
+
+    std::vector<std::string> names;
+
+    for (const json& object : dump_json)
+    {
+        for (auto it = object.begin(); it != object.end(); it++) names.push_back(it.key());
+    }
+
+    for (const char* pattern : {".*usec", ".*aggr.*latency_ave.*usec", ".*(WRITE|READ)\\..*"})
+    {
+        MetricFilter    compiled(pattern);
+        std::regex      regex(pattern, std::regex_constants::icase | std::regex_constants::ECMAScript);
+        std::size_t     matched = 0;
+
+        seconds = seconds_per_run([&]()
+        {
+            for (const std::string& name : names) matched += compiled.matches(name);
+        });
+        report(std::string("MetricFilter (") + compiled.strategy_name() + ") " + pattern, seconds, 0, names.size(), "names");
+
+        seconds = seconds_per_run([&]()
+        {
+            for (const std::string& name : names) matched += std::regex_match(name, regex);
+        });
+        report(std::string("std::regex ") + pattern, seconds, 0, names.size(), "names");
+
+        if (matched == 0) std::cout << "(nothing matched)" << std::endl;
+    }
+
+    const int   conversions = 1000000;
+    double      sum = 0;
+
+    std::vector<std::string> values;
+
+    for (const json& object : dump_json)
+    {
+        for (auto it = object.begin(); it != object.end(); it++) values.push_back(it.value().get<std::string>());
+    }
+
+    seconds = seconds_per_run([&]()
+    {
+        for (const std::string& value : values) sum += parse_double(value.data(), value.data() + value.size());
+    });
+    report("parse_double", seconds, 0, values.size(), "values");
+
+    seconds = seconds_per_run([&]()
+    {
+        for (const std::string& value : values) sum += std::stod(value);
+    });
+    report("std::stod", seconds, 0, values.size(), "values");
+
+    seconds = seconds_per_run([&]()
+    {
+        for (int i = 0; i < conversions; i++)
+        {
+            sum += convert({(double) i, (UnitType) (i % 3)}, UnitType::Miliseconds).value;
+        }
+    });
+    report("convert x1M", seconds, 0, conversions, "conversions");
+
+    seconds = seconds_per_run([&]()
+    {
+        for (int i = 0; i < conversions; i++) sum += unit::Quantity<unit::Microseconds>((double) i).to<unit::Miliseconds>().value();
+    });
+    report("Quantity::to x1M", seconds, 0, conversions, "conversions");
+
+    std::vector<double> column_values(conversions), column_weights(conversions);
+
+    for (int i = 0; i < conversions; i++)
+    {
+        column_values[i]  = i % 1000;
+        column_weights[i] = i % 7;
+    }
+
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2})
+    {
+        if (! cpu_runs(level)) continue;
+
+        seconds = seconds_per_run([&]()
+        {
+            sum += aggregate_columns(column_values.data(), nullptr, conversions, level).mean();
+        });
+        report(std::string("aggregate_columns x1M (") + simd_level_name(level) + ")", seconds, 0, conversions, "values");
+
+        seconds = seconds_per_run([&]()
+        {
+            sum += aggregate_columns(column_values.data(), column_weights.data(), conversions, level).mean();
+        });
+        report(std::string("aggregate_columns weighted x1M (") + simd_level_name(level) + ")", seconds, 0, conversions, "values");
+    }
+
+    CheckOptions    baseline_options = bench_options(false);
+    std::string     baseline_file = directory + "/micro.baseline";
+    std::time_t     baseline_dump = 1;
+
+    baseline_options.apply_on_baseline = true;
+
+    seconds = seconds_per_run([&]()
+    {
+        MetricBaselines baselines(baseline_file, baseline_options.baseline_alpha);
+
+        sum += (int) baselines.apply_thresholds(metrics_table, baseline_options, baseline_dump++) + 1;
+        baselines.save();
+    });
+    report("MetricBaselines load, apply and save", seconds, 0, metrics_table.metrics().size(), "metrics");
+
+    std::remove(baseline_file.c_str());
+
+    std::size_t output_size = 0;
+
+    seconds = seconds_per_run([&]()
+    {
+        output_size += nagios_output_metrics(metrics_table, warning, critical).size();
+    });
+    report("nagios_output_metrics", seconds, 0, metrics_table.metrics().size(), "metrics");
+
+    if (sum == 0 || output_size == 0) std::cout << "(unexpected empty results)" << std::endl;
+
+    std::remove(path.c_str());
+}
+
+/* Runs a whole check in a child process, returns its wall time and peak RSS */
+static void end_to_end(const std::string& directory, const std::string& volume, bool stream, double& seconds, long& peak_rss_kb)
+{
+    typedef std::chrono::steady_clock clock;
+
+    clock::time_point   start = clock::now();
+    pid_t               child = fork();
+    struct rusage       usage;
+    int                 status;
+
+    if (child == 0)
+    {
+        MetricFilter filter(".*usec");
+        CheckResult  result = check_volume(bench_options(stream), filter, volume, directory + "/glusterfs_" + volume + ".dump");
+
+        std::fflush(nullptr);
+        _exit(result.has_average ? 0 : 1);
+    }
+
+    wait4(child, &status, 0, &usage);
+
+    seconds     = std::chrono::duration<double>(clock::now() - start).count();
+    peak_rss_kb = usage.ru_maxrss;
+
+    if (! WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        std::cout << "(the check of " << volume << " failed)" << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    double  max_megabytes = argc > 1 ? std::atof(argv[1]) : 128;
+    char    directory[] = "/tmp/check_gluster_perf_bench.XXXXXX";
+
+    if (mkdtemp(directory) == nullptr)
+    {
+        std::perror("mkdtemp");
+        return 1;
+    }
+
+    microbenchmarks(directory);
+
+    std::cout << std::endl << "End to end, one check per process" << std::endl;
+
+    for (double megabytes : {0.01, 1.0, 16.0, 128.0, 512.0})
+    {
+        if (megabytes > max_megabytes) break;
+
+        std::ostringstream  volume;
+        std::size_t         size;
+
+        volume << "e2e" << megabytes;
+
+        DumpShape   shape   = dump_shape_for_size(volume.str(), megabytes);
+        std::string path    = write_dump(directory, shape, size);
+        double      metrics = generated_metric_count(shape);
+
+        for (bool stream : {false, true})
+        {
+            double  seconds;
+            long    peak_rss_kb;
+
+            end_to_end(directory, shape.volume, stream, seconds, peak_rss_kb);
+
+            std::ostringstream name;
+            name << (stream ? "stream " : "DOM    ") << std::fixed << std::setprecision(2) << size / (1024.0 * 1024.0) << " MB";
+
+            report(name.str(), seconds, size, metrics, "metrics");
+            std::cout << std::left << std::setw(48) << "" << std::right << std::setw(12) << peak_rss_kb << " KB peak RSS" << std::endl;
+        }
+
+        std::remove(path.c_str());
+    }
+
+    rmdir(directory);
+
+    return 0;
+}
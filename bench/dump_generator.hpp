@@ -0,0 +1,154 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - synthetic GlusterFS dumps for benchmarking
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_DUMP_GENERATOR_HPP
+#define CHECK_GLUSTER_PERF_DUMP_GENERATOR_HPP
+
+#include <string>
+#include <ostream>
+#include <cstdint>
+#include <cstdio>
+
+/*
+The shape of a generated dump. Like the io-stats dumps GlusterFS writes, every interval is a
+root object of its own: the first one holds the aggregated ("aggr") counters, the following
+ones the interval ("inter") counters. Each brick reports every fop with a count and its
+average/min/max latency, plus a few per brick totals.
+*/
+struct DumpShape {
+    std::string     volume;
+    unsigned        bricks;
+    unsigned        fops;
+    unsigned        intervals;
+    std::uint32_t   seed;
+};
+
+static const char* const GENERATOR_FOPS[] = {
+    "WRITE", "READ", "LOOKUP", "FSYNC", "STAT", "OPEN", "CREATE", "FLUSH", "FSTAT", "STATFS",
+    "GETXATTR", "SETXATTR", "FGETXATTR", "FSETXATTR", "REMOVEXATTR", "FREMOVEXATTR", "OPENDIR",
+    "READDIR", "READDIRP", "FSYNCDIR", "ACCESS", "FTRUNCATE", "TRUNCATE", "LK", "INODELK",
+    "FINODELK", "ENTRYLK", "FENTRYLK", "XATTROP", "FXATTROP", "RCHECKSUM", "SETATTR", "FSETATTR",
+    "MKNOD", "MKDIR", "UNLINK", "RMDIR", "SYMLINK", "RENAME", "LINK", "READLINK", "FALLOCATE",
+    "DISCARD", "ZEROFILL", "SEEK", "LEASE", "IPC", "GETACTIVELK", "SETACTIVELK", "COPY_FILE_RANGE"
+};
+
+static const unsigned GENERATOR_FOP_COUNT = sizeof(GENERATOR_FOPS) / sizeof(GENERATOR_FOPS[0]);
+
+/* Metrics written per brick and interval, to size dumps without generating them */
+inline std::uint64_t generated_metric_count(const DumpShape& shape)
+{
+    return (std::uint64_t) shape.intervals * shape.bricks * (4 + 5 * (std::uint64_t) shape.fops);
+}
+
+/* A shape of roughly 'megabytes' MB: all the real fops, aggregated and one interval object, as many bricks as it takes */
+inline DumpShape dump_shape_for_size(const std::string& volume, double megabytes)
+{
+    const double    bytes_per_metric = 74; // about what a "storage.gluster.brickN.<volume>.aggr.fop.X.stat": "value" line takes
+    DumpShape       shape = {volume, 1, GENERATOR_FOP_COUNT, 2, 1};
+    std::uint64_t   per_brick = generated_metric_count(shape);
+
+    shape.bricks = (unsigned) (megabytes * 1024 * 1024 / (per_brick * bytes_per_metric));
+
+    if (shape.bricks == 0)
+    {
+        // smaller than a single brick: fewer fops, a single root object
+        shape.bricks    = 1;
+        shape.intervals = 1;
+        shape.fops      = (unsigned) (megabytes * 1024 * 1024 / (5 * bytes_per_metric));
+
+        if (shape.fops == 0) shape.fops = 1;
+    }
+
+    return shape;
+}
+
+/* Writes the dump described by 'shape', the same shape and seed always give the same bytes */
+inline void generate_dump(const DumpShape& shape, std::ostream& output)
+{
+    std::uint32_t   state = shape.seed ? shape.seed : 1;
+    char            line[512];
+
+    // xorshift, deterministic and fast enough for hundreds of megabytes
+    auto next = [&state]() -> std::uint32_t
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    };
+
+    for (unsigned interval = 0; interval < shape.intervals; interval++)
+    {
+        const char* scope = interval == 0 ? "aggr" : "inter";
+        bool        first = true;
+
+        output << "{\n";
+
+        for (unsigned brick = 0; brick < shape.bricks; brick++)
+        {
+            char prefix[128];
+
+            std::snprintf(prefix, sizeof(prefix), "storage.gluster.brick%u.%s.%s", brick, shape.volume.c_str(), scope);
+
+            auto metric = [&](const char* name, const char* value)
+            {
+                std::snprintf(line, sizeof(line), "%s \"%s.%s\": \"%s\"", first ? "" : ",\n", prefix, name, value);
+                output << line;
+                first = false;
+            };
+
+            char value[32], name[96];
+
+            std::snprintf(value, sizeof(value), "%u", next() % 1000000);
+            metric("uptime", value);
+            std::snprintf(value, sizeof(value), "%u", next());
+            metric("read_bytes", value);
+            std::snprintf(value, sizeof(value), "%u", next());
+            metric("write_bytes", value);
+            std::snprintf(value, sizeof(value), "%u", next() % 100);
+            metric("fop_hits", value);
+
+            for (unsigned fop = 0; fop < shape.fops; fop++)
+            {
+                char        fop_name[48];
+                double      average = (next() % 5000000) / 10000.0; // 0 .. 500us
+                double      minimum = average * (next() % 100) / 100.0;
+                double      maximum = average * (1 + (next() % 1000) / 100.0);
+
+                // past the real fops, the names repeat with a suffix
+                if (fop < GENERATOR_FOP_COUNT)
+                    std::snprintf(fop_name, sizeof(fop_name), "%s", GENERATOR_FOPS[fop]);
+                else
+                    std::snprintf(fop_name, sizeof(fop_name), "%s_%u", GENERATOR_FOPS[fop % GENERATOR_FOP_COUNT], fop / GENERATOR_FOP_COUNT);
+
+                std::snprintf(name, sizeof(name), "fop.%s.count", fop_name);
+                std::snprintf(value, sizeof(value), "%u", next() % 10000000);
+                metric(name, value);
+
+                std::snprintf(name, sizeof(name), "fop.%s.fop_hits", fop_name);
+                std::snprintf(value, sizeof(value), "%u", next() % 1000);
+                metric(name, value);
+
+                std::snprintf(name, sizeof(name), "fop.%s.latency_ave_usec", fop_name);
+                std::snprintf(value, sizeof(value), "%.4f", average);
+                metric(name, value);
+
+                std::snprintf(name, sizeof(name), "fop.%s.latency_min_usec", fop_name);
+                std::snprintf(value, sizeof(value), "%.4f", minimum);
+                metric(name, value);
+
+                std::snprintf(name, sizeof(name), "fop.%s.latency_max_usec", fop_name);
+                std::snprintf(value, sizeof(value), "%.4f", maximum);
+                metric(name, value);
+            }
+        }
+
+        output << "\n}\n";
+    }
+}
+
+#endif
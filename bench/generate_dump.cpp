@@ -0,0 +1,45 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - synthetic GlusterFS dump generator
+
+Writes a dump to stdout, either of a given shape or of roughly a given size:
+
+    generate_dump <volume> <bricks> <fops> <intervals> [seed]
+    generate_dump <volume> <megabytes>
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include <iostream>
+#include <cstdlib>
+
+#include "dump_generator.hpp"
+
+int main(int argc, char** argv)
+{
+    DumpShape shape;
+
+    if (argc == 3)
+    {
+        shape = dump_shape_for_size(argv[1], std::atof(argv[2]));
+    }
+    else if (argc == 5 || argc == 6)
+    {
+        shape = {argv[1], (unsigned) std::atoi(argv[2]), (unsigned) std::atoi(argv[3]), (unsigned) std::atoi(argv[4]), argc == 6 ? (std::uint32_t) std::atol(argv[5]) : 1};
+    }
+    else
+    {
+        std::cerr << "Usage: " << argv[0] << " <volume> <bricks> <fops> <intervals> [seed]" << std::endl
+                  << "       " << argv[0] << " <volume> <megabytes>" << std::endl;
+        return 1;
+    }
+
+    std::ios::sync_with_stdio(false);
+
+    generate_dump(shape, std::cout);
+
+    std::cerr << shape.bricks << " brick(s), " << shape.fops << " fop(s), " << shape.intervals << " root object(s), "
+              << generated_metric_count(shape) << " metrics" << std::endl;
+
+    return std::cout.good() ? 0 : 1;
+}
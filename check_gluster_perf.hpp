@@ -0,0 +1,176 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - types shared by all translation units
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_HPP
+#define CHECK_GLUSTER_PERF_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <ostream>
+#include <stdexcept>
+#include <ctime>
+#include <cstdint>
+
+/* Time unit used to process performance metrics */
+enum class UnitType : short {
+    Microseconds, Miliseconds, Seconds
+
+};
+
+/* What -interval compares with the thresholds: the dump's values or their change since the previous dump */
+enum class IntervalMode : short {
+    Off, Delta, Rate
+};
+
+/* Parts of the metric names -group-by can group metrics by, as flags */
+enum GroupBy : unsigned {
+    GroupByScope    = 1,
+    GroupByFop      = 2,
+    GroupByStat     = 4
+};
+
+/* What -apply-on-groups compares with the thresholds, instead of each metric */
+enum class GroupTarget : short {
+    Off, Average, Maximum
+};
+
+/* How the metrics are weighted in total_average: equally, or by the number of calls of their fop */
+enum class AverageWeight : short {
+    None, Calls
+};
+
+/* What -apply-on-window compares with the thresholds: a statistic of each metric over the recent dumps */
+enum class WindowStat : short {
+    Off, Average, Maximum, Percentile
+};
+
+/* Which rule of a -rules file a metric gets when several match: the first one, or the most specific one */
+enum class RuleMatch : short {
+    First, MostSpecific
+};
+
+/* What -output-format writes: Nagios plugin output, or the metrics for a time series database */
+enum class OutputFormat : short {
+    Nagios, Prometheus, Influx, Json
+};
+
+/* What the dump files are: the JSON dumps of the io-stats translator, or saved 'gluster volume profile info --xml' */
+enum class DumpFormat : short {
+    Json, ProfileXml
+};
+
+/* Nagios specific return codes */
+enum class ReturnCode : int {
+    OK          = 0,
+    Warning     = 1,
+    Critical    = 2,
+    Unknown     = 3
+};
+
+
+struct Metric {
+    double      value;
+    UnitType    unit;
+};
+
+
+class check_error : public std::runtime_error
+{
+    public:
+        check_error(const std::string& what) : std::runtime_error(what){}
+};
+
+/* Everything a single volume check needs, as given on the command line */
+struct CheckOptions {
+    Metric      warning_threshold;
+    Metric      critical_threshold;
+    UnitType    unit_type_output;
+    UnitType    gluster_unit_type;
+    std::string filter_regex;
+    int         max_file_age;
+    int         max_report_metrics;
+    bool        apply_on_total;
+    bool        stream;
+    IntervalMode interval_mode;
+    std::string state_dir;      // where -interval, -apply-on-window and -apply-on-baseline keep the previous dumps' values
+    std::string cache_dir;      // where evaluated dumps are cached, empty if they aren't
+    unsigned    group_by;       // GroupBy flags, 0 if no group aggregates are computed
+    GroupTarget group_target;
+    AverageWeight average_weight;
+    OutputFormat output_format;
+    WindowStat  window_stat;
+    double      window_percentile;  // with WindowStat::Percentile, in (0, 100]
+    int         window_seconds;
+    int         history_size;       // the number of dumps kept for -apply-on-window
+    bool        apply_on_baseline;  // -w and -c are standard deviations above each metric's own baseline
+    double      baseline_alpha;     // the weight of the newest dump in the baselines
+    int         baseline_warmup;    // dumps in a baseline before it's compared with
+    bool        self_profile;       // the check's own phase timings and allocations are reported
+    std::string rules_file;         // per metric thresholds, empty if -w and -c apply to every metric
+    RuleMatch   rule_match;
+    DumpFormat  dump_format;
+    int         read_attempts;      // reads of a dump GlusterFS is rewriting before the last cached result is used
+};
+
+/* False if the thresholds are compared with something else than each metric's value: the total average, groups, windows or baselines */
+inline bool compares_each_metric(const CheckOptions& options)
+{
+    return ! options.apply_on_total && options.group_target == GroupTarget::Off && options.window_stat == WindowStat::Off && ! options.apply_on_baseline;
+}
+
+/* One -group-by group's own result, submitted as a service of its own with -submit */
+struct GroupResult {
+    std::string label;          // "group.<parts>"
+    ReturnCode  code;
+    std::string output;
+};
+
+/* Outcome of a single volume check: the Nagios return code and the line that goes with it */
+struct CheckResult {
+    std::string volume;
+    ReturnCode  code;
+    std::string output;         // "<check output message>|<performance metrics>"
+    bool        has_average;    // false if the check didn't get as far as computing total_average
+    Metric      total_average;
+    std::time_t dump_mtime;     // 0 if the dump couldn't be stat'ed
+    std::vector<GroupResult> groups; // with -group-by, checked in this process (not over -client)
+};
+
+class MetricFilter;
+class MetricRules;
+class MetricTable;
+
+Metric      convert         (const Metric& src, const UnitType dst_unit);
+
+/* The unit's suffix: "us", "ms" or "s", safe to call from the worker threads */
+const char* unit_name       (UnitType unit);
+
+/* FNV-1a, used where a file name or a cache key needs a short, stable digest of some text */
+std::uint64_t hash_text     (const std::string& text);
+
+/*
+To be called from within a catch block: writes the message for the exception being handled
+and returns the Nagios code it maps to.
+*/
+ReturnCode  report_exception(std::ostream& output);
+
+/* Checks a single volume's dump file, never throws (see main.cpp), -rules are compiled here unless 'rules' are given */
+CheckResult check_volume(const CheckOptions& options, const MetricFilter& metric_filter, const std::string& volume, std::string dump_file,
+                         const MetricRules* rules = nullptr);
+
+/*
+Evaluates a whole dump the way check_volume does, -stream or not, without comparing it with any
+thresholds or keeping any state. Throws if the dump can't be read or holds no data.
+*/
+void        evaluate_dump(const CheckOptions& options, const MetricFilter& metric_filter, const std::string& dump_file,
+                          MetricTable& metrics, Metric& total_average) throw (std::exception, std::runtime_error);
+
+extern std::map<std::string, UnitType> g_unit_enum_map;
+extern bool                            g_verbose;
+
+#endif
@@ -0,0 +1,575 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - resident daemon and its client
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "daemon.hpp"
+#include "metric_filter.hpp"
+#include "metric_rules.hpp"
+
+#include <map>
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <iostream>
+#include <cstdlib>
+
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+
+namespace {
+
+const char          REQUEST_VERSION[]   = "CGP12";
+const std::size_t   MAX_CACHED_CHECKS   = 1024;     // checks with more distinct arguments than this are computed on demand
+const std::size_t   MAX_REQUEST_SIZE    = 64 * 1024;
+const int           CLIENT_TIMEOUT_MS   = 1000;
+
+volatile sig_atomic_t g_stop_daemon = 0;
+
+void on_stop_signal(int)
+{
+    g_stop_daemon = 1;
+}
+
+std::runtime_error system_error(const std::string& what)
+{
+    return std::runtime_error(what + ": " + strerror(errno));
+}
+
+void set_timeout(int fd, int milliseconds)
+{
+    struct timeval timeout = {milliseconds / 1000, (milliseconds % 1000) * 1000};
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+bool write_all(int fd, const std::string& data)
+{
+    for (std::size_t written = 0; written < data.size(); )
+    {
+        ssize_t count = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+
+        if (count == -1)
+        {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        written += count;
+    }
+
+    return true;
+}
+
+/* Reads until EOF, 'delimiter' or 'limit' bytes, whichever comes first */
+bool read_until(int fd, std::string& data, char delimiter, std::size_t limit)
+{
+    char buffer[4096];
+
+    while (data.size() < limit && (delimiter == '\0' || data.find(delimiter) == std::string::npos))
+    {
+        ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+
+        if (count == 0) break;
+
+        if (count == -1)
+        {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        data.append(buffer, count);
+    }
+
+    return true;
+}
+
+sockaddr_un socket_address(const std::string& socket_path) throw (std::runtime_error)
+{
+    sockaddr_un address;
+
+    if (socket_path.size() >= sizeof(address.sun_path))
+    {
+        throw std::runtime_error("Socket path too long: " + socket_path);
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    return address;
+}
+
+std::string encode_result(const CheckResult& result)
+{
+    std::ostringstream encoded;
+
+    encoded.precision(17);
+    encoded << (int) result.code << '\t' << result.has_average << '\t' << result.total_average.value << '\t'
+            << (int) result.total_average.unit << '\t' << (long long) result.dump_mtime << '\n' << result.output;
+
+    return encoded.str();
+}
+
+/* What the daemon answers instead of a check it won't or can't run */
+CheckResult unknown_result(const std::string& volume, const std::string& message)
+{
+    CheckResult result;
+
+    result.volume       = volume;
+    result.code         = ReturnCode::Unknown;
+    result.output       = "Runtime error: " + message + "\n";
+    result.has_average  = false;
+    result.total_average = {0, UnitType::Microseconds};
+    result.dump_mtime   = 0;
+
+    return result;
+}
+
+/*
+The files a client may have the daemon read, it does so with its own privileges: the dumps of
+-stats-dir (or those the daemon was started with) and the daemon's own -state-dir, -cache-dir
+and -rules. Anything else in a request is refused, clients can't point it at other files.
+*/
+class DaemonScope
+{
+    public:
+        DaemonScope(const std::string& stats_dir, const CheckOptions& options, const std::vector<VolumeDump>& preload)
+            : m_stats_dir(stats_dir), m_state_dir(options.state_dir), m_cache_dir(options.cache_dir), m_rules_file(options.rules_file)
+        {
+            for (const VolumeDump& target : preload) m_dump_files.push_back(target.dump_file);
+        }
+
+        /* An empty string if the daemon may run the check, why not otherwise */
+        std::string refusal(const CheckOptions& options, const VolumeDump& target) const
+        {
+            bool volume_dump = target.volume != "" && target.volume != "." && target.volume != ".." &&
+                               target.volume.find('/') == std::string::npos &&
+                               target.dump_file == m_stats_dir + "/glusterfs_" + target.volume + ".dump";
+
+            if (! volume_dump && std::find(m_dump_files.begin(), m_dump_files.end(), target.dump_file) == m_dump_files.end())
+            {
+                return "The daemon only reads the dumps in " + m_stats_dir + ", not " + target.dump_file + ".";
+            }
+
+            if (options.state_dir != m_state_dir || options.cache_dir != m_cache_dir || options.rules_file != m_rules_file)
+            {
+                return "The daemon only uses its own -state-dir, -cache-dir and -rules.";
+            }
+
+            return "";
+        }
+
+    private:
+        std::string                 m_stats_dir;
+        std::string                 m_state_dir;
+        std::string                 m_cache_dir;
+        std::string                 m_rules_file;
+        std::vector<std::string>    m_dump_files;   // checked when the daemon started, -override-stats-file
+};
+
+/* One cached check, re-evaluated when the dump it reads is rewritten */
+struct CachedCheck {
+    CheckOptions                    options;
+    VolumeDump                      target;
+    std::unique_ptr<MetricFilter>   filter;
+    std::unique_ptr<MetricRules>    rules;      // nullptr without -rules, or if they couldn't be compiled and check_volume reports why
+    CheckResult                     result;
+    int                             watch;      // inotify watch of the dump's directory, -1 if it couldn't be watched
+    std::string                     file_name;  // the dump's name inside that directory
+};
+
+class CheckCache
+{
+    public:
+        explicit CheckCache(int inotify_fd) : m_inotify_fd(inotify_fd) {}
+
+        /*
+        Returns the result of the check described by 'request', computing it if needed. Throws
+        std::regex_error for an invalid filter, nothing is cached then.
+        */
+        CheckResult get(const std::string& request, const CheckOptions& options, const VolumeDump& target)
+        {
+            auto found = m_checks.find(request);
+
+            if (found == m_checks.end())
+            {
+                std::unique_ptr<MetricFilter> filter(new MetricFilter(options.filter_regex)); // this throws
+
+                if (m_checks.size() >= MAX_CACHED_CHECKS)
+                {
+                    return check_volume(options, *filter, target.volume, target.dump_file);
+                }
+
+                std::unique_ptr<MetricRules> rules = compile_rules(options);
+                CachedCheck&                 check = m_checks[request];
+
+                check.options = options;
+                check.target  = target;
+                check.filter  = std::move(filter);
+                check.rules   = std::move(rules);
+                check.watch   = -1;
+
+                watch(check);
+                evaluate(check);
+
+                return check.result;
+            }
+
+            CachedCheck& check = found->second;
+            std::time_t  now   = std::time(nullptr);
+
+            // without a watch nothing tells us the dump changed, and an unchanged dump still ages
+            if (check.watch == -1 || (now - check.result.dump_mtime) > check.options.max_file_age)
+            {
+                if (check.watch == -1) watch(check);
+
+                evaluate(check);
+            }
+
+            return check.result;
+        }
+
+        /* Re-evaluates every check reading 'file_name' in the directory watched by 'watch' */
+        void dump_changed(int watch, const std::string& file_name)
+        {
+            for (auto& entry : m_checks)
+            {
+                if (entry.second.watch == watch && entry.second.file_name == file_name)
+                {
+                    if (g_verbose) std::cout << "Dump changed: " << entry.second.target.dump_file << std::endl;
+
+                    evaluate(entry.second);
+                }
+            }
+        }
+
+    private:
+        /* The rules are read once per cached check, like the filter is compiled once */
+        static std::unique_ptr<MetricRules> compile_rules(const CheckOptions& options)
+        {
+            std::unique_ptr<MetricRules> rules;
+
+            if (options.rules_file == "") return rules;
+
+            try
+            {
+                rules.reset(new MetricRules(options.rules_file, options.rule_match, options.warning_threshold.unit));
+            }
+            catch (const std::exception& e)
+            {
+                if (g_verbose) std::cout << "Couldn't compile the rules: " << e.what() << std::endl;
+            }
+
+            return rules;
+        }
+
+        void watch(CachedCheck& check)
+        {
+            std::string::size_type  slash     = check.target.dump_file.rfind('/');
+            std::string             directory = slash == std::string::npos ? "." : check.target.dump_file.substr(0, slash + 1);
+
+            check.file_name = slash == std::string::npos ? check.target.dump_file : check.target.dump_file.substr(slash + 1);
+
+            // watching the directory rather than the file survives Gluster replacing the dump
+            check.watch = inotify_add_watch(m_inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_ATTRIB);
+        }
+
+        void evaluate(CachedCheck& check)
+        {
+            check.result = check_volume(check.options, *check.filter, check.target.volume, check.target.dump_file, check.rules.get());
+        }
+
+        int                                 m_inotify_fd;
+        std::map<std::string, CachedCheck>  m_checks;
+};
+
+void handle_inotify(int inotify_fd, CheckCache& cache)
+{
+    alignas(struct inotify_event) char buffer[16 * 1024];
+
+    for (;;)
+    {
+        ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+
+        if (length <= 0) return; // EAGAIN, drained
+
+        for (char* position = buffer; position < buffer + length; )
+        {
+            struct inotify_event* event = reinterpret_cast<struct inotify_event*>(position);
+
+            if (event->len > 0)
+            {
+                cache.dump_changed(event->wd, event->name);
+            }
+
+            position += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+void handle_client(int client_fd, CheckCache& cache, const DaemonScope& scope)
+{
+    std::string     request, line, refusal;
+    CheckOptions    options;
+    VolumeDump      target;
+
+    set_timeout(client_fd, CLIENT_TIMEOUT_MS);
+
+    if (! read_until(client_fd, request, '\n', MAX_REQUEST_SIZE)) return;
+
+    line = request.substr(0, request.find('\n'));
+
+    if (! decode_check_request(line, options, target))
+    {
+        write_all(client_fd, encode_result(unknown_result(target.volume, "Invalid request sent to the daemon.")));
+        return;
+    }
+
+    if ((refusal = scope.refusal(options, target)) != "")
+    {
+        write_all(client_fd, encode_result(unknown_result(target.volume, refusal)));
+        return;
+    }
+
+    try
+    {
+        write_all(client_fd, encode_result(cache.get(line, options, target)));
+    }
+    catch (const std::exception& e) // a request the daemon can't run mustn't stop it
+    {
+        write_all(client_fd, encode_result(unknown_result(target.volume, e.what())));
+    }
+}
+
+} // namespace
+
+
+std::string encode_check_request(const CheckOptions& options, const VolumeDump& target) throw (std::invalid_argument)
+{
+    std::ostringstream request;
+
+    if (target.volume.find_first_of("\t\n") != std::string::npos ||
+        target.dump_file.find_first_of("\t\n") != std::string::npos ||
+        options.state_dir.find_first_of("\t\n") != std::string::npos ||
+        options.cache_dir.find_first_of("\t\n") != std::string::npos ||
+        options.rules_file.find_first_of("\t\n") != std::string::npos ||
+        options.filter_regex.find('\n') != std::string::npos)
+    {
+        throw std::invalid_argument("Tabs and new lines aren't supported in volume names, file names, -state-dir, -cache-dir, -rules or filters when using the daemon.");
+    }
+
+    request.precision(17); // enough for doubles to survive the round trip
+    request << REQUEST_VERSION << '\t' << target.volume << '\t' << target.dump_file << '\t'
+            << options.warning_threshold.value << '\t' << (int) options.warning_threshold.unit << '\t'
+            << options.critical_threshold.value << '\t' << (int) options.critical_threshold.unit << '\t'
+            << (int) options.unit_type_output << '\t' << (int) options.gluster_unit_type << '\t'
+            << options.max_file_age << '\t' << options.max_report_metrics << '\t'
+            << options.apply_on_total << '\t' << options.stream << '\t'
+            << (int) options.interval_mode << '\t' << options.state_dir << '\t' << options.cache_dir << '\t'
+            << options.group_by << '\t' << (int) options.group_target << '\t' << (int) options.average_weight << '\t'
+            << (int) options.output_format << '\t'
+            << (int) options.window_stat << '\t' << options.window_percentile << '\t' << options.window_seconds << '\t' << options.history_size << '\t'
+            << options.apply_on_baseline << '\t' << options.baseline_alpha << '\t' << options.baseline_warmup << '\t'
+            << options.self_profile << '\t'
+            << options.rules_file << '\t' << (int) options.rule_match << '\t' << (int) options.dump_format << '\t' << options.read_attempts << '\t'
+            << options.filter_regex; // last, it's the only field that may contain tabs
+
+    return request.str();
+}
+
+bool decode_check_request(const std::string& line, CheckOptions& options, VolumeDump& target)
+{
+    std::istringstream  request(line);
+    std::string         version;
+    int                 warning_unit, critical_unit, output_unit, gluster_unit, interval_mode, group_target, average_weight, output_format, window_stat, rule_match, dump_format;
+
+    if (! std::getline(request, version, '\t') || version != REQUEST_VERSION) return false;
+    if (! std::getline(request, target.volume, '\t')) return false;
+    if (! std::getline(request, target.dump_file, '\t')) return false;
+
+    request >> options.warning_threshold.value >> warning_unit
+            >> options.critical_threshold.value >> critical_unit
+            >> output_unit >> gluster_unit
+            >> options.max_file_age >> options.max_report_metrics
+            >> options.apply_on_total >> options.stream
+            >> interval_mode;
+
+    if (! request || request.get() != '\t') return false;
+    if (! std::getline(request, options.state_dir, '\t')) return false;
+    if (! std::getline(request, options.cache_dir, '\t')) return false;
+    if (interval_mode < (int) IntervalMode::Off || interval_mode > (int) IntervalMode::Rate) return false;
+
+    request >> options.group_by >> group_target >> average_weight >> output_format
+            >> window_stat >> options.window_percentile >> options.window_seconds >> options.history_size
+            >> options.apply_on_baseline >> options.baseline_alpha >> options.baseline_warmup
+            >> options.self_profile;
+
+    if (! request || request.get() != '\t') return false;
+    if (! std::getline(request, options.rules_file, '\t')) return false;
+
+    request >> rule_match >> dump_format >> options.read_attempts;
+
+    if (! request || request.get() != '\t') return false;
+    if (rule_match < (int) RuleMatch::First || rule_match > (int) RuleMatch::MostSpecific) return false;
+    if (dump_format < (int) DumpFormat::Json || dump_format > (int) DumpFormat::ProfileXml) return false;
+    if (options.read_attempts < 1) return false;
+    if (options.group_by > (GroupByScope | GroupByFop | GroupByStat)) return false;
+    if (group_target < (int) GroupTarget::Off || group_target > (int) GroupTarget::Maximum) return false;
+    if (average_weight < (int) AverageWeight::None || average_weight > (int) AverageWeight::Calls) return false;
+    if (output_format < (int) OutputFormat::Nagios || output_format > (int) OutputFormat::Json) return false;
+    if (window_stat < (int) WindowStat::Off || window_stat > (int) WindowStat::Percentile) return false;
+    if (options.window_seconds <= 0 || options.history_size <= 0) return false;
+    if (options.baseline_alpha <= 0 || options.baseline_alpha >= 1 || options.baseline_warmup < 0) return false;
+
+    for (int unit : {warning_unit, critical_unit, output_unit, gluster_unit})
+    {
+        if (unit < (int) UnitType::Microseconds || unit > (int) UnitType::Seconds) return false;
+    }
+
+    options.warning_threshold.unit  = (UnitType) warning_unit;
+    options.critical_threshold.unit = (UnitType) critical_unit;
+    options.unit_type_output        = (UnitType) output_unit;
+    options.gluster_unit_type       = (UnitType) gluster_unit;
+    options.interval_mode           = (IntervalMode) interval_mode;
+    options.group_target            = (GroupTarget) group_target;
+    options.average_weight          = (AverageWeight) average_weight;
+    options.output_format           = (OutputFormat) output_format;
+    options.window_stat             = (WindowStat) window_stat;
+    options.rule_match              = (RuleMatch) rule_match;
+    options.dump_format             = (DumpFormat) dump_format;
+
+    std::getline(request, options.filter_regex);
+
+    return true;
+}
+
+void run_daemon(const std::string& socket_path, const std::string& stats_dir, const CheckOptions& options, const std::vector<VolumeDump>& preload) throw (std::runtime_error)
+{
+    DaemonScope         scope(stats_dir, options, preload);
+    sockaddr_un         address     = socket_address(socket_path);
+    int                 inotify_fd  = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    int                 listen_fd;
+    struct sigaction    stop_action;
+
+    if (inotify_fd == -1) throw system_error("Couldn't initialize inotify");
+
+    CheckCache cache(inotify_fd);
+
+    for (const VolumeDump& target : preload)
+    {
+        cache.get(encode_check_request(options, target), options, target);
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+
+    if (listen_fd == -1)
+    {
+        close(inotify_fd);
+        throw system_error("Couldn't create the daemon socket");
+    }
+
+    unlink(socket_path.c_str()); // a leftover from a previous run
+
+    if (bind(listen_fd, (sockaddr*) &address, sizeof(address)) == -1 || listen(listen_fd, 64) == -1)
+    {
+        std::runtime_error error = system_error("Couldn't listen on " + socket_path);
+        close(listen_fd);
+        close(inotify_fd);
+        throw error;
+    }
+
+    memset(&stop_action, 0, sizeof(stop_action));
+    stop_action.sa_handler = on_stop_signal; // no SA_RESTART, poll has to be interrupted
+    sigaction(SIGTERM, &stop_action, nullptr);
+    sigaction(SIGINT, &stop_action, nullptr);
+
+    if (g_verbose) std::cout << "Serving check results on " << socket_path << std::endl;
+
+    while (! g_stop_daemon)
+    {
+        struct pollfd watched[2] = {{inotify_fd, POLLIN, 0}, {listen_fd, POLLIN, 0}};
+
+        if (poll(watched, 2, -1) == -1)
+        {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        // dump changes first, a client connecting right after a rewrite gets the new result
+        if (watched[0].revents & POLLIN)
+        {
+            handle_inotify(inotify_fd, cache);
+        }
+
+        if (watched[1].revents & POLLIN)
+        {
+            int client_fd;
+
+            while ((client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC)) != -1)
+            {
+                handle_client(client_fd, cache, scope); // one at a time, see run_daemon
+                close(client_fd);
+            }
+        }
+    }
+
+    close(listen_fd);
+    close(inotify_fd);
+    unlink(socket_path.c_str());
+}
+
+CheckResult query_daemon(const std::string& socket_path, const CheckOptions& options, const VolumeDump& target) throw (std::runtime_error)
+{
+    sockaddr_un address = socket_address(socket_path);
+    std::string request = encode_check_request(options, target) + "\n",
+                response;
+    CheckResult result;
+    int         client_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int         code, unit;
+    long long   dump_mtime;
+
+    if (client_fd == -1) throw system_error("Couldn't create a socket");
+
+    set_timeout(client_fd, 10 * CLIENT_TIMEOUT_MS);
+
+    if (connect(client_fd, (sockaddr*) &address, sizeof(address)) == -1)
+    {
+        std::runtime_error error = system_error("Couldn't connect to the daemon at " + socket_path);
+        close(client_fd);
+        throw error;
+    }
+
+    bool exchanged = write_all(client_fd, request) && shutdown(client_fd, SHUT_WR) == 0 && read_until(client_fd, response, '\0', std::string::npos);
+
+    close(client_fd);
+
+    std::string::size_type  header_end = response.find('\n');
+    std::istringstream      header(response.substr(0, header_end));
+
+    header >> code >> result.has_average >> result.total_average.value >> unit >> dump_mtime;
+
+    if (! exchanged || header_end == std::string::npos || ! header || code < 0 || code > 3 || unit < 0 || unit > 2)
+    {
+        throw std::runtime_error("Invalid response from the daemon at " + socket_path);
+    }
+
+    result.volume               = target.volume;
+    result.code                 = (ReturnCode) code;
+    result.total_average.unit   = (UnitType) unit;
+    result.dump_mtime           = dump_mtime;
+    result.output               = response.substr(header_end + 1);
+
+    return result;
+}
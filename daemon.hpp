@@ -0,0 +1,52 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - resident daemon and its client
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_DAEMON_HPP
+#define CHECK_GLUSTER_PERF_DAEMON_HPP
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "check_gluster_perf.hpp"
+
+/* A volume and the dump file it's checked from */
+struct VolumeDump {
+    std::string volume;
+    std::string dump_file;
+};
+
+/*
+Serializes a check (its options, volume and dump file) as a single request line. The same line
+is the daemon's cache key, so two checks with the same arguments share one cached result.
+*/
+std::string encode_check_request(const CheckOptions& options, const VolumeDump& target) throw (std::invalid_argument);
+bool        decode_check_request(const std::string& line, CheckOptions& options, VolumeDump& target);
+
+/*
+Runs until SIGTERM/SIGINT. Results are computed with check_volume and cached per request, the
+directories holding the dumps are watched with inotify and a volume is only re-evaluated once
+its dump has been rewritten. Results are served over a Unix domain socket at 'socket_path'.
+
+'preload' are evaluated before the socket is opened, with 'options', so the first client
+checks with the same arguments already find a result.
+
+The daemon reads files with its own privileges, so clients are restricted to the volumes'
+dumps in 'stats_dir', the dumps in 'preload', and the -state-dir, -cache-dir and -rules of
+'options'; other requests and invalid filters get an UNKNOWN result.
+
+Clients are served one at a time, in a single thread: one that connects and doesn't send its
+request holds the others up for at most a second (the client timeout), a check that isn't
+cached yet for as long as it takes to evaluate.
+*/
+void        run_daemon(const std::string& socket_path, const std::string& stats_dir, const CheckOptions& options,
+                       const std::vector<VolumeDump>& preload) throw (std::runtime_error);
+
+/* Asks the daemon at 'socket_path' for the result of a check */
+CheckResult query_daemon(const std::string& socket_path, const CheckOptions& options, const VolumeDump& target) throw (std::runtime_error);
+
+#endif
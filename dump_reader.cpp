@@ -0,0 +1,479 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - dump file access
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "dump_reader.hpp"
+#include "structural_index.hpp"
+#include "metric_filter.hpp"
+
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+MappedFile::MappedFile(const std::string& path) throw (std::runtime_error)
+    : m_data(nullptr), m_size(0), m_mapped(false)
+{
+    std::ostringstream  error_message;
+    struct stat         attrib;
+    int                 fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1)
+    {
+        error_message << "Couldn't open file '" << path << "': " << strerror(errno);
+        throw std::runtime_error(error_message.str());
+    }
+
+    if (fstat(fd, &attrib) == 0 && S_ISREG(attrib.st_mode) && attrib.st_size > 0)
+    {
+        void* mapping = mmap(nullptr, attrib.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (mapping != MAP_FAILED)
+        {
+            madvise(mapping, attrib.st_size, MADV_SEQUENTIAL); // we only ever walk it front to back, once
+
+            m_data   = static_cast<const char*>(mapping);
+            m_size   = attrib.st_size;
+            m_mapped = true;
+        }
+    }
+
+    if (! m_mapped)
+    {
+        try
+        {
+            read_fallback(fd, path);
+        }
+        catch (...)
+        {
+            close(fd);
+            throw;
+        }
+    }
+
+    close(fd); // the mapping stays valid after the descriptor is closed
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_mapped)
+    {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+}
+
+void MappedFile::read_fallback(int fd, const std::string& path) throw (std::runtime_error)
+{
+    std::size_t used = 0;
+
+    m_buffer.resize(64 * 1024);
+
+    for (;;)
+    {
+        if (used == m_buffer.size())
+        {
+            m_buffer.resize(m_buffer.size() * 2);
+        }
+
+        ssize_t got = read(fd, m_buffer.data() + used, m_buffer.size() - used);
+
+        if (got == 0)
+        {
+            break;
+        }
+
+        if (got == -1)
+        {
+            if (errno == EINTR) continue;
+
+            std::ostringstream error_message;
+            error_message << "Couldn't read file '" << path << "': " << strerror(errno);
+            throw std::runtime_error(error_message.str());
+        }
+
+        used += got;
+    }
+
+    m_buffer.resize(used);
+    m_data = m_buffer.data();
+    m_size = used;
+}
+
+static DumpIdentity identity_of(const struct stat& attrib)
+{
+    return {(std::uint64_t) attrib.st_dev, (std::uint64_t) attrib.st_ino, attrib.st_size, attrib.st_mtim.tv_sec, attrib.st_mtim.tv_nsec};
+}
+
+DumpSnapshot::DumpSnapshot(const std::string& path, int attempts) throw (std::runtime_error, torn_dump_error)
+    : m_path(path), m_capacity(0), m_size(0), m_identity(), m_attempts(0), m_max_attempts(std::max(attempts, 1)), m_backoff_ms(1)
+{
+    read_stable();
+}
+
+void DumpSnapshot::read_stable() throw (std::runtime_error, torn_dump_error)
+{
+    static const int MAX_BACKOFF_MS = 100;
+
+    while (m_attempts < m_max_attempts)
+    {
+        if (m_attempts > 0)
+        {
+            m_backoff_ms = std::min(m_backoff_ms * 2, MAX_BACKOFF_MS);
+            std::this_thread::sleep_for(std::chrono::milliseconds(m_backoff_ms));
+        }
+
+        m_attempts++;
+
+        if (read_once()) return; // this throws
+    }
+
+    std::ostringstream error_message;
+    error_message << "The dump at '" << m_path << "' was being rewritten, it changed during each of " << m_attempts << " reads";
+
+    throw torn_dump_error(error_message.str());
+}
+
+void DumpSnapshot::read_again(const torn_dump_error& cut) throw (std::runtime_error, torn_dump_error)
+{
+    if (m_attempts >= m_max_attempts)
+    {
+        std::ostringstream error_message;
+        error_message << "The dump at '" << m_path << "' is empty or cut short (" << cut.what() << "), read " << m_attempts << " times";
+
+        throw torn_dump_error(error_message.str());
+    }
+
+    read_stable();
+}
+
+bool DumpSnapshot::read_once() throw (std::runtime_error)
+{
+    const std::string&  path = m_path;
+    std::ostringstream  error_message;
+    struct stat         before, after, named;
+    int                 fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1)
+    {
+        error_message << "Couldn't open file '" << path << "': " << strerror(errno);
+        throw std::runtime_error(error_message.str());
+    }
+
+    if (fstat(fd, &before) == -1)
+    {
+        error_message << "Couldn't stat file '" << path << "': " << strerror(errno);
+        close(fd);
+        throw std::runtime_error(error_message.str());
+    }
+
+    // one byte more than the file has, a file that grew shows in the byte count (pipes, procfs and some FUSE mounts report a size of 0)
+    std::size_t wanted = (S_ISREG(before.st_mode) && before.st_size > 0 ? before.st_size : 64 * 1024) + 1;
+
+    m_size = 0;
+
+    for (;;)
+    {
+        if (m_size == m_capacity || wanted > m_capacity)
+        {
+            std::size_t             capacity = std::max(wanted, m_capacity * 2);
+            std::unique_ptr<char[]> data(new char[capacity]);
+
+            std::copy(m_data.get(), m_data.get() + m_size, data.get());
+
+            m_data.swap(data);
+            m_capacity = capacity;
+        }
+
+        ssize_t got = read(fd, m_data.get() + m_size, m_capacity - m_size);
+
+        if (got == 0)
+        {
+            break;
+        }
+
+        if (got == -1)
+        {
+            if (errno == EINTR) continue;
+
+            error_message << "Couldn't read file '" << path << "': " << strerror(errno);
+            close(fd);
+            throw std::runtime_error(error_message.str());
+        }
+
+        m_size += got;
+    }
+
+    int after_ret = fstat(fd, &after);
+
+    close(fd);
+
+    if (after_ret == -1) return false;
+
+    m_identity = identity_of(after);
+
+    if (! S_ISREG(after.st_mode)) return true; // nothing to compare a pipe's contents with
+
+    return identity_of(before) == m_identity &&
+           stat(path.c_str(), &named) == 0 && identity_of(named) == m_identity && // not replaced by another file meanwhile
+           (std::int64_t) m_size == after.st_size;
+}
+
+/*
+The line number is only needed for the error message, so it's computed on the error path
+rather than tracked for every byte.
+*/
+static void throw_unexpected_brace(const DumpView& input, const char* position) throw (std::runtime_error)
+{
+    std::ostringstream  error_message;
+    int                 line_count = 1;
+    const char*         line_start = input.begin;
+
+    for (const char* it = input.begin; it < position; it++)
+    {
+        if (*it == '\n')
+        {
+            line_count++;
+            line_start = it + 1;
+        }
+    }
+
+    error_message << "Unexpected '}' found at line" << line_count << ":" << (position - line_start);
+    throw std::runtime_error(error_message.str());
+}
+
+/*
+Walks the flat object whose '{' the index just handed out and returns the end of it if 'filter'
+rules out a prefix of each of its keys, nullptr otherwise. The index is left anywhere.
+*/
+static const char* skip_flat_object(StructuralIndexer& index, const MetricFilter& filter)
+{
+    const char* key_start    = nullptr;
+    const char* dead_key     = nullptr;     // the last key that ran the DFA
+    std::size_t dead_length  = 0;           // the length of its prefix nothing matches
+    bool        expect_key   = true;
+    bool        expect_colon = false;
+
+    for (const char* it = index.next(); it != nullptr; it = index.next())
+    {
+        if (expect_key)
+        {
+            if (*it != '"') return nullptr; // an empty object or not JSON, nothing to gain either way
+
+            key_start    = it + 1;
+            expect_key   = false;
+            expect_colon = true;
+        }
+        else if (expect_colon)
+        {
+            if (*it != ':') return nullptr;
+
+            const char* key_end = it;
+
+            while (key_end > key_start && std::isspace((unsigned char) key_end[-1])) key_end--;
+
+            if (key_end == key_start || key_end[-1] != '"') return nullptr;
+
+            key_end--;
+
+            // keys are mostly ruled out by the same prefix as the previous one, only the others run the DFA
+            if (dead_key == nullptr || std::size_t(key_end - key_start) < dead_length || std::memcmp(key_start, dead_key, dead_length) != 0)
+            {
+                dead_length = filter.dead_prefix(key_start, key_end);
+
+                // past a backslash the bytes aren't the name anymore
+                if (dead_length == 0 || std::memchr(key_start, '\\', dead_length) != nullptr) return nullptr;
+
+                dead_key = key_start;
+            }
+
+            expect_colon = false;
+        }
+        else
+        {
+            switch (*it)
+            {
+                case '"':   break;                  // a string value
+                case ',':   expect_key = true; break;
+                case '}':   return it + 1;
+                default:    return nullptr;         // nested values are the parsers' business, they fail on them
+            }
+        }
+    }
+
+    return nullptr; // never closed
+}
+
+const char* skip_unmatched_object(const DumpView& input, const char* object, const MetricFilter& filter)
+{
+    if (! filter.prunes_prefixes()) return nullptr;
+
+    StructuralIndexer index({object + 1, input.end});
+
+    return skip_flat_object(index, filter);
+}
+
+static bool only_whitespace(const char* begin, const char* end)
+{
+    for (const char* it = begin; it != end; it++)
+    {
+        if (! std::isspace((unsigned char) *it)) return false;
+    }
+
+    return true;
+}
+
+int split_root_objects(const DumpView& input, std::vector<DumpView>& objects, const MetricFilter* filter) throw (std::runtime_error)
+{
+    StructuralIndexer   index(input);
+    const char*         object_start = input.begin; // whatever follows the previous object is handed to the parser with the next one
+    int                 level        = -1;          // -1 means no object found
+    int                 skipped      = 0;
+    bool                pruning      = filter != nullptr && filter->prunes_prefixes();
+
+    for (const char* it = index.next(); it != nullptr; it = index.next())
+    {
+        switch (*it)
+        {
+            case '{':
+                if (level == -1 && pruning && only_whitespace(object_start, it)) // junk before it is left to the parser to report
+                {
+                    const char* end = skip_flat_object(index, *filter);
+
+                    if (end != nullptr)
+                    {
+                        skipped++;
+                        object_start = end;
+                        index.seek(end);
+
+                        continue;
+                    }
+
+                    index.seek(it + 1); // go over it again, counting braces
+                }
+
+                level > 0 ? level++ : level = 1;
+
+                break;
+            case '}':
+                if (level > 0)
+                    level--;
+                else
+                    throw_unexpected_brace(input, it);
+
+                break;
+            case '[':
+                if (level == -1 && objects.size() == 0) // if we're not inside any objects, the file MIGHT be enclosed in arrays
+                {
+                    // let the JSON library deal with the whole input, it'll throw should it be invalid
+                    objects.push_back(input);
+                    return 0;
+                }
+
+                break;
+        }
+
+        if (level == 0)
+        {
+            objects.push_back({object_start, it + 1});
+
+            // reset the state machine
+            level        = -1;
+            object_start = it + 1;
+        }
+    }
+
+    // what a dump GlusterFS is still writing looks like, its reader tries again (see DumpSnapshot)
+    if (level > 0) throw torn_dump_error("it ends inside a root object");
+    if (only_whitespace(input.begin, input.end)) throw torn_dump_error("it's blank");
+
+    return skipped;
+}
+
+void replace_file(const std::string& path, const std::string& contents, int mode) throw (std::runtime_error)
+{
+    std::string temp_file = path + ".XXXXXX";
+    std::size_t written   = 0;
+    int         err_code  = 0;
+    int         fd        = mkstemp(&temp_file[0]);
+
+    if (fd == -1)
+    {
+        std::ostringstream error;
+        error << strerror(errno) << " While trying to create: " << temp_file;
+
+        throw std::runtime_error(error.str());
+    }
+
+    if (fchmod(fd, mode) == -1) err_code = errno; // mkstemp always creates 0600
+
+    while (err_code == 0 && written < contents.size())
+    {
+        ssize_t count = write(fd, contents.data() + written, contents.size() - written);
+
+        if (count == -1 && errno == EINTR) continue;
+        if (count == -1) { err_code = errno; break; }
+
+        written += count;
+    }
+
+    if (close(fd) == -1 && err_code == 0) err_code = errno;
+
+    if (err_code == 0 && rename(temp_file.c_str(), path.c_str()) == -1) err_code = errno;
+
+    if (err_code != 0)
+    {
+        unlink(temp_file.c_str());
+
+        std::ostringstream error;
+        error << strerror(err_code) << " While trying to write: " << path;
+
+        throw std::runtime_error(error.str());
+    }
+}
+
+int open_locked(const std::string& path) throw (std::runtime_error)
+{
+    struct stat locked, current;
+
+    for (;;)
+    {
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+
+        if (fd == -1)
+        {
+            std::ostringstream error;
+            error << strerror(errno) << " While trying to open: " << path;
+
+            throw std::runtime_error(error.str());
+        }
+
+        if (flock(fd, LOCK_EX) == -1 || fstat(fd, &locked) == -1)
+        {
+            std::ostringstream error;
+            error << strerror(errno) << " While trying to lock: " << path;
+
+            close(fd);
+            throw std::runtime_error(error.str());
+        }
+
+        if (stat(path.c_str(), &current) == 0 && current.st_ino == locked.st_ino && current.st_dev == locked.st_dev) return fd;
+
+        close(fd); // replaced while waiting
+    }
+}
@@ -0,0 +1,189 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - dump file access
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_DUMP_READER_HPP
+#define CHECK_GLUSTER_PERF_DUMP_READER_HPP
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/* A [begin, end) range of bytes inside a MappedFile or a DumpSnapshot. Nothing is owned or copied. */
+struct DumpView {
+    const char* begin;
+    const char* end;
+
+    std::size_t size() const { return end - begin; }
+};
+
+/* What identifies one version of a dump: a rewrite changes at least one of these */
+struct DumpIdentity {
+    std::uint64_t   device;
+    std::uint64_t   inode;
+    std::int64_t    size;
+    std::int64_t    mtime_sec;
+    std::int64_t    mtime_nsec;
+
+    bool operator==(const DumpIdentity& other) const
+    {
+        return device == other.device && inode == other.inode && size == other.size &&
+               mtime_sec == other.mtime_sec && mtime_nsec == other.mtime_nsec;
+    }
+};
+
+/*
+Read-only, whole-file view of a dump.
+
+The file is mmap'ed when possible. Files that can't be mapped (pipes, procfs, some FUSE
+mounts report a size of 0) are read() into a single heap buffer instead, so callers never
+need to care which of the two happened. For the check's own files (state, cache, rules), which
+are replaced by rename, never rewritten in place; dumps are read with DumpSnapshot.
+*/
+class MappedFile
+{
+    public:
+        explicit MappedFile(const std::string& path) throw (std::runtime_error);
+        ~MappedFile();
+
+        const char* data() const { return m_data; }
+        std::size_t size() const { return m_size; }
+        bool        is_mapped() const { return m_mapped; }
+        DumpView    view() const { return {m_data, m_data + m_size}; }
+
+    private:
+        MappedFile(const MappedFile&);              // not copyable, owns the mapping
+        MappedFile& operator=(const MappedFile&);
+
+        void        read_fallback(int fd, const std::string& path) throw (std::runtime_error);
+
+        const char*         m_data;
+        std::size_t         m_size;
+        bool                m_mapped;
+        std::vector<char>   m_buffer; // only used by the read() fallback
+};
+
+/* Thrown by DumpSnapshot when no read of the dump saw it whole */
+class torn_dump_error : public std::runtime_error
+{
+    public:
+        torn_dump_error(const std::string& what) : std::runtime_error(what){}
+};
+
+/*
+One consistent version of a JSON dump GlusterFS rewrites in place (truncates and writes again)
+every interval, copied into memory. A mapping isn't safe for such a file: touching a page past
+its new end is a SIGBUS.
+
+The file is read() into one buffer sized from fstat, then fstat'ed and the path stat'ed again.
+The copy is kept if the dump's identity didn't change while it was read, the path still names
+the same file and all of its bytes were read. Otherwise it's read again 2, 4, 8... ms later, at
+most 100 ms apart, 'attempts' times in all, then torn_dump_error is thrown.
+
+Whether the copy is whole is left to the pass that goes over it anyway, run with consume():
+split_root_objects and DumpScanner throw torn_dump_error for a dump that's empty or ends inside
+a root object, the dump is read again with the attempts left and the pass starts over. A stable
+dump costs no pass more than that. A dump cut exactly between two root objects (GlusterFS 3.8
+writes two) looks whole, it's only caught by its identity changing while the writer goes on.
+
+Unlike a mapping, the copy costs memory the size of the dump, and one read() and two stat calls
+more. That's the price of never touching pages a truncation took away (a SIGBUS).
+*/
+class DumpSnapshot
+{
+    public:
+        DumpSnapshot(const std::string& path, int attempts) throw (std::runtime_error, torn_dump_error);
+
+        /*
+        Runs 'pass' over the copy, again over a new one each time it throws torn_dump_error, as long
+        as there are attempts left. 'pass' must start over from scratch every time.
+        */
+        template <typename Pass>
+        void                consume(Pass pass) throw (std::runtime_error, torn_dump_error);
+
+        DumpView            view() const { return {m_data.get(), m_data.get() + m_size}; }
+        const DumpIdentity& identity() const { return m_identity; }
+        int                 attempts() const { return m_attempts; } // the reads it took
+
+    private:
+        DumpSnapshot(const DumpSnapshot&);
+        DumpSnapshot& operator=(const DumpSnapshot&);
+
+        /* Reads until a copy is one version of the file, the first time or after a pass found it cut short */
+        void                read_stable() throw (std::runtime_error, torn_dump_error);
+        void                read_again(const torn_dump_error& cut) throw (std::runtime_error, torn_dump_error);
+
+        /* True if the copy is one version of the file */
+        bool                read_once() throw (std::runtime_error);
+
+        std::string             m_path;
+        std::unique_ptr<char[]> m_data; // not a vector, zeroing it first would be one more pass over the dump
+        std::size_t         m_capacity;
+        std::size_t         m_size;
+        DumpIdentity        m_identity;
+        int                 m_attempts;
+        int                 m_max_attempts;
+        int                 m_backoff_ms;   // the wait before the last read
+};
+
+template <typename Pass>
+void DumpSnapshot::consume(Pass pass) throw (std::runtime_error, torn_dump_error)
+{
+    for (;;)
+    {
+        try
+        {
+            pass(view());
+            return;
+        }
+        catch (const torn_dump_error& cut)
+        {
+            read_again(cut); // this throws once there are no attempts left
+        }
+    }
+}
+
+class MetricFilter;
+
+/*
+Splits 'input' into its top level JSON values by counting {}'s outside of strings, found with
+StructuralIndexer. Each root object is appended to 'objects' as a view; if the input starts with
+an array, the whole input is returned as a single view and left to the JSON library to validate.
+
+With a 'filter', root objects skip_unmatched_object rules out are left out, never parsed; the
+number of those is returned. Throws torn_dump_error if 'input' is blank or ends inside a root
+object, a dump GlusterFS was still writing (see DumpSnapshot).
+*/
+int split_root_objects(const DumpView& input, std::vector<DumpView>& objects, const MetricFilter* filter = nullptr) throw (std::runtime_error);
+
+/*
+If 'filter' can't match any key of the flat root object starting at 'object' (its '{'), known
+from a prefix of each key (MetricFilter::dead_prefix, "storage.gluster.brick1." against
+"storage\.gluster\.brick2\..*"), returns the end of it, nullptr otherwise. Keys sharing the
+prefix that ruled out the previous one cost a memcmp. Only the keys are looked at; the values
+aren't checked beyond being strings or literals, nothing needs them.
+*/
+const char* skip_unmatched_object(const DumpView& input, const char* object, const MetricFilter& filter);
+
+/*
+Replaces 'path' with 'contents' by writing a temporary file next to it and renaming it over
+'path': concurrent readers see either the old or the new file, never half of one. The file gets
+the permissions in 'mode', state files are only the check's business by default.
+*/
+void replace_file(const std::string& path, const std::string& contents, int mode = 0600) throw (std::runtime_error);
+
+/*
+Opens 'path' read-write, creating it empty if needed, and returns the descriptor once it holds
+an exclusive flock() on it; closing it releases the lock. A file replace_file() renamed over
+'path' while waiting for the lock isn't the file anymore, the new one is opened and waited for
+instead, so the holder always has the file everyone else would lock.
+*/
+int  open_locked(const std::string& path) throw (std::runtime_error);
+
+#endif
@@ -0,0 +1,243 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - streaming dump scanner
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "dump_stream.hpp"
+#include "metric_evaluator.hpp"
+
+#include <sstream>
+#include <cstring>
+
+static const std::size_t STREAM_RESERVED_METRICS = 256; // a GlusterFS 3.8 brick dumps a few hundred metrics
+
+void DumpScanner::skip_whitespace()
+{
+    while (m_position != m_input.end && (*m_position == ' ' || *m_position == '\n' || *m_position == '\r' || *m_position == '\t'))
+    {
+        m_position++;
+    }
+}
+
+void DumpScanner::expect(char character) throw (std::runtime_error)
+{
+    if (at_end() || *m_position != character)
+    {
+        std::string what = std::string("expected '") + character + "'";
+        at_end() ? cut_short(what.c_str()) : fail(what.c_str());
+    }
+
+    m_position++;
+}
+
+void DumpScanner::fail(const char* what) const throw (std::runtime_error)
+{
+    throw std::runtime_error(where(what));
+}
+
+void DumpScanner::cut_short(const char* what) const throw (torn_dump_error)
+{
+    throw torn_dump_error(where(what));
+}
+
+std::string DumpScanner::where(const char* what) const
+{
+    std::ostringstream  error_message;
+    int                 line_count = 1;
+    const char*         line_start = m_input.begin;
+
+    for (const char* it = m_input.begin; it < m_position; it++)
+    {
+        if (*it == '\n')
+        {
+            line_count++;
+            line_start = it + 1;
+        }
+    }
+
+    error_message << "Malformed GlusterFS dump at line " << line_count << ":" << (m_position - line_start) << ", " << what;
+    return error_message.str();
+}
+
+static void append_utf8(std::string& out, unsigned long code_point)
+{
+    if (code_point < 0x80)
+    {
+        out += (char) code_point;
+    } else if (code_point < 0x800)
+    {
+        out += (char) (0xC0 | (code_point >> 6));
+        out += (char) (0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000)
+    {
+        out += (char) (0xE0 | (code_point >> 12));
+        out += (char) (0x80 | ((code_point >> 6) & 0x3F));
+        out += (char) (0x80 | (code_point & 0x3F));
+    } else
+    {
+        out += (char) (0xF0 | (code_point >> 18));
+        out += (char) (0x80 | ((code_point >> 12) & 0x3F));
+        out += (char) (0x80 | ((code_point >> 6) & 0x3F));
+        out += (char) (0x80 | (code_point & 0x3F));
+    }
+}
+
+/*
+Reads a JSON string starting at the opening quote. Strings without escapes (all GlusterFS
+metric names and values) are returned as views of the input, only escaped ones are decoded.
+*/
+DumpView DumpScanner::read_string(std::string& scratch) throw (std::runtime_error)
+{
+    expect('"');
+
+    const char* start   = m_position;
+    const char* closing = static_cast<const char*>(std::memchr(start, '"', m_input.end - start));
+    const char* escape  = closing ? static_cast<const char*>(std::memchr(start, '\\', closing - start)) : nullptr;
+
+    if (closing == nullptr) cut_short("unterminated string");
+
+    if (escape == nullptr)
+    {
+        m_position = closing + 1;
+        return {start, closing};
+    }
+
+    scratch.assign(start, escape);
+    m_position = escape;
+
+    while (! at_end() && *m_position != '"')
+    {
+        if (*m_position != '\\')
+        {
+            scratch += *m_position++;
+            continue;
+        }
+
+        if (++m_position == m_input.end) cut_short("unterminated string");
+
+        switch (*m_position++)
+        {
+            case '"':  scratch += '"';  break;
+            case '\\': scratch += '\\'; break;
+            case '/':  scratch += '/';  break;
+            case 'b':  scratch += '\b'; break;
+            case 'f':  scratch += '\f'; break;
+            case 'n':  scratch += '\n'; break;
+            case 'r':  scratch += '\r'; break;
+            case 't':  scratch += '\t'; break;
+            case 'u':
+            {
+                unsigned long code_point = 0;
+
+                for (int pass = 0; pass < 2; pass++)
+                {
+                    unsigned long unit = 0;
+
+                    if (m_input.end - m_position < 4) cut_short("truncated \\u escape");
+
+                    for (int digit = 0; digit < 4; digit++)
+                    {
+                        char c = *m_position++;
+                        unit <<= 4;
+
+                        if      (c >= '0' && c <= '9') unit |= c - '0';
+                        else if (c >= 'a' && c <= 'f') unit |= c - 'a' + 10;
+                        else if (c >= 'A' && c <= 'F') unit |= c - 'A' + 10;
+                        else fail("invalid \\u escape");
+                    }
+
+                    if (pass == 0 && unit >= 0xD800 && unit <= 0xDBFF) // high surrogate, the low one must follow
+                    {
+                        if (m_input.end - m_position < 2 || m_position[0] != '\\' || m_position[1] != 'u') fail("unpaired surrogate");
+
+                        m_position += 2;
+                        code_point = unit;
+                        continue;
+                    }
+
+                    if (pass == 1)
+                    {
+                        if (unit < 0xDC00 || unit > 0xDFFF) fail("unpaired surrogate");
+
+                        unit = 0x10000 + ((code_point - 0xD800) << 10) + (unit - 0xDC00);
+                    }
+
+                    code_point = unit;
+                    break;
+                }
+
+                append_utf8(scratch, code_point);
+                break;
+            }
+            default:
+                fail("invalid escape sequence");
+        }
+    }
+
+    expect('"');
+
+    return {scratch.data(), scratch.data() + scratch.size()};
+}
+
+/* Reads a number/true/false/null token as-is */
+DumpView DumpScanner::read_literal() throw (std::runtime_error)
+{
+    const char* start = m_position;
+
+    while (! at_end() && *m_position != ',' && *m_position != '}' && *m_position != ' ' && *m_position != '\n' && *m_position != '\r' && *m_position != '\t')
+    {
+        m_position++;
+    }
+
+    if (m_position == start) fail("expected a value");
+
+    return {start, m_position};
+}
+
+
+/* Glues the scanner events to the evaluator, this is the whole pipeline in one pass */
+class StreamEvaluationHandler
+{
+    public:
+        explicit StreamEvaluationHandler(MetricEvaluator& evaluator) : m_evaluator(evaluator) {}
+
+        void on_root_object() {}
+        void on_member(const DumpView& key, const DumpView& value) { m_evaluator.evaluate(key, value); }
+
+    private:
+        MetricEvaluator& m_evaluator;
+};
+
+ReturnCode  process_metrics_stream(
+        MetricTable& metrics,
+        Metric& total_average,
+        int& root_objects,
+        const DumpView& dump,
+        const Metric& warning_threshold,
+        const Metric& critical_threshold,
+        const UnitType& unit_type_output,
+        const UnitType& gluster_unit_type,
+        const MetricFilter& metric_filter,
+        bool disable_threshold_comparison,
+        IntervalState* interval_state,
+        MetricGroups* groups,
+        AverageWeight average_weight,
+        const MetricRules* rules) throw (std::runtime_error)
+{
+    MetricEvaluator         evaluator(metrics,
+                                      warning_threshold, critical_threshold,
+                                      unit_type_output, gluster_unit_type,
+                                      metric_filter, disable_threshold_comparison,
+                                      interval_state, groups, average_weight, rules);
+    StreamEvaluationHandler handler(evaluator);
+    DumpScanner             scanner(dump, MetricEvaluator::skip_filter(metric_filter, average_weight));
+
+    // a fixed first guess, not one from the dump size: a narrow -f keeps a few metrics of a large dump, the table grows past it on demand
+    metrics.reserve(STREAM_RESERVED_METRICS, STREAM_RESERVED_METRICS * 64);
+
+    root_objects = scanner.scan(handler);
+
+    return evaluator.finish(total_average);
+}
@@ -0,0 +1,169 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - streaming dump scanner
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_DUMP_STREAM_HPP
+#define CHECK_GLUSTER_PERF_DUMP_STREAM_HPP
+
+#include <string>
+#include <stdexcept>
+
+#include "check_gluster_perf.hpp"
+#include "dump_reader.hpp"
+#include "metric_filter.hpp"
+#include "interval.hpp"
+#include "metric_table.hpp"
+#include "metric_groups.hpp"
+
+/*
+Event based scanner for GlusterFS dumps: a sequence of flat root objects mapping metric names
+to scalar values. No document is built, the handler is called for every member as it's found:
+
+    handler.on_root_object()                      - a new root object starts
+    handler.on_member(key, value)                 - key and value are views of the unquoted text
+
+Views point into the input unless the JSON text used escape sequences, in which case they point
+into a scratch buffer that's reused for the next member.
+
+With a 'skip_filter', root objects skip_unmatched_object rules out are stepped over: counted, but
+neither scanned nor handed to the handler.
+
+An input that's blank or ends inside a root object throws torn_dump_error, what a dump GlusterFS
+is still writing looks like (see DumpSnapshot); anything else malformed std::runtime_error.
+*/
+class DumpScanner
+{
+    public:
+        explicit DumpScanner(const DumpView& input, const MetricFilter* skip_filter = nullptr)
+            : m_input(input), m_position(input.begin),
+              m_skip_filter(skip_filter != nullptr && skip_filter->prunes_prefixes() ? skip_filter : nullptr) {}
+
+        /* Scans the whole input, returns the number of root objects found. */
+        template <typename Handler>
+        int scan(Handler& handler) throw (std::runtime_error);
+
+    private:
+        void        skip_whitespace();
+        bool        at_end() const { return m_position == m_input.end; }
+        DumpView    read_string(std::string& scratch) throw (std::runtime_error);
+        DumpView    read_literal() throw (std::runtime_error);
+        void        expect(char character) throw (std::runtime_error);
+        void        fail(const char* what) const throw (std::runtime_error);
+        void        cut_short(const char* what) const throw (torn_dump_error); // the input ends too early
+        std::string where(const char* what) const;
+
+        DumpView        m_input;
+        const char*     m_position;
+        const MetricFilter* m_skip_filter;
+        std::string     m_key_scratch;
+        std::string     m_value_scratch;
+};
+
+template <typename Handler>
+int DumpScanner::scan(Handler& handler) throw (std::runtime_error)
+{
+    int root_objects = 0;
+
+    for (skip_whitespace(); ! at_end(); skip_whitespace())
+    {
+        expect('{');
+        root_objects++;
+
+        if (m_skip_filter != nullptr)
+        {
+            const char* end = skip_unmatched_object(m_input, m_position - 1, *m_skip_filter);
+
+            if (end != nullptr)
+            {
+                m_position = end;
+                continue;
+            }
+        }
+
+        handler.on_root_object();
+
+        skip_whitespace();
+
+        if (! at_end() && *m_position == '}')
+        {
+            m_position++;
+            continue; // empty object
+        }
+
+        for (;;)
+        {
+            skip_whitespace();
+
+            DumpView key = read_string(m_key_scratch);
+
+            skip_whitespace();
+            expect(':');
+            skip_whitespace();
+
+            if (at_end()) cut_short("unexpected end of dump");
+
+            DumpView value;
+
+            if (*m_position == '"')
+            {
+                value = read_string(m_value_scratch);
+            }
+            else if (*m_position == '{' || *m_position == '[')
+            {
+                fail("nested objects and arrays are not supported as metric values");
+            }
+            else
+            {
+                value = read_literal();
+            }
+
+            handler.on_member(key, value);
+
+            skip_whitespace();
+
+            if (at_end()) cut_short("unexpected end of dump");
+
+            if (*m_position == ',')
+            {
+                m_position++;
+                continue;
+            }
+
+            expect('}');
+            break;
+        }
+    }
+
+    if (root_objects == 0) cut_short("it's blank");
+
+    return root_objects;
+}
+
+/*
+Fused single pass variant of process_metrics: scans 'dump' and evaluates every member as it's
+found, without building a JSON document. The results are identical to process_metrics.
+Besides 'dump' itself, which the caller holds in memory (see DumpSnapshot), memory use only
+depends on the number of metrics passing the filter, not on the dump size.
+Root objects the filter rules out by their keys' prefix are stepped over, see DumpScanner.
+
+Returns the number of root objects found through 'root_objects'.
+*/
+ReturnCode  process_metrics_stream(MetricTable& metrics,
+                                   Metric& total_average,
+                                   int& root_objects,
+                                   const DumpView& dump,
+                                   const Metric& warning_threshold,
+                                   const Metric& critical_threshold,
+                                   const UnitType& unit_type_output,
+                                   const UnitType& gluster_unit_type,
+                                   const MetricFilter& metric_filter,
+                                   bool disable_threshold_comparison,
+                                   IntervalState* interval_state = nullptr,
+                                   MetricGroups* groups = nullptr,
+                                   AverageWeight average_weight = AverageWeight::None,
+                                   const MetricRules* rules = nullptr) throw (std::runtime_error);
+
+#endif
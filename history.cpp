@@ -0,0 +1,461 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - metric history and windowed thresholds
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "history.hpp"
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+static const char           HISTORY_MAGIC[4]    = {'C', 'G', 'P', 'H'};
+static const std::uint32_t  HISTORY_VERSION     = 1;
+
+struct HistoryHeader {
+    char            magic[4];
+    std::uint32_t   version;
+    std::uint32_t   capacity;       // slots per column
+    std::uint32_t   metric_count;
+    std::uint32_t   head;           // the slot the next snapshot goes to
+    std::uint32_t   filled;         // slots holding a snapshot, at most capacity
+    std::uint32_t   names_size;
+    std::uint32_t   reserved;
+};
+
+struct HistoryName {
+    std::uint32_t   offset;         // in the names
+    std::uint32_t   length;
+};
+
+static_assert(sizeof(HistoryHeader) == 32 && sizeof(HistoryName) == 8, "the history file layout depends on these having no padding");
+
+/* Offsets of the sections of a history file */
+struct HistoryLayout {
+    std::size_t times;
+    std::size_t values;
+    std::size_t index;
+    std::size_t names;
+    std::size_t size;
+
+    HistoryLayout(std::uint32_t capacity, std::uint32_t metric_count, std::uint32_t names_size)
+    {
+        times   = sizeof(HistoryHeader);
+        values  = times + (std::size_t) capacity * sizeof(std::int64_t);
+        index   = values + (std::size_t) metric_count * capacity * sizeof(double);
+        names   = index + (std::size_t) metric_count * sizeof(HistoryName);
+        size    = names + names_size;
+    }
+};
+
+static std::runtime_error history_error(const std::string& what, const std::string& file)
+{
+    std::ostringstream error;
+    error << strerror(errno) << " While trying to " << what << ": " << file;
+
+    return std::runtime_error(error.str());
+}
+
+MetricHistory::MetricHistory(const std::string& file, std::uint32_t capacity) throw (std::runtime_error)
+    : m_file(file),
+      m_capacity(capacity),
+      m_fd(-1),
+      m_data(nullptr),
+      m_size(0)
+{
+    map();
+
+    if (! valid() || reinterpret_cast<const HistoryHeader*>(m_data)->capacity != m_capacity)
+    {
+        rebuild(std::vector<std::string>()); // new, damaged or resized: keeps what can be kept
+    }
+}
+
+MetricHistory::~MetricHistory()
+{
+    unmap();
+}
+
+void MetricHistory::map() throw (std::runtime_error)
+{
+    struct stat info;
+
+    m_fd = open_locked(m_file); // this throws
+
+    if (fstat(m_fd, &info) == -1)
+    {
+        std::runtime_error error = history_error("stat", m_file);
+        unmap();
+        throw error;
+    }
+
+    m_size = info.st_size;
+
+    if (m_size == 0) return; // just created
+
+    void* data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+
+    if (data == MAP_FAILED)
+    {
+        std::runtime_error error = history_error("map", m_file);
+        unmap();
+        throw error;
+    }
+
+    m_data = static_cast<char*>(data);
+}
+
+void MetricHistory::unmap()
+{
+    if (m_data != nullptr) munmap(m_data, m_size);
+    if (m_fd != -1) close(m_fd); // also releases the lock
+
+    m_data  = nullptr;
+    m_size  = 0;
+    m_fd    = -1;
+}
+
+bool MetricHistory::valid() const
+{
+    if (m_data == nullptr || m_size < sizeof(HistoryHeader)) return false;
+
+    const HistoryHeader* header = reinterpret_cast<const HistoryHeader*>(m_data);
+    HistoryLayout        layout(header->capacity, header->metric_count, header->names_size);
+
+    if (std::memcmp(header->magic, HISTORY_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != HISTORY_VERSION ||
+        header->capacity == 0 || header->head >= header->capacity || header->filled > header->capacity ||
+        layout.size != m_size)
+    {
+        return false;
+    }
+
+    const HistoryName* index = reinterpret_cast<const HistoryName*>(m_data + layout.index);
+
+    for (std::uint32_t id = 0; id < header->metric_count; id++)
+    {
+        if ((std::uint64_t) index[id].offset + index[id].length > header->names_size) return false;
+    }
+
+    return true;
+}
+
+std::uint32_t MetricHistory::snapshots() const
+{
+    return reinterpret_cast<const HistoryHeader*>(m_data)->filled;
+}
+
+long MetricHistory::find(const DumpView& name) const
+{
+    const HistoryHeader*    header  = reinterpret_cast<const HistoryHeader*>(m_data);
+    HistoryLayout           layout(header->capacity, header->metric_count, header->names_size);
+    const HistoryName*      index   = reinterpret_cast<const HistoryName*>(m_data + layout.index);
+    const char*             names   = m_data + layout.names;
+    long                    low     = 0,
+                            high    = (long) header->metric_count - 1;
+
+    // the index is in name order
+    while (low <= high)
+    {
+        long        middle = (low + high) / 2;
+        std::size_t length = std::min<std::size_t>(index[middle].length, name.size());
+        int         result = std::memcmp(names + index[middle].offset, name.begin, length);
+
+        if (result == 0) result = index[middle].length < name.size() ? -1 : (index[middle].length > name.size() ? 1 : 0);
+
+        if (result == 0) return middle;
+
+        if (result < 0)
+            low = middle + 1;
+        else
+            high = middle - 1;
+    }
+
+    return -1;
+}
+
+/*
+Writes a new file with the union of the current metrics and 'names', and the newest snapshots
+that fit m_capacity, then maps it in place of the old one.
+*/
+void MetricHistory::rebuild(const std::vector<std::string>& names) throw (std::runtime_error)
+{
+    std::vector<std::string>    all_names(names);
+    const HistoryHeader*        old_header  = valid() ? reinterpret_cast<const HistoryHeader*>(m_data) : nullptr;
+    std::uint32_t               kept        = 0;
+
+    if (old_header != nullptr)
+    {
+        HistoryLayout       old_layout(old_header->capacity, old_header->metric_count, old_header->names_size);
+        const HistoryName*  index = reinterpret_cast<const HistoryName*>(m_data + old_layout.index);
+
+        for (std::uint32_t id = 0; id < old_header->metric_count; id++)
+        {
+            all_names.push_back(std::string(m_data + old_layout.names + index[id].offset, index[id].length));
+        }
+
+        kept = std::min(old_header->filled, m_capacity);
+    }
+
+    std::sort(all_names.begin(), all_names.end());
+    all_names.erase(std::unique(all_names.begin(), all_names.end()), all_names.end());
+
+    std::size_t names_size = 0;
+
+    for (const std::string& name : all_names) names_size += name.size();
+
+    HistoryHeader   header;
+    HistoryLayout   layout(m_capacity, all_names.size(), names_size);
+    std::string     contents(layout.size, '\0');
+    double          missing = std::numeric_limits<double>::quiet_NaN();
+
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, HISTORY_MAGIC, sizeof(header.magic));
+
+    header.version      = HISTORY_VERSION;
+    header.capacity     = m_capacity;
+    header.metric_count = all_names.size();
+    header.head         = kept % m_capacity;
+    header.filled       = kept;
+    header.names_size   = names_size;
+
+    std::memcpy(&contents[0], &header, sizeof(header));
+
+    std::int64_t*   times   = reinterpret_cast<std::int64_t*>(&contents[layout.times]);
+    double*         values  = reinterpret_cast<double*>(&contents[layout.values]);
+    HistoryName*    index   = reinterpret_cast<HistoryName*>(&contents[layout.index]);
+    std::size_t     offset  = 0;
+
+    std::fill(values, values + (std::size_t) header.metric_count * m_capacity, missing);
+
+    for (std::uint32_t id = 0; id < header.metric_count; id++)
+    {
+        index[id].offset = offset;
+        index[id].length = all_names[id].size();
+
+        std::memcpy(&contents[layout.names + offset], all_names[id].data(), all_names[id].size());
+        offset += all_names[id].size();
+    }
+
+    // the kept snapshots, oldest first, from slot 0 on
+    if (old_header != nullptr)
+    {
+        HistoryLayout       old_layout(old_header->capacity, old_header->metric_count, old_header->names_size);
+        const std::int64_t* old_times   = reinterpret_cast<const std::int64_t*>(m_data + old_layout.times);
+        const double*       old_values  = reinterpret_cast<const double*>(m_data + old_layout.values);
+        const HistoryName*  old_index   = reinterpret_cast<const HistoryName*>(m_data + old_layout.index);
+        std::uint32_t       first       = (old_header->head + old_header->capacity - kept) % old_header->capacity;
+
+        for (std::uint32_t slot = 0; slot < kept; slot++)
+        {
+            times[slot] = old_times[(first + slot) % old_header->capacity];
+        }
+
+        for (std::uint32_t old_id = 0, id = 0; old_id < old_header->metric_count; old_id++)
+        {
+            std::string name(m_data + old_layout.names + old_index[old_id].offset, old_index[old_id].length);
+
+            while (all_names[id] != name) id++; // both in name order
+
+            for (std::uint32_t slot = 0; slot < kept; slot++)
+            {
+                values[(std::size_t) id * m_capacity + slot] = old_values[(std::size_t) old_id * old_header->capacity + (first + slot) % old_header->capacity];
+            }
+        }
+    }
+
+    std::string file = m_file;
+
+    replace_file(file, contents); // this throws
+    unmap();
+    map();
+
+    if (! valid()) throw std::runtime_error("The history file was changed while being rebuilt: " + m_file);
+}
+
+void MetricHistory::append(const MetricTable& metrics, std::time_t dump_mtime) throw (std::runtime_error)
+{
+    const std::vector<MetricTable::Index>& list = metrics.metrics();
+    std::vector<std::string>               new_names;
+
+    for (MetricTable::Index index : list)
+    {
+        if (find(metrics.name(index)) == -1) new_names.push_back(std::string(metrics.name(index).begin, metrics.name(index).end));
+    }
+
+    if (! new_names.empty()) rebuild(new_names);
+
+    HistoryHeader*  header  = reinterpret_cast<HistoryHeader*>(m_data);
+    HistoryLayout   layout(header->capacity, header->metric_count, header->names_size);
+    std::int64_t*   times   = reinterpret_cast<std::int64_t*>(m_data + layout.times);
+    double*         values  = reinterpret_cast<double*>(m_data + layout.values);
+    std::uint32_t   slot    = header->head;
+
+    if (header->filled > 0 && times[(slot + m_capacity - 1) % m_capacity] == (std::int64_t) dump_mtime) return; // this dump is already in
+
+    for (std::uint32_t id = 0; id < header->metric_count; id++)
+    {
+        values[(std::size_t) id * m_capacity + slot] = std::numeric_limits<double>::quiet_NaN(); // not in this dump
+    }
+
+    // the metrics are in name order too, but there may be fewer of them than columns
+    for (MetricTable::Index index : list)
+    {
+        values[(std::size_t) find(metrics.name(index)) * m_capacity + slot] = metrics.value(index).value;
+    }
+
+    times[slot]     = dump_mtime;
+    header->head    = (slot + 1) % m_capacity;
+    header->filled  = std::min(header->filled + 1, m_capacity);
+}
+
+bool MetricHistory::window(const DumpView& name, WindowStat stat, double percentile, std::time_t end, int window_seconds, double& result) const
+{
+    long id = find(name);
+
+    if (id == -1) return false;
+
+    const HistoryHeader*    header  = reinterpret_cast<const HistoryHeader*>(m_data);
+    HistoryLayout           layout(header->capacity, header->metric_count, header->names_size);
+    const std::int64_t*     times   = reinterpret_cast<const std::int64_t*>(m_data + layout.times);
+    const double*           column  = reinterpret_cast<const double*>(m_data + layout.values) + (std::size_t) id * m_capacity;
+    std::size_t             count   = 0;
+    double                  sum     = 0,
+                            maximum = -std::numeric_limits<double>::infinity();
+
+    m_scratch.clear();
+
+    // newest first, until the window or the history ends
+    for (std::uint32_t age = 0; age < header->filled; age++)
+    {
+        std::uint32_t   slot  = (header->head + m_capacity - 1 - age) % m_capacity;
+        double          value = column[slot];
+
+        if (times[slot] > (std::int64_t) end) continue; // a newer dump than the one checked
+        if (times[slot] <= (std::int64_t) end - window_seconds) break;
+        if (std::isnan(value)) continue;
+
+        count++;
+        sum    += value;
+        maximum = std::max(maximum, value);
+
+        if (stat == WindowStat::Percentile) m_scratch.push_back(value);
+    }
+
+    if (count == 0) return false;
+
+    switch (stat)
+    {
+        case WindowStat::Average:
+            result = sum / count;
+            break;
+        case WindowStat::Percentile:
+        {
+            // nearest rank: the smallest value with at least 'percentile' % of the values at or below it
+            std::size_t rank = (std::size_t) std::ceil(percentile / 100 * count);
+
+            rank = std::max<std::size_t>(rank, 1) - 1;
+
+            std::nth_element(m_scratch.begin(), m_scratch.begin() + rank, m_scratch.end());
+            result = m_scratch[rank];
+            break;
+        }
+        default:
+            result = maximum;
+    }
+
+    return true;
+}
+
+ReturnCode MetricHistory::apply_thresholds(MetricTable& metrics, const CheckOptions& options, std::time_t end) const
+{
+    std::ostringstream                              suffix;
+    std::vector<std::pair<std::string, Metric> >    exceeding;
+    std::vector<double>                             severities;
+    ReturnCode                                      check_code = ReturnCode::OK;
+
+    switch (options.window_stat)
+    {
+        case WindowStat::Average:       suffix << ".avg"; break;
+        case WindowStat::Maximum:       suffix << ".max"; break;
+        case WindowStat::Percentile:    suffix << ".p" << options.window_percentile; break;
+        default:                        return check_code;
+    }
+
+    for (MetricTable::Index index : metrics.metrics())
+    {
+        const Metric&   metric = metrics.value(index);
+        double          value;
+
+        if (! window(metrics.name(index), options.window_stat, options.window_percentile, end, options.window_seconds, value)) continue;
+
+        Metric  warning_t   = convert(options.warning_threshold, metric.unit);
+        Metric  critical_t  = convert(options.critical_threshold, metric.unit);
+
+        if (value >= warning_t.value || value >= critical_t.value)
+        {
+            DumpView name = metrics.name(index);
+
+            // listed after the loop, adding to the table moves its names
+            exceeding.push_back({std::string(name.begin, name.end) + suffix.str(), {value, metric.unit}});
+            severities.push_back(severity_ratio(value, warning_t.value));
+
+            if (value >= critical_t.value)
+                check_code = ReturnCode::Critical;
+            else if (check_code != ReturnCode::Critical)
+                check_code = ReturnCode::Warning;
+        }
+    }
+
+    for (std::size_t i = 0; i < exceeding.size(); i++)
+    {
+        metrics.set_exceeding(exceeding[i].first, exceeding[i].second, severities[i]);
+    }
+
+    return check_code;
+}
+
+std::string history_file(const std::string& state_dir, const std::string& volume, const CheckOptions& options)
+{
+    std::ostringstream key, path;
+
+    // the values are stored as evaluated, in the output unit
+    key << (int) options.unit_type_output << '\t' << (int) options.gluster_unit_type << '\t' << (int) options.interval_mode << '\t' << options.filter_regex;
+
+    path << state_dir << "/check_gluster_perf_" << volume << "_" << std::hex << std::setw(16) << std::setfill('0') << hash_text(key.str()) << ".history";
+
+    return path.str();
+}
+
+WindowStat parse_window_stat(const std::string& text, double& percentile) throw (std::invalid_argument)
+{
+    percentile = 0;
+
+    if (text == "off") return WindowStat::Off;
+    if (text == "avg") return WindowStat::Average;
+    if (text == "max") return WindowStat::Maximum;
+
+    if (text.size() > 1 && text[0] == 'p')
+    {
+        char* end;
+
+        percentile = std::strtod(text.c_str() + 1, &end);
+
+        if (*end == '\0' && percentile > 0 && percentile <= 100) return WindowStat::Percentile;
+    }
+
+    throw std::invalid_argument("Invalid -apply-on-window value '" + text + "'. Expected: off avg max p<percentile>, e.g. p95");
+}
@@ -0,0 +1,81 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - metric history and windowed thresholds
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_HISTORY_HPP
+#define CHECK_GLUSTER_PERF_HISTORY_HPP
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <ctime>
+#include <cstdint>
+
+#include "check_gluster_perf.hpp"
+#include "dump_reader.hpp"
+#include "metric_table.hpp"
+
+/*
+The values of the last 'capacity' checked dumps of a volume, in a fixed size file that is
+mmap'ed read-write:
+
+    header | dump mtime per slot | values[metric][slot] | name index | names
+
+Each metric's values over time are one contiguous column, the slots are a ring: appending a
+dump writes one slot of every column and moves the head, the file is never rewritten. Only a
+metric not seen before, or another -history-size, rebuilds the file (through replace_file).
+
+Checks of the same volume at the same time are serialized with open_locked(): a check waiting on
+the file while a rebuild replaces it locks the new file, its snapshot isn't lost.
+*/
+class MetricHistory
+{
+    public:
+        MetricHistory(const std::string& file, std::uint32_t capacity) throw (std::runtime_error);
+        ~MetricHistory();
+
+        /* Records the metrics' values as the snapshot of the dump modified at 'dump_mtime', once per dump */
+        void        append(const MetricTable& metrics, std::time_t dump_mtime) throw (std::runtime_error);
+
+        /*
+        The statistic of a metric's values in the snapshots of the 'window_seconds' up to and
+        including 'end', in O(window). False if the metric has no value in the window.
+        */
+        bool        window(const DumpView& name, WindowStat stat, double percentile, std::time_t end, int window_seconds, double& result) const;
+
+        /*
+        Compares every metric's windowed statistic with the thresholds, lists those exceeding
+        them as "<metric>.<stat>" in 'metrics' and returns the resulting check code.
+        */
+        ReturnCode  apply_thresholds(MetricTable& metrics, const CheckOptions& options, std::time_t end) const;
+
+        std::uint32_t   snapshots() const;
+
+    private:
+        MetricHistory(const MetricHistory&);
+        MetricHistory& operator=(const MetricHistory&);
+
+        void        map() throw (std::runtime_error);
+        void        unmap();
+        bool        valid() const;
+        void        rebuild(const std::vector<std::string>& names) throw (std::runtime_error);
+        long        find(const DumpView& name) const; // the metric's column, -1 if it has none
+
+        std::string         m_file;
+        std::uint32_t       m_capacity;
+        int                 m_fd;
+        char*               m_data;
+        std::size_t         m_size;
+        mutable std::vector<double> m_scratch; // the window's values, for percentiles
+};
+
+/* The file the history of 'volume' is kept in, one per volume, filter and output unit */
+std::string history_file(const std::string& state_dir, const std::string& volume, const CheckOptions& options);
+
+/* Parses -apply-on-window: "off", "avg", "max" or "p<percentile>", e.g. "p95" */
+WindowStat  parse_window_stat(const std::string& text, double& percentile) throw (std::invalid_argument);
+
+#endif
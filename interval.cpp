@@ -0,0 +1,269 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - interval (delta/rate) evaluation
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "interval.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+/*
+State file layout, native byte order (the file never leaves the host that wrote it):
+
+    "CGPI" u32 version u32 generation_count
+    per generation: i64 dump_mtime u32 entry_count u32 names_size Entry[entry_count] char names[names_size]
+
+The oldest generation comes first.
+*/
+static const char           STATE_MAGIC[4]  = {'C', 'G', 'P', 'I'};
+static const std::uint32_t  STATE_VERSION   = 1;
+
+template <typename T>
+static void append_raw(std::string& output, const T& value)
+{
+    output.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static const char* read_raw(const char* position, const char* end, T& value) throw (std::runtime_error)
+{
+    if ((std::size_t) (end - position) < sizeof(value))
+    {
+        throw std::runtime_error("truncated");
+    }
+
+    std::memcpy(&value, position, sizeof(value));
+
+    return position + sizeof(value);
+}
+
+void MetricSnapshot::reset(std::time_t dump_mtime)
+{
+    m_dump_mtime = dump_mtime;
+    m_names.clear();
+    m_entries.clear();
+    m_sorted.clear();
+    m_cursor = 0;
+}
+
+void MetricSnapshot::add(const DumpView& name, double value)
+{
+    m_entries.push_back({(std::uint32_t) m_names.size(), (std::uint32_t) name.size(), value});
+    m_names.append(name.begin, name.end);
+}
+
+int MetricSnapshot::compare(const Entry& entry, const DumpView& name) const
+{
+    std::size_t length = std::min<std::size_t>(entry.name_length, name.size());
+    int         result = std::memcmp(m_names.data() + entry.name_offset, name.begin, length);
+
+    if (result != 0) return result;
+
+    return entry.name_length < name.size() ? -1 : (entry.name_length > name.size() ? 1 : 0);
+}
+
+bool MetricSnapshot::find(const DumpView& name, double& value) const
+{
+    // the common case: the metric follows the one found last, as it did in the previous dump
+    if (m_cursor < m_entries.size() && compare(m_entries[m_cursor], name) == 0)
+    {
+        value = m_entries[m_cursor++].value;
+        return true;
+    }
+
+    if (m_sorted.empty() && ! m_entries.empty())
+    {
+        m_sorted.resize(m_entries.size());
+
+        for (std::uint32_t i = 0; i < m_sorted.size(); i++) m_sorted[i] = i;
+
+        std::sort(m_sorted.begin(), m_sorted.end(), [this](std::uint32_t a, std::uint32_t b)
+        {
+            return compare(m_entries[a], name_of(m_entries[b])) < 0;
+        });
+    }
+
+    auto found = std::lower_bound(m_sorted.begin(), m_sorted.end(), name, [this](std::uint32_t index, const DumpView& key)
+    {
+        return compare(m_entries[index], key) < 0;
+    });
+
+    if (found == m_sorted.end() || compare(m_entries[*found], name) != 0)
+    {
+        return false;
+    }
+
+    m_cursor = *found + 1; // the dump's order resumes from here
+    value    = m_entries[*found].value;
+
+    return true;
+}
+
+void MetricSnapshot::serialize(std::string& output) const
+{
+    append_raw<std::int64_t>(output, m_dump_mtime);
+    append_raw<std::uint32_t>(output, m_entries.size());
+    append_raw<std::uint32_t>(output, m_names.size());
+
+    output.append(reinterpret_cast<const char*>(m_entries.data()), m_entries.size() * sizeof(Entry));
+    output.append(m_names);
+}
+
+const char* MetricSnapshot::deserialize(const char* position, const char* end) throw (std::runtime_error)
+{
+    std::int64_t    dump_mtime;
+    std::uint32_t   entry_count, names_size;
+
+    static_assert(sizeof(Entry) == 16, "the state file layout depends on Entry having no padding");
+
+    position = read_raw(position, end, dump_mtime);
+    position = read_raw(position, end, entry_count);
+    position = read_raw(position, end, names_size);
+
+    if ((std::size_t) (end - position) < (std::size_t) entry_count * sizeof(Entry) + names_size)
+    {
+        throw std::runtime_error("truncated");
+    }
+
+    reset(dump_mtime);
+
+    m_entries.resize(entry_count);
+    std::memcpy(m_entries.data(), position, entry_count * sizeof(Entry));
+    position += entry_count * sizeof(Entry);
+
+    m_names.assign(position, names_size);
+    position += names_size;
+
+    for (const Entry& entry : m_entries)
+    {
+        if ((std::uint64_t) entry.name_offset + entry.name_length > names_size)
+        {
+            throw std::runtime_error("metric name out of bounds");
+        }
+    }
+
+    return position;
+}
+
+IntervalState::IntervalState(IntervalMode mode, const std::string& state_file, std::time_t dump_mtime) throw (std::runtime_error)
+    : m_mode(mode),
+      m_state_file(state_file),
+      m_has_baseline(false),
+      m_dump_changed(true)
+{
+    std::vector<MetricSnapshot> generations;
+    struct stat                 attrib;
+
+    m_current.reset(dump_mtime);
+
+    if (stat(state_file.c_str(), &attrib) == -1 && errno == ENOENT)
+    {
+        return; // first run for this volume
+    }
+
+    MappedFile  state(state_file); // this throws
+    const char* position = state.data();
+    const char* end      = state.data() + state.size();
+
+    try
+    {
+        char            magic[4];
+        std::uint32_t   version, generation_count;
+
+        position = read_raw(position, end, magic);
+        position = read_raw(position, end, version);
+        position = read_raw(position, end, generation_count);
+
+        if (std::memcmp(magic, STATE_MAGIC, sizeof(magic)) != 0 || version != STATE_VERSION || generation_count > 2)
+        {
+            throw std::runtime_error("unknown format");
+        }
+
+        generations.resize(generation_count);
+
+        for (MetricSnapshot& generation : generations)
+        {
+            position = generation.deserialize(position, end);
+        }
+    }
+    catch (const std::runtime_error& e)
+    {
+        // written by another version or damaged, it's rewritten on save() and the next run has a baseline again
+        if (g_verbose) std::cout << "Ignoring interval state " << state_file << ": " << e.what() << std::endl;
+
+        return;
+    }
+
+    if (! generations.empty() && generations.back().dump_mtime() == dump_mtime)
+    {
+        // the dump hasn't been rewritten since the last run, compare it with the generation before
+        m_dump_changed = false;
+        generations.pop_back();
+    }
+
+    if (! generations.empty())
+    {
+        m_baseline     = generations.back();
+        m_has_baseline = true;
+    }
+}
+
+bool IntervalState::apply(const DumpView& name, double& value) const
+{
+    double previous;
+
+    if (! m_has_baseline || ! m_baseline.find(name, previous))
+    {
+        return false;
+    }
+
+    value -= previous;
+
+    if (m_mode == IntervalMode::Rate)
+    {
+        std::time_t seconds = m_current.dump_mtime() - m_baseline.dump_mtime();
+
+        if (seconds <= 0) return false;
+
+        value /= seconds;
+    }
+
+    return true;
+}
+
+void IntervalState::save() const throw (std::runtime_error)
+{
+    std::string     contents;
+    std::uint32_t   generation_count = m_has_baseline ? 2 : 1;
+
+    if (! m_dump_changed) return;
+
+    contents.append(STATE_MAGIC, sizeof(STATE_MAGIC));
+    append_raw(contents, STATE_VERSION);
+    append_raw(contents, generation_count);
+
+    if (m_has_baseline) m_baseline.serialize(contents);
+
+    m_current.serialize(contents);
+
+    replace_file(m_state_file, contents); // concurrent checks never see half a file
+}
+
+std::string interval_state_file(const std::string& state_dir, const std::string& volume, const std::string& filter)
+{
+    std::ostringstream path;
+
+    path << state_dir << "/check_gluster_perf_" << volume << "_" << std::hex << std::setw(16) << std::setfill('0') << hash_text(filter) << ".interval";
+
+    return path.str();
+}
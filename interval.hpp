@@ -0,0 +1,98 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - interval (delta/rate) evaluation
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_INTERVAL_HPP
+#define CHECK_GLUSTER_PERF_INTERVAL_HPP
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <ctime>
+#include <cstdint>
+
+#include "check_gluster_perf.hpp"
+#include "dump_reader.hpp"
+
+/*
+The raw values of the metrics evaluated from one dump, in the order they were found in it.
+
+GlusterFS writes its metrics in the same order on every dump, so find() first tries the entry
+following the last one found and only falls back to a binary search over a name sorted index
+when that misses: looking up every metric of the next dump is O(metrics).
+*/
+class MetricSnapshot
+{
+    public:
+        MetricSnapshot() : m_dump_mtime(0), m_cursor(0) {}
+
+        std::time_t dump_mtime() const { return m_dump_mtime; }
+        std::size_t size() const { return m_entries.size(); }
+
+        void        reset(std::time_t dump_mtime);
+        void        add(const DumpView& name, double value);
+        bool        find(const DumpView& name, double& value) const;
+
+        void        serialize(std::string& output) const;
+        const char* deserialize(const char* begin, const char* end) throw (std::runtime_error); // returns the end of what was read
+
+    private:
+        struct Entry {
+            std::uint32_t   name_offset; // in m_names
+            std::uint32_t   name_length;
+            double          value;
+        };
+
+        DumpView    name_of(const Entry& entry) const { return {m_names.data() + entry.name_offset, m_names.data() + entry.name_offset + entry.name_length}; }
+        int         compare(const Entry& entry, const DumpView& name) const;
+
+        std::time_t                         m_dump_mtime;
+        std::string                         m_names; // every name, back to back
+        std::vector<Entry>                  m_entries;
+        mutable std::vector<std::uint32_t>  m_sorted; // indexes of m_entries sorted by name, built on the first miss
+        mutable std::size_t                 m_cursor;
+};
+
+/*
+The snapshots -interval keeps for one volume (and filter) in a state file under -state-dir.
+
+Two generations are kept: the last dump seen and the one before it. A new dump is compared with
+the last one and becomes the last one when save() is called; while the dump isn't rewritten,
+checks keep comparing it with the generation before, so every run between two dumps reports the
+same interval instead of deltas of zero.
+*/
+class IntervalState
+{
+    public:
+        IntervalState(IntervalMode mode, const std::string& state_file, std::time_t dump_mtime) throw (std::runtime_error);
+
+        IntervalMode            mode() const { return m_mode; }
+
+        /* The generation the current dump is compared with, nullptr if there isn't one yet */
+        const MetricSnapshot*   baseline() const { return m_has_baseline ? &m_baseline : nullptr; }
+
+        /* Filled by MetricEvaluator with the raw values of the current dump */
+        MetricSnapshot&         current() { return m_current; }
+
+        /* Turns a metric's raw value into its delta (or rate) since the baseline, false if it has no previous value */
+        bool                    apply(const DumpView& name, double& value) const;
+
+        /* Persists the current dump as the last generation, unless it already was */
+        void                    save() const throw (std::runtime_error);
+
+    private:
+        IntervalMode    m_mode;
+        std::string     m_state_file;
+        bool            m_has_baseline;
+        bool            m_dump_changed;     // the state file's last generation isn't the current dump
+        MetricSnapshot  m_baseline;
+        MetricSnapshot  m_current;
+};
+
+/* The state file used by -interval for a volume, one per volume and filter */
+std::string interval_state_file(const std::string& state_dir, const std::string& volume, const std::string& filter);
+
+#endif
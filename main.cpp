@@ -40,66 +40,62 @@ const char PROGRAM_VERSION[]    = "1.0.0";
 #include <map>
 #include <exception>
 #include <sstream>
-#include <cmath>
 #include <functional>
-#include <regex>
-#include <fstream>
+#include <memory>
+#include <algorithm>
 #include <ctime>
+#include <cstdio>
 #include "json/src/json.hpp"
 #include "CmdParser/cmdparser.hpp"
+#include "check_gluster_perf.hpp"
+#include "dump_reader.hpp"
+#include "dump_stream.hpp"
+#include "metric_evaluator.hpp"
+#include "metric_filter.hpp"
+#include "batch.hpp"
+#include "daemon.hpp"
+#include "interval.hpp"
+#include "result_cache.hpp"
+#include "metric_table.hpp"
+#include "metric_groups.hpp"
+#include "output_writer.hpp"
+#include "history.hpp"
+#include "baseline.hpp"
+#include "profile.hpp"
+#include "replay.hpp"
+#include "metric_rules.hpp"
+#include "nodes.hpp"
+#include "submit.hpp"
+#include "profile_xml.hpp"
 
 
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 #include <errno.h>
 #include <string.h>
 
 using json = nlohmann::json;
 
-/* Time unit used to process performance metrics */
-enum class UnitType : short {
-    Microseconds, Miliseconds, Seconds
-
-};
-
-/* Nagios specific return codes */
-enum class ReturnCode : int {
-    OK          = 0, 
-    Warning     = 1, 
-    Critical    = 2, 
-    Unknown     = 3
-};
-
-
-struct Metric {
-    double      value;
-    UnitType    unit;
-};
-
-
-class check_error : public std::runtime_error
-{
-    public:
-        check_error(const std::string& what) : std::runtime_error(what){}
-};
-
 void        setup_cli_parameters(cli::Parser& parser);
-Metric      convert         (const Metric& src, const UnitType dst_unit);
 template <typename T> 
 T           map_enum_to_value(const std::map<std::string, T>& map, const std::string& value) throw (std::invalid_argument);
-std::time_t get_file_timestamp(std::string& path) throw (std::runtime_error);
-std::string nagios_output_metrics(const std::map<std::string, Metric>& metrics, const Metric& warn, const Metric& crit);
-void        read_json_dump(const std::string& file_path, std::vector<json>& results) throw (std::runtime_error);
-ReturnCode  process_metrics(std::map<std::string, Metric>& exceeding_metrics, 
-                            std::map<std::string, Metric>& performance_metrics,
+std::time_t get_file_timestamp(std::string& path, DumpIdentity* identity = nullptr) throw (std::runtime_error);
+std::string nagios_output_metrics(const MetricTable& metrics, const Metric& warn, const Metric& crit);
+int         parse_json_dump(const DumpView& dump, const std::string& file_path, std::vector<json>& results, const MetricFilter* filter = nullptr) throw (std::runtime_error);
+ReturnCode  process_metrics(MetricTable& metrics,
                             Metric& total_average,
                             const std::vector<json>& dump_data, 
                             const Metric& warning_threshold, 
                             const Metric& critical_threshold, 
                             const UnitType& unit_type_output,
                             const UnitType& gluster_unit_type,
-                            const std::regex& metric_filter, 
-                            bool disable_threshold_comparison) throw(std::exception, std::runtime_error);
+                            const MetricFilter& metric_filter, 
+                            bool disable_threshold_comparison,
+                            IntervalState* interval_state = nullptr,
+                            MetricGroups* groups = nullptr,
+                            AverageWeight average_weight = AverageWeight::None,
+                            const MetricRules* rules = nullptr) throw(std::exception, std::runtime_error);
 
 
 // Possible values for -u and -ou and their final value
@@ -109,14 +105,49 @@ std::map<std::string, UnitType> g_unit_enum_map = {
     {std::string("s"),  UnitType::Seconds}    
 };
 
-std::map<UnitType, std::string> g_unit_enum_map_reverse = {
-    {UnitType::Microseconds,    std::string("us")}, // the .s initializes the s field of the ParamValue union
-    {UnitType::Miliseconds,     std::string("ms")},
-    {UnitType::Seconds,         std::string("s") }    
+// Possible values for -interval
+std::map<std::string, IntervalMode> g_interval_mode_map = {
+    {std::string("off"),   IntervalMode::Off},
+    {std::string("delta"), IntervalMode::Delta},
+    {std::string("rate"),  IntervalMode::Rate}
+};
+
+// Possible values for -total-avg-weight
+std::map<std::string, AverageWeight> g_average_weight_map = {
+    {std::string("none"),  AverageWeight::None},
+    {std::string("calls"), AverageWeight::Calls}
+};
+
+// Possible values for -output-format
+std::map<std::string, OutputFormat> g_output_format_map = {
+    {std::string("nagios"),     OutputFormat::Nagios},
+    {std::string("prometheus"), OutputFormat::Prometheus},
+    {std::string("influx"),     OutputFormat::Influx},
+    {std::string("json"),       OutputFormat::Json}
+};
+
+// Possible values for -rules-match
+std::map<std::string, RuleMatch> g_rule_match_map = {
+    {std::string("first"),    RuleMatch::First},
+    {std::string("specific"), RuleMatch::MostSpecific}
+};
+
+// Possible values for -apply-on-groups
+std::map<std::string, GroupTarget> g_group_target_map = {
+    {std::string("off"), GroupTarget::Off},
+    {std::string("avg"), GroupTarget::Average},
+    {std::string("max"), GroupTarget::Maximum}
+};
+
+// Possible values for -dump-format
+std::map<std::string, DumpFormat> g_dump_format_map = {
+    {std::string("json"),        DumpFormat::Json},
+    {std::string("profile-xml"), DumpFormat::ProfileXml}
 };
 
 bool g_verbose = false;
 
+#ifndef CHECK_GLUSTER_PERF_NO_MAIN // the benchmarks and tests (make bench, make test) link everything else in main.cpp with their own main()
 /*
 Program Entry Point
 ===================
@@ -124,10 +155,7 @@ Program Entry Point
 - configures CLI parameters
 - checks if the help or version (-V) were passed, exits early with message
 - puts parsed CLI parameters in their corresp. global variables
-- looks at the GlusterFS dump file age and exists if its too old (parameter -dump-max-age-seconds)
-- reads GlusterFS JSON dump
-- goes through each metric read that also fits the regex filter (parameter -f)
-- makes the nagios output "<check output message>| <performance metrics reported to nagios>"
+- checks the volume (see check_volume) or, given a list of volumes, checks them concurrently
 - returns Nagios related result code (0 = OK, 1 = Warning, 2 = Critical, 3 = Unknown)
 */
 int main(int argc, char** argv)
@@ -177,85 +205,563 @@ int main(int argc, char** argv)
         double      g_critical          = parser.get<double>("c");
         std::string g_volname           = parser.get<std::string>("vol");
         UnitType    g_unit_type_input   = map_enum_to_value<UnitType>(g_unit_enum_map, parser.get<std::string>("u"));
-        UnitType    g_unit_type_output  = map_enum_to_value<UnitType>(g_unit_enum_map, parser.get<std::string>("ou"));
-        UnitType    g_gluster_unit_type = map_enum_to_value<UnitType>(g_unit_enum_map, parser.get<std::string>("gluster-src-unit"));
-        std::string g_filter_regex      = parser.get<std::string>("f");
         std::string g_gluster_stats_file= parser.get<std::string>("override-stats-file");
+        std::string g_stats_dir         = parser.get<std::string>("stats-dir");
                     g_verbose           = parser.get<bool>("v");
-        int         g_max_file_age      = parser.get<int>("dump-max-age-seconds");
-        int         g_max_report_metrics= parser.get<int>("exceeded-metrics-report-count");
-        bool        g_apply_on_total    = parser.get<bool>("apply-on-total-avg"); // if set to true, the total average of all metrics is compared to the thresholds
+        int         g_threads           = parser.get<int>("threads");
+        bool        g_batch_combined    = parser.get<bool>("batch-combined"); // if set to true, a list of volumes is reported as a single worst-state result
+        bool        g_daemon            = parser.get<bool>("daemon");
+        bool        g_client            = parser.get<bool>("client");
+        std::string g_socket            = parser.get<std::string>("socket");
+        std::string g_output_file       = parser.get<std::string>("output-file"); // if set, the output replaces this file instead of going to stdout
+        std::string g_replay            = parser.get<std::string>("replay"); // if set, archived dumps are evaluated against a grid of thresholds instead of checking a volume
+        std::string g_nodes             = parser.get<std::string>("nodes"); // if set, the volume is checked from the dumps of several of its nodes at once
+        std::string g_submit            = parser.get<std::string>("submit"); // if set, the results are submitted as passive check results instead of being printed
+        int         g_submit_timeout    = parser.get<int>("submit-timeout");
+        CheckOptions options;
+
+        options.warning_threshold   = {g_warning, g_unit_type_input};
+        options.critical_threshold  = {g_critical, g_unit_type_input};
+        options.unit_type_output    = map_enum_to_value<UnitType>(g_unit_enum_map, parser.get<std::string>("ou"));
+        options.gluster_unit_type   = map_enum_to_value<UnitType>(g_unit_enum_map, parser.get<std::string>("gluster-src-unit"));
+        options.filter_regex        = parser.get<std::string>("f");
+        options.max_file_age        = parser.get<int>("dump-max-age-seconds");
+        options.max_report_metrics  = parser.get<int>("exceeded-metrics-report-count");
+        options.apply_on_total      = parser.get<bool>("apply-on-total-avg"); // if set to true, the total average of all metrics is compared to the thresholds
+        options.stream              = parser.get<bool>("stream"); // if set to true, the dump is evaluated while it's scanned, no JSON document is built
+        options.interval_mode       = map_enum_to_value<IntervalMode>(g_interval_mode_map, parser.get<std::string>("interval"));
+        options.state_dir           = parser.get<std::string>("state-dir");
+        options.cache_dir           = parser.get<std::string>("cache-dir"); // if set, evaluated dumps are cached there until they're rewritten
+        options.average_weight      = map_enum_to_value<AverageWeight>(g_average_weight_map, parser.get<std::string>("total-avg-weight"));
+        options.group_by            = parse_group_by(parser.get<std::string>("group-by"));
+        options.group_target        = map_enum_to_value<GroupTarget>(g_group_target_map, parser.get<std::string>("apply-on-groups"));
+        options.output_format       = map_enum_to_value<OutputFormat>(g_output_format_map, parser.get<std::string>("output-format"));
+        options.window_stat         = parse_window_stat(parser.get<std::string>("apply-on-window"), options.window_percentile);
+        options.window_seconds      = parser.get<int>("window-seconds");
+        options.history_size        = parser.get<int>("history-size");
+        options.apply_on_baseline   = parser.get<bool>("apply-on-baseline"); // if set to true, -w and -c are standard deviations from each metric's baseline
+        options.baseline_alpha      = parser.get<double>("baseline-alpha");
+        options.baseline_warmup     = parser.get<int>("baseline-warmup");
+        options.self_profile        = parser.get<bool>("self-profile"); // if set to true, the check's own timings and allocations are added to the performance data
+        options.rules_file          = parser.get<std::string>("rules"); // if set, the metrics matching a rule are compared with its thresholds instead of -w and -c
+        options.rule_match          = map_enum_to_value<RuleMatch>(g_rule_match_map, parser.get<std::string>("rules-match"));
+        options.dump_format         = map_enum_to_value<DumpFormat>(g_dump_format_map, parser.get<std::string>("dump-format")); // what the dump files are, io-stats JSON or saved profiles
+        options.read_attempts       = parser.get<int>("dump-read-attempts");
 
         if (g_warning > g_critical)
         {
             throw std::invalid_argument("Warning threshold has to be lower than Critical.");
         }
 
-        if (g_gluster_stats_file == "")
+        if (options.read_attempts < 1)
+        {
+            throw std::invalid_argument("-dump-read-attempts has to be at least 1.");
+        }
+
+        if (g_threads < 0)
+        {
+            throw std::invalid_argument("The number of threads can't be negative.");
+        }
+
+        if (options.group_target != GroupTarget::Off && options.group_by == 0)
+        {
+            throw std::invalid_argument("-apply-on-groups needs the groups to be set with -group-by.");
+        }
+
+        if (options.group_target != GroupTarget::Off && options.apply_on_total)
+        {
+            throw std::invalid_argument("-apply-on-groups and -apply-on-total-avg can't be used together.");
+        }
+
+        if (options.window_stat != WindowStat::Off && (options.apply_on_total || options.group_target != GroupTarget::Off))
+        {
+            throw std::invalid_argument("-apply-on-window can't be used together with -apply-on-total-avg or -apply-on-groups.");
+        }
+
+        if (options.window_seconds <= 0 || options.history_size <= 0)
+        {
+            throw std::invalid_argument("-window-seconds and -history-size have to be positive.");
+        }
+
+        if (options.apply_on_baseline && (options.apply_on_total || options.group_target != GroupTarget::Off || options.window_stat != WindowStat::Off))
+        {
+            throw std::invalid_argument("-apply-on-baseline can't be used together with -apply-on-total-avg, -apply-on-groups or -apply-on-window.");
+        }
+
+        if (options.baseline_alpha <= 0 || options.baseline_alpha >= 1 || options.baseline_warmup < 0)
+        {
+            throw std::invalid_argument("-baseline-alpha has to be between 0 and 1, -baseline-warmup can't be negative.");
+        }
+
+        if (options.rules_file != "" && ! compares_each_metric(options))
+        {
+            throw std::invalid_argument("-rules sets the thresholds of each metric, it can't be used together with -apply-on-total-avg, -apply-on-groups, -apply-on-window or -apply-on-baseline.");
+        }
+
+        MetricFilter metric_filter(options.filter_regex); // compiled once, see MetricFilter for the strategies
+
+        std::unique_ptr<MetricRules> rules; // only with -rules, compiled once like the filter
+
+        if (options.rules_file != "")
+        {
+            rules.reset(new MetricRules(options.rules_file, options.rule_match, options.warning_threshold.unit)); // this throws
+        }
+
+        if (g_daemon && g_client)
+        {
+            throw std::invalid_argument("-daemon and -client can't be used together.");
+        }
+
+        if (g_submit != "" && (g_daemon || g_replay != "" || options.output_format != OutputFormat::Nagios))
+        {
+            throw std::invalid_argument("-submit hands plugin output over to Nagios/Icinga, it can't be used with -daemon, -replay or another -output-format than nagios.");
+        }
+
+        if (g_submit_timeout < 0)
+        {
+            throw std::invalid_argument("-submit-timeout can't be negative.");
+        }
+
+        std::vector<std::string> node_files; // only with -nodes
+
+        if (g_nodes != "")
+        {
+            if (is_volume_list(g_volname) || g_gluster_stats_file != "" || g_daemon || g_client || g_replay != "" ||
+                options.interval_mode != IntervalMode::Off || options.group_by != 0 || options.window_stat != WindowStat::Off || options.apply_on_baseline)
+            {
+                throw std::invalid_argument("-nodes checks one volume from its nodes' dumps, it can't be used with a list of volumes, -override-stats-file, -daemon, -client, -replay, -interval, -group-by, -apply-on-window or -apply-on-baseline.");
+            }
+
+            node_files = expand_dump_files(g_nodes); // this throws
+
+            if (node_files.empty())
+            {
+                error << "No node dumps found at " << g_nodes;
+                throw std::runtime_error(error.str());
+            }
+        }
+
+        if (g_replay != "")
+        {
+            if (options.interval_mode != IntervalMode::Off || options.group_by != 0 || options.window_stat != WindowStat::Off || options.apply_on_baseline || rules)
+            {
+                throw std::invalid_argument("-replay evaluates every dump on its own against one pair of thresholds, it can't be used with -interval, -group-by, -apply-on-window, -apply-on-baseline or -rules.");
+            }
+
+            std::vector<std::string>    files       = expand_dump_files(g_replay); // this throws
+            std::vector<double>         warnings    = parse_threshold_list(parser.get<std::string>("replay-warning"));
+            std::vector<double>         criticals   = parse_threshold_list(parser.get<std::string>("replay-critical"));
+
+            if (files.empty())
+            {
+                error << "No dumps to replay found at " << g_replay;
+                throw std::runtime_error(error.str());
+            }
+
+            if (warnings.empty())   warnings.push_back(g_warning);
+            if (criticals.empty())  criticals.push_back(g_critical);
+
+            output_replay_summary(std::cout, replay_dumps(files, options, metric_filter, warnings, criticals, g_threads));
+
+            return (int) ReturnCode::OK;
+        }
+
+        std::vector<VolumeDump> targets;
+
+        if (! is_volume_list(g_volname))
+        {
+            if (g_gluster_stats_file == "")
+            {
+                g_gluster_stats_file = g_stats_dir + "/glusterfs_" + g_volname + ".dump";
+            }
+
+            targets.push_back({g_volname, g_gluster_stats_file});
+        }
+        else
+        {
+            // a list of volumes, each one is checked as a task of its own on a bounded thread pool
+            if (g_gluster_stats_file != "")
+            {
+                throw std::invalid_argument("-override-stats-file can only be used when checking a single volume.");
+            }
+
+            for (const std::string& volume : expand_volume_list(g_volname, g_stats_dir)) // this throws
+            {
+                targets.push_back({volume, g_stats_dir + "/glusterfs_" + volume + ".dump"});
+            }
+
+            if (targets.empty())
+            {
+                error << "No volumes to check, no GlusterFS dumps found in " << g_stats_dir;
+                throw std::runtime_error(error.str());
+            }
+        }
+
+        if (g_daemon)
+        {
+            run_daemon(g_socket, g_stats_dir, options, targets); // returns once stopped by a signal
+
+            return 0;
+        }
+
+        std::vector<CheckResult> results(targets.size());
+
+        if (g_client)
+        {
+            // the daemon answers from its cache, no point in a thread pool here
+            for (std::size_t index = 0; index < targets.size(); index++)
+            {
+                results[index] = query_daemon(g_socket, options, targets[index]);
+            }
+        }
+        else if (! node_files.empty())
+        {
+            results[0] = check_nodes(options, metric_filter, g_volname, node_files, rules.get(), g_threads); // parses the nodes' dumps on the thread pool
+        }
+        else
+        {
+            run_parallel(targets.size(), g_threads, [&](std::size_t index)
+            {
+                results[index] = check_volume(options, metric_filter, targets[index].volume, targets[index].dump_file, rules.get());
+            });
+        }
+
+        OutputBuffer    output;
+        ReturnCode      check_code = results[0].code;
+
+        if (g_submit != "")
+        {
+            std::string host = parser.get<std::string>("submit-host");
+
+            if (host == "")
+            {
+                char name[256] = {0};
+
+                gethostname(name, sizeof(name) - 1);
+                host = name;
+            }
+
+            std::vector<PassiveResult> passive = passive_results(results, host, parser.get<std::string>("submit-service")); // this throws
+
+            submit_results(g_submit, passive, g_submit_timeout); // this throws
+
+            for (const PassiveResult& result : passive) check_code = worst_state(check_code, result.code);
+
+            // this run's own result: the submission went fine, the services carry the states
+            std::cout << "GlusterFS Latency OK - Submitted " << passive.size() << " passive check results to " << g_submit
+                      << ", the worst one is " << state_name(check_code) << "." << std::endl;
+
+            return (int) ReturnCode::OK;
+        }
+
+        if (! is_volume_list(g_volname))
+        {
+            output.append(results[0].output);
+        }
+        else if (options.output_format != OutputFormat::Nagios)
+        {
+            for (const CheckResult& result : results) check_code = worst_state(check_code, result.code);
+
+            output.append(join_outputs(options.output_format, results));
+        }
+        else
+        {
+            std::ostringstream batch_output;
+
+            check_code = g_batch_combined ? output_batch_combined(batch_output, results, options)
+                                          : output_batch_per_volume(batch_output, results);
+
+            output.append(batch_output.str());
+        }
+
+        if (g_output_file != "")
+        {
+            output.write_to_file(g_output_file); // atomically, a textfile collector never reads half of it
+        } else
         {
-            g_gluster_stats_file = "/var/lib/glusterd/stats/glusterfs_" + g_volname + ".dump";
+            std::cout.flush(); // -v output comes first
+            output.write_to(STDOUT_FILENO);
         }
 
+        program_ret_val = (int) check_code;
+    } 
+    catch (...)
+    {
+        return (int) report_exception(std::cout);
+    }
+
+    return program_ret_val;
+}
+#endif // CHECK_GLUSTER_PERF_NO_MAIN
+
+/*
+Checks a single volume's dump file, this never throws: 
+
+- looks at the GlusterFS dump file age and reports CRITICAL if its too old (parameter -dump-max-age-seconds)
+- reads GlusterFS JSON dump
+- goes through each metric read that also fits the regex filter (parameter -f)
+- makes the nagios output "<check output message>| <performance metrics reported to nagios>"
+
+Errors are turned into their Nagios output and return code, the same way main() reports them.
+Batch mode runs this concurrently for several volumes, it only reads the shared arguments.
+*/
+CheckResult check_volume(const CheckOptions& options, const MetricFilter& metric_filter, const std::string& volume, std::string dump_file,
+                         const MetricRules* rules)
+{
+    CheckResult         result;
+    std::ostringstream  error;
+    CheckProfile        profile(options.self_profile); // does nothing without -self-profile
+
+    result.volume       = volume;
+    result.code         = ReturnCode::Unknown;
+    result.has_average  = false;
+    result.dump_mtime   = 0;
+
+    try
+    {
+        profile.begin(Phase::Stat);
+
         if (g_verbose)
         {
-            std::cout << "Established dump file: " << g_gluster_stats_file << std::endl << "Reading timestamp..." << std::endl;
+            std::cout << "Established dump file: " << dump_file << std::endl << "Reading timestamp..." << std::endl;
         }
 
-        std::time_t stats_last_modified = get_file_timestamp(g_gluster_stats_file); // this throws
+        std::unique_ptr<MetricRules> own_rules; // if the caller couldn't compile them, so that the reason is reported
+
+        if (rules == nullptr && options.rules_file != "")
+        {
+            own_rules.reset(new MetricRules(options.rules_file, options.rule_match, options.warning_threshold.unit)); // this throws
+            rules = own_rules.get();
+        }
+
+        DumpIdentity dump_identity;
+        std::time_t stats_last_modified = get_file_timestamp(dump_file, &dump_identity); // this throws
         std::time_t now                 = std::time(nullptr);
 
-        if ((now - stats_last_modified) > g_max_file_age)
+        result.dump_mtime = stats_last_modified;
+
+        if ((now - stats_last_modified) > options.max_file_age)
         {            
-            error << "Stats dump is older than " << g_max_file_age << " seconds. Current age: " << (now - stats_last_modified) << " seconds.";
+            error << "Stats dump is older than " << options.max_file_age << " seconds. Current age: " << (now - stats_last_modified) << " seconds.";
             throw check_error(error.str());
        }
 
-        
-        //read_json_dump(g_gluster_stats_file, dump_data);
+        profile.begin(Phase::Parse);
 
-        if (g_verbose) std::cout << "Reading JSON data from dump file...";
+        const Metric&                   warning_threshold   = options.warning_threshold;
+        const Metric&                   critical_threshold  = options.critical_threshold;
+        MetricTable                     metrics; // the metrics found and parsed in the GlusterFS dump, reported to Nagios as performance fields, and those exceeding thresholds for the output message
+        Metric                          total_average;
+        ReturnCode                      check_code;
+        std::unique_ptr<IntervalState>  interval_state; // only with -interval, holds the values of the previous dump
 
-        std::vector<json>   dump_json;
-        read_json_dump(g_gluster_stats_file, dump_json);
+        metrics.set_exceeding_limit(std::max(options.max_report_metrics, 0)); // only the worst ones are kept for the message, the others are counted
 
-        if (dump_json.size() == 0) // if we have read any data
+        if (options.interval_mode != IntervalMode::Off)
         {
-            error << "No data was read from the dump file at " << g_gluster_stats_file;
-            throw std::runtime_error(error.str());
+            interval_state.reset(new IntervalState(options.interval_mode, interval_state_file(options.state_dir, volume, options.filter_regex), stats_last_modified)); // this throws
         }
 
-        if (g_verbose) std::cout << " Done." << std::endl;
+        std::unique_ptr<MetricGroups>   groups; // only with -group-by, the per group aggregates
 
-        Metric                          warning_threshold   = {g_warning, g_unit_type_input},
-                                        critical_threshold  = {g_critical, g_unit_type_input};
-        std::ostringstream              output;
-        std::map<std::string, Metric>   exceeding_metrics, // all metrics exceeding thresholds are placed here to form the output message at the end
-                                        performance_metrics; // the metrics found and parsed in the GlusterFS dump, they are reported to Nagios as performance fields
-        std::regex                      metric_filter(g_filter_regex, std::regex::ECMAScript|std::regex::icase);
-        Metric                          total_average;
+        if (options.group_by != 0)
+        {
+            groups.reset(new MetricGroups(options.group_by, options.group_target));
+        }
 
-        if (g_verbose) std::cout << "Processing metrics..." << std::endl;
+        // the evaluated metric set of this very dump, if a previous check with the same arguments left it in -cache-dir
+        // -interval results depend on the previous dumps as well, they aren't cached, neither are the -group-by aggregates
+        std::unique_ptr<ResultCache>    result_cache;
+        bool                            cached = false;
 
-        if (g_verbose && g_filter_regex != ".*") std::cout << "Applying regex filter: " << g_filter_regex << std::endl;
+        if (options.cache_dir != "" && ! interval_state && ! groups)
+        {
+            result_cache.reset(new ResultCache(options.cache_dir, volume, options, dump_identity, rules != nullptr ? rules->digest() : 0));
+            cached = result_cache->load(metrics, total_average, check_code);
+        }
+
+        std::unique_ptr<DumpSnapshot>   snapshot;           // the JSON dump as one consistent version, GlusterFS rewrites it in place
+        std::vector<json>               dump_json;          // without -stream, what was read from it
+        int                             root_objects = 0;   // the number of JSON root objects found in it
+
+        if (! cached && options.dump_format == DumpFormat::Json)
+        {
+            std::string torn;       // why the dump couldn't be read whole, if it couldn't
+            int         passes = 0;
 
-        ReturnCode check_code = process_metrics(
-                                    exceeding_metrics, // the function places the metrics that exceed thresholds in this map
-                                    performance_metrics, // all metrics are place here by the function
+            if (g_verbose) std::cout << (options.stream ? "Processing metrics while streaming the dump file..." : "Reading JSON data from dump file...") << std::endl;
+
+            if (g_verbose && options.stream && options.filter_regex != ".*") std::cout << "Applying regex filter: " << options.filter_regex << " (" << metric_filter.strategy_name() << ")" << std::endl;
+
+            try
+            {
+                snapshot.reset(new DumpSnapshot(dump_file, options.read_attempts)); // this throws
+
+                // the pass over the dump tells whether it's whole, one cut short is read again and gone over from scratch
+                snapshot->consume([&](const DumpView& dump)
+                {
+                    if (passes++ > 0)
+                    {
+                        metrics.clear();
+                        dump_json.clear();
+
+                        if (interval_state) interval_state->current().reset(stats_last_modified);
+                        if (groups) groups.reset(new MetricGroups(options.group_by, options.group_target));
+                    }
+
+                    if (! options.stream)
+                    {
+                        root_objects = parse_json_dump(dump, dump_file, dump_json, MetricEvaluator::skip_filter(metric_filter, options.average_weight));
+                        return;
+                    }
+
+                    check_code = process_metrics_stream(
+                                    metrics,
                                     total_average,
-                                    dump_json, // this is what was read from the GlusterFS dump file
-                                    warning_threshold, 
-                                    critical_threshold, 
-                                    g_unit_type_output, // the type of unit used to output to performance_metrics above
-                                    g_gluster_unit_type, // the type of unit as interpreted from GlusterFS dump
-                                    metric_filter, // only metrics that match this regex filter are considered
-                                    g_apply_on_total // if true, the function won't compare metrics with the thresholds and will always return ReturnCode::OK
+                                    root_objects,
+                                    dump,
+                                    warning_threshold,
+                                    critical_threshold,
+                                    options.unit_type_output,
+                                    options.gluster_unit_type,
+                                    metric_filter,
+                                    ! compares_each_metric(options),
+                                    interval_state.get(),
+                                    groups.get(),
+                                    options.average_weight,
+                                    rules
                                 );
+                });
+            }
+            catch (const torn_dump_error& e)
+            {
+                torn = e.what();
+            }
+
+            if (g_verbose && snapshot && snapshot->attempts() > 1) std::cout << "Read the dump " << snapshot->attempts() << " times, it was being rewritten" << std::endl;
+
+            // the last good result instead, if it's still recent enough: a torn dump says nothing about the volume
+            if (torn != "" && result_cache && result_cache->load_last(metrics, total_average, check_code, now - options.max_file_age, stats_last_modified))
+            {
+                if (g_verbose) std::cout << torn << ", reporting the last result instead" << std::endl;
+
+                cached              = true;
+                result.dump_mtime   = stats_last_modified;
+            }
+            else if (torn != "")
+            {
+                throw std::runtime_error(torn);
+            }
+            else if (result_cache && ! (snapshot->identity() == dump_identity))
+            {
+                // rewritten since it was stat'ed, the result is cached for the version that was read
+                result_cache.reset(new ResultCache(options.cache_dir, volume, options, snapshot->identity(), rules != nullptr ? rules->digest() : 0));
+            }
+        }
+
+        if (cached)
+        {
+            if (g_verbose) std::cout << "Using the metrics cached in " << result_cache->file() << std::endl;
+        }
+        else if (options.dump_format == DumpFormat::ProfileXml)
+        {
+            if (g_verbose) std::cout << "Processing metrics while reading the profile XML..." << std::endl;
+
+            if (g_verbose && options.filter_regex != ".*") std::cout << "Applying regex filter: " << options.filter_regex << " (" << metric_filter.strategy_name() << ")" << std::endl;
+
+            int bricks = 0;
+
+            check_code = process_profile_xml(
+                            metrics,
+                            total_average,
+                            bricks, // the number of bricks found in the profile
+                            dump_file,
+                            warning_threshold,
+                            critical_threshold,
+                            options.unit_type_output,
+                            options.gluster_unit_type,
+                            metric_filter,
+                            ! compares_each_metric(options),
+                            interval_state.get(),
+                            groups.get(),
+                            options.average_weight,
+                            rules
+                        );
+
+            if (bricks == 0)
+            {
+                error << "No data was read from the profile at " << dump_file;
+                throw std::runtime_error(error.str());
+            }
+
+            profile.begin(Phase::Evaluate); // read and evaluated in one pass, like -stream
+        }
+        else if (options.stream)
+        {
+            if (root_objects == 0) // if we have read any data
+            {
+                error << "No data was read from the dump file at " << dump_file;
+                throw std::runtime_error(error.str());
+            }
+
+            profile.begin(Phase::Evaluate); // the stream was parsed and evaluated in one pass
+        } 
+        else
+        {
+            if (root_objects == 0) // if we have read any data
+            {
+                error << "No data was read from the dump file at " << dump_file;
+                throw std::runtime_error(error.str());
+            }
+
+            profile.begin(Phase::Evaluate);
+
+            if (g_verbose) std::cout << "Processing metrics..." << std::endl;
+
+            if (g_verbose && options.filter_regex != ".*") std::cout << "Applying regex filter: " << options.filter_regex << " (" << metric_filter.strategy_name() << ")" << std::endl;
+
+            check_code = process_metrics(
+                            metrics, // all metrics are placed here by the function, the ones exceeding thresholds are also listed as such
+                            total_average,
+                            dump_json, // this is what was read from the GlusterFS dump file
+                            warning_threshold, 
+                            critical_threshold, 
+                            options.unit_type_output, // the type of unit used to output to performance_metrics above
+                            options.gluster_unit_type, // the type of unit as interpreted from GlusterFS dump
+                            metric_filter, // only metrics that match this regex filter are considered
+                            ! compares_each_metric(options), // if true, the function won't compare metrics with the thresholds and will always return ReturnCode::OK
+                            interval_state.get(), // if set, the function evaluates the change since the previous dump
+                            groups.get(), // if set, the function also aggregates the metrics per group
+                            options.average_weight, // how the metrics are weighted in total_average
+                            rules // if set, the metrics a rule matches are compared with its thresholds
+                        );
+        }
+
+        if (interval_state)
+        {
+            interval_state->save(); // this throws
+        }
+
+        if (result_cache && ! cached)
+        {
+            try
+            {
+                result_cache->store(metrics, total_average, check_code);
+            }
+            catch (const std::runtime_error& e)
+            {
+                // the check itself went fine, the next one just won't find a cached result
+                if (g_verbose) std::cout << "Couldn't cache the metrics: " << e.what() << std::endl;
+            }
+        }
 
         // also report the total average
-        performance_metrics["total_average"] = total_average;
+        metrics.set("total_average", total_average);
 
+        result.has_average      = true;
+        result.total_average    = total_average;
     
-        if (g_apply_on_total)
+        if (options.apply_on_total)
         {
             Metric temp_warning = convert(warning_threshold, total_average.unit);
             Metric temp_critical = convert(critical_threshold, total_average.unit);
@@ -263,95 +769,115 @@ int main(int argc, char** argv)
             if (total_average.value >= temp_warning.value)
             {
                 check_code = ReturnCode::Warning;
-                exceeding_metrics["total_average"] = total_average;
             }
 
             if (total_average.value >= temp_critical.value)
             {
                 check_code = ReturnCode::Critical;
-                exceeding_metrics["total_average"] = total_average;
+            }
+
+            if (check_code != ReturnCode::OK)
+            {
+                metrics.set_exceeding("total_average", total_average, severity_ratio(total_average.value, temp_warning.value));
             }
         }
         
-        if (g_verbose) std::cout << "Processing metrics done." << std::endl;
-        
-        switch (check_code)
+        if (groups)
         {
-            case ReturnCode::OK:
-                output << "GlusterFS Latency OK - All performance metrics within thresholds. Total avg: " << total_average.value << g_unit_enum_map_reverse[total_average.unit];
-                break;
-            case ReturnCode::Critical:
-                output << "GlusterFS Latency CRITICAL - Metrics(s) exceeding thresholds: ";
-            break;
-            case ReturnCode::Warning:
-                output << "GlusterFS Latency WARNING - Metric(s) exceeding thresholds: ";
-                break;
+            check_code = worst_state(check_code, groups->apply_thresholds(warning_threshold, critical_threshold, metrics));
+
+            result.groups = group_results(*groups, options); // each group's own state, for -submit
         }
 
-        // if process_metrics found something exceeding, list those exceeding metrics
-        if (check_code != ReturnCode::OK) 
+        if (options.window_stat != WindowStat::Off)
         {
-            auto metric_pair = exceeding_metrics.begin();
+            MetricHistory history(history_file(options.state_dir, volume, options), options.history_size); // this throws
 
-            // the metric_count is not used as an index here but to keep count of how many metrics we're outputing from the total number we're allowed as specified by the user
-            for (int metric_count = 1; metric_pair != exceeding_metrics.end() && metric_count <= g_max_report_metrics; metric_count++)
-            {
-                output << metric_pair->first << ": " << metric_pair->second.value << g_unit_enum_map_reverse[metric_pair->second.unit];            
+            history.append(metrics, stats_last_modified);
 
-                if (std::next(metric_pair) != exceeding_metrics.end()) // if we're not at the last element
-                {
-                    output << ", ";
-                }
+            check_code = worst_state(check_code, history.apply_thresholds(metrics, options, stats_last_modified));
 
-                metric_pair++; // iterator
-            }
+            if (g_verbose) std::cout << "Compared the metrics over the last " << options.window_seconds << " seconds, " << history.snapshots() << " dump(s) in the history." << std::endl;
+        }
 
-            // if we did not show all the metrics, inform the user that there are more
-            if ((int) exceeding_metrics.size()-g_max_report_metrics > 0)
-            {
-                output << " - " << exceeding_metrics.size()-g_max_report_metrics << " metrics hidden.";
-            }
+        if (options.apply_on_baseline)
+        {
+            MetricBaselines baselines(baseline_state_file(options.state_dir, volume, options), options.baseline_alpha); // this throws
+
+            check_code = worst_state(check_code, baselines.apply_thresholds(metrics, options, stats_last_modified));
+
+            baselines.save(); // this throws
         }
 
-        // dump all output
-        std::cout << output.str() << "|" << nagios_output_metrics(performance_metrics, warning_threshold, critical_threshold); // outputs Nagios check friendly performance metrics
+        if (g_verbose) std::cout << "Processing metrics done." << std::endl;
+
+        profile.begin(Phase::Output);
         
-        program_ret_val = (int) check_code;
-    } 
+        std::ostringstream ok_message;
+
+        if (interval_state && interval_state->baseline() == nullptr)
+        {
+            ok_message << "No previous dump to compare with yet, interval values are reported from the next dump on.";
+        }
+        else
+        {
+            ok_message << "All performance metrics within thresholds. Total avg: " << total_average.value << unit_name(total_average.unit);
+        }
+
+        // all output, in -output-format
+        std::string     message = status_message(check_code, ok_message.str(), metrics);
+        CheckReport     report  = {volume, check_code, message, &metrics, groups.get(), true, total_average, warning_threshold, critical_threshold, stats_last_modified,
+                                   rules, profile.enabled() ? &profile : nullptr};
+
+        result.code     = check_code;
+        result.output   = format_report(options.output_format, report);
+    }
+    catch (...)
+    {
+        result.output = format_failure(options, volume, result.dump_mtime, profile.enabled() ? &profile : nullptr, result.code);
+    }
+
+    return result;
+}
+
+ReturnCode report_exception(std::ostream& output)
+{
+    try
+    {
+        throw;
+    }
     catch (const check_error& ce)
     {
-        std::cout << "CRITICAL - " << ce.what();
+        output << "CRITICAL - " << ce.what();
 
-        return (int) ReturnCode::Critical;
+        return ReturnCode::Critical;
     }
     catch (const std::runtime_error& re)
     {
-        std::cout << "Runtime error: " << re.what() << std::endl;
+        output << "Runtime error: " << re.what() << std::endl;
 
-        return (int) ReturnCode::Unknown;
+        return ReturnCode::Unknown;
     }
     catch (const std::invalid_argument& ia)
     {   
-        std::cout << "Invalid paramteres/arguments: " << ia.what() << std::endl;
-        return (int) ReturnCode::Unknown;        
+        output << "Invalid paramteres/arguments: " << ia.what() << std::endl;
+        return ReturnCode::Unknown;        
     }
     catch (const std::logic_error& le)
     {
-        std::cout << "Program logic exception: " << le.what() << std::endl;
-        return (int) ReturnCode::Unknown;        
+        output << "Program logic exception: " << le.what() << std::endl;
+        return ReturnCode::Unknown;        
     } 
     catch (const std::exception& e)
     {
-        std::cout << "Unexpected program exception: " << e.what() << std::endl;
-        return (int) ReturnCode::Unknown;        
+        output << "Unexpected program exception: " << e.what() << std::endl;
+        return ReturnCode::Unknown;        
     } catch (...)
     {
-        std::cout << "Unknown exception occured." << std::endl;
+        output << "Unknown exception occured." << std::endl;
 
-        return (int) ReturnCode::Unknown;
+        return ReturnCode::Unknown;
     }
-
-    return program_ret_val;
 }
 
 
@@ -359,16 +885,50 @@ void setup_cli_parameters(cli::Parser& parser)
 {    
     parser.set_required<double>("w", "warning", "Warning threshold in -u units or in microseconds if -u is not specified.");
     parser.set_required<double>("c", "critical", "Critical threshold in -u units or in microseconds if -u is not specified.");
-    parser.set_required<std::string>("vol", "volume", "GlusterFS Volume name.");
+    parser.set_required<std::string>("vol", "volume", "GlusterFS Volume name. Several volumes can be checked at once as a comma separated list, or '*' for all the dumps in -stats-dir.");
     parser.set_optional<std::string>("u", "unit", "us", "Time measurement unit used to interpret input arguments -w and -c. Possible values: 'us': microseconds, 'ms': miliseconds, 's': seconds");
     parser.set_optional<std::string>("ou", "out-unit", "us", "Time measurement unit used to output the key performance indicators read. Possible values: 'us': microseconds, 'ms': miliseconds, 's': seconds");
-    parser.set_optional<std::string>("f", "filter", ".*usec", "Regular expression (ECMAScript grammar, case insesitive) filter. If given, only the metrics that fully match the pattern will be considered for evaluation and reporting.");    
+    parser.set_optional<std::string>("f", "filter", ".*usec", "Regular expression (ECMAScript grammar, case insesitive) filter. If given, only the metrics that fully match the pattern will be considered for evaluation and reporting. Patterns nesting groups, or stacking quantifiers, more than 100 levels deep are refused.");    
     parser.set_optional<bool>("apply-on-total-avg", "", false, "If set to true, the thresholds are applied to the total average of all metrics instead of each metric.");
     parser.set_optional<bool>("v", "verbose", false, "Verbose output.");    
     parser.set_optional<std::string>("override-stats-file", "", "", "If given, this file will be read instead of the default GlusterFS dump file.");    
-    parser.set_optional<std::string>("gluster-src-unit", "", "us", "The time unit dumped by GlusterFS.");
+    parser.set_optional<std::string>("gluster-src-unit", "", "us", "The time unit of the latencies whose name doesn't end in their unit, see Non time based metrics.");
     parser.set_optional<int>("dump-max-age-seconds", "", 300, "Maximum dump age allowed. If the file is older, a CRITICAL will be reported.");
-    parser.set_optional<int>("exceeded-metrics-report-count", "", 1000, "The maximum number of metrics to report over the threshold. Only affects check output, not performance data.");
+    parser.set_optional<int>("exceeded-metrics-report-count", "", 1000, "The maximum number of metrics to report over the threshold, the most severe ones (by their ratio to the threshold) first, the others are only counted. Only affects check output, not performance data.");
+    parser.set_optional<bool>("stream", "", false, "If set to true, the dump is evaluated in a single streaming pass without building a JSON document in memory. The results are the same.");
+    parser.set_optional<std::string>("stats-dir", "", "/var/lib/glusterd/stats", "Directory GlusterFS writes the glusterfs_<volume>.dump files to.");
+    parser.set_optional<int>("threads", "", 0, "When checking several volumes, the maximum number of volumes checked at the same time, and the number of dumps -nodes and -replay evaluate at the same time. 0 means one per CPU core.");
+    parser.set_optional<bool>("batch-combined", "", false, "When checking several volumes, report a single line with the worst state of all volumes instead of one line per volume.");
+    parser.set_optional<std::string>("interval", "", "off", "Evaluate how much each metric changed since the previous dump instead of its value. Possible values: 'off', 'delta': the change, 'rate': the change per second.");
+    parser.set_optional<std::string>("state-dir", "", "/var/tmp", "Directory -interval, -apply-on-window and -apply-on-baseline keep the values of the previous dumps in.");
+    parser.set_optional<std::string>("cache-dir", "", "", "If given, the metrics evaluated from a dump are cached in this directory and reused by the next checks with the same arguments, until the dump is rewritten.");
+    parser.set_optional<std::string>("total-avg-weight", "", "none", "How the metrics are weighted in the total average. Possible values: 'none': equally, 'calls': by the number of calls of their fop ('<fop>.count' in the dump).");
+    parser.set_optional<std::string>("group-by", "", "", "Also report the average, maximum and count of the metrics per group, grouped by these parts of their names: comma separated list of 'scope', 'fop', 'stat'.");
+    parser.set_optional<std::string>("apply-on-groups", "", "off", "Compare the group aggregates of -group-by with the thresholds instead of each metric. Possible values: 'off', 'avg', 'max'.");
+    parser.set_optional<std::string>("apply-on-window", "", "off", "Compare a statistic of each metric over the dumps of the last -window-seconds with the thresholds instead of its current value. Possible values: 'off', 'avg', 'max', 'p<percentile>', e.g. 'p95'.");
+    parser.set_optional<int>("window-seconds", "", 3600, "The time window of -apply-on-window, counted back from the dump's modification time.");
+    parser.set_optional<int>("history-size", "", 288, "The number of dumps -apply-on-window keeps in its history file in -state-dir.");
+    parser.set_optional<bool>("apply-on-baseline", "", false, "Compare each metric with its own baseline, a moving average and standard deviation of its previous dumps. -w and -c are then the number of standard deviations above the average.");
+    parser.set_optional<double>("baseline-alpha", "", 0.1, "How much the newest dump weighs in the baselines of -apply-on-baseline, between 0 and 1.");
+    parser.set_optional<int>("baseline-warmup", "", 10, "The number of dumps a metric's baseline is learned from before -apply-on-baseline compares the metric with it.");
+    parser.set_optional<bool>("self-profile", "", false, "Add the check's own run time per phase (check_stat_us, check_parse_us, check_evaluate_us, check_output_us, check_total_us) and allocations (check_allocs, check_alloc_bytes) to the performance data.");
+    parser.set_optional<std::string>("output-format", "", "nagios", "Output format. Possible values: 'nagios': plugin output with performance data, 'prometheus': text exposition format, 'influx': InfluxDB line protocol, 'json': one object per volume.");
+    parser.set_optional<std::string>("rules", "", "", "A file of per metric thresholds, one '<regex> <warning> <critical> [<unit>]' per line, '#' starts a comment. The warning threshold can't be above the critical one. The unit is 'us', 'ms' or 's' and defaults to -u. The metrics a rule matches are compared with its thresholds and reported with them in the performance data, all others with -w and -c. Back-references and look-arounds aren't supported in rules. A -daemon reads the file when it first evaluates a check.");
+    parser.set_optional<std::string>("rules-match", "", "first", "Which rule a metric matching several gets. Possible values: 'first': the first one in the file, 'specific': the one with the most literal characters in its pattern.");
+    parser.set_optional<std::string>("dump-format", "", "json", "What the dump files are: json (the io-stats dumps) or profile-xml (saved 'gluster volume profile <volume> info --xml' output, read in one streaming pass). Profile metrics are named <brick>.aggr.fop.<FOP>.latency_ave_usec, 'inter' for the interval statistics.");
+    parser.set_optional<int>("dump-read-attempts", "", 5, "How many times a JSON dump GlusterFS is rewriting is read, 2, 4, 8... ms apart, until one read sees it whole and unchanged. If none does, the last result cached in -cache-dir is reported, as long as its dump isn't older than -dump-max-age-seconds.");
+    parser.set_optional<std::string>("nodes", "", "", "Check the volume from the dumps of several of its servers and clients at once: every file in this directory, or matching this glob pattern. Each metric is reported as its average and maximum over the nodes, the maximum is compared with the thresholds and the message names the node it was found on. The dumps are evaluated concurrently, on -threads workers. Not cached in -cache-dir.");
+    parser.set_optional<std::string>("replay", "", "", "Instead of checking a volume, evaluate every archived dump in this directory, or matching this glob pattern, and print how many OK, WARNING and CRITICAL states each pair of -replay-warning and -replay-critical thresholds would have reported.");
+    parser.set_optional<std::string>("replay-warning", "", "", "Comma separated warning thresholds to replay, in the -u unit. -w if not given.");
+    parser.set_optional<std::string>("replay-critical", "", "", "Comma separated critical thresholds to replay, in the -u unit. -c if not given.");
+    parser.set_optional<std::string>("output-file", "", "", "If given, the output atomically replaces this file instead of being printed, e.g. for the node_exporter textfile collector.");
+    parser.set_optional<std::string>("submit", "", "", "Instead of printing the results, submit every volume's, and with -group-by every group's, as a passive check result: as PROCESS_SERVICE_CHECK_RESULT commands to this external command pipe (a FIFO), or as check result files into this spool directory. With -client only the volumes' results are submitted.");
+    parser.set_optional<std::string>("submit-host", "", "", "The host the passive results are submitted for. The local host name if not given.");
+    parser.set_optional<std::string>("submit-service", "", "gluster_perf_%v", "The service a volume's passive result is submitted for, %v is replaced by the volume. A group's service is '<volume service>_<group>', e.g. gluster_perf_vol1_WRITE.latency_ave.");
+    parser.set_optional<int>("submit-timeout", "", 10, "The seconds -submit waits at most for Nagios/Icinga to make room in a full external command pipe before giving up.");
+    parser.set_optional<bool>("daemon", "", false, "Stay resident: keep the results cached, re-evaluate a volume only when its dump is rewritten and serve the results on -socket.");
+    parser.set_optional<bool>("client", "", false, "Ask the daemon listening on -socket for the result instead of reading the dump.");
+    parser.set_optional<std::string>("socket", "", "/var/run/check_gluster_perf.sock", "Unix domain socket used by -daemon and -client.");
     parser.set_optional<bool>("V", "version", false, "Show program version.");
     
 
@@ -402,108 +962,145 @@ T map_enum_to_value(const std::map<std::string, T>& map, const std::string& valu
     }
 }
 
+/*
+The text of a member's value, as the streaming scanner hands it over: strings unquoted, numbers,
+true, false and null as a token. Numbers are printed with 17 digits, which reads back as the
+same double. Nested objects and arrays are rejected like the scanner rejects them.
+*/
+static const std::string& scalar_text(const json& value, const std::string& key, std::string& scratch) throw (std::runtime_error)
+{
+    char number[32];
+
+    switch (value.type())
+    {
+        case json::value_t::string:
+            return value.get_ref<const std::string&>();
+        case json::value_t::number_integer:
+            scratch = std::to_string(value.get<std::int64_t>());
+            break;
+        case json::value_t::number_unsigned:
+            scratch = std::to_string(value.get<std::uint64_t>());
+            break;
+        case json::value_t::number_float:
+            std::snprintf(number, sizeof(number), "%.17g", value.get<double>());
+            scratch = number;
+            break;
+        case json::value_t::boolean:
+            scratch = value.get<bool>() ? "true" : "false";
+            break;
+        case json::value_t::null:
+            scratch = "null";
+            break;
+        default:
+            throw std::runtime_error("Malformed GlusterFS dump, nested objects and arrays are not supported as metric values (found one for '" + key + "')");
+    }
+
+    return scratch;
+}
+
 ReturnCode  process_metrics(
-        std::map<std::string, Metric>& exceeding_metrics, 
-        std::map<std::string, Metric>& performance_metrics, 
+        MetricTable& metrics,
         Metric& total_average,
         const std::vector<json>& dump_data, 
         const Metric& warning_threshold, 
         const Metric& critical_threshold, 
         const UnitType& unit_type_output,
         const UnitType& gluster_unit_type,
-        const std::regex& metric_filter,
-        bool disable_threshold_comparison) throw(std::exception, std::runtime_error)
+        const MetricFilter& metric_filter,
+        bool disable_threshold_comparison,
+        IntervalState* interval_state,
+        MetricGroups* groups,
+        AverageWeight average_weight,
+        const MetricRules* rules) throw(std::exception, std::runtime_error)
 {
+    std::size_t members = 0;
 
-    Metric              dump_metric;
-    double              avg_sum = 0;
-    ReturnCode          check_code = ReturnCode::OK;    
-    std::string         buffer;
+    for (const json& dump_json_object : dump_data)
+    {
+        members += dump_json_object.size();
+    }
 
-    
+    metrics.reserve(members, members * 64); // at most one metric per member, most names fit in 64 bytes
+
+    MetricEvaluator evaluator(metrics,
+                              warning_threshold, critical_threshold, 
+                              unit_type_output, gluster_unit_type, 
+                              metric_filter, disable_threshold_comparison,
+                              interval_state, groups, average_weight, rules);
+    std::string     value_scratch;
 
     for (const json& dump_json_object : dump_data)
     {
         // loop over the JSON parsed GlusterFS dump
         for (auto res_it = dump_json_object.begin(); res_it != dump_json_object.end(); res_it++)
         {
-            buffer = res_it.value();
+            const std::string& key   = res_it.key();
+            const std::string& value = scalar_text(res_it.value(), key, value_scratch); // GlusterFS dumps every value as a string
 
+            evaluator.evaluate({key.data(), key.data() + key.size()}, {value.data(), value.data() + value.size()});
 
-            // if the filter does not match the name of the current metric
-            if (std::regex_match((std::string) res_it.key(), metric_filter) != true)
-            {
-                if (g_verbose) std::cout << "Skipping metric '" << res_it.key() << "', does not match regex." << std::endl;
-                continue; // skip to the next metric    
-            }
-
-
-
-            //std::cout << res_it.key() << ": " << res_it.value() << std::endl; 
-            try
-            {
-                
-
-                // takes the JSON dump parsed metric, coverts it to specified unit type and makes the Metric object dump_metric
-                dump_metric = convert({std::stod(buffer), gluster_unit_type}, warning_threshold.unit); 
-
-                // this stores all metrics regardless of their value
-                performance_metrics[res_it.key()] = convert(dump_metric, unit_type_output); // also, convert the metric to the requested output unit type (ms/s/us)
-
-                if (g_verbose) std::cout << res_it.key() << ": " << dump_metric.value << g_unit_enum_map_reverse[dump_metric.unit];  
-
-
-                if (! disable_threshold_comparison )
-                {
-                    if (dump_metric.value >= warning_threshold.value) 
-                    {
-                        check_code = ReturnCode::Warning;
-                        exceeding_metrics[res_it.key()] = convert(dump_metric, unit_type_output);
+        } // end for (auto res_it = dump_json_object.begin(); res_it != dump_json_object.end(); res_it++)
 
-                        if (g_verbose) std::cout << " - Found bigger than WARNING threhsold! Threshold: " << warning_threshold.value << g_unit_enum_map_reverse[warning_threshold.unit];
-                    }
+    } // end for (const json& dump_json_object : dump_data)  
 
-                    if (dump_metric.value >= critical_threshold.value)
-                    {
-                        check_code = ReturnCode::Critical;
-                        exceeding_metrics[res_it.key()] = convert(dump_metric, unit_type_output);
+    return evaluator.finish(total_average);
+}
 
-                        if (g_verbose) std::cout << " - Found bigger than CRITICAL threhsold! Threshold: " << critical_threshold.value << g_unit_enum_map_reverse[critical_threshold.unit];
-                    }       
-                }                                
-                    
 
-                if (dump_metric.value != 0.0)
-                {
-                    Metric output_type = convert(dump_metric, unit_type_output);
-                    avg_sum += output_type.value;
-                }
-                                
-            } 
-            catch (const std::exception& e)
-            {
-                std::ostringstream osserror;
-                osserror << "Error reading GlusterFS dump. Found the value of '" << res_it.value() <<"' for the metric '" << res_it.key()  << "' which failed when passed to std::stod.";
-                throw std::runtime_error(osserror.str());
-            }
+void evaluate_dump(const CheckOptions& options, const MetricFilter& metric_filter, const std::string& dump_file, MetricTable& metrics, Metric& total_average) throw (std::exception, std::runtime_error)
+{
+    if (options.dump_format == DumpFormat::ProfileXml)
+    {
+        int bricks = 0;
 
-             if (g_verbose) std::cout << std::endl;
+        process_profile_xml(metrics, total_average, bricks, dump_file,
+                            options.warning_threshold, options.critical_threshold,
+                            options.unit_type_output, options.gluster_unit_type, metric_filter, true,
+                            nullptr, nullptr, options.average_weight);
 
-        } // end for (auto res_it = dump_json_object.begin(); res_it != dump_json_object.end(); res_it++)
+        if (bricks != 0) return;
+    }
+    else if (options.stream)
+    {
+        DumpSnapshot    snapshot(dump_file, options.read_attempts); // this throws
+        int             root_objects = 0,
+                        passes       = 0;
 
-       
+        snapshot.consume([&](const DumpView& dump)
+        {
+            if (passes++ > 0) metrics.clear(); // starting over on a dump read again, the previous copy was cut short
 
-    } // end for (const json& dump_json_object : dump_data)  
+            process_metrics_stream(metrics, total_average, root_objects, dump,
+                                   options.warning_threshold, options.critical_threshold,
+                                   options.unit_type_output, options.gluster_unit_type, metric_filter, true,
+                                   nullptr, nullptr, options.average_weight);
+        });
 
-    if (avg_sum != 0 && performance_metrics.size() != 0)
+        if (root_objects != 0) return;
+    }
+    else
     {
-        total_average.value = avg_sum / performance_metrics.size();
-    } else
-        total_average.value = 0;
+        DumpSnapshot        snapshot(dump_file, options.read_attempts); // this throws
+        std::vector<json>   dump_json;
+        int                 root_objects = 0;
+
+        snapshot.consume([&](const DumpView& dump)
+        {
+            dump_json.clear();
+            root_objects = parse_json_dump(dump, dump_file, dump_json, MetricEvaluator::skip_filter(metric_filter, options.average_weight));
+        });
 
-    total_average.unit = unit_type_output;
+        if (root_objects != 0)
+        {
+            process_metrics(metrics, total_average, dump_json,
+                            options.warning_threshold, options.critical_threshold,
+                            options.unit_type_output, options.gluster_unit_type, metric_filter, true,
+                            nullptr, nullptr, options.average_weight);
+            return;
+        }
+    }
 
-    return check_code;
+    throw std::runtime_error("No data was read from the dump file at " + dump_file);
 }
 
 
@@ -513,73 +1110,38 @@ this function parses the top level JSON objects by their enclosing {}'s separati
 object into different inputs sent to the JSON library.
 
 This is needed because GlusterFS 3.8 dumps two root level objects in the stats.
+
+'dump' is the dump already in memory (see DumpSnapshot), 'file_path' is only for the messages.
+The root objects are handed to the parser as views over it, no line or object copies are made.
+Root objects 'filter' rules out by their keys (see skip_unmatched_object) aren't parsed. Returns
+the number of root objects found, those included.
 */
-void read_json_dump(const std::string& file_path, std::vector<json>& results) throw (std::runtime_error)
+int parse_json_dump(const DumpView& dump, const std::string& file_path, std::vector<json>& results, const MetricFilter* filter) throw (std::runtime_error)
 {
-    
-    std::ostringstream  error_message,
-                        current_object_buffer;
-    std::ifstream       json_file(file_path);
-    std::string         current_line;
-    int                 level  = -1; // -1 means no object found    
-    int                 line_count = 1;
-
-    if (! json_file.is_open())
-    {        
-        error_message << "Couldn't open file '" << file_path << "'";
-        throw std::runtime_error(error_message.str());
-    }
+    std::vector<DumpView> root_objects;
 
+    int skipped = split_root_objects(dump, root_objects, filter);
 
-    while(std::getline(json_file, current_line))
-    {
-        current_object_buffer << current_line;
+    results.reserve(results.size() + root_objects.size());
 
-        for (int current_character_pos = 0; current_character_pos < current_line.length(); current_character_pos++)
+    for (const DumpView& root_object : root_objects)
+    {
+        try
         {
-            switch(current_line[current_character_pos])
-            {
-                case '{':                
-                    level > 0 ? level++ : level = 1;
-                    
-                    break;
-                case '}':
-
-                    if (level > 0)
-                        level--;
-                    else 
-                    {
-                        error_message << "Unexpected '}' found at line" << line_count << ":" << current_character_pos;
-                        throw std::runtime_error(error_message.str());
-                    }
-
-                    break;
-                case '[':
-                    if (level == -1 && results.size() == 0) // if we're not inside any objects, the file MIGHT be enclosed in arrays
-                    {
-                        // let's pass this to the library and let it throw should it be the case
-                        json_file.seekg(0);
-                        results.push_back(json::parse(json_file));
-                    }
-            } 
-
-            if  (level == 0)           
-            {                                
-                results.push_back(json::parse(current_object_buffer.str()));
-            
-                // reset the state machine
-                level = -1;
-                current_object_buffer.clear();
-                current_object_buffer.seekp(0);
-            }
+            results.push_back(json::parse(root_object.begin, root_object.end));
+        }
+        catch (const std::exception& e) // the JSON library has its own exception types, keep the declared contract
+        {
+            std::ostringstream error_message;
+            error_message << "Couldn't parse JSON in '" << file_path << "': " << e.what();
+            throw std::runtime_error(error_message.str());
         }
-
-        line_count++;
     }
 
+    return root_objects.size() + skipped;
 }
 
-std::time_t get_file_timestamp(std::string& path) throw (std::runtime_error)
+std::time_t get_file_timestamp(std::string& path, DumpIdentity* identity) throw (std::runtime_error)
 {
     struct stat attrib;
     int         stat_ret = 0;
@@ -596,50 +1158,32 @@ std::time_t get_file_timestamp(std::string& path) throw (std::runtime_error)
         throw std::runtime_error(error.str());
     }
 
+    if (identity != nullptr)
+    {
+        *identity = {attrib.st_dev, attrib.st_ino, attrib.st_size, attrib.st_mtim.tv_sec, attrib.st_mtim.tv_nsec};
+    }
+
     return attrib.st_mtim.tv_sec; // return the seconds
 }
 
-std::string nagios_output_metrics(const std::map<std::string, Metric>& metrics, const Metric& warn, const Metric& crit)
+std::string nagios_output_metrics(const MetricTable& metrics, const Metric& warn, const Metric& crit)
 {
-    std::ostringstream output;
-    auto& unit_map = g_unit_enum_map_reverse;
-
-    Metric warn_t, crit_t;
+    OutputBuffer output(metrics.metrics().size() * 128);
 
-    for (auto& metric : metrics)
-    {
-        warn_t = convert(warn, metric.second.unit);
-        crit_t = convert(crit, metric.second.unit);
-        output << '\'' << metric.first << "'=" << metric.second.value << unit_map[metric.second.unit] << ";" << warn_t.value <<  ";" << crit_t.value << " ";
-    }
+    append_nagios_perfdata(output, metrics, warn, crit);
 
     return output.str();
 }
 
 
-Metric convert (const Metric& src, const UnitType dst_unit)
+std::uint64_t hash_text(const std::string& text)
 {
-    std::map<UnitType, int> exp_map = {
-        {UnitType::Microseconds, 6},
-        {UnitType::Miliseconds,  3},
-        {UnitType::Seconds,      0}
-    };
-
-    double  result      = 0.0;
-    int     exp_diff    = exp_map[src.unit] - exp_map[dst_unit];
+    std::uint64_t hash = 14695981039346656037ULL;
 
-    if (exp_diff < 0)
-    {
-        result = src.value * std::pow(10, std::abs(exp_diff));
-    } 
-    else if (exp_diff > 0)
-    {
-        result = src.value / std::pow(10, std::abs(exp_diff));
-    } 
-    else
+    for (unsigned char c : text)
     {
-        result = src.value;
+        hash = (hash ^ c) * 1099511628211ULL;
     }
 
-    return {result, dst_unit};
+    return hash;
 }
@@ -0,0 +1,178 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - column aggregation of evaluated metrics
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "metric_aggregate.hpp"
+
+#include <limits>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static const std::size_t LANES = 4; // two SSE2 or one AVX register of doubles
+
+/* The partial results of each lane, value i goes to lane i % LANES in every implementation */
+struct Lanes {
+    double sum[LANES], weight[LANES], maximum[LANES], minimum[LANES];
+};
+
+/*
+Aggregates the first 'count' values, a multiple of LANES, into 'lanes'. Weighted is a template
+argument so that neither loop tests for the weights column.
+*/
+typedef void (*AggregateLanes)(const double* values, const double* weights, std::size_t count, Lanes& lanes);
+
+template <bool Weighted>
+static void aggregate_scalar(const double* values, const double* weights, std::size_t count, Lanes& lanes)
+{
+    for (std::size_t i = 0; i < count; i += LANES)
+    {
+        for (std::size_t lane = 0; lane < LANES; lane++)
+        {
+            double value = values[i + lane];
+            double w     = Weighted ? weights[i + lane] : 1.0;
+
+            lanes.sum[lane]       += value * w;
+            lanes.weight[lane]    += w;
+            lanes.maximum[lane]    = value > lanes.maximum[lane] ? value : lanes.maximum[lane];
+            lanes.minimum[lane]    = value < lanes.minimum[lane] ? value : lanes.minimum[lane];
+        }
+    }
+}
+
+#if defined(__x86_64__)
+
+// max_pd(value, maximum) is "value > maximum ? value : maximum", NaNs included, min_pd alike
+
+template <bool Weighted>
+static void aggregate_sse2(const double* values, const double* weights, std::size_t count, Lanes& lanes)
+{
+    __m128d sum[2], weight[2], maximum[2], minimum[2];
+    __m128d one = _mm_set1_pd(1.0);
+
+    for (int half = 0; half < 2; half++)
+    {
+        sum[half]       = _mm_loadu_pd(lanes.sum + 2 * half);
+        weight[half]    = _mm_loadu_pd(lanes.weight + 2 * half);
+        maximum[half]   = _mm_loadu_pd(lanes.maximum + 2 * half);
+        minimum[half]   = _mm_loadu_pd(lanes.minimum + 2 * half);
+    }
+
+    for (std::size_t i = 0; i < count; i += LANES)
+    {
+        for (int half = 0; half < 2; half++)
+        {
+            __m128d value = _mm_loadu_pd(values + i + 2 * half);
+            __m128d w     = Weighted ? _mm_loadu_pd(weights + i + 2 * half) : one;
+
+            sum[half]       = _mm_add_pd(sum[half], _mm_mul_pd(value, w));
+            weight[half]    = _mm_add_pd(weight[half], w);
+            maximum[half]   = _mm_max_pd(value, maximum[half]);
+            minimum[half]   = _mm_min_pd(value, minimum[half]);
+        }
+    }
+
+    for (int half = 0; half < 2; half++)
+    {
+        _mm_storeu_pd(lanes.sum + 2 * half, sum[half]);
+        _mm_storeu_pd(lanes.weight + 2 * half, weight[half]);
+        _mm_storeu_pd(lanes.maximum + 2 * half, maximum[half]);
+        _mm_storeu_pd(lanes.minimum + 2 * half, minimum[half]);
+    }
+}
+
+template <bool Weighted>
+__attribute__((target("avx2")))
+static void aggregate_avx2(const double* values, const double* weights, std::size_t count, Lanes& lanes)
+{
+    __m256d sum     = _mm256_loadu_pd(lanes.sum);
+    __m256d weight  = _mm256_loadu_pd(lanes.weight);
+    __m256d maximum = _mm256_loadu_pd(lanes.maximum);
+    __m256d minimum = _mm256_loadu_pd(lanes.minimum);
+    __m256d one     = _mm256_set1_pd(1.0);
+
+    for (std::size_t i = 0; i < count; i += LANES)
+    {
+        __m256d value = _mm256_loadu_pd(values + i);
+        __m256d w     = Weighted ? _mm256_loadu_pd(weights + i) : one;
+
+        sum     = _mm256_add_pd(sum, _mm256_mul_pd(value, w)); // not fused, the other implementations round the product
+        weight  = _mm256_add_pd(weight, w);
+        maximum = _mm256_max_pd(value, maximum);
+        minimum = _mm256_min_pd(value, minimum);
+    }
+
+    _mm256_storeu_pd(lanes.sum, sum);
+    _mm256_storeu_pd(lanes.weight, weight);
+    _mm256_storeu_pd(lanes.maximum, maximum);
+    _mm256_storeu_pd(lanes.minimum, minimum);
+}
+
+#endif
+
+static AggregateLanes aggregator(SimdLevel level, bool weighted)
+{
+    switch (level)
+    {
+#if defined(__x86_64__)
+        case SimdLevel::Avx2:   return weighted ? aggregate_avx2<true> : aggregate_avx2<false>;
+        case SimdLevel::Sse2:   return weighted ? aggregate_sse2<true> : aggregate_sse2<false>;
+#endif
+        default:                return weighted ? aggregate_scalar<true> : aggregate_scalar<false>;
+    }
+}
+
+// chosen once, before main()
+static const SimdLevel s_level = best_simd_level();
+
+Aggregate aggregate_columns(const double* values, const double* weights, std::size_t count)
+{
+    return aggregate_columns(values, weights, count, s_level);
+}
+
+Aggregate aggregate_columns(const double* values, const double* weights, std::size_t count, SimdLevel level)
+{
+    Lanes       lanes;
+    std::size_t body = count - count % LANES;
+
+    for (std::size_t lane = 0; lane < LANES; lane++)
+    {
+        lanes.sum[lane]       = 0;
+        lanes.weight[lane]    = 0;
+        lanes.maximum[lane]   = -std::numeric_limits<double>::infinity();
+        lanes.minimum[lane]   = std::numeric_limits<double>::infinity();
+    }
+
+    if (! cpu_runs(level)) level = SimdLevel::Scalar;
+
+    aggregator(level, weights != nullptr)(values, weights, body, lanes);
+
+    for (std::size_t i = body, lane = 0; i < count; i++, lane++) // the tail, at most LANES - 1 values
+    {
+        double value = values[i];
+        double w     = weights != nullptr ? weights[i] : 1.0;
+
+        lanes.sum[lane]       += value * w;
+        lanes.weight[lane]    += w;
+        lanes.maximum[lane]    = value > lanes.maximum[lane] ? value : lanes.maximum[lane];
+        lanes.minimum[lane]    = value < lanes.minimum[lane] ? value : lanes.minimum[lane];
+    }
+
+    Aggregate result = {0, 0, lanes.maximum[0], lanes.minimum[0], count};
+
+    for (std::size_t lane = 0; lane < LANES; lane++)
+    {
+        result.weighted_sum += lanes.sum[lane];
+        result.weight       += lanes.weight[lane];
+        result.maximum       = lanes.maximum[lane] > result.maximum ? lanes.maximum[lane] : result.maximum;
+        result.minimum       = lanes.minimum[lane] < result.minimum ? lanes.minimum[lane] : result.minimum;
+    }
+
+    if (count == 0) result.maximum = result.minimum = 0;
+
+    return result;
+}
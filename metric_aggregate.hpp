@@ -0,0 +1,38 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - column aggregation of evaluated metrics
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_METRIC_AGGREGATE_HPP
+#define CHECK_GLUSTER_PERF_METRIC_AGGREGATE_HPP
+
+#include <cstddef>
+
+#include "simd.hpp"
+
+/* Weighted sum, total weight, maximum and minimum of a column of values */
+struct Aggregate {
+    double      weighted_sum;
+    double      weight;
+    double      maximum;
+    double      minimum;
+    std::size_t count;
+
+    double      mean() const { return weight > 0 ? weighted_sum / weight : 0; }
+};
+
+/*
+Aggregates 'count' values in one pass. 'weights' is a column of the same length, or nullptr for
+every value weighing 1. Both are plain contiguous arrays: the loop keeps independent partial
+results in four lanes, with AVX2 or SSE2 instructions when the CPU has them, and does no unit
+conversions. Convert the results, not the values.
+
+Every SimdLevel adds the same values in the same order, the results are identical to the bit.
+The second form runs a given level, the plain code if the CPU can't, for tests and benchmarks.
+*/
+Aggregate   aggregate_columns(const double* values, const double* weights, std::size_t count);
+Aggregate   aggregate_columns(const double* values, const double* weights, std::size_t count, SimdLevel level);
+
+#endif
@@ -0,0 +1,347 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - per metric evaluation
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "metric_evaluator.hpp"
+#include "metric_aggregate.hpp"
+#include "metric_schema.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+
+MetricEvaluator::MetricEvaluator(
+        MetricTable& metrics,
+        const Metric& warning_threshold,
+        const Metric& critical_threshold,
+        const UnitType& unit_type_output,
+        const UnitType& gluster_unit_type,
+        const MetricFilter& metric_filter,
+        bool disable_threshold_comparison,
+        IntervalState* interval_state,
+        MetricGroups* groups,
+        AverageWeight average_weight,
+        const MetricRules* rules)
+    : m_metrics(metrics),
+      m_warning_threshold(warning_threshold),
+      m_critical_threshold(critical_threshold),
+      m_unit_type_output(unit_type_output),
+      m_gluster_unit_type(gluster_unit_type),
+      m_metric_filter(metric_filter),
+      m_disable_threshold_comparison(disable_threshold_comparison),
+      m_interval_state(interval_state),
+      m_groups(groups),
+      m_average_weight(average_weight),
+      m_rules(rules),
+      m_evaluate_in(nullptr),
+      m_first_index(0),
+      m_check_code(ReturnCode::OK)
+{
+    // -u is only known at run time, this is the one place it's dispatched on
+    switch (warning_threshold.unit)
+    {
+        case UnitType::Microseconds:    m_evaluate_in = &MetricEvaluator::evaluate_in<unit::Microseconds>; break;
+        case UnitType::Miliseconds:     m_evaluate_in = &MetricEvaluator::evaluate_in<unit::Miliseconds>; break;
+        case UnitType::Seconds:         m_evaluate_in = &MetricEvaluator::evaluate_in<unit::Seconds>; break;
+    }
+}
+
+static const char CALL_COUNT_SUFFIX[] = ".count";
+
+static bool is_call_count(const DumpView& key)
+{
+    std::size_t length = sizeof(CALL_COUNT_SUFFIX) - 1;
+
+    return key.size() > length && std::memcmp(key.end - length, CALL_COUNT_SUFFIX, length) == 0;
+}
+
+void MetricEvaluator::add_call_count(const DumpView& key, double count)
+{
+    m_scratch.assign(key.begin, key.end - (sizeof(CALL_COUNT_SUFFIX) - 1));
+    m_call_counts[m_scratch] = count;
+}
+
+/* Call counts are needed whether the filter selects them or not, those it doesn't aren't evaluated */
+void MetricEvaluator::read_call_count(const DumpView& key, const DumpView& value)
+{
+    double count;
+
+    try
+    {
+        count = parse_double(value.begin, value.end);
+    }
+    catch (const std::exception&)
+    {
+        return; // not a number, the metrics of this fop weigh 1
+    }
+
+    if (m_interval_state != nullptr)
+    {
+        m_interval_state->current().add(key, count);
+
+        if (! m_interval_state->apply(key, count)) return; // the calls since the previous dump
+    }
+
+    add_call_count(key, count);
+}
+
+/* The rest of evaluate() once the value is read, comparing in the -u unit: ThresholdUnit is the type of m_warning_threshold.unit */
+template <class ThresholdUnit>
+void MetricEvaluator::evaluate_in(const DumpView& key, UnitType dump_unit, double dump_value)
+{
+    typedef unit::Quantity<ThresholdUnit> Threshold;
+
+    const UnitType threshold_unit = ThresholdUnit::type; // a copy, the member has no definition operator[] could bind to
+
+    // the dump metric in the threshold unit, and in the requested output unit type (ms/s/us), that's what's reported
+    Threshold   dump_metric     = unit::quantity<ThresholdUnit>({dump_value, dump_unit});
+    Metric      output_metric   = unit::metric(dump_metric, m_unit_type_output);
+
+    // this stores all metrics regardless of their value
+    MetricTable::Index index = m_metrics.add(key, output_metric);
+
+    if (m_values.empty()) m_first_index = index;
+
+    m_values.push_back(dump_value); // converted once, as a total per unit
+    m_value_units.push_back(dump_unit);
+
+    if (m_groups != nullptr) m_groups->add(key, output_metric);
+
+    if (g_verbose) std::cout << std::string(key.begin, key.end) << ": " << dump_metric.value() << unit_name(threshold_unit);
+
+    if (m_disable_threshold_comparison) return;
+
+    const MetricRule*   rule                = m_rules != nullptr ? m_rules->find(key) : nullptr;
+    Threshold           warning_threshold   = unit::quantity<ThresholdUnit>(rule != nullptr ? rule->warning : m_warning_threshold);
+    Threshold           critical_threshold  = unit::quantity<ThresholdUnit>(rule != nullptr ? rule->critical : m_critical_threshold);
+
+    if (g_verbose && rule != nullptr) std::cout << " - Rule: " << rule->pattern;
+
+    if (dump_metric >= warning_threshold)
+    {
+        if (m_check_code != ReturnCode::Critical) m_check_code = ReturnCode::Warning; // a CRITICAL metric found before stays CRITICAL
+
+        if (g_verbose) std::cout << " - Found bigger than WARNING threhsold! Threshold: " << warning_threshold.value() << unit_name(threshold_unit);
+    }
+
+    if (dump_metric >= critical_threshold)
+    {
+        m_check_code = ReturnCode::Critical;
+
+        if (g_verbose) std::cout << " - Found bigger than CRITICAL threhsold! Threshold: " << critical_threshold.value() << unit_name(threshold_unit);
+    }
+
+    if (dump_metric >= warning_threshold || dump_metric >= critical_threshold)
+    {
+        m_metrics.mark_exceeding(index, severity_ratio(dump_metric.value(), warning_threshold.value()));
+    }
+}
+
+void MetricEvaluator::evaluate(const DumpView& key, const DumpView& value) throw (std::runtime_error)
+{
+    UnitType    dump_unit;
+    bool        matches     = m_metric_filter.matches(key.begin, key.end);
+    bool        duration    = matches && duration_unit(key, m_gluster_unit_type, dump_unit);
+
+    if (m_average_weight == AverageWeight::Calls && is_call_count(key) && ! duration)
+    {
+        read_call_count(key, value);
+    }
+
+    // if the filter does not match the name of the current metric
+    if (matches != true)
+    {
+        if (g_verbose) std::cout << "Skipping metric '" << std::string(key.begin, key.end) << "', does not match regex." << std::endl;
+        return; // skip to the next metric
+    }
+
+    // counters and gauges have no time unit, they're neither compared with the thresholds nor part of the average
+    if (! duration)
+    {
+        if (g_verbose) std::cout << "Skipping metric '" << std::string(key.begin, key.end) << "', not a latency." << std::endl;
+        return;
+    }
+
+    try
+    {
+        double dump_value = parse_double(value.begin, value.end);
+
+        if (m_interval_state != nullptr)
+        {
+            m_interval_state->current().add(key, dump_value);
+
+            if (! m_interval_state->apply(key, dump_value))
+            {
+                if (g_verbose) std::cout << "Skipping metric '" << std::string(key.begin, key.end) << "', not found in the previous dump." << std::endl;
+                return; // nothing to compare with yet
+            }
+        }
+
+        (this->*m_evaluate_in)(key, dump_unit, dump_value);
+    }
+    catch (const std::exception& e)
+    {
+        std::ostringstream osserror;
+        osserror << "Error reading GlusterFS dump. Found the value of '\"" << std::string(value.begin, value.end) << "\"' for the metric '" << std::string(key.begin, key.end) << "' which failed when passed to std::stod.";
+        throw std::runtime_error(osserror.str());
+    }
+
+    if (g_verbose) std::cout << std::endl;
+}
+
+ReturnCode MetricEvaluator::finish(Metric& total_average)
+{
+    m_metrics.sort(); // also drops the values of metrics found more than once, the average is over distinct names
+
+    // gathered in name order: both the distinct values only and the same sum whatever order the dump was read in
+    const std::vector<MetricTable::Index>&  rows = m_metrics.metrics();
+    const int                               unit_count = (int) UnitType::Seconds + 1;
+    std::vector<double>                     values[unit_count],
+                                            weights[unit_count];
+
+    for (MetricTable::Index index : rows)
+    {
+        UnitType unit = m_value_units[index - m_first_index];
+
+        values[(int) unit].push_back(m_values[index - m_first_index]);
+
+        if (m_average_weight != AverageWeight::Calls) continue;
+
+        DumpView    name    = m_metrics.name(index);
+        const char* dot     = name.end;
+
+        while (dot != name.begin && *(dot - 1) != '.') dot--;
+
+        m_scratch.assign(name.begin, dot == name.begin ? name.begin : dot - 1);
+
+        auto calls = m_call_counts.find(m_scratch);
+
+        weights[(int) unit].push_back(calls != m_call_counts.end() ? calls->second : 1.0); // not a fop metric, a single call
+    }
+
+    // each unit's column is aggregated in its own unit, the results are converted and put together
+    Aggregate total = {0, 0, 0, 0, 0};
+
+    for (int unit = 0; unit < unit_count; unit++)
+    {
+        if (values[unit].empty()) continue;
+
+        Aggregate   column  = aggregate_columns(values[unit].data(), weights[unit].empty() ? nullptr : weights[unit].data(), values[unit].size());
+        double      maximum = convert({column.maximum, (UnitType) unit}, m_unit_type_output).value,
+                    minimum = convert({column.minimum, (UnitType) unit}, m_unit_type_output).value;
+
+        total.maximum        = total.count == 0 || maximum > total.maximum ? maximum : total.maximum;
+        total.minimum        = total.count == 0 || minimum < total.minimum ? minimum : total.minimum;
+        total.weighted_sum  += convert({column.weighted_sum, (UnitType) unit}, m_unit_type_output).value;
+        total.weight        += column.weight;
+        total.count         += column.count;
+    }
+
+    total_average = {total.mean(), m_unit_type_output};
+
+    if (g_verbose)
+    {
+        std::cout << "Total average of " << total.count << " metrics: " << total_average.value << unit_name(m_unit_type_output)
+                  << ", minimum: " << total.minimum
+                  << ", maximum: " << total.maximum
+                  << ", weight: " << total.weight << std::endl;
+    }
+
+    return m_check_code;
+}
+
+/*
+The exact fast path of a decimal number: a mantissa of up to 2^53 and a power of ten of up to
+10^22 are both exact doubles, so one multiplication or division of the two is correctly rounded,
+the same double strtod finds. That's every value GlusterFS dumps ("17611", "284.6019").
+Returns false for anything else, strtod then takes over.
+*/
+static bool parse_plain_decimal(const char* begin, const char* end, double& result)
+{
+    static const double POWERS_OF_TEN[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                           1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    const std::uint64_t MAX_EXACT_MANTISSA = 1ULL << 53;
+
+    const char*     it          = begin;
+    bool            negative    = false;
+    std::uint64_t   mantissa    = 0;
+    int             digits      = 0;
+    int             exponent    = 0;
+
+    if (it != end && (*it == '-' || *it == '+')) negative = *it++ == '-';
+
+    for (; it != end && *it >= '0' && *it <= '9'; it++, digits++) mantissa = mantissa * 10 + (*it - '0');
+
+    if (it != end && *it == '.')
+    {
+        for (it++; it != end && *it >= '0' && *it <= '9'; it++, digits++, exponent--) mantissa = mantissa * 10 + (*it - '0');
+    }
+
+    if (it != end && (*it == 'e' || *it == 'E'))
+    {
+        const char* exponent_begin  = ++it;
+        bool        exponent_sign   = it != end && (*it == '-' || *it == '+');
+        int         value           = 0;
+
+        if (exponent_sign) it++;
+
+        for (; it != end && *it >= '0' && *it <= '9' && value < 1000; it++) value = value * 10 + (*it - '0');
+
+        if (it == exponent_begin + exponent_sign) return false;
+
+        exponent += *exponent_begin == '-' ? -value : value;
+    }
+
+    // up to 19 digits can't overflow the mantissa, anything left over isn't a plain decimal
+    if (it != end || digits == 0 || digits > 19 || mantissa > MAX_EXACT_MANTISSA || exponent < -22 || exponent > 22) return false;
+
+    result = exponent < 0 ? (double) mantissa / POWERS_OF_TEN[-exponent] : (double) mantissa * POWERS_OF_TEN[exponent];
+
+    if (negative) result = -result;
+
+    return true;
+}
+
+double parse_double(const char* begin, const char* end)
+{
+    char        small_buffer[64];
+    std::string large_buffer;
+    const char* number  = small_buffer;
+    char*       parsed_end;
+    std::size_t length  = end - begin;
+    double      result;
+
+    if (parse_plain_decimal(begin, end, result)) return result;
+
+    // strtod needs a terminated string, dump values are short enough to almost always fit the stack buffer
+    if (length < sizeof(small_buffer))
+    {
+        std::memcpy(small_buffer, begin, length);
+        small_buffer[length] = '\0';
+    } else
+    {
+        large_buffer.assign(begin, end);
+        number = large_buffer.c_str();
+    }
+
+    errno  = 0;
+    result = std::strtod(number, &parsed_end);
+
+    if (parsed_end == number)
+    {
+        throw std::invalid_argument("parse_double");
+    }
+
+    if (errno == ERANGE)
+    {
+        throw std::out_of_range("parse_double");
+    }
+
+    return result;
+}
@@ -0,0 +1,110 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - per metric evaluation
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_METRIC_EVALUATOR_HPP
+#define CHECK_GLUSTER_PERF_METRIC_EVALUATOR_HPP
+
+#include <string>
+#include "metric_filter.hpp"
+#include <stdexcept>
+#include <vector>
+#include <unordered_map>
+
+#include "check_gluster_perf.hpp"
+#include "dump_reader.hpp"
+#include "interval.hpp"
+#include "metric_table.hpp"
+#include "metric_groups.hpp"
+#include "units.hpp"
+#include "metric_rules.hpp"
+
+/*
+Holds the state of one evaluation run: filters a metric by name, converts its value,
+compares it with the thresholds and accumulates the total average.
+
+The values that make up the total average are kept as raw dump values, each in the unit its
+name gives (see duration_unit), and with AverageWeight::Calls the call counts of their fops
+("<fop>.count" next to "<fop>.latency_...") are looked up once, at the end. The average is
+computed over one column per unit by aggregate_columns, each result converted to the output
+unit once.
+
+The thresholds' unit (-u) is turned into a type once, when the evaluator is constructed: every
+metric is then compared as a unit::Quantity of it, only the unit its name gives is looked at per
+metric.
+
+Both the JSON document based process_metrics and the streaming pipeline feed metrics through
+this class one at a time, which is what keeps their results identical.
+*/
+class MetricEvaluator
+{
+    public:
+        MetricEvaluator(MetricTable& metrics,
+                        const Metric& warning_threshold,
+                        const Metric& critical_threshold,
+                        const UnitType& unit_type_output,
+                        const UnitType& gluster_unit_type,
+                        const MetricFilter& metric_filter,
+                        bool disable_threshold_comparison,
+                        IntervalState* interval_state = nullptr,
+                        MetricGroups* groups = nullptr,
+                        AverageWeight average_weight = AverageWeight::None,
+                        const MetricRules* rules = nullptr);
+
+        /* Evaluates one metric as read from the dump, 'value' is the raw (unquoted) text. */
+        void        evaluate(const DumpView& key, const DumpView& value) throw (std::runtime_error);
+
+        /*
+        The filter root objects can be left out by, unparsed (see skip_unmatched_object), nullptr
+        if every member has to be seen: call counts are read from the metrics the filter doesn't
+        select, and in verbose mode each of those is listed.
+        */
+        static const MetricFilter* skip_filter(const MetricFilter& metric_filter, AverageWeight average_weight)
+        {
+            return g_verbose || average_weight == AverageWeight::Calls ? nullptr : &metric_filter;
+        }
+
+        /* Sorts the metrics, computes the total average of everything evaluated and returns the check code. */
+        ReturnCode  finish(Metric& total_average);
+
+    private:
+        void        add_call_count(const DumpView& key, double count);
+        void        read_call_count(const DumpView& key, const DumpView& value);
+
+        template <class ThresholdUnit>
+        void        evaluate_in(const DumpView& key, UnitType dump_unit, double dump_value);
+
+        typedef void (MetricEvaluator::*EvaluateIn)(const DumpView& key, UnitType dump_unit, double dump_value);
+
+        MetricTable&                    m_metrics;
+        const Metric&                   m_warning_threshold;
+        const Metric&                   m_critical_threshold;
+        UnitType                        m_unit_type_output;
+        UnitType                        m_gluster_unit_type;
+        const MetricFilter&             m_metric_filter;
+        bool                            m_disable_threshold_comparison;
+        IntervalState*                  m_interval_state; // if set, deltas/rates since the previous dump are evaluated instead of the values
+        MetricGroups*                   m_groups; // if set, every evaluated metric is also added to its group's aggregates
+
+        AverageWeight                   m_average_weight;
+        const MetricRules*              m_rules; // if set, the metrics a rule matches are compared with its thresholds instead
+        EvaluateIn                      m_evaluate_in; // evaluate_in for the -u unit, picked once
+
+        std::vector<double>             m_values; // every evaluated value, in its metric's unit, by table index - m_first_index
+        std::vector<UnitType>           m_value_units; // the unit of each of m_values, see duration_unit
+        MetricTable::Index              m_first_index;
+        std::unordered_map<std::string, double> m_call_counts; // "<...>.fop.<FOP>" -> calls, only with AverageWeight::Calls
+        std::string                     m_scratch;
+        ReturnCode                      m_check_code;
+};
+
+/*
+Parses the leading number in [begin, end) the same way std::stod does, without building a
+std::string first. Throws std::invalid_argument/std::out_of_range like std::stod.
+*/
+double      parse_double(const char* begin, const char* end);
+
+#endif
@@ -0,0 +1,1069 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - metric name filter (-f)
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "metric_filter.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <map>
+#include <functional>
+#include <cstring>
+
+namespace {
+
+/* Raised while compiling when the pattern needs std::regex */
+struct unsupported_pattern {};
+
+const int MAX_NFA_STATES = 20000;
+const int MAX_DFA_STATES = 4096;
+const int MAX_NESTING    = 100;   // groups in groups, or quantifiers on quantifiers
+const int UNBOUNDED      = -1;
+
+typedef std::bitset<256> ByteSet;
+
+inline unsigned char fold(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+/* icase only folds ASCII, which is what std::regex does under the classic locale */
+ByteSet case_closed(ByteSet set)
+{
+    for (int c = 'a'; c <= 'z'; c++)
+    {
+        if (set[c] || set[c - 'a' + 'A'])
+        {
+            set[c] = set[c - 'a' + 'A'] = true;
+        }
+    }
+
+    return set;
+}
+
+ByteSet any_but_line_terminators()
+{
+    ByteSet set;
+    set.set();
+    set['\n'] = set['\r'] = false;
+
+    return set;
+}
+
+/* \d \w \s and their negations, 0 if 'letter' isn't one of them */
+bool class_escape(char letter, ByteSet& set)
+{
+    ByteSet base;
+
+    switch (fold(letter))
+    {
+        case 'd':
+            for (int c = '0'; c <= '9'; c++) base[c] = true;
+            break;
+        case 'w':
+            for (int c = '0'; c <= '9'; c++) base[c] = true;
+            for (int c = 'a'; c <= 'z'; c++) base[c] = base[c - 'a' + 'A'] = true;
+            base['_'] = true;
+            break;
+        case 's':
+            for (const char* c = " \t\n\v\f\r"; *c; c++) base[(unsigned char) *c] = true;
+            break;
+        default:
+            return false;
+    }
+
+    set = (letter >= 'A' && letter <= 'Z') ? ~base : base;
+
+    return true;
+}
+
+int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+
+    throw unsupported_pattern();
+}
+
+/* Regex syntax tree, nodes refer to each other by index */
+struct Node {
+    enum Kind { Set, Concat, Alternation, Repeat, Empty } kind;
+    ByteSet             set;
+    std::vector<int>    children;
+    int                 min, max;
+};
+
+/*
+Recursive descent parser for the subset of ECMAScript the DFA supports. Anything outside of it
+raises unsupported_pattern; that includes invalid patterns, which are then left to std::regex
+to report.
+*/
+class PatternParser
+{
+    public:
+        PatternParser(const std::string& pattern, std::vector<Node>& nodes) : m_pattern(pattern), m_position(0), m_nodes(nodes) {}
+
+        int parse()
+        {
+            refuse_deep_nesting();
+
+            // ^ and $ are no-ops for a full match as long as they're at the very ends of the pattern
+            if (! m_pattern.empty() && m_pattern[0] == '^') m_position++;
+
+            int root = parse_alternation();
+
+            if (m_position < m_pattern.size() && m_pattern[m_position] == '$' && m_position + 1 == m_pattern.size()) m_position++;
+
+            if (m_position != m_pattern.size()) throw unsupported_pattern();
+
+            return root;
+        }
+
+    private:
+        /*
+        Parsing a pattern, building its NFA and compiling it with std::regex all recurse once per
+        nesting level, and the daemon takes patterns from its clients: one nested deeper than
+        MAX_NESTING throws std::regex_error rather than overflowing the stack. It's scanned for
+        before parsing, which may give up on some other feature first and leave it to std::regex.
+        */
+        void refuse_deep_nesting() const
+        {
+            int     groups = 0, quantifiers = 0;
+            bool    in_class = false, in_braces = false;
+
+            for (std::size_t i = 0; i < m_pattern.size(); i++)
+            {
+                char c = m_pattern[i];
+
+                if (c == '\\') { i++; quantifiers = 0; continue; }
+                if (in_class) { in_class = c != ']'; continue; }
+                if (in_braces) { in_braces = c != '}'; continue; }
+
+                switch (c)
+                {
+                    case '(': groups++; quantifiers = 0; break;
+                    case ')': groups = std::max(groups - 1, 0); quantifiers = 0; break;
+                    case '[': in_class = true; quantifiers = 0; break;
+                    case '{': in_braces = true; quantifiers++; break;
+                    case '*': case '+': case '?': quantifiers++; break;
+                    default:  quantifiers = 0;
+                }
+
+                if (groups > MAX_NESTING || quantifiers > MAX_NESTING) throw std::regex_error(std::regex_constants::error_complexity);
+            }
+        }
+
+        bool at_end() const { return m_position >= m_pattern.size(); }
+        char peek() const { return m_pattern[m_position]; }
+
+        int add(const Node& node)
+        {
+            m_nodes.push_back(node);
+            return m_nodes.size() - 1;
+        }
+
+        int add_set(const ByteSet& set)
+        {
+            Node node = {Node::Set, case_closed(set), {}, 0, 0};
+            return add(node);
+        }
+
+        int parse_alternation()
+        {
+            Node alternation = {Node::Alternation, ByteSet(), {parse_concatenation()}, 0, 0};
+
+            while (! at_end() && peek() == '|')
+            {
+                m_position++;
+                alternation.children.push_back(parse_concatenation());
+            }
+
+            return alternation.children.size() == 1 ? alternation.children[0] : add(alternation);
+        }
+
+        int parse_concatenation()
+        {
+            Node concatenation = {Node::Concat, ByteSet(), {}, 0, 0};
+
+            while (! at_end() && peek() != '|' && peek() != ')')
+            {
+                if (peek() == '$' && m_position + 1 == m_pattern.size()) break; // trailing anchor, handled by parse()
+
+                concatenation.children.push_back(parse_repeat());
+            }
+
+            if (concatenation.children.empty())
+            {
+                Node empty = {Node::Empty, ByteSet(), {}, 0, 0};
+                return add(empty);
+            }
+
+            return concatenation.children.size() == 1 ? concatenation.children[0] : add(concatenation);
+        }
+
+        int parse_repeat()
+        {
+            int atom = parse_atom();
+
+            while (! at_end())
+            {
+                int min, max;
+
+                switch (peek())
+                {
+                    case '*': min = 0; max = UNBOUNDED; m_position++; break;
+                    case '+': min = 1; max = UNBOUNDED; m_position++; break;
+                    case '?': min = 0; max = 1;         m_position++; break;
+                    case '{': parse_braces(min, max); break;
+                    default:  return atom;
+                }
+
+                if (! at_end() && peek() == '?') m_position++; // lazy quantifiers match the same set of strings
+
+                Node repeat = {Node::Repeat, ByteSet(), {atom}, min, max};
+                atom = add(repeat);
+            }
+
+            return atom;
+        }
+
+        void parse_braces(int& min, int& max)
+        {
+            m_position++; // {
+            min = parse_number();
+            max = min;
+
+            if (! at_end() && peek() == ',')
+            {
+                m_position++;
+                max = (! at_end() && peek() == '}') ? UNBOUNDED : parse_number();
+            }
+
+            if (at_end() || peek() != '}' || (max != UNBOUNDED && max < min)) throw unsupported_pattern();
+
+            m_position++;
+        }
+
+        int parse_number()
+        {
+            int value = 0, digits = 0;
+
+            while (! at_end() && peek() >= '0' && peek() <= '9' && digits < 4)
+            {
+                value = value * 10 + (peek() - '0');
+                m_position++;
+                digits++;
+            }
+
+            if (digits == 0 || (! at_end() && peek() >= '0' && peek() <= '9')) throw unsupported_pattern();
+
+            return value;
+        }
+
+        int parse_atom()
+        {
+            char c = peek();
+
+            switch (c)
+            {
+                case '(':
+                {
+                    m_position++;
+
+                    if (! at_end() && peek() == '?') // only non capturing groups, no lookaheads
+                    {
+                        if (m_position + 1 >= m_pattern.size() || m_pattern[m_position + 1] != ':') throw unsupported_pattern();
+                        m_position += 2;
+                    }
+
+                    int group = parse_alternation();
+
+                    if (at_end() || peek() != ')') throw unsupported_pattern();
+
+                    m_position++;
+                    return group;
+                }
+                case '[':
+                    return add_set(parse_class());
+                case '.':
+                    m_position++;
+                    return add_set(any_but_line_terminators());
+                case '\\':
+                    m_position++;
+                    return add_set(parse_escape(false));
+                case '^': case '$': case ')': case ']': case '{': case '}':
+                case '*': case '+': case '?': case '|':
+                    throw unsupported_pattern();
+                default:
+                {
+                    ByteSet set;
+                    set[(unsigned char) c] = true;
+                    m_position++;
+                    return add_set(set);
+                }
+            }
+        }
+
+        /* Parses the escape following a '\', returns the set it stands for */
+        ByteSet parse_escape(bool in_class)
+        {
+            if (at_end()) throw unsupported_pattern();
+
+            char    c = m_pattern[m_position++];
+            ByteSet set;
+
+            if (class_escape(c, set)) return set;
+
+            switch (c)
+            {
+                case 't': set['\t'] = true; return set;
+                case 'n': set['\n'] = true; return set;
+                case 'r': set['\r'] = true; return set;
+                case 'f': set['\f'] = true; return set;
+                case 'v': set['\v'] = true; return set;
+                case '0': set[0]    = true; return set;
+                case 'x':
+                case 'u':
+                {
+                    int digits = c == 'x' ? 2 : 4, value = 0;
+
+                    if (m_position + digits > m_pattern.size()) throw unsupported_pattern();
+
+                    for (int i = 0; i < digits; i++) value = value * 16 + hex_value(m_pattern[m_position++]);
+
+                    if (value > 0xFF || (c == 'u' && value > 0x7F)) throw unsupported_pattern(); // no multi byte code points
+
+                    set[value] = true;
+                    return set;
+                }
+                case 'b':
+                    if (in_class)
+                    {
+                        set['\b'] = true;
+                        return set;
+                    }
+
+                    throw unsupported_pattern(); // word boundary
+            }
+
+            // escaped punctuation is a literal, letters and digits are back references, \B, \c...
+            if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || (unsigned char) c >= 0x80) throw unsupported_pattern();
+
+            set[(unsigned char) c] = true;
+
+            return set;
+        }
+
+        ByteSet parse_class()
+        {
+            ByteSet set;
+            bool    negated = false;
+
+            m_position++; // [
+
+            if (! at_end() && peek() == '^')
+            {
+                negated = true;
+                m_position++;
+            }
+
+            for (;;)
+            {
+                if (at_end()) throw unsupported_pattern();
+
+                char c = peek();
+
+                if (c == ']') break; // in ECMAScript [] is an empty class, not a literal ]
+
+                if (c == '[' && m_position + 1 < m_pattern.size() && std::strchr(":=.", m_pattern[m_position + 1])) throw unsupported_pattern(); // [:alpha:] and friends
+
+                ByteSet low_set;
+                int     low = class_atom(low_set);
+
+                if (low >= 0 && m_position + 1 < m_pattern.size() && peek() == '-' && m_pattern[m_position + 1] != ']')
+                {
+                    m_position++; // -
+
+                    ByteSet high_set;
+                    int     high = class_atom(high_set);
+
+                    if (high < 0 || high < low) throw unsupported_pattern();
+
+                    for (int b = low; b <= high; b++) set[b] = true;
+
+                    continue;
+                }
+
+                set |= low_set;
+            }
+
+            m_position++; // ]
+
+            set = case_closed(set); // icase applies before the negation
+
+            return negated ? ~set : set;
+        }
+
+        /* One class member, returns its byte value if it's a single character or -1 for \d and friends */
+        int class_atom(ByteSet& set)
+        {
+            char c = m_pattern[m_position++];
+
+            if (c != '\\')
+            {
+                set[(unsigned char) c] = true;
+                return (unsigned char) c;
+            }
+
+            set = parse_escape(true);
+
+            return set.count() == 1 ? first_member(set) : -1;
+        }
+
+        static int first_member(const ByteSet& set)
+        {
+            for (int b = 0; b < 256; b++) if (set[b]) return b;
+
+            return -1;
+        }
+
+        const std::string&  m_pattern;
+        std::size_t         m_position;
+        std::vector<Node>&  m_nodes;
+};
+
+/* Thompson NFA built from the syntax tree */
+struct NfaState {
+    enum Kind { Set, Split, Match } kind;
+    int     set;        // index into Nfa::sets, for a Match the pattern's index in a PatternSet
+    int     out, out1;  // -1 when not connected
+};
+
+struct Nfa {
+    std::vector<NfaState>   states;
+    std::vector<ByteSet>    sets;
+};
+
+/* A partially built NFA: its entry state and the dangling (state, out slot) pairs to patch */
+struct Fragment {
+    int                                 start;
+    std::vector<std::pair<int, int> >   outs;
+};
+
+class NfaBuilder
+{
+    public:
+        NfaBuilder(const std::vector<Node>& nodes, Nfa& nfa) : m_nodes(nodes), m_nfa(nfa) {}
+
+        int build(int root, int pattern = 0)
+        {
+            Fragment fragment = build_node(root);
+            int      match    = add_state({NfaState::Match, pattern, -1, -1});
+
+            patch(fragment, match);
+
+            return fragment.start;
+        }
+
+    private:
+        int add_state(const NfaState& state)
+        {
+            if ((int) m_nfa.states.size() >= MAX_NFA_STATES) throw unsupported_pattern();
+
+            m_nfa.states.push_back(state);
+            return m_nfa.states.size() - 1;
+        }
+
+        void patch(const Fragment& fragment, int target)
+        {
+            for (auto& out : fragment.outs)
+            {
+                (out.second == 0 ? m_nfa.states[out.first].out : m_nfa.states[out.first].out1) = target;
+            }
+        }
+
+        Fragment empty_fragment()
+        {
+            int split = add_state({NfaState::Split, -1, -1, -1}); // a Split with a single exit is an epsilon move
+            return {split, {{split, 0}}};
+        }
+
+        Fragment build_node(int index)
+        {
+            const Node& node = m_nodes[index];
+
+            switch (node.kind)
+            {
+                case Node::Set:
+                {
+                    m_nfa.sets.push_back(node.set);
+
+                    int state = add_state({NfaState::Set, (int) m_nfa.sets.size() - 1, -1, -1});
+                    return {state, {{state, 0}}};
+                }
+                case Node::Empty:
+                    return empty_fragment();
+                case Node::Concat:
+                {
+                    Fragment result = build_node(node.children[0]);
+
+                    for (std::size_t i = 1; i < node.children.size(); i++)
+                    {
+                        Fragment next = build_node(node.children[i]);
+                        patch(result, next.start);
+                        result.outs = next.outs;
+                    }
+
+                    return result;
+                }
+                case Node::Alternation:
+                {
+                    Fragment result = build_node(node.children[0]);
+
+                    for (std::size_t i = 1; i < node.children.size(); i++)
+                    {
+                        Fragment next  = build_node(node.children[i]);
+                        int      split = add_state({NfaState::Split, -1, result.start, next.start});
+
+                        result.start = split;
+                        result.outs.insert(result.outs.end(), next.outs.begin(), next.outs.end());
+                    }
+
+                    return result;
+                }
+                case Node::Repeat:
+                    return build_repeat(node);
+            }
+
+            throw unsupported_pattern();
+        }
+
+        Fragment build_repeat(const Node& node)
+        {
+            Fragment result  = empty_fragment();
+
+            for (int i = 0; i < node.min; i++)
+            {
+                Fragment copy = build_node(node.children[0]);
+                patch(result, copy.start);
+                result.outs = copy.outs;
+            }
+
+            if (node.max == UNBOUNDED)
+            {
+                Fragment body  = build_node(node.children[0]);
+                int      split = add_state({NfaState::Split, -1, body.start, -1});
+
+                patch(body, split);
+                patch(result, split);
+                result.outs = {{split, 1}};
+            }
+            else
+            {
+                for (int i = node.min; i < node.max; i++)
+                {
+                    Fragment optional = build_node(node.children[0]);
+                    int      split    = add_state({NfaState::Split, -1, optional.start, -1});
+
+                    patch(result, split);
+                    result.outs = optional.outs;
+                    result.outs.push_back({split, 1});
+                }
+            }
+
+            return result;
+        }
+
+        const std::vector<Node>&    m_nodes;
+        Nfa&                        m_nfa;
+};
+
+/*
+Replaces 'closure' with the sorted Set/Match states reachable from the states on 'stack' through
+epsilon moves. Iterative, 'visited' must be all zeroes and is left that way.
+*/
+void epsilon_closure(const Nfa& nfa, std::vector<int>& stack, std::vector<char>& visited, std::vector<int>& closure)
+{
+    std::vector<int> seen;
+
+    closure.clear();
+
+    while (! stack.empty())
+    {
+        int state = stack.back();
+        stack.pop_back();
+
+        if (state < 0 || visited[state]) continue;
+
+        visited[state] = 1;
+        seen.push_back(state);
+
+        const NfaState& nfa_state = nfa.states[state];
+
+        if (nfa_state.kind == NfaState::Split)
+        {
+            stack.push_back(nfa_state.out1);
+            stack.push_back(nfa_state.out);
+        }
+        else
+        {
+            closure.push_back(state);
+        }
+    }
+
+    std::sort(closure.begin(), closure.end());
+
+    for (int state : seen) visited[state] = 0;
+}
+
+/*
+Subset construction over byte equivalence classes: bytes no set tells apart share a column of
+the transition table. 'accept' gives what a DFA state made of the given NFA states accepts, -1
+for nothing. Raises unsupported_pattern past MAX_DFA_STATES.
+*/
+void build_dfa(const Nfa& nfa,
+               int start,
+               const std::function<int(const std::vector<int>&)>& accept,
+               std::uint8_t byte_class[256],
+               int& class_count,
+               std::vector<std::int32_t>& transitions,
+               std::vector<std::int32_t>& accepting)
+{
+    std::map<std::vector<bool>, int> signatures;
+
+    for (int b = 0; b < 256; b++)
+    {
+        std::vector<bool> signature(nfa.sets.size());
+
+        for (std::size_t s = 0; s < nfa.sets.size(); s++) signature[s] = nfa.sets[s][b];
+
+        auto inserted = signatures.insert({signature, (int) signatures.size()});
+        byte_class[b] = inserted.first->second;
+    }
+
+    class_count = signatures.size();
+
+    std::map<std::vector<int>, int>     dfa_states;
+    std::vector<std::vector<int> >      pending;
+    std::vector<int>                    stack(1, start), closure;
+    std::vector<char>                   visited(nfa.states.size(), 0);
+
+    epsilon_closure(nfa, stack, visited, closure);
+    dfa_states[closure] = 0;
+    pending.push_back(closure);
+    transitions.assign(class_count, -1);
+    accepting.clear();
+
+    for (std::size_t current = 0; current < pending.size(); current++)
+    {
+        std::vector<int> members = pending[current];
+
+        accepting.push_back(accept(members));
+
+        for (int byte_class_index = 0; byte_class_index < class_count; byte_class_index++)
+        {
+            int representative = 0;
+
+            while (byte_class[representative] != byte_class_index) representative++;
+
+            for (int state : members)
+            {
+                const NfaState& nfa_state = nfa.states[state];
+
+                if (nfa_state.kind == NfaState::Set && nfa.sets[nfa_state.set][representative])
+                {
+                    stack.push_back(nfa_state.out);
+                }
+            }
+
+            epsilon_closure(nfa, stack, visited, closure);
+
+            if (closure.empty()) continue; // dead state
+
+            auto found = dfa_states.find(closure);
+            int  target;
+
+            if (found == dfa_states.end())
+            {
+                if ((int) pending.size() >= MAX_DFA_STATES) throw unsupported_pattern();
+
+                target = pending.size();
+                dfa_states[closure] = target;
+                pending.push_back(closure);
+                transitions.resize(transitions.size() + class_count, -1);
+            }
+            else
+            {
+                target = found->second;
+            }
+
+            transitions[current * class_count + byte_class_index] = target;
+        }
+    }
+}
+
+/* How specific a pattern is: the number of single characters it spells out, wildcards and classes don't count */
+int literal_count(const std::vector<Node>& nodes)
+{
+    int count = 0;
+
+    for (const Node& node : nodes)
+    {
+        if (node.kind != Node::Set) continue;
+
+        if (node.set.count() == 1)
+        {
+            count++;
+        }
+        else if (node.set.count() == 2)
+        {
+            for (int c = 'a'; c <= 'z'; c++)
+            {
+                if (node.set[c] && node.set[c - 'a' + 'A']) { count++; break; } // a letter, case insensitively
+            }
+        }
+    }
+
+    return count;
+}
+
+} // namespace
+
+
+MetricFilter::MetricFilter(const std::string& pattern)
+    : m_strategy(Strategy::Dfa), m_anchored_start(true), m_anchored_end(true), m_class_count(0), m_prunes_prefixes(false)
+{
+    try
+    {
+        compile_dfa(pattern);
+    }
+    catch (const unsupported_pattern&)
+    {
+        m_strategy = Strategy::Regex;
+        m_regex.reset(new std::regex(pattern, std::regex::ECMAScript|std::regex::icase)); // invalid patterns throw here
+
+        return;
+    }
+
+    // the DFA is kept for names containing line terminators, which '.' doesn't match
+    if (compile_glob(pattern))
+    {
+        m_strategy = (m_segments.empty() && ! m_anchored_start) ? Strategy::MatchAll : Strategy::Glob;
+    }
+}
+
+const char* MetricFilter::strategy_name() const
+{
+    switch (m_strategy)
+    {
+        case Strategy::MatchAll:    return "match all";
+        case Strategy::Glob:        return "glob";
+        case Strategy::Dfa:         return "DFA";
+        case Strategy::Regex:       return "std::regex";
+    }
+
+    return "";
+}
+
+bool MetricFilter::matches(const char* begin, const char* end) const
+{
+    switch (m_strategy)
+    {
+        case Strategy::MatchAll:
+        case Strategy::Glob:
+            if (std::memchr(begin, '\n', end - begin) || std::memchr(begin, '\r', end - begin))
+            {
+                return matches_dfa(begin, end);
+            }
+
+            return m_strategy == Strategy::MatchAll || matches_glob(begin, end);
+        case Strategy::Dfa:
+            return matches_dfa(begin, end);
+        case Strategy::Regex:
+            return std::regex_match(begin, end, *m_regex);
+    }
+
+    return false;
+}
+
+/* Accepts patterns made only of literals and ".*" gaps */
+bool MetricFilter::compile_glob(const std::string& pattern)
+{
+    std::string literal;
+    bool        gap_before = false;
+
+    m_segments.clear();
+    m_anchored_start = true;
+    m_anchored_end   = true;
+
+    for (std::size_t i = 0; i < pattern.size(); i++)
+    {
+        char c = pattern[i];
+
+        if (c == '.' && i + 1 < pattern.size() && pattern[i + 1] == '*')
+        {
+            if (i + 2 < pattern.size() && std::strchr("*+?{", pattern[i + 2])) return false;
+
+            if (literal.empty() && m_segments.empty() && ! gap_before)
+            {
+                m_anchored_start = false;
+            }
+            else if (! literal.empty())
+            {
+                m_segments.push_back({literal, {}});
+                literal.clear();
+            }
+
+            gap_before = true;
+            i++;
+            continue;
+        }
+
+        if (c == '\\')
+        {
+            if (i + 1 >= pattern.size()) return false;
+
+            c = pattern[++i];
+
+            if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || (unsigned char) c >= 0x80) return false;
+        }
+        else if (std::strchr("^$.|?*+()[]{}", c))
+        {
+            return false;
+        }
+
+        // a quantifier would apply to this character only
+        if (i + 1 < pattern.size() && std::strchr("*+?{", pattern[i + 1])) return false;
+
+        literal += fold(c);
+        gap_before = false;
+    }
+
+    if (! literal.empty())
+    {
+        m_segments.push_back({literal, {}});
+    }
+
+    m_anchored_end = ! gap_before;
+
+    if (! m_anchored_start && m_segments.empty()) return true; // .* or .*.*
+
+    if (m_segments.empty()) return false; // empty pattern, leave it to the DFA
+
+    for (GlobSegment& segment : m_segments)
+    {
+        const std::string& s = segment.literal;
+        segment.failure.assign(s.size(), 0);
+
+        for (std::size_t i = 1, k = 0; i < s.size(); i++)
+        {
+            while (k > 0 && s[i] != s[k]) k = segment.failure[k - 1];
+            if (s[i] == s[k]) k++;
+            segment.failure[i] = k;
+        }
+    }
+
+    return true;
+}
+
+bool MetricFilter::matches_glob(const char* begin, const char* end) const
+{
+    const char* position = begin;
+    std::size_t first    = 0;
+    std::size_t last     = m_segments.size();
+
+    if (m_anchored_start)
+    {
+        const std::string& prefix = m_segments[0].literal;
+
+        if ((std::size_t) (end - begin) < prefix.size()) return false;
+
+        for (std::size_t i = 0; i < prefix.size(); i++)
+        {
+            if (fold(begin[i]) != (unsigned char) prefix[i]) return false;
+        }
+
+        position += prefix.size();
+        first = 1;
+
+        if (m_segments.size() == 1 && m_anchored_end) return position == end;
+    }
+
+    if (m_anchored_end && last > first)
+    {
+        const std::string& suffix = m_segments[last - 1].literal;
+
+        if ((std::size_t) (end - position) < suffix.size()) return false;
+
+        for (std::size_t i = 0; i < suffix.size(); i++)
+        {
+            if (fold(end[i - suffix.size()]) != (unsigned char) suffix[i]) return false;
+        }
+
+        end -= suffix.size();
+        last--;
+    }
+
+    // the remaining segments are floating, the leftmost occurrence of each is always the best choice
+    for (std::size_t index = first; index < last; index++)
+    {
+        const GlobSegment&  segment = m_segments[index];
+        const std::string&  s       = segment.literal;
+        std::size_t         k       = 0;
+
+        for (; position != end && k < s.size(); position++)
+        {
+            unsigned char c = fold(*position);
+
+            while (k > 0 && c != (unsigned char) s[k]) k = segment.failure[k - 1];
+            if (c == (unsigned char) s[k]) k++;
+        }
+
+        if (k < s.size()) return false;
+    }
+
+    return true;
+}
+
+void MetricFilter::compile_dfa(const std::string& pattern)
+{
+    std::vector<Node>           nodes;
+    Nfa                         nfa;
+    int                         root  = PatternParser(pattern, nodes).parse();
+    int                         start = NfaBuilder(nodes, nfa).build(root);
+    std::vector<std::int32_t>   accepting;
+
+    build_dfa(nfa, start, [&](const std::vector<int>& members)
+    {
+        for (int state : members)
+        {
+            if (nfa.states[state].kind == NfaState::Match) return 0;
+        }
+
+        return -1;
+    }, m_byte_class, m_class_count, m_transitions, accepting);
+
+    m_accepting.assign(accepting.size(), false);
+
+    for (std::size_t state = 0; state < accepting.size(); state++) m_accepting[state] = accepting[state] >= 0;
+
+    m_prunes_prefixes = std::find(m_transitions.begin(), m_transitions.end(), -1) != m_transitions.end();
+}
+
+bool MetricFilter::matches_dfa(const char* begin, const char* end) const
+{
+    std::int32_t state = 0;
+
+    for (const char* it = begin; it != end; it++)
+    {
+        state = m_transitions[state * m_class_count + m_byte_class[(unsigned char) *it]];
+
+        if (state < 0) return false; // nothing can match anymore
+    }
+
+    return m_accepting[state];
+}
+
+std::size_t MetricFilter::dead_prefix(const char* begin, const char* end) const
+{
+    if (! m_prunes_prefixes) return 0;
+
+    std::int32_t state = 0;
+
+    for (const char* it = begin; it != end; it++)
+    {
+        state = m_transitions[state * m_class_count + m_byte_class[(unsigned char) *it]];
+
+        if (state < 0) return it - begin + 1;
+    }
+
+    return 0;
+}
+
+PatternSet::PatternSet(const std::vector<std::string>& patterns, Priority priority) throw (std::invalid_argument, std::regex_error)
+    : m_class_count(0)
+{
+    Nfa                 nfa;
+    std::vector<int>    specificity;
+    std::size_t         index = 0;
+
+    try
+    {
+        std::vector<int> starts;
+
+        for (index = 0; index < patterns.size(); index++)
+        {
+            std::vector<Node> nodes;
+
+            int root = PatternParser(patterns[index], nodes).parse();
+
+            starts.push_back(NfaBuilder(nodes, nfa).build(root, index));
+            specificity.push_back(literal_count(nodes));
+        }
+
+        // one entry state branching into every pattern
+        int start = starts.empty() ? -1 : starts[0];
+
+        for (std::size_t i = 1; i < starts.size(); i++)
+        {
+            nfa.states.push_back({NfaState::Split, -1, start, starts[i]});
+            start = nfa.states.size() - 1;
+        }
+
+        if (start == -1)
+        {
+            nfa.states.push_back({NfaState::Split, -1, -1, -1}); // no patterns, nothing matches
+            start = 0;
+        }
+
+        build_dfa(nfa, start, [&](const std::vector<int>& members)
+        {
+            int winner = -1;
+
+            for (int state : members)
+            {
+                if (nfa.states[state].kind != NfaState::Match) continue;
+
+                int pattern = nfa.states[state].set;
+
+                if (winner == -1 ||
+                    (priority == Priority::First && pattern < winner) ||
+                    (priority == Priority::MostSpecific && (specificity[pattern] > specificity[winner] || (specificity[pattern] == specificity[winner] && pattern < winner))))
+                {
+                    winner = pattern;
+                }
+            }
+
+            return winner;
+        }, m_byte_class, m_class_count, m_transitions, m_accepting);
+    }
+    catch (const unsupported_pattern&)
+    {
+        if (index < patterns.size())
+        {
+            std::regex validate(patterns[index], std::regex::ECMAScript|std::regex::icase); // invalid patterns throw here
+
+            throw std::invalid_argument("The pattern '" + patterns[index] + "' uses features only std::regex supports, it can't be part of a combined pattern set.");
+        }
+
+        throw std::invalid_argument("The patterns are too many or too complex to be combined into a single DFA.");
+    }
+}
+
+int PatternSet::match(const char* begin, const char* end) const
+{
+    std::int32_t state = 0;
+
+    for (const char* it = begin; it != end; it++)
+    {
+        state = m_transitions[state * m_class_count + m_byte_class[(unsigned char) *it]];
+
+        if (state < 0) return -1; // no pattern can match anymore
+    }
+
+    return m_accepting[state];
+}
@@ -0,0 +1,115 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - metric name filter (-f)
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_METRIC_FILTER_HPP
+#define CHECK_GLUSTER_PERF_METRIC_FILTER_HPP
+
+#include <string>
+#include <vector>
+#include <regex>
+#include <memory>
+#include <stdexcept>
+#include <cstdint>
+
+/*
+Full match, case insensitive metric name filter with ECMAScript regex semantics.
+
+The pattern is compiled once, into the cheapest matcher able to represent it:
+
+    MatchAll    - ".*"
+    Glob        - literals joined by ".*", eg ".*usec" or ".*aggr.*latency_ave.*"; each literal
+                  is found with a precomputed KMP table
+    Dfa         - everything else made of literals, classes, '.', groups, alternations and
+                  quantifiers; compiled to a DFA over byte equivalence classes
+    Regex       - patterns using features a DFA can't express (back references, lookaheads,
+                  word boundaries...) or blowing the DFA size limits fall back to std::regex
+
+All but the last one match in linear time without recursion. Invalid patterns throw
+std::regex_error, the same way constructing the std::regex did. So do patterns nesting groups,
+or stacking quantifiers, more than 100 levels deep, which std::regex overflows the stack on.
+*/
+class MetricFilter
+{
+    public:
+        enum class Strategy { MatchAll, Glob, Dfa, Regex };
+
+        explicit MetricFilter(const std::string& pattern);
+
+        bool        matches(const char* begin, const char* end) const;
+        bool        matches(const std::string& name) const { return matches(name.data(), name.data() + name.size()); }
+
+        /*
+        The length of the shortest prefix of the name no name starting with can match, 0 if there's
+        none. Only the DFA finds them, with the std::regex fallback nothing is ever ruled out.
+        */
+        std::size_t dead_prefix(const char* begin, const char* end) const;
+        bool        prunes_prefixes() const { return m_prunes_prefixes; } // false if dead_prefix always is 0
+
+        Strategy    strategy() const { return m_strategy; }
+        const char* strategy_name() const;
+
+    private:
+        struct GlobSegment {
+            std::string         literal;    // lower case
+            std::vector<int>    failure;    // KMP failure table
+        };
+
+        bool        compile_glob(const std::string& pattern);
+        void        compile_dfa(const std::string& pattern);
+        bool        matches_glob(const char* begin, const char* end) const;
+        bool        matches_dfa(const char* begin, const char* end) const;
+
+        Strategy                    m_strategy;
+
+        // Glob
+        bool                        m_anchored_start;   // the pattern doesn't start with .*
+        bool                        m_anchored_end;     // the pattern doesn't end with .*
+        std::vector<GlobSegment>    m_segments;
+
+        // Dfa, row 'state' of m_transitions has m_class_count entries, -1 is the dead state
+        std::uint8_t                m_byte_class[256];
+        int                         m_class_count;
+        std::vector<std::int32_t>   m_transitions;
+        std::vector<bool>           m_accepting;
+        bool                        m_prunes_prefixes;  // the DFA has a transition to the dead state
+
+        // Regex
+        std::unique_ptr<std::regex> m_regex;
+};
+
+/*
+Several patterns, with the syntax and matching of MetricFilter, compiled into a single DFA: the
+pattern a name matches is found in one pass over the name, however many patterns there are.
+Every DFA state knows which pattern it accepts with, chosen among those matching:
+
+    First           - the first one in the list
+    MostSpecific    - the one spelling out the most characters (".*aggr.*WRITE.*" over ".*WRITE.*"),
+                      the first one of those on a tie
+
+Patterns that only std::regex supports, or too many patterns for the DFA size limits, throw
+std::invalid_argument. Invalid and too deeply nested patterns throw std::regex_error.
+*/
+class PatternSet
+{
+    public:
+        enum class Priority { First, MostSpecific };
+
+        PatternSet(const std::vector<std::string>& patterns, Priority priority) throw (std::invalid_argument, std::regex_error);
+
+        /* The index of the matching pattern, -1 if none matches */
+        int         match(const char* begin, const char* end) const;
+
+        std::size_t state_count() const { return m_accepting.size(); }
+
+    private:
+        std::uint8_t                m_byte_class[256];
+        int                         m_class_count;
+        std::vector<std::int32_t>   m_transitions;
+        std::vector<std::int32_t>   m_accepting; // the pattern accepted in each state, -1 for none
+};
+
+#endif
@@ -0,0 +1,272 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - structured metric names and group aggregates
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "metric_groups.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <cstring>
+
+static std::uint32_t hash_bytes(const char* begin, const char* end)
+{
+    std::uint32_t hash = 2166136261u; // FNV-1a
+
+    for (; begin != end; begin++)
+    {
+        hash = (hash ^ (unsigned char) *begin) * 16777619u;
+    }
+
+    return hash;
+}
+
+static bool equals(const DumpView& view, const char* text)
+{
+    std::size_t length = std::strlen(text);
+
+    return view.size() == length && std::memcmp(view.begin, text, length) == 0;
+}
+
+NameInterner::NameInterner()
+    : m_slots(64, 0)
+{
+    m_spans.push_back({0, 0}); // ID 0, the empty string
+    m_hashes.push_back(0);
+}
+
+void NameInterner::reserve(std::size_t names, std::size_t bytes)
+{
+    std::size_t slots = m_slots.size();
+
+    while ((names + 1) * 2 > slots) slots *= 2;
+
+    m_names.reserve(bytes);
+    m_spans.reserve(names + 1);
+    m_hashes.reserve(names + 1);
+
+    if (slots != m_slots.size()) grow(slots);
+}
+
+std::uint32_t NameInterner::hash(const DumpView& name)
+{
+    return hash_bytes(name.begin, name.end);
+}
+
+void NameInterner::grow(std::size_t size)
+{
+    std::vector<std::uint32_t> slots(size, 0);
+
+    for (std::uint32_t id = 1; id < m_spans.size(); id++)
+    {
+        std::size_t slot = m_hashes[id] & (slots.size() - 1);
+
+        while (slots[slot] != 0) slot = (slot + 1) & (slots.size() - 1);
+
+        slots[slot] = id + 1;
+    }
+
+    m_slots.swap(slots);
+}
+
+std::uint32_t NameInterner::intern(const DumpView& text, std::uint32_t hash)
+{
+    if (text.size() == 0) return 0;
+
+    std::size_t slot = hash & (m_slots.size() - 1);
+
+    for (; m_slots[slot] != 0; slot = (slot + 1) & (m_slots.size() - 1))
+    {
+        DumpView candidate = name(m_slots[slot] - 1);
+
+        if (m_hashes[m_slots[slot] - 1] == hash && candidate.size() == text.size() && std::memcmp(candidate.begin, text.begin, text.size()) == 0)
+        {
+            return m_slots[slot] - 1;
+        }
+    }
+
+    std::uint32_t id = m_spans.size();
+
+    m_spans.push_back({(std::uint32_t) m_names.size(), (std::uint32_t) text.size()});
+    m_hashes.push_back(hash);
+    m_names.append(text.begin, text.end);
+    m_slots[slot] = id + 1;
+
+    if (m_spans.size() * 2 > m_slots.size()) grow(m_slots.size() * 2); // keeps probe sequences short
+
+    return id;
+}
+
+MetricKey parse_metric_key(const DumpView& name, NameInterner& interner)
+{
+    static const char* const time_units[] = {"usec", "msec", "sec", "us", "ms", "s"};
+
+    MetricKey   key = {0, 0, 0, 0};
+    DumpView    previous = {name.begin, name.begin};
+    const char* position = name.begin;
+
+    while (position <= name.end)
+    {
+        const char* dot       = static_cast<const char*>(std::memchr(position, '.', name.end - position));
+        DumpView    component = {position, dot ? dot : name.end};
+
+        if (dot == nullptr)
+        {
+            // the last component is the stat, possibly followed by a time unit: latency_ave_usec
+            const char* underscore = component.end;
+
+            while (underscore != component.begin && *(underscore - 1) != '_') underscore--;
+
+            if (underscore != component.begin)
+            {
+                DumpView suffix = {underscore, component.end};
+
+                for (const char* unit : time_units)
+                {
+                    if (equals(suffix, unit))
+                    {
+                        key.unit       = interner.intern(suffix);
+                        component.end  = underscore - 1;
+                        break;
+                    }
+                }
+            }
+
+            key.stat = interner.intern(component);
+            break;
+        }
+
+        if (equals(component, "aggr") || equals(component, "inter"))
+        {
+            key.scope = interner.intern(component);
+        }
+        else if (equals(previous, "fop"))
+        {
+            key.fop = interner.intern(component);
+        }
+
+        previous = component;
+        position = dot + 1;
+    }
+
+    return key;
+}
+
+unsigned parse_group_by(const std::string& components) throw (std::invalid_argument)
+{
+    std::istringstream  list(components);
+    std::string         component;
+    unsigned            group_by = 0;
+
+    while (std::getline(list, component, ','))
+    {
+        if (component == "scope")       group_by |= GroupByScope;
+        else if (component == "fop")    group_by |= GroupByFop;
+        else if (component == "stat")   group_by |= GroupByStat;
+        else if (component != "")
+        {
+            throw std::invalid_argument("Invalid -group-by part '" + component + "'. Expected a comma separated list of: scope fop stat");
+        }
+    }
+
+    return group_by;
+}
+
+MetricGroups::MetricGroups(unsigned group_by, GroupTarget target)
+    : m_group_by(group_by),
+      m_target(target)
+{
+}
+
+void MetricGroups::add(const DumpView& name, const Metric& value)
+{
+    MetricKey key = parse_metric_key(name, m_interner);
+
+    // only the selected parts tell groups apart, a metric missing one of them isn't in any group
+    if (((m_group_by & GroupByScope) && key.scope == 0) ||
+        ((m_group_by & GroupByFop) && key.fop == 0) ||
+        ((m_group_by & GroupByStat) && key.stat == 0))
+    {
+        return;
+    }
+
+    if (! (m_group_by & GroupByScope))  key.scope = 0;
+    if (! (m_group_by & GroupByFop))    key.fop = 0;
+    if (! (m_group_by & GroupByStat))   key.stat = 0;
+
+    std::uint64_t   packed = ((std::uint64_t) key.scope << 42) ^ ((std::uint64_t) key.fop << 21) ^ key.stat;
+    auto            found  = m_index.find(packed);
+
+    if (found == m_index.end())
+    {
+        found = m_index.insert({packed, m_groups.size()}).first;
+        m_groups.push_back({key, 0, 0, value.value, value.unit});
+    }
+
+    Group& group = m_groups[found->second];
+
+    group.count++;
+    group.sum += value.value;
+    group.max  = std::max(group.max, value.value);
+}
+
+std::string MetricGroups::label(const Group& group) const
+{
+    std::string label = "group";
+
+    for (std::uint32_t id : {group.key.scope, group.key.fop, group.key.stat})
+    {
+        if (id == 0) continue;
+
+        DumpView part = m_interner.name(id);
+
+        label += '.';
+        label.append(part.begin, part.end);
+    }
+
+    return label;
+}
+
+ReturnCode MetricGroups::apply_thresholds(const Metric& warning, const Metric& critical, MetricTable& metrics)
+{
+    ReturnCode check_code = ReturnCode::OK;
+
+    if (m_target == GroupTarget::Off) return check_code;
+
+    for (const Group& group : m_groups)
+    {
+        Metric  value       = {m_target == GroupTarget::Average ? group.sum / group.count : group.max, group.unit};
+        Metric  warning_t   = convert(warning, group.unit);
+        Metric  critical_t  = convert(critical, group.unit);
+
+        if (value.value >= warning_t.value || value.value >= critical_t.value)
+        {
+            metrics.set_exceeding(label(group) + (m_target == GroupTarget::Average ? ".avg" : ".max"), value, severity_ratio(value.value, warning_t.value));
+
+            if (value.value >= critical_t.value)
+                check_code = ReturnCode::Critical;
+            else if (check_code != ReturnCode::Critical)
+                check_code = ReturnCode::Warning;
+        }
+    }
+
+    return check_code;
+}
+
+std::vector<MetricGroups::Aggregate> MetricGroups::aggregates() const
+{
+    std::vector<Aggregate> result;
+
+    result.reserve(m_groups.size());
+
+    for (const Group& group : m_groups)
+    {
+        result.push_back({label(group), group.sum / group.count, group.max, group.count, group.unit});
+    }
+
+    std::sort(result.begin(), result.end(), [](const Aggregate& a, const Aggregate& b) { return a.label < b.label; });
+
+    return result;
+}
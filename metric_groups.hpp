@@ -0,0 +1,121 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - structured metric names and group aggregates
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_METRIC_GROUPS_HPP
+#define CHECK_GLUSTER_PERF_METRIC_GROUPS_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include "check_gluster_perf.hpp"
+#include "dump_reader.hpp"
+#include "metric_table.hpp"
+
+/*
+Assigns a small, dense ID to every distinct string it's given, without allocating per lookup:
+names are kept back to back in one arena and found through an open addressing hash table.
+ID 0 is the empty string.
+*/
+class NameInterner
+{
+    public:
+        NameInterner();
+
+        /* Room for 'names' names of 'bytes' bytes in total, without growing */
+        void            reserve(std::size_t names, std::size_t bytes);
+
+        std::uint32_t   intern(const DumpView& name) { return intern(name, hash(name)); }
+
+        /* With the name's hash() already known, e.g. stored along with it */
+        std::uint32_t   intern(const DumpView& name, std::uint32_t hash);
+
+        static std::uint32_t hash(const DumpView& name);
+        std::uint32_t   hash(std::uint32_t id) const { return m_hashes[id]; }
+        DumpView        name(std::uint32_t id) const { return {m_names.data() + m_spans[id].first, m_names.data() + m_spans[id].first + m_spans[id].second}; }
+        std::size_t     size() const { return m_spans.size(); }
+
+    private:
+        void            grow(std::size_t slots);
+
+        std::string                                         m_names;
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> m_spans; // offset and length in m_names, indexed by ID
+        std::vector<std::uint32_t>                          m_hashes; // indexed by ID, growing never hashes a name again
+        std::vector<std::uint32_t>                          m_slots; // ID + 1, 0 for a free slot
+};
+
+/*
+The parts of a GlusterFS metric name, as interned IDs (0 when the name has no such part):
+
+    storage.gluster.brick.vol1.aggr.fop.WRITE.latency_ave_usec
+                               ^scope   ^fop  ^stat       ^unit
+
+The scope is "aggr" (since the brick started) or "inter" (last interval), the stat is the last
+component without its time unit suffix.
+*/
+struct MetricKey {
+    std::uint32_t   scope;
+    std::uint32_t   fop;
+    std::uint32_t   stat;
+    std::uint32_t   unit;
+};
+
+MetricKey   parse_metric_key(const DumpView& name, NameInterner& interner);
+
+/* Turns the -group-by list ("scope", "fop", "stat", comma separated) into GroupBy flags */
+unsigned    parse_group_by(const std::string& components) throw (std::invalid_argument);
+
+/*
+Per group average, maximum and count of the evaluated metrics, in the same pass as the rest of
+the evaluation. Metrics are grouped by the parts of their name selected with -group-by; those
+without one of these parts (e.g. uptime has no fop) don't belong to any group.
+*/
+class MetricGroups
+{
+    public:
+        MetricGroups(unsigned group_by, GroupTarget target);
+
+        /* 'value' is the metric in the output unit */
+        void        add(const DumpView& name, const Metric& value);
+
+        /*
+        Compares each group's average or maximum (see GroupTarget) with the thresholds, lists the
+        groups exceeding them in 'metrics' and returns the resulting check code.
+        */
+        ReturnCode  apply_thresholds(const Metric& warning, const Metric& critical, MetricTable& metrics);
+
+        struct Aggregate {
+            std::string     label; // "group.<parts>"
+            double          average;
+            double          maximum;
+            std::uint64_t   count;
+            UnitType        unit;
+        };
+
+        /* Every group's aggregates, by label */
+        std::vector<Aggregate>  aggregates() const;
+
+    private:
+        struct Group {
+            MetricKey       key;
+            std::uint64_t   count;
+            double          sum;
+            double          max;
+            UnitType        unit;
+        };
+
+        std::string         label(const Group& group) const;
+
+        unsigned                                    m_group_by;
+        GroupTarget                                 m_target;
+        NameInterner                                m_interner;
+        std::vector<Group>                          m_groups;
+        std::unordered_map<std::uint64_t, std::size_t> m_index; // packed selected IDs -> m_groups
+};
+
+#endif
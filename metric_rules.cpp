@@ -0,0 +1,102 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - per metric threshold rules (-rules)
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "metric_rules.hpp"
+
+#include <sstream>
+#include <cstdlib>
+
+MetricRules::MetricRules(const std::string& file, RuleMatch match, UnitType default_unit) throw (std::runtime_error)
+{
+    MappedFile                  contents(file); // this throws
+    std::istringstream          lines(std::string(contents.data(), contents.size()));
+    std::string                 line;
+    std::vector<std::string>    patterns;
+    int                         line_number = 0;
+
+    while (std::getline(lines, line))
+    {
+        line_number++;
+
+        std::size_t comment = line.find('#');
+
+        if (comment != std::string::npos) line.erase(comment);
+
+        std::istringstream  fields(line);
+        std::string         pattern, warning, critical, unit, extra;
+
+        if (! (fields >> pattern)) continue; // blank
+
+        fields >> warning >> critical >> unit >> extra;
+
+        char*       warning_end;
+        char*       critical_end;
+        MetricRule  rule = {pattern, {std::strtod(warning.c_str(), &warning_end), default_unit}, {std::strtod(critical.c_str(), &critical_end), default_unit}};
+
+        if (warning.empty() || critical.empty() || *warning_end != '\0' || *critical_end != '\0' || ! extra.empty())
+        {
+            std::ostringstream error;
+            error << file << ":" << line_number << ": expected '<pattern> <warning> <critical> [<unit>]'";
+
+            throw std::runtime_error(error.str());
+        }
+
+        if (! unit.empty())
+        {
+            auto found = g_unit_enum_map.find(unit);
+
+            if (found == g_unit_enum_map.end())
+            {
+                std::ostringstream error;
+                error << file << ":" << line_number << ": unknown unit '" << unit << "', expected us, ms or s";
+
+                throw std::runtime_error(error.str());
+            }
+
+            rule.warning.unit = rule.critical.unit = found->second;
+        }
+
+        if (rule.warning.value > rule.critical.value)
+        {
+            std::ostringstream error;
+            error << file << ":" << line_number << ": the warning threshold can't be above the critical one";
+
+            throw std::runtime_error(error.str());
+        }
+
+        m_rules.push_back(rule);
+        patterns.push_back(pattern);
+    }
+
+    try
+    {
+        m_index.reset(new PatternSet(patterns, match == RuleMatch::First ? PatternSet::Priority::First : PatternSet::Priority::MostSpecific));
+    }
+    catch (const std::exception& e)
+    {
+        throw std::runtime_error(file + ": " + e.what());
+    }
+
+    std::ostringstream key;
+
+    key.precision(17);
+    key << (int) match;
+
+    for (const MetricRule& rule : m_rules)
+    {
+        key << '\n' << rule.pattern << '\t' << rule.warning.value << '\t' << (int) rule.warning.unit << '\t' << rule.critical.value;
+    }
+
+    m_digest = hash_text(key.str());
+}
+
+const MetricRule* MetricRules::find(const DumpView& name) const
+{
+    int rule = m_index->match(name.begin, name.end);
+
+    return rule < 0 ? nullptr : &m_rules[rule];
+}
@@ -0,0 +1,60 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - per metric threshold rules (-rules)
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_METRIC_RULES_HPP
+#define CHECK_GLUSTER_PERF_METRIC_RULES_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <cstdint>
+
+#include "check_gluster_perf.hpp"
+#include "dump_reader.hpp"
+#include "metric_filter.hpp"
+
+/* The thresholds of the metrics matching 'pattern' */
+struct MetricRule {
+    std::string     pattern;
+    Metric          warning;
+    Metric          critical;
+};
+
+/*
+The rules of a -rules file, one per line:
+
+    # pattern                           warning  critical  [unit]
+    .*aggr.*fop\.LOOKUP\.latency_ave.*  200      500       us
+    .*aggr.*fop\.FSYNC\.latency_ave.*   20       50        ms
+
+Patterns are full match, case insensitive regular expressions like -f, without blanks. The unit
+defaults to -u. Metrics no rule matches get -w and -c.
+
+All patterns are compiled into one PatternSet, finding a metric's rule is a single pass over its
+name however many rules there are.
+*/
+class MetricRules
+{
+    public:
+        MetricRules(const std::string& file, RuleMatch match, UnitType default_unit) throw (std::runtime_error);
+
+        /* The rule for a metric, nullptr if none matches */
+        const MetricRule*   find(const DumpView& name) const;
+
+        std::size_t         size() const { return m_rules.size(); }
+
+        /* Changes with the rules and their priority, for cache keys */
+        std::uint64_t       digest() const { return m_digest; }
+
+    private:
+        std::vector<MetricRule>     m_rules;
+        std::unique_ptr<PatternSet> m_index;
+        std::uint64_t               m_digest;
+};
+
+#endif
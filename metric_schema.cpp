@@ -0,0 +1,58 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - what the values of a dump are
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "metric_schema.hpp"
+
+#include <cstring>
+#include <strings.h>
+
+/* 'suffix' is lower case, the name's case doesn't matter, like for -f */
+static bool ends_with(const DumpView& name, const char* suffix)
+{
+    std::size_t length = std::strlen(suffix);
+
+    return name.size() >= length && strncasecmp(name.end - length, suffix, length) == 0;
+}
+
+static bool contains(const DumpView& name, const char* word)
+{
+    std::size_t length = std::strlen(word);
+
+    for (const char* it = name.begin; it + length <= name.end; it++)
+    {
+        if (strncasecmp(it, word, length) == 0) return true;
+    }
+
+    return false;
+}
+
+bool duration_unit(const DumpView& name, UnitType unnamed_unit, UnitType& unit)
+{
+    static const struct {
+        const char* suffix;
+        UnitType    unit;
+    } UNIT_SUFFIXES[] = {
+        {"_usec", UnitType::Microseconds},
+        {"_msec", UnitType::Miliseconds},
+        {"_sec",  UnitType::Seconds}        // after the others, it ends them too
+    };
+
+    for (const auto& suffix : UNIT_SUFFIXES)
+    {
+        if (ends_with(name, suffix.suffix))
+        {
+            unit = suffix.unit;
+            return true;
+        }
+    }
+
+    if (! contains(name, "latency")) return false;
+
+    unit = unnamed_unit;
+
+    return true;
+}
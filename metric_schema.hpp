@@ -0,0 +1,26 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - what the values of a dump are
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_METRIC_SCHEMA_HPP
+#define CHECK_GLUSTER_PERF_METRIC_SCHEMA_HPP
+
+#include "check_gluster_perf.hpp"
+#include "dump_reader.hpp"
+
+/*
+The unit of a duration metric, from its GlusterFS name alone:
+
+- "..._usec", "..._msec", "..._sec", in any case: microseconds, miliseconds, seconds
+- any other name holding "latency", in any case: 'unnamed_unit', -gluster-src-unit
+
+Returns false for everything else: counters ("...fop.WRITE.count", "...read_4kb", "...hits")
+and gauges ("...uptime"). Only durations are checked, converted, compared with the thresholds and
+averaged; the others have no time unit, averaging them with latencies means nothing.
+*/
+bool        duration_unit(const DumpView& name, UnitType unnamed_unit, UnitType& unit);
+
+#endif
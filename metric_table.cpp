@@ -0,0 +1,189 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - flat storage of evaluated metrics
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "metric_table.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+const double MetricTable::NOT_EXCEEDING = std::numeric_limits<double>::quiet_NaN();
+
+void MetricTable::clear()
+{
+    m_entries.clear();
+    m_names.clear();
+    m_metrics.clear();
+    m_worst.clear();
+    m_exceeding.clear();
+    m_exceeding_count = 0;
+}
+
+void MetricTable::reserve(std::size_t metrics, std::size_t name_bytes)
+{
+    m_entries.reserve(metrics);
+    m_metrics.reserve(metrics);
+    m_names.reserve(name_bytes);
+}
+
+MetricTable::Index MetricTable::append(const DumpView& name, const Metric& value)
+{
+    Index index = m_entries.size();
+
+    m_entries.push_back({(std::uint32_t) m_names.size(), (std::uint32_t) name.size(), value, NOT_EXCEEDING});
+    m_names.append(name.begin, name.end);
+
+    return index;
+}
+
+MetricTable::Index MetricTable::add(const DumpView& name, const Metric& value)
+{
+    Index index = append(name, value);
+
+    m_metrics.push_back(index);
+
+    return index;
+}
+
+void MetricTable::mark_exceeding(Index index, double severity)
+{
+    m_entries[index].severity = severity; // listed by sort(), once per name
+}
+
+void MetricTable::add_exceeding(const DumpView& name, const Metric& value, double severity)
+{
+    push_exceeding({append(name, value), severity});
+}
+
+bool MetricTable::more_severe(const Exceeding& a, const Exceeding& b) const
+{
+    if (a.severity != b.severity) return a.severity > b.severity;
+
+    return less(a.index, b.index); // ties in name order, so the message doesn't depend on the evaluation order
+}
+
+void MetricTable::push_exceeding(const Exceeding& exceeding)
+{
+    auto less_severe_on_top = [this](const Exceeding& a, const Exceeding& b) { return more_severe(a, b); };
+
+    m_exceeding_count++;
+
+    if (m_worst.size() < m_exceeding_limit)
+    {
+        m_worst.push_back(exceeding);
+        std::push_heap(m_worst.begin(), m_worst.end(), less_severe_on_top);
+    }
+    else if (! m_worst.empty() && more_severe(exceeding, m_worst.front()))
+    {
+        std::pop_heap(m_worst.begin(), m_worst.end(), less_severe_on_top);
+        m_worst.back() = exceeding;
+        std::push_heap(m_worst.begin(), m_worst.end(), less_severe_on_top);
+    }
+}
+
+int MetricTable::compare(Index index, const DumpView& name) const
+{
+    const Entry&    entry  = m_entries[index];
+    std::size_t     length = std::min<std::size_t>(entry.name_length, name.size());
+    int             result = std::memcmp(m_names.data() + entry.name_offset, name.begin, length);
+
+    if (result != 0) return result;
+
+    return entry.name_length < name.size() ? -1 : (entry.name_length > name.size() ? 1 : 0);
+}
+
+bool MetricTable::less(Index a, Index b) const
+{
+    return compare(a, name(b)) < 0;
+}
+
+void MetricTable::sort()
+{
+    // stable, so of equally named metrics the last one evaluated ends up last and is kept
+    std::stable_sort(m_metrics.begin(), m_metrics.end(), [this](Index a, Index b) { return less(a, b); });
+
+    std::size_t kept  = 0;
+    Exceeding   worst = {0, NOT_EXCEEDING};
+
+    for (std::size_t i = 0; i < m_metrics.size(); i++)
+    {
+        Entry& entry = m_entries[m_metrics[i]];
+
+        // of the values of a name the most severe one is listed, whichever the performance data keeps
+        if (! std::isnan(entry.severity) && (std::isnan(worst.severity) || entry.severity >= worst.severity))
+        {
+            worst = {m_metrics[i], entry.severity};
+        }
+
+        entry.severity = NOT_EXCEEDING; // listed once, even if sorted again
+
+        if (i + 1 < m_metrics.size() && compare(m_metrics[i], name(m_metrics[i + 1])) == 0)
+        {
+            continue; // overwritten by the next one
+        }
+
+        m_metrics[kept++] = m_metrics[i];
+
+        if (! std::isnan(worst.severity)) push_exceeding(worst);
+
+        worst.severity = NOT_EXCEEDING;
+    }
+
+    m_metrics.resize(kept);
+
+    std::sort(m_worst.begin(), m_worst.end(), [this](const Exceeding& a, const Exceeding& b) { return more_severe(a, b); });
+
+    m_exceeding.clear();
+
+    for (const Exceeding& exceeding : m_worst) m_exceeding.push_back(exceeding.index);
+}
+
+void MetricTable::set_in(std::vector<Index>& list, const std::string& name, const Metric& value)
+{
+    DumpView    key   = {name.data(), name.data() + name.size()};
+    Index       index = append(key, value); // a new entry, the old one may be shared with the other list
+
+    auto position = std::lower_bound(list.begin(), list.end(), key, [this](Index element, const DumpView& name)
+    {
+        return compare(element, name) < 0;
+    });
+
+    if (position != list.end() && compare(*position, key) == 0)
+    {
+        *position = index;
+    } else
+    {
+        list.insert(position, index);
+    }
+}
+
+void MetricTable::set_exceeding(const std::string& name, const Metric& value, double severity)
+{
+    DumpView key = {name.data(), name.data() + name.size()};
+
+    auto same = std::find_if(m_worst.begin(), m_worst.end(), [&](const Exceeding& exceeding) { return compare(exceeding.index, key) == 0; });
+
+    if (same != m_worst.end())
+    {
+        m_worst.erase(same); // replaced, still counted
+    } else
+    {
+        m_exceeding_count++;
+    }
+
+    if (m_worst.size() >= m_exceeding_limit && (m_worst.empty() || severity < m_worst.back().severity)) return; // only counted
+
+    Exceeding exceeding = {append(key, value), severity}; // a new entry, the old one may be shared with the other list
+
+    m_worst.insert(std::upper_bound(m_worst.begin(), m_worst.end(), exceeding, [this](const Exceeding& a, const Exceeding& b) { return more_severe(a, b); }), exceeding);
+
+    if (m_worst.size() > m_exceeding_limit) m_worst.pop_back();
+
+    m_exceeding.clear();
+
+    for (const Exceeding& listed : m_worst) m_exceeding.push_back(listed.index);
+}
@@ -0,0 +1,122 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - flat storage of evaluated metrics
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_METRIC_TABLE_HPP
+#define CHECK_GLUSTER_PERF_METRIC_TABLE_HPP
+
+#include <string>
+#include <vector>
+#include <limits>
+#include <cstdint>
+
+#include "check_gluster_perf.hpp"
+#include "dump_reader.hpp"
+
+/*
+The metrics of one check: every evaluated metric (the performance data), ordered by name, and the
+worst of those that exceeded a threshold, the worst first, for the message.
+
+Metrics are appended to one contiguous array in the order they're evaluated, their names are
+copied back to back into a single arena and referenced by offset, and the two lists are arrays
+of indexes into the table. Nothing is ordered until sort(), which runs once, after evaluation.
+A run costs a handful of allocations however many metrics the dump holds.
+
+Of the exceeding metrics only the 'limit' most severe ones, by their ratio to the threshold, are
+listed: evaluating a metric only records its severity in its entry, sort() then feeds them to a
+min-heap of that size, the least severe on top to be replaced, and the others are only counted.
+A degraded brick with thousands of metrics over the thresholds costs no more than a healthy one.
+
+A name evaluated more than once (dumps with several root objects, -nodes) keeps its last value
+in the performance data, as std::map assignment did, and its most severe value in the exceeding
+list: the check's state comes from the worst value, the message names it. Either way a name is
+listed and counted once.
+*/
+class MetricTable
+{
+    public:
+        typedef std::uint32_t Index;
+
+        void        clear();
+        void        reserve(std::size_t metrics, std::size_t name_bytes);
+
+        /* How many exceeding metrics are listed at most, before evaluating, all of them by default */
+        void        set_exceeding_limit(std::size_t limit) { m_exceeding_limit = limit; }
+
+        /* Appends a metric to the performance data, returns its index */
+        Index       add(const DumpView& name, const Metric& value);
+
+        /* Also lists an added metric as exceeding a threshold, 'severity' is its ratio to the threshold, from sort() on */
+        void        mark_exceeding(Index index, double severity);
+
+        /* Lists a metric as exceeding a threshold without adding it to the performance data */
+        void        add_exceeding(const DumpView& name, const Metric& value, double severity);
+
+        /* Counts exceeding metrics that aren't listed, those a cached result left out */
+        void        add_hidden_exceeding(std::size_t count) { m_exceeding_count += count; }
+
+        /*
+        Orders the performance data by name and the exceeding list the most severe first, drops the
+        values overwritten by a later one of the same name and lists the most severe marked value
+        of each name
+        */
+        void        sort();
+
+        /* After sort(): sets a metric in the (ordered) performance data or exceeding list */
+        void        set(const std::string& name, const Metric& value) { set_in(m_metrics, name, value); }
+        void        set_exceeding(const std::string& name, const Metric& value, double severity);
+
+        /* The lists after sort(): the performance data in name order, the listed exceeding metrics the most severe first */
+        const std::vector<Index>&   metrics() const { return m_metrics; }
+        const std::vector<Index>&   exceeding() const { return m_exceeding; }
+
+        /* The severity of the i-th listed exceeding metric */
+        double      exceeding_severity(std::size_t i) const { return m_worst[i].severity; }
+
+        /* How many metrics exceeded a threshold, listed or not */
+        std::size_t exceeding_count() const { return m_exceeding_count; }
+
+        DumpView        name(Index index) const { return {m_names.data() + m_entries[index].name_offset, m_names.data() + m_entries[index].name_offset + m_entries[index].name_length}; }
+        const Metric&   value(Index index) const { return m_entries[index].value; }
+
+    private:
+        struct Entry {
+            std::uint32_t   name_offset; // in m_names
+            std::uint32_t   name_length;
+            Metric          value;
+            double          severity;    // set by mark_exceeding() until sort(), NOT_EXCEEDING otherwise
+        };
+
+        static const double NOT_EXCEEDING;
+
+        struct Exceeding {
+            Index   index;
+            double  severity;
+        };
+
+        Index       append(const DumpView& name, const Metric& value);
+        bool        more_severe(const Exceeding& a, const Exceeding& b) const;
+        void        push_exceeding(const Exceeding& exceeding);
+        bool        less(Index a, Index b) const;
+        int         compare(Index index, const DumpView& name) const;
+        void        set_in(std::vector<Index>& list, const std::string& name, const Metric& value);
+
+        std::vector<Entry>      m_entries;
+        std::string             m_names;
+        std::vector<Index>      m_metrics;
+        std::vector<Exceeding>  m_worst;     // a min-heap on the severity until sort(), then the most severe first
+        std::vector<Index>      m_exceeding; // m_worst's indexes, after sort()
+        std::size_t             m_exceeding_count = 0;
+        std::size_t             m_exceeding_limit = std::numeric_limits<std::size_t>::max();
+};
+
+/* How severely 'value' exceeds 'threshold', the ratio the exceeding metrics are ranked by */
+inline double severity_ratio(double value, double threshold)
+{
+    return threshold > 0 ? value / threshold : value;
+}
+
+#endif
@@ -0,0 +1,253 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - cluster wide checks of several nodes' dumps
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "nodes.hpp"
+
+#include <queue>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+#include "metric_table.hpp"
+#include "output_writer.hpp"
+#include "profile.hpp"
+#include "batch.hpp"
+
+// defined in main.cpp
+std::time_t get_file_timestamp(std::string& path, DumpIdentity* identity = nullptr) throw (std::runtime_error);
+
+/* One node's evaluated dump */
+struct NodeMetrics {
+    std::string     name;
+    MetricTable     metrics;        // sorted by name
+    Metric          total_average;
+    std::time_t     dump_mtime;
+};
+
+static const std::size_t NO_NODE = (std::size_t) -1;
+
+std::string node_name(const std::string& dump_file)
+{
+    std::string::size_type slash = dump_file.rfind('/');
+
+    return slash == std::string::npos ? dump_file : dump_file.substr(slash + 1);
+}
+
+/* The order MetricTable sorts names in */
+static int compare_names(const DumpView& a, const DumpView& b)
+{
+    int result = std::memcmp(a.begin, b.begin, std::min(a.size(), b.size()));
+
+    if (result != 0) return result;
+
+    return a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
+}
+
+static void evaluate_node(NodeMetrics& node, std::string dump_file, const CheckOptions& options, const MetricFilter& metric_filter)
+{
+    try
+    {
+        node.dump_mtime = get_file_timestamp(dump_file); // this throws
+
+        std::time_t age = std::time(nullptr) - node.dump_mtime;
+
+        if (age > options.max_file_age)
+        {
+            std::ostringstream error;
+            error << "Stats dump is older than " << options.max_file_age << " seconds. Current age: " << age << " seconds.";
+
+            throw check_error(error.str());
+        }
+
+        evaluate_dump(options, metric_filter, dump_file, node.metrics, node.total_average); // this throws
+    }
+    catch (const check_error& e)
+    {
+        throw check_error(node.name + ": " + e.what());
+    }
+    catch (const std::exception& e)
+    {
+        throw std::runtime_error(node.name + ": " + e.what());
+    }
+}
+
+/*
+The k-way merge: fills 'cluster' with the '.avg' and '.max' of every metric and compares the
+maximums with the thresholds. 'worst_nodes' gets the node of each '.max', by table index.
+*/
+static ReturnCode merge_nodes(const std::vector<NodeMetrics>& nodes, const CheckOptions& options, const MetricRules* rules,
+                              MetricTable& cluster, std::vector<std::size_t>& worst_nodes)
+{
+    typedef std::pair<std::size_t, std::size_t> Cursor; // a node and a position in its sorted metrics
+
+    ReturnCode  check_code = ReturnCode::OK;
+    std::string scratch;
+
+    auto name_of = [&](const Cursor& cursor)
+    {
+        const MetricTable& metrics = nodes[cursor.first].metrics;
+
+        return metrics.name(metrics.metrics()[cursor.second]);
+    };
+
+    // a min-heap on the names, of the same name the first node comes first
+    auto later = [&](const Cursor& a, const Cursor& b)
+    {
+        int order = compare_names(name_of(a), name_of(b));
+
+        return order > 0 || (order == 0 && a.first > b.first);
+    };
+
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(later)> heap(later);
+
+    for (std::size_t node = 0; node < nodes.size(); node++)
+    {
+        if (! nodes[node].metrics.metrics().empty()) heap.push({node, 0});
+    }
+
+    while (! heap.empty())
+    {
+        DumpView    name        = name_of(heap.top());
+        double      sum         = 0;
+        std::size_t count       = 0;
+        Metric      maximum     = {0, options.unit_type_output};
+        std::size_t worst_node  = NO_NODE;
+
+        // every node reporting the metric, their values are all in the output unit
+        do
+        {
+            Cursor          cursor  = heap.top();
+            const Metric&   value   = nodes[cursor.first].metrics.value(nodes[cursor.first].metrics.metrics()[cursor.second]);
+
+            heap.pop();
+
+            sum += value.value;
+            count++;
+
+            if (worst_node == NO_NODE || value.value > maximum.value)
+            {
+                maximum     = value;
+                worst_node  = cursor.first;
+            }
+
+            if (cursor.second + 1 < nodes[cursor.first].metrics.metrics().size()) heap.push({cursor.first, cursor.second + 1});
+        }
+        while (! heap.empty() && compare_names(name_of(heap.top()), name) == 0);
+
+        scratch.assign(name.begin, name.end).append(".avg");
+        cluster.add({scratch.data(), scratch.data() + scratch.size()}, {std::min(sum / count, maximum.value), maximum.unit}); // of equal values the rounded sum may land above them
+
+        scratch.assign(name.begin, name.end).append(".max");
+        MetricTable::Index index = cluster.add({scratch.data(), scratch.data() + scratch.size()}, maximum);
+
+        worst_nodes.resize(index + 1, NO_NODE);
+        worst_nodes[index] = worst_node;
+
+        if (options.apply_on_total) continue;
+
+        const MetricRule*   rule        = rules != nullptr ? rules->find(name) : nullptr;
+        Metric              warning     = convert(rule != nullptr ? rule->warning : options.warning_threshold, maximum.unit);
+        Metric              critical    = convert(rule != nullptr ? rule->critical : options.critical_threshold, maximum.unit);
+
+        if (maximum.value >= warning.value && check_code != ReturnCode::Critical) check_code = ReturnCode::Warning;
+        if (maximum.value >= critical.value) check_code = ReturnCode::Critical;
+
+        if (maximum.value >= warning.value || maximum.value >= critical.value) cluster.mark_exceeding(index, severity_ratio(maximum.value, warning.value));
+    }
+
+    return check_code;
+}
+
+CheckResult check_nodes(const CheckOptions& options,
+                        const MetricFilter& metric_filter,
+                        const std::string& volume,
+                        const std::vector<std::string>& dump_files,
+                        const MetricRules* rules,
+                        unsigned threads)
+{
+    CheckResult         result;
+    CheckProfile        profile(options.self_profile); // only times this thread, the nodes' allocations aren't counted
+
+    result.volume       = volume;
+    result.code         = ReturnCode::Unknown;
+    result.has_average  = false;
+    result.dump_mtime   = 0;
+
+    try
+    {
+        profile.begin(Phase::Parse);
+
+        std::vector<NodeMetrics> nodes(dump_files.size());
+
+        run_parallel(dump_files.size(), threads, [&](std::size_t index)
+        {
+            nodes[index].name = node_name(dump_files[index]);
+
+            evaluate_node(nodes[index], dump_files[index], options, metric_filter);
+        });
+
+        profile.begin(Phase::Evaluate);
+
+        MetricTable                 cluster;
+        std::vector<std::size_t>    worst_nodes;
+
+        cluster.set_exceeding_limit(std::max(options.max_report_metrics, 0));
+
+        ReturnCode                  check_code      = merge_nodes(nodes, options, rules, cluster, worst_nodes);
+        Metric                      total_average   = {0, options.unit_type_output};
+
+        cluster.sort();
+
+        for (const NodeMetrics& node : nodes)
+        {
+            total_average.value += convert(node.total_average, total_average.unit).value / nodes.size();
+            result.dump_mtime    = std::max(result.dump_mtime, node.dump_mtime);
+        }
+
+        cluster.set("total_average", total_average);
+
+        result.has_average      = true;
+        result.total_average    = total_average;
+
+        if (options.apply_on_total)
+        {
+            Metric warning = convert(options.warning_threshold, total_average.unit);
+
+            if (total_average.value >= warning.value) check_code = ReturnCode::Warning;
+            if (total_average.value >= convert(options.critical_threshold, total_average.unit).value) check_code = ReturnCode::Critical;
+
+            if (check_code != ReturnCode::OK) cluster.set_exceeding("total_average", total_average, severity_ratio(total_average.value, warning.value));
+        }
+
+        profile.begin(Phase::Output);
+
+        std::ostringstream ok_message;
+
+        ok_message << "All performance metrics of " << nodes.size() << " nodes within thresholds. Total avg: "
+                   << total_average.value << unit_name(total_average.unit);
+
+        // each metric the node it was found on, the total average is the cluster's
+        auto worst_node = [&](std::ostream& output, MetricTable::Index index)
+        {
+            if (index < worst_nodes.size() && worst_nodes[index] != NO_NODE) output << " (" << nodes[worst_nodes[index]].name << ")";
+        };
+
+        std::string     message = status_message(check_code, ok_message.str(), cluster, worst_node);
+        CheckReport     report  = {volume, check_code, message, &cluster, nullptr, true, total_average, options.warning_threshold, options.critical_threshold, result.dump_mtime,
+                                   nullptr, profile.enabled() ? &profile : nullptr};
+
+        result.code     = check_code;
+        result.output   = format_report(options.output_format, report);
+    }
+    catch (...)
+    {
+        result.output = format_failure(options, volume, result.dump_mtime, profile.enabled() ? &profile : nullptr, result.code);
+    }
+
+    return result;
+}
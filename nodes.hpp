@@ -0,0 +1,41 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - cluster wide checks of several nodes' dumps
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_NODES_HPP
+#define CHECK_GLUSTER_PERF_NODES_HPP
+
+#include <string>
+#include <vector>
+
+#include "check_gluster_perf.hpp"
+#include "metric_filter.hpp"
+#include "metric_rules.hpp"
+
+/*
+Checks one volume from the dumps of several of its servers and clients (-nodes), never throws.
+
+Every node's dump is evaluated on its own, concurrently on up to 'threads' workers (0 means one
+per core), into a metric table sorted by name. The tables are then merged by a k-way merge over
+those sorted lists, a heap holding the next metric of every node, so each metric name is visited
+once with the values of all the nodes reporting it, whatever the number of nodes.
+
+Each metric is reported as '<name>.avg', its average over the nodes, and '<name>.max', its
+highest value. The maximum, that is the worst node, is compared with the thresholds (those of
+its -rules if any) and the message names that node. The total average is the average of the
+nodes' total averages. A node whose dump can't be read, or is too old, fails the check.
+*/
+CheckResult check_nodes(const CheckOptions& options,
+                        const MetricFilter& metric_filter,
+                        const std::string& volume,
+                        const std::vector<std::string>& dump_files,
+                        const MetricRules* rules,
+                        unsigned threads);
+
+/* The name a node is reported with: its dump's file name */
+std::string node_name(const std::string& dump_file);
+
+#endif
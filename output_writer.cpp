@@ -0,0 +1,626 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - output formats
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "output_writer.hpp"
+#include "batch.hpp"
+
+#include <sstream>
+#include <cstdio>
+#include <cmath>
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+static const int MACHINE_PRECISION = 15; // the formats read by programs get every digit a dump value has
+
+OutputBuffer& OutputBuffer::append_number(double value, int precision)
+{
+    char buffer[32];
+    int  length = std::snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+
+    m_data.append(buffer, length);
+
+    return *this;
+}
+
+OutputBuffer& OutputBuffer::append_integer(std::int64_t value)
+{
+    char buffer[24];
+    int  length = std::snprintf(buffer, sizeof(buffer), "%lld", (long long) value);
+
+    m_data.append(buffer, length);
+
+    return *this;
+}
+
+void OutputBuffer::write_to(int fd) const throw (std::runtime_error)
+{
+    std::size_t written = 0;
+
+    while (written < m_data.size())
+    {
+        ssize_t count = write(fd, m_data.data() + written, m_data.size() - written);
+
+        if (count == -1 && errno == EINTR) continue;
+
+        if (count == -1)
+        {
+            std::ostringstream error;
+            error << strerror(errno) << " While trying to write the output";
+
+            throw std::runtime_error(error.str());
+        }
+
+        written += count;
+    }
+}
+
+void append_nagios_perfdata(OutputBuffer& output, const MetricTable& metrics, const Metric& warning, const Metric& critical,
+                            const MetricRules* rules)
+{
+    const int       unit_count = (int) UnitType::Seconds + 1;
+    OutputBuffer    suffixes[unit_count]; // "<unit>;<warning>;<critical> " in each unit
+
+    // the thresholds are formatted once per unit rather than for every metric
+    for (int unit = 0; unit < unit_count; unit++)
+    {
+        suffixes[unit].append(unit_name((UnitType) unit))
+                      .append(';').append_number(convert(warning, (UnitType) unit).value)
+                      .append(';').append_number(convert(critical, (UnitType) unit).value).append(' ');
+    }
+
+    for (MetricTable::Index index : metrics.metrics())
+    {
+        const Metric&       metric  = metrics.value(index);
+        const MetricRule*   rule    = rules != nullptr ? rules->find(metrics.name(index)) : nullptr;
+
+        output.append('\'').append(metrics.name(index)).append("'=").append_number(metric.value);
+
+        if (rule == nullptr)
+        {
+            output.append(suffixes[(int) metric.unit].str());
+            continue;
+        }
+
+        output.append(unit_name(metric.unit))
+              .append(';').append_number(convert(rule->warning, metric.unit).value)
+              .append(';').append_number(convert(rule->critical, metric.unit).value).append(' ');
+    }
+}
+
+/* The classic check output: "<message>|<performance data>" */
+class NagiosWriter : public OutputWriter
+{
+    public:
+        void write(OutputBuffer& output, const CheckReport& report) const
+        {
+            if (report.metrics == nullptr && report.profile == nullptr)
+            {
+                output.append(report.message);
+                return;
+            }
+
+            // error messages end with a newline, the performance data belongs on their line
+            bool newline = ! report.message.empty() && report.message[report.message.size() - 1] == '\n';
+
+            output.append(newline ? report.message.substr(0, report.message.size() - 1) : report.message).append('|');
+
+            if (report.metrics != nullptr) perfdata(output, report);
+
+            if (report.profile != nullptr)
+            {
+                for (const ProfileSample& sample : report.profile->samples())
+                {
+                    output.append('\'').append(sample.name).append("'=").append_integer(sample.value).append(sample.unit).append(' ');
+                }
+            }
+
+            if (newline) output.append('\n');
+        }
+
+    private:
+        static void perfdata(OutputBuffer& output, const CheckReport& report)
+        {
+            append_nagios_perfdata(output, *report.metrics, report.warning_threshold, report.critical_threshold, report.rules);
+
+            if (report.groups == nullptr) return;
+
+            for (const MetricGroups::Aggregate& group : report.groups->aggregates())
+            {
+                Metric      warn_t  = convert(report.warning_threshold, group.unit);
+                Metric      crit_t  = convert(report.critical_threshold, group.unit);
+                const char* unit    = unit_name(group.unit);
+
+                output.append('\'').append(group.label).append(".avg'=").append_number(group.average).append(unit)
+                      .append(';').append_number(warn_t.value).append(';').append_number(crit_t.value).append(' ');
+                output.append('\'').append(group.label).append(".max'=").append_number(group.maximum).append(unit)
+                      .append(';').append_number(warn_t.value).append(';').append_number(crit_t.value).append(' ');
+                output.append('\'').append(group.label).append(".count'=").append_integer(group.count).append(' ');
+            }
+        }
+};
+
+/*
+Prometheus text exposition, for the node_exporter textfile collector. Samples only, no # TYPE
+lines, so that the outputs of several volumes can simply follow each other.
+*/
+class PrometheusWriter : public OutputWriter
+{
+    public:
+        void write(OutputBuffer& output, const CheckReport& report) const
+        {
+            sample(output, "gluster_perf_check_status", report.volume);
+            output.append('}').append(' ').append_integer((int) report.code).append('\n');
+
+            if (report.dump_mtime != 0)
+            {
+                sample(output, "gluster_perf_dump_mtime_seconds", report.volume);
+                output.append('}').append(' ').append_integer(report.dump_mtime).append('\n');
+            }
+
+            if (report.metrics != nullptr) metric_samples(output, report);
+
+            if (report.profile == nullptr) return;
+
+            for (const ProfileSample& profile : report.profile->samples())
+            {
+                sample(output, "gluster_perf_check_profile", report.volume);
+                output.append(",name=\"").append(profile.name).append("\"} ").append_integer(profile.value).append('\n');
+            }
+        }
+
+    private:
+        static void metric_samples(OutputBuffer& output, const CheckReport& report)
+        {
+            threshold(output, report.volume, "warning", report.warning_threshold);
+            threshold(output, report.volume, "critical", report.critical_threshold);
+
+            for (MetricTable::Index index : report.metrics->metrics())
+            {
+                const Metric& metric = report.metrics->value(index);
+
+                sample(output, "gluster_perf_metric", report.volume);
+                output.append(",metric=\"");
+                escape_label(output, report.metrics->name(index));
+                output.append("\",unit=\"").append(unit_name(metric.unit)).append("\"} ");
+                value(output, metric.value);
+            }
+
+            if (report.groups == nullptr) return;
+
+            for (const MetricGroups::Aggregate& group : report.groups->aggregates())
+            {
+                group_sample(output, "gluster_perf_group_average", report.volume, group, unit_name(group.unit));
+                value(output, group.average);
+                group_sample(output, "gluster_perf_group_maximum", report.volume, group, unit_name(group.unit));
+                value(output, group.maximum);
+                group_sample(output, "gluster_perf_group_count", report.volume, group, nullptr);
+                output.append_integer(group.count).append('\n');
+            }
+        }
+
+        /* Starts "name{volume="<volume>"", the caller adds more labels and closes the brace */
+        static void sample(OutputBuffer& output, const char* name, const std::string& volume)
+        {
+            output.append(name).append("{volume=\"");
+            escape_label(output, {volume.data(), volume.data() + volume.size()});
+            output.append('"');
+        }
+
+        static void threshold(OutputBuffer& output, const std::string& volume, const char* level, const Metric& threshold)
+        {
+            sample(output, "gluster_perf_threshold", volume);
+            output.append(",level=\"").append(level).append("\",unit=\"").append(unit_name(threshold.unit)).append("\"} ");
+            value(output, threshold.value);
+        }
+
+        static void group_sample(OutputBuffer& output, const char* name, const std::string& volume, const MetricGroups::Aggregate& group, const char* unit)
+        {
+            sample(output, name, volume);
+            output.append(",group=\"");
+            escape_label(output, {group.label.data(), group.label.data() + group.label.size()});
+            output.append('"');
+
+            if (unit != nullptr) output.append(",unit=\"").append(unit).append('"');
+
+            output.append("} ");
+        }
+
+        static void value(OutputBuffer& output, double value)
+        {
+            if (std::isnan(value))          output.append("NaN");
+            else if (std::isinf(value))     output.append(value > 0 ? "+Inf" : "-Inf");
+            else                            output.append_number(value, MACHINE_PRECISION);
+
+            output.append('\n');
+        }
+
+        static void escape_label(OutputBuffer& output, const DumpView& text)
+        {
+            for (const char* it = text.begin; it != text.end; it++)
+            {
+                switch (*it)
+                {
+                    case '\\':  output.append("\\\\"); break;
+                    case '"':   output.append("\\\""); break;
+                    case '\n':  output.append("\\n");  break;
+                    default:    output.append(*it);
+                }
+            }
+        }
+};
+
+/* InfluxDB line protocol, timestamped with the dump's modification time */
+class InfluxWriter : public OutputWriter
+{
+    public:
+        void write(OutputBuffer& output, const CheckReport& report) const
+        {
+            output.append("gluster_perf_check,volume=");
+            escape_tag(output, report.volume);
+            output.append(" status=").append_integer((int) report.code).append("i,message=\"");
+            escape_string(output, report.message);
+            output.append('"');
+            timestamp(output, report);
+
+            if (report.metrics != nullptr) metric_lines(output, report);
+
+            if (report.profile == nullptr) return;
+
+            const char* separator = " ";
+
+            output.append("gluster_perf_check_profile,volume=");
+            escape_tag(output, report.volume);
+
+            for (const ProfileSample& sample : report.profile->samples())
+            {
+                output.append(separator).append(sample.name).append('=').append_integer(sample.value).append('i');
+                separator = ",";
+            }
+
+            timestamp(output, report);
+        }
+
+    private:
+        static void metric_lines(OutputBuffer& output, const CheckReport& report)
+        {
+            for (MetricTable::Index index : report.metrics->metrics())
+            {
+                const Metric&       metric = report.metrics->value(index);
+                const MetricRule*   rule   = report.rules != nullptr ? report.rules->find(report.metrics->name(index)) : nullptr;
+                Metric              warn_t = convert(rule != nullptr ? rule->warning : report.warning_threshold, metric.unit);
+                Metric              crit_t = convert(rule != nullptr ? rule->critical : report.critical_threshold, metric.unit);
+
+                if (! std::isfinite(metric.value)) continue; // line protocol has no way to write these
+
+                output.append("gluster_perf_metric,volume=");
+                escape_tag(output, report.volume);
+                output.append(",metric=");
+                escape_tag(output, report.metrics->name(index));
+                output.append(",unit=").append(unit_name(metric.unit))
+                      .append(" value=").append_number(metric.value, MACHINE_PRECISION)
+                      .append(",warning=").append_number(warn_t.value, MACHINE_PRECISION)
+                      .append(",critical=").append_number(crit_t.value, MACHINE_PRECISION);
+                timestamp(output, report);
+            }
+
+            if (report.groups == nullptr) return;
+
+            for (const MetricGroups::Aggregate& group : report.groups->aggregates())
+            {
+                output.append("gluster_perf_group,volume=");
+                escape_tag(output, report.volume);
+                output.append(",group=");
+                escape_tag(output, group.label);
+                output.append(",unit=").append(unit_name(group.unit))
+                      .append(" average=").append_number(group.average, MACHINE_PRECISION)
+                      .append(",maximum=").append_number(group.maximum, MACHINE_PRECISION)
+                      .append(",count=").append_integer(group.count).append('i');
+                timestamp(output, report);
+            }
+        }
+
+        static void timestamp(OutputBuffer& output, const CheckReport& report)
+        {
+            if (report.dump_mtime != 0) output.append(' ').append_integer(report.dump_mtime).append("000000000"); // in nanoseconds
+
+            output.append('\n');
+        }
+
+        static void escape_tag(OutputBuffer& output, const std::string& text)
+        {
+            escape_tag(output, DumpView{text.data(), text.data() + text.size()});
+        }
+
+        static void escape_tag(OutputBuffer& output, const DumpView& text)
+        {
+            for (const char* it = text.begin; it != text.end; it++)
+            {
+                if (*it == ',' || *it == '=' || *it == ' ' || *it == '\\') output.append('\\');
+
+                output.append(*it == '\n' ? ' ' : *it);
+            }
+        }
+
+        static void escape_string(OutputBuffer& output, const std::string& text)
+        {
+            std::size_t length = text.size();
+
+            while (length > 0 && text[length - 1] == '\n') length--; // error messages end with one
+
+            for (std::size_t i = 0; i < length; i++)
+            {
+                if (text[i] == '"' || text[i] == '\\') output.append('\\');
+
+                output.append(text[i] == '\n' ? ' ' : text[i]);
+            }
+        }
+};
+
+/* One JSON object per volume */
+class JsonWriter : public OutputWriter
+{
+    public:
+        void write(OutputBuffer& output, const CheckReport& report) const
+        {
+            output.append("{\"volume\":");
+            string(output, report.volume);
+            output.append(",\"status\":").append_integer((int) report.code)
+                  .append(",\"state\":\"").append(state_name(report.code)).append("\",\"message\":");
+            string(output, report.message);
+            output.append(",\"dump_mtime\":").append_integer(report.dump_mtime);
+
+            if (report.metrics != nullptr)
+            {
+                output.append(",\"warning\":");
+                metric(output, report.warning_threshold);
+                output.append(",\"critical\":");
+                metric(output, report.critical_threshold);
+
+                if (report.has_average)
+                {
+                    output.append(",\"total_average\":");
+                    metric(output, report.total_average);
+                }
+
+                output.append(",\"metrics\":");
+                metric_list(output, *report.metrics, report.metrics->metrics());
+                output.append(",\"exceeding\":");
+                metric_list(output, *report.metrics, report.metrics->exceeding()); // the most severe first
+                output.append(",\"exceeding_count\":").append_integer(report.metrics->exceeding_count());
+            }
+
+            if (report.groups != nullptr)
+            {
+                const char* separator = "";
+
+                output.append(",\"groups\":[");
+
+                for (const MetricGroups::Aggregate& group : report.groups->aggregates())
+                {
+                    output.append(separator).append("{\"group\":");
+                    string(output, group.label);
+                    output.append(",\"average\":");
+                    number(output, group.average);
+                    output.append(",\"maximum\":");
+                    number(output, group.maximum);
+                    output.append(",\"count\":").append_integer(group.count)
+                          .append(",\"unit\":\"").append(unit_name(group.unit)).append("\"}");
+                    separator = ",";
+                }
+
+                output.append(']');
+            }
+
+            if (report.profile != nullptr)
+            {
+                const char* separator = "";
+
+                output.append(",\"profile\":{");
+
+                for (const ProfileSample& sample : report.profile->samples())
+                {
+                    output.append(separator).append('"').append(sample.name).append("\":").append_integer(sample.value);
+                    separator = ",";
+                }
+
+                output.append('}');
+            }
+
+            output.append("}\n");
+        }
+
+    private:
+        static void metric_list(OutputBuffer& output, const MetricTable& metrics, const std::vector<MetricTable::Index>& list)
+        {
+            const char* separator = "";
+
+            output.append('[');
+
+            for (MetricTable::Index index : list)
+            {
+                output.append(separator).append("{\"name\":");
+                string(output, metrics.name(index));
+                output.append(',');
+                metric_fields(output, metrics.value(index));
+                output.append('}');
+                separator = ",";
+            }
+
+            output.append(']');
+        }
+
+        static void metric(OutputBuffer& output, const Metric& value)
+        {
+            output.append('{');
+            metric_fields(output, value);
+            output.append('}');
+        }
+
+        static void metric_fields(OutputBuffer& output, const Metric& value)
+        {
+            output.append("\"value\":");
+            number(output, value.value);
+            output.append(",\"unit\":\"").append(unit_name(value.unit)).append('"');
+        }
+
+        static void number(OutputBuffer& output, double value)
+        {
+            if (std::isfinite(value))
+                output.append_number(value, MACHINE_PRECISION);
+            else
+                output.append("null");
+        }
+
+        static void string(OutputBuffer& output, const std::string& text)
+        {
+            string(output, DumpView{text.data(), text.data() + text.size()});
+        }
+
+        static void string(OutputBuffer& output, const DumpView& text)
+        {
+            static const char hex[] = "0123456789abcdef";
+
+            output.append('"');
+
+            for (const char* it = text.begin; it != text.end; it++)
+            {
+                unsigned char c = *it;
+
+                if (c == '"' || c == '\\')
+                {
+                    output.append('\\').append(*it);
+                }
+                else if (c < 0x20)
+                {
+                    output.append("\\u00").append(hex[c >> 4]).append(hex[c & 0xF]);
+                }
+                else
+                {
+                    output.append(*it);
+                }
+            }
+
+            output.append('"');
+        }
+};
+
+const OutputWriter& output_writer(OutputFormat format)
+{
+    static const NagiosWriter       nagios;
+    static const PrometheusWriter   prometheus;
+    static const InfluxWriter       influx;
+    static const JsonWriter         json;
+
+    switch (format)
+    {
+        case OutputFormat::Nagios:      break;
+        case OutputFormat::Prometheus:  return prometheus;
+        case OutputFormat::Influx:      return influx;
+        case OutputFormat::Json:        return json;
+    }
+
+    return nagios;
+}
+
+std::string join_outputs(OutputFormat format, const std::vector<CheckResult>& results)
+{
+    std::string joined;
+
+    if (format == OutputFormat::Json) joined += '[';
+
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+        std::string output = results[i].output;
+
+        if (format == OutputFormat::Json)
+        {
+            while (! output.empty() && output[output.size() - 1] == '\n') output.erase(output.size() - 1);
+
+            if (i != 0) joined += ',';
+        }
+
+        joined += output;
+    }
+
+    if (format == OutputFormat::Json) joined += "]\n";
+
+    return joined;
+}
+
+std::string status_message(ReturnCode code, const std::string& ok_message, const MetricTable& metrics, const MetricAnnotation& annotate)
+{
+    std::ostringstream output;
+
+    switch (code)
+    {
+        case ReturnCode::OK:
+            output << "GlusterFS Latency OK - " << ok_message;
+            return output.str();
+        case ReturnCode::Critical:
+            output << "GlusterFS Latency CRITICAL - Metrics(s) exceeding thresholds: ";
+            break;
+        case ReturnCode::Warning:
+            output << "GlusterFS Latency WARNING - Metric(s) exceeding thresholds: ";
+            break;
+        default:
+            break;
+    }
+
+    const std::vector<MetricTable::Index>&  exceeding_metrics   = metrics.exceeding(); // the worst ones, at most as many as the user allows
+    std::size_t                             exceeding_count     = metrics.exceeding_count();
+
+    // the metric_count is not used as an index here but to keep count of how many metrics we're outputing
+    for (std::size_t metric_count = 1; metric_count <= exceeding_metrics.size(); metric_count++)
+    {
+        MetricTable::Index  index = exceeding_metrics[metric_count - 1];
+        DumpView            name  = metrics.name(index);
+
+        output.write(name.begin, name.size());
+        output << ": " << metrics.value(index).value << unit_name(metrics.value(index).unit);
+
+        if (annotate) annotate(output, index);
+
+        if (metric_count != exceeding_count) // if we're not at the last element
+        {
+            output << ", ";
+        }
+    }
+
+    // if we did not show all the metrics, inform the user that there are more
+    if (exceeding_count > exceeding_metrics.size())
+    {
+        output << " - " << exceeding_count - exceeding_metrics.size() << " metrics hidden.";
+    }
+
+    return output.str();
+}
+
+std::string format_report(OutputFormat format, const CheckReport& report)
+{
+    std::size_t     metric_count = report.metrics != nullptr ? report.metrics->metrics().size() : 0;
+    OutputBuffer    formatted(report.message.size() + metric_count * 128); // about the longest perfdata entry, so it's never reallocated
+
+    output_writer(format).write(formatted, report);
+
+    return formatted.str();
+}
+
+std::string format_failure(const CheckOptions& options, const std::string& volume, std::time_t dump_mtime, const CheckProfile* profile,
+                           ReturnCode& code)
+{
+    std::ostringstream output;
+
+    code = report_exception(output);
+
+    std::string     message = output.str();
+    CheckReport     report  = {volume, code, message, nullptr, nullptr, false, {0, UnitType::Microseconds}, options.warning_threshold, options.critical_threshold, dump_mtime,
+                               nullptr, profile};
+
+    return format_report(options.output_format, report);
+}
@@ -0,0 +1,114 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - output formats
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_OUTPUT_WRITER_HPP
+#define CHECK_GLUSTER_PERF_OUTPUT_WRITER_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <ostream>
+#include <stdexcept>
+#include <cstdint>
+#include <ctime>
+
+#include "check_gluster_perf.hpp"
+#include "dump_reader.hpp"
+#include "metric_table.hpp"
+#include "metric_groups.hpp"
+#include "profile.hpp"
+#include "metric_rules.hpp"
+
+/*
+Text built by appending to one growing buffer, numbers are printed straight into it (snprintf,
+the C++11 stand-in for std::to_chars) instead of going through a stream. The result is written
+with as few write() calls as the kernel allows, or atomically replaces a file.
+*/
+class OutputBuffer
+{
+    public:
+        explicit OutputBuffer(std::size_t capacity = 4096) { m_data.reserve(capacity); }
+
+        void            reserve(std::size_t capacity) { m_data.reserve(capacity); }
+
+        OutputBuffer&   append(char character) { m_data += character; return *this; }
+        OutputBuffer&   append(const char* text) { m_data += text; return *this; }
+        OutputBuffer&   append(const std::string& text) { m_data += text; return *this; }
+        OutputBuffer&   append(const DumpView& text) { m_data.append(text.begin, text.end); return *this; }
+
+        /* %g with 'precision' significant digits, 6 prints exactly what std::ostream does by default */
+        OutputBuffer&   append_number(double value, int precision = 6);
+        OutputBuffer&   append_integer(std::int64_t value);
+
+        const std::string&  str() const { return m_data; }
+
+        void            write_to(int fd) const throw (std::runtime_error);
+        void            write_to_file(const std::string& path) const throw (std::runtime_error) { replace_file(path, m_data, 0644); }
+
+    private:
+        std::string     m_data;
+};
+
+/* What a check found, for the output formats to pick from */
+struct CheckReport {
+    const std::string&  volume;
+    ReturnCode          code;
+    const std::string&  message;        // the Nagios status text, without the performance data
+    const MetricTable*  metrics;        // nullptr if the check failed before evaluating the dump
+    const MetricGroups* groups;         // nullptr without -group-by
+    bool                has_average;
+    Metric              total_average;
+    Metric              warning_threshold;
+    Metric              critical_threshold;
+    std::time_t         dump_mtime;     // 0 if the dump couldn't be stat'ed
+    const MetricRules*  rules;          // nullptr without -rules, the metrics they match are reported with their rule's thresholds
+    const CheckProfile* profile;        // nullptr without -self-profile, written last so that it covers the rest of the output
+};
+
+/*
+One output format. Writers are stateless, the report of one volume is written at a time and
+the outputs of several volumes are put together by join_outputs.
+*/
+class OutputWriter
+{
+    public:
+        virtual         ~OutputWriter() {}
+
+        virtual void    write(OutputBuffer& output, const CheckReport& report) const = 0;
+};
+
+/* The writer of -output-format */
+const OutputWriter& output_writer(OutputFormat format);
+
+/* Puts the outputs of several volumes' checks together: one after the other, or as a JSON array */
+std::string         join_outputs(OutputFormat format, const std::vector<CheckResult>& results);
+
+/* Nagios performance data, "'name'=value<unit>;warning;critical " for every metric, with its rule's thresholds if one matches */
+void                append_nagios_perfdata(OutputBuffer& output, const MetricTable& metrics, const Metric& warning, const Metric& critical,
+                                           const MetricRules* rules = nullptr);
+
+/* Appends what a listed exceeding metric is annotated with, e.g. the node -nodes found it on */
+typedef std::function<void(std::ostream& output, MetricTable::Index index)> MetricAnnotation;
+
+/*
+The Nagios status text of an evaluated check: "GlusterFS Latency OK - <ok_message>", or the
+exceeding metrics of 'metrics', the worst ones first and the others only counted.
+*/
+std::string         status_message(ReturnCode code, const std::string& ok_message, const MetricTable& metrics,
+                                   const MetricAnnotation& annotate = nullptr);
+
+/* The report of an evaluated check in 'format', with room for its performance data reserved up front */
+std::string         format_report(OutputFormat format, const CheckReport& report);
+
+/*
+To be called from within a catch block: the report of a check that failed, in -output-format,
+with the message of report_exception. 'code' gets the Nagios code the exception maps to.
+*/
+std::string         format_failure(const CheckOptions& options, const std::string& volume, std::time_t dump_mtime, const CheckProfile* profile,
+                                   ReturnCode& code);
+
+#endif
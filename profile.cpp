@@ -0,0 +1,109 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - self profiling
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "profile.hpp"
+
+#include <new>
+#include <cstdlib>
+
+/*
+Every allocation of the program goes through this operator new, which counts them in the
+allocating thread: a few plain increments of thread local counters, cheap enough to stay on
+whether -self-profile is given or not. Allocations the standard library makes with malloc()
+directly aren't counted.
+*/
+static thread_local std::uint64_t t_allocations     = 0;
+static thread_local std::uint64_t t_allocated_bytes = 0;
+
+void* operator new(std::size_t size)
+{
+    t_allocations++;
+    t_allocated_bytes += size;
+
+    for (;;)
+    {
+        if (void* memory = std::malloc(size != 0 ? size : 1)) return memory;
+
+        std::new_handler handler = std::get_new_handler();
+
+        if (handler == nullptr) throw std::bad_alloc();
+
+        handler();
+    }
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+std::uint64_t thread_allocations()
+{
+    return t_allocations;
+}
+
+std::uint64_t thread_allocated_bytes()
+{
+    return t_allocated_bytes;
+}
+
+CheckProfile::CheckProfile(bool enabled)
+    : m_enabled(enabled),
+      m_phase(-1),
+      m_phase_us(),
+      m_allocations(0),
+      m_allocated_bytes(0)
+{
+    if (! m_enabled) return;
+
+    m_start           = Clock::now();
+    m_phase_start     = m_start;
+    m_allocations     = thread_allocations();
+    m_allocated_bytes = thread_allocated_bytes();
+}
+
+void CheckProfile::begin(Phase phase)
+{
+    if (! m_enabled) return;
+
+    Clock::time_point now = Clock::now();
+
+    if (m_phase != -1)
+    {
+        m_phase_us[m_phase] += std::chrono::duration_cast<std::chrono::microseconds>(now - m_phase_start).count();
+    }
+
+    m_phase       = (int) phase;
+    m_phase_start = now;
+}
+
+std::vector<ProfileSample> CheckProfile::samples() const
+{
+    static const char* const phase_names[PHASE_COUNT] = {"check_stat_us", "check_parse_us", "check_evaluate_us", "check_output_us"};
+
+    std::uint64_t               allocations     = thread_allocations() - m_allocations; // before the samples allocate
+    std::uint64_t               allocated_bytes = thread_allocated_bytes() - m_allocated_bytes;
+    Clock::time_point           now             = Clock::now();
+    std::vector<ProfileSample>  samples;
+
+    if (! m_enabled) return samples;
+
+    for (int phase = 0; phase < PHASE_COUNT; phase++)
+    {
+        std::int64_t elapsed = m_phase_us[phase];
+
+        if (phase == m_phase) elapsed += std::chrono::duration_cast<std::chrono::microseconds>(now - m_phase_start).count();
+
+        samples.push_back({phase_names[phase], elapsed, "us"});
+    }
+
+    samples.push_back({"check_total_us", std::chrono::duration_cast<std::chrono::microseconds>(now - m_start).count(), "us"});
+    samples.push_back({"check_allocs", (std::int64_t) allocations, ""});
+    samples.push_back({"check_alloc_bytes", (std::int64_t) allocated_bytes, "B"});
+
+    return samples;
+}
@@ -0,0 +1,72 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - self profiling
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_PROFILE_HPP
+#define CHECK_GLUSTER_PERF_PROFILE_HPP
+
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+/*
+The phases of a check -self-profile times:
+
+- Stat:     finding the dump and checking its age (get_file_timestamp)
+- Parse:    reading and parsing the dump (DumpSnapshot, parse_json_dump); with -stream, parsing and evaluating it, which is one pass
+- Evaluate: filtering the metrics and comparing them with the thresholds, groups, windows, baselines
+- Output:   the message and the performance data, in -output-format
+*/
+enum class Phase : short {
+    Stat, Parse, Evaluate, Output
+};
+
+/* One value of the profile, reported as performance data */
+struct ProfileSample {
+    const char*     name;   // e.g. "check_parse_us"
+    std::int64_t    value;
+    const char*     unit;   // Nagios unit of measurement, "" for counts
+};
+
+/*
+Wall time per phase on a monotonic clock, and the allocations made by the calling thread while
+the profile runs (see the operator new in profile.cpp, which counts per thread: the checks of a
+batch run on several threads at once).
+
+A disabled profile does nothing, so check_volume can time its phases unconditionally.
+*/
+class CheckProfile
+{
+    public:
+        explicit CheckProfile(bool enabled);
+
+        bool        enabled() const { return m_enabled; }
+
+        /* Ends the running phase, if any, and starts 'phase' */
+        void        begin(Phase phase);
+
+        /* The profile so far, the running phase counted up to now */
+        std::vector<ProfileSample> samples() const;
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        static const int PHASE_COUNT = (int) Phase::Output + 1;
+
+        bool                m_enabled;
+        int                 m_phase;            // -1 until the first begin()
+        Clock::time_point   m_start;
+        Clock::time_point   m_phase_start;
+        std::int64_t        m_phase_us[PHASE_COUNT];
+        std::uint64_t       m_allocations;      // the thread's counters when the profile started
+        std::uint64_t       m_allocated_bytes;
+};
+
+/* Allocations made by the calling thread since it started, through operator new */
+std::uint64_t thread_allocations();
+std::uint64_t thread_allocated_bytes();
+
+#endif
@@ -0,0 +1,479 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - streaming reader of saved volume profiles
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "profile_xml.hpp"
+#include "metric_evaluator.hpp"
+
+#include <sstream>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+XmlPullParser::XmlPullParser(const std::string& path) throw (std::runtime_error)
+    : m_path(path), m_fd(open(path.c_str(), O_RDONLY | O_CLOEXEC))
+{
+    if (m_fd == -1)
+    {
+        std::ostringstream error;
+        error << strerror(errno) << " While trying to open: " << path;
+
+        throw std::runtime_error(error.str());
+    }
+}
+
+XmlPullParser::~XmlPullParser()
+{
+    close(m_fd);
+}
+
+bool XmlPullParser::refill() throw (std::runtime_error)
+{
+    for (;;)
+    {
+        ssize_t count = read(m_fd, m_buffer, sizeof(m_buffer));
+
+        if (count == -1 && errno == EINTR) continue;
+
+        if (count == -1)
+        {
+            std::ostringstream error;
+            error << strerror(errno) << " While trying to read: " << m_path;
+
+            throw std::runtime_error(error.str());
+        }
+
+        m_position  = 0;
+        m_end       = count;
+
+        return count > 0;
+    }
+}
+
+int XmlPullParser::get()
+{
+    int character = peek();
+
+    if (character != -1)
+    {
+        m_position++;
+
+        if (character == '\n') m_line++;
+    }
+
+    return character;
+}
+
+void XmlPullParser::fail(const std::string& what) const throw (std::runtime_error)
+{
+    std::ostringstream error;
+    error << "Malformed profile XML " << m_path << " at line " << m_line << ", " << what;
+
+    throw std::runtime_error(error.str());
+}
+
+void XmlPullParser::read_name() throw (std::runtime_error)
+{
+    m_name.clear();
+
+    for (int character = peek(); character != -1 && std::strchr(" \t\r\n/>=", character) == nullptr; character = peek())
+    {
+        m_name += (char) get();
+
+        if (m_name.size() > MAX_TOKEN) fail("element name longer than supported");
+    }
+
+    if (m_name.empty()) fail("expected an element name");
+}
+
+void XmlPullParser::skip_past(const char* terminator) throw (std::runtime_error)
+{
+    std::size_t length = std::strlen(terminator);
+    std::string window; // the last characters read, as many as the terminator has
+
+    while (window.size() < length || window.compare(window.size() - length, length, terminator) != 0)
+    {
+        int character = get();
+
+        if (character == -1) fail(std::string("expected '") + terminator + "'");
+
+        if (window.size() == length) window.erase(0, 1);
+
+        window += (char) character;
+    }
+}
+
+void XmlPullParser::read_entity() throw (std::runtime_error)
+{
+    std::string entity;
+    int         character;
+
+    while ((character = get()) != ';')
+    {
+        if (character == -1 || entity.size() > 8) fail("unterminated entity");
+
+        entity += (char) character;
+    }
+
+    if      (entity == "amp")   m_text += '&';
+    else if (entity == "lt")    m_text += '<';
+    else if (entity == "gt")    m_text += '>';
+    else if (entity == "quot")  m_text += '"';
+    else if (entity == "apos")  m_text += '\'';
+    else if (entity.size() > 1 && entity[0] == '#')
+    {
+        char*           end;
+        unsigned long   code = entity[1] == 'x' ? std::strtoul(entity.c_str() + 2, &end, 16) : std::strtoul(entity.c_str() + 1, &end, 10);
+
+        if (*end != '\0' || code == 0 || code > 0x10FFFF) fail("invalid character reference &" + entity + ";");
+
+        // UTF-8
+        if (code < 0x80)
+        {
+            m_text += (char) code;
+        }
+        else if (code < 0x800)
+        {
+            m_text += (char) (0xC0 | (code >> 6));
+            m_text += (char) (0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000)
+        {
+            m_text += (char) (0xE0 | (code >> 12));
+            m_text += (char) (0x80 | ((code >> 6) & 0x3F));
+            m_text += (char) (0x80 | (code & 0x3F));
+        }
+        else
+        {
+            m_text += (char) (0xF0 | (code >> 18));
+            m_text += (char) (0x80 | ((code >> 12) & 0x3F));
+            m_text += (char) (0x80 | ((code >> 6) & 0x3F));
+            m_text += (char) (0x80 | (code & 0x3F));
+        }
+    }
+    else
+    {
+        fail("unknown entity &" + entity + ";");
+    }
+}
+
+XmlPullParser::Event XmlPullParser::next() throw (std::runtime_error)
+{
+    if (m_empty_element)
+    {
+        m_empty_element = false;
+        m_depth--;
+
+        return Event::EndElement;
+    }
+
+    for (;;)
+    {
+        int character = peek();
+
+        if (character == -1)
+        {
+            if (m_depth != 0) fail("unexpected end of file, elements left open");
+
+            return Event::End;
+        }
+
+        if (character != '<')
+        {
+            bool blank = true;
+
+            m_text.clear();
+
+            while ((character = peek()) != -1 && character != '<')
+            {
+                get();
+
+                if (character == '&')
+                    read_entity();
+                else
+                    m_text += (char) character;
+
+                if (character != ' ' && character != '\t' && character != '\r' && character != '\n') blank = false;
+
+                if (m_text.size() > MAX_TOKEN) fail("text longer than supported");
+            }
+
+            if (blank) continue;
+
+            if (m_depth == 0) fail("text outside of the root element");
+
+            return Event::Text;
+        }
+
+        get(); // '<'
+
+        character = peek();
+
+        if (character == '?')
+        {
+            skip_past("?>"); // the declaration, processing instructions
+            continue;
+        }
+
+        if (character == '!')
+        {
+            get();
+
+            if (peek() == '-')
+            {
+                get();
+
+                if (get() != '-') fail("expected a comment");
+
+                skip_past("-->");
+                continue;
+            }
+
+            if (peek() == '[')
+            {
+                skip_past("[CDATA[");
+
+                m_text.clear();
+
+                while (m_text.size() < 3 || m_text.compare(m_text.size() - 3, 3, "]]>") != 0)
+                {
+                    if ((character = get()) == -1) fail("unterminated CDATA section");
+
+                    m_text += (char) character;
+
+                    if (m_text.size() > MAX_TOKEN) fail("text longer than supported");
+                }
+
+                m_text.resize(m_text.size() - 3);
+
+                if (m_depth == 0) fail("text outside of the root element");
+
+                return Event::Text;
+            }
+
+            skip_past(">"); // a DOCTYPE, the CLI never writes one with an internal subset
+            continue;
+        }
+
+        if (character == '/')
+        {
+            get();
+            read_name();
+
+            while ((character = get()) == ' ' || character == '\t' || character == '\r' || character == '\n');
+
+            if (character != '>') fail("expected '>'");
+            if (m_depth == 0) fail("end tag without a start tag");
+
+            m_depth--;
+
+            return Event::EndElement;
+        }
+
+        read_name();
+
+        // attributes are skipped, a quoted value may hold '>'
+        for (;;)
+        {
+            character = get();
+
+            if (character == -1) fail("unexpected end of file in a tag");
+
+            if (character == '"' || character == '\'')
+            {
+                int quote = character;
+
+                while ((character = get()) != quote)
+                {
+                    if (character == -1) fail("unexpected end of file in an attribute");
+                }
+
+                continue;
+            }
+
+            if (character == '/' && peek() == '>')
+            {
+                get();
+                m_empty_element = true;
+                break;
+            }
+
+            if (character == '>') break;
+        }
+
+        m_depth++;
+
+        return Event::StartElement;
+    }
+}
+
+static bool equals(const DumpView& view, const char* text)
+{
+    return view.size() == std::strlen(text) && std::memcmp(view.begin, text, view.size()) == 0;
+}
+
+static DumpView trim(const DumpView& view)
+{
+    DumpView trimmed = view;
+
+    while (trimmed.begin != trimmed.end && std::strchr(" \t\r\n", *trimmed.begin) != nullptr) trimmed.begin++;
+    while (trimmed.end != trimmed.begin && std::strchr(" \t\r\n", *(trimmed.end - 1)) != nullptr) trimmed.end--;
+
+    return trimmed;
+}
+
+ReturnCode  process_profile_xml(
+        MetricTable& metrics,
+        Metric& total_average,
+        int& bricks,
+        const std::string& profile_file,
+        const Metric& warning_threshold,
+        const Metric& critical_threshold,
+        const UnitType& unit_type_output,
+        const UnitType& gluster_unit_type,
+        const MetricFilter& metric_filter,
+        bool disable_threshold_comparison,
+        IntervalState* interval_state,
+        MetricGroups* groups,
+        AverageWeight average_weight,
+        const MetricRules* rules) throw (std::runtime_error)
+{
+    static const std::size_t MAX_DEPTH = 64; // the CLI's output is about 8 deep
+
+    MetricEvaluator             evaluator(metrics,
+                                          warning_threshold, critical_threshold,
+                                          unit_type_output, gluster_unit_type,
+                                          metric_filter, disable_threshold_comparison,
+                                          interval_state, groups, average_weight, rules);
+    XmlPullParser               parser(profile_file); // this throws
+    std::vector<std::string>    path; // the names of the open elements, the strings are reused
+    std::size_t                 depth = 0;
+    std::string                 brick, scope, key,
+                                fop, hits, latency_ave, latency_min, latency_max,  // of the <fop> being read
+                                block_size, block_reads, block_writes,              // of the <block> being read
+                                op_ret, op_error;
+
+    // evaluates "<brick>.<scope><prefix><middle><suffix>" with 'value' as read from the XML
+    auto emit = [&](const char* prefix, const std::string& middle, const char* suffix, const DumpView& value)
+    {
+        if (value.size() == 0) return;
+
+        if (brick.empty() || scope.empty()) parser.fail("statistics outside of a brick's cumulativeStats or intervalStats");
+
+        key.assign(brick).append(1, '.').append(scope).append(prefix).append(middle).append(suffix);
+        evaluator.evaluate({key.data(), key.data() + key.size()}, value);
+    };
+
+    auto view = [](const std::string& text) -> DumpView { return {text.data(), text.data() + text.size()}; };
+
+    bricks = 0;
+
+    for (XmlPullParser::Event event = parser.next(); event != XmlPullParser::Event::End; event = parser.next())
+    {
+        DumpView name = parser.name();
+
+        if (event == XmlPullParser::Event::StartElement)
+        {
+            if (depth == 0 && ! equals(name, "cliOutput")) parser.fail("not a gluster CLI output, expected <cliOutput>");
+            if (depth == MAX_DEPTH) parser.fail("elements nested deeper than supported");
+
+            if (depth == path.size()) path.emplace_back();
+
+            path[depth++].assign(name.begin, name.end);
+
+            if      (equals(name, "brick"))           brick.clear();
+            else if (equals(name, "cumulativeStats")) scope = "aggr";
+            else if (equals(name, "intervalStats"))   scope = "inter";
+            else if (equals(name, "fop"))             fop.clear(), hits.clear(), latency_ave.clear(), latency_min.clear(), latency_max.clear();
+            else if (equals(name, "block"))           block_size.clear(), block_reads.clear(), block_writes.clear();
+        }
+        else if (event == XmlPullParser::Event::EndElement)
+        {
+            if (path[depth - 1].size() != name.size() || path[depth - 1].compare(0, name.size(), name.begin, name.size()) != 0)
+            {
+                parser.fail("</" + std::string(name.begin, name.end) + "> doesn't close <" + path[depth - 1] + ">");
+            }
+
+            if (equals(name, "fop"))
+            {
+                if (fop.empty()) parser.fail("a <fop> without a <name>");
+
+                emit(".fop.", fop, ".count", view(hits));
+                emit(".fop.", fop, ".latency_ave_usec", view(latency_ave));
+                emit(".fop.", fop, ".latency_min_usec", view(latency_min));
+                emit(".fop.", fop, ".latency_max_usec", view(latency_max));
+            }
+            else if (equals(name, "block"))
+            {
+                if (block_size.empty()) parser.fail("a <block> without a <size>");
+
+                emit(".read_", block_size, "b", view(block_reads));
+                emit(".write_", block_size, "b", view(block_writes));
+            }
+            else if (equals(name, "cumulativeStats") || equals(name, "intervalStats"))
+            {
+                scope.clear();
+            }
+            else if (equals(name, "brick"))
+            {
+                bricks++;
+            }
+
+            depth--;
+        }
+        else
+        {
+            const std::string&  element = path[depth - 1];
+            const std::string*  parent  = depth >= 2 ? &path[depth - 2] : nullptr;
+            DumpView            text    = trim(parser.text());
+            std::string*        target  = nullptr; // where the text is kept until its element's parent ends
+
+            if (parent == nullptr) continue;
+
+            if (*parent == "fop")
+            {
+                if      (element == "name")         target = &fop;
+                else if (element == "hits")         target = &hits;
+                else if (element == "avgLatency")   target = &latency_ave;
+                else if (element == "minLatency")   target = &latency_min;
+                else if (element == "maxLatency")   target = &latency_max;
+            }
+            else if (*parent == "block")
+            {
+                if      (element == "size")         target = &block_size;
+                else if (element == "reads")        target = &block_reads;
+                else if (element == "writes")       target = &block_writes;
+            }
+            else if (*parent == "cumulativeStats" || *parent == "intervalStats")
+            {
+                if      (element == "duration")     emit(".duration", "", "", text);
+                else if (element == "totalRead")    emit(".read_bytes", "", "", text);
+                else if (element == "totalWrite")   emit(".write_bytes", "", "", text);
+            }
+            else if (*parent == "brick" && element == "brickName")
+            {
+                target = &brick;
+            }
+            else if (*parent == "cliOutput")
+            {
+                if      (element == "opRet")        target = &op_ret;
+                else if (element == "opErrstr")     target = &op_error;
+            }
+
+            if (target != nullptr) target->assign(text.begin, text.end);
+        }
+    }
+
+    if (op_ret != "" && op_ret != "0")
+    {
+        throw std::runtime_error("The saved profile records a failed gluster command: " + (op_error.empty() ? "opRet " + op_ret : op_error));
+    }
+
+    return evaluator.finish(total_average);
+}
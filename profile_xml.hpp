@@ -0,0 +1,108 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - streaming reader of saved volume profiles
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_PROFILE_XML_HPP
+#define CHECK_GLUSTER_PERF_PROFILE_XML_HPP
+
+#include <string>
+#include <stdexcept>
+
+#include "check_gluster_perf.hpp"
+#include "dump_reader.hpp"
+#include "metric_filter.hpp"
+#include "interval.hpp"
+#include "metric_table.hpp"
+#include "metric_groups.hpp"
+
+/*
+Pull parser for the subset of XML the gluster CLI writes: elements, text, the declaration,
+comments and CDATA sections. Attributes are skipped, entities are decoded in text. The file is
+read through a fixed size buffer, one event per next():
+
+    StartElement    name() is the element's
+    EndElement      name() is the element's, also right after the start of an empty element <a/>
+    Text            text() is the decoded text, text made of white space only isn't reported
+    End             the whole file was read
+
+Memory doesn't depend on the file size, only names and texts up to MAX_TOKEN bytes are held.
+*/
+class XmlPullParser
+{
+    public:
+        enum class Event {
+            StartElement, EndElement, Text, End
+        };
+
+        explicit XmlPullParser(const std::string& path) throw (std::runtime_error);
+        ~XmlPullParser();
+
+        Event       next() throw (std::runtime_error);
+
+        DumpView    name() const { return {m_name.data(), m_name.data() + m_name.size()}; }
+        DumpView    text() const { return {m_text.data(), m_text.data() + m_text.size()}; }
+
+        /* Throws a runtime_error locating the current position */
+        void        fail(const std::string& what) const throw (std::runtime_error);
+
+        static const std::size_t MAX_TOKEN = 64 * 1024;
+
+    private:
+        XmlPullParser(const XmlPullParser&);            // not copyable, owns the file
+        XmlPullParser& operator=(const XmlPullParser&);
+
+        bool        refill() throw (std::runtime_error);
+        int         peek() { return m_position < m_end || refill() ? (unsigned char) m_buffer[m_position] : -1; }
+        int         get();
+        void        read_name() throw (std::runtime_error);
+        void        skip_past(const char* terminator) throw (std::runtime_error);
+        void        read_entity() throw (std::runtime_error);
+
+        std::string m_path;
+        int         m_fd;
+        char        m_buffer[64 * 1024];
+        std::size_t m_position  = 0;
+        std::size_t m_end       = 0;
+        int         m_line      = 1;
+        int         m_depth     = 0;
+        bool        m_empty_element = false; // <a/> was read, its EndElement comes next
+        std::string m_name;
+        std::string m_text;
+};
+
+/*
+Evaluates a saved 'gluster volume profile <volume> info --xml' (-dump-format profile-xml) the
+way process_metrics_stream does a dump, through the same MetricEvaluator, in one pass of an
+XmlPullParser over the file. Every brick's cumulative and interval statistics become metrics
+named like the ones of the dumps:
+
+    <brick>.aggr.fop.WRITE.latency_ave_usec     avgLatency, also _min_usec and _max_usec
+    <brick>.aggr.fop.WRITE.count                hits
+    <brick>.aggr.read_4096b                     the block size histogram, also write_<size>b
+    <brick>.aggr.read_bytes                     totalRead, also write_bytes and duration
+
+'inter' instead of 'aggr' for the interval statistics. The latencies are in microseconds, the
+only ones compared and averaged; the rest are counters, see metric_schema.hpp.
+
+Returns the number of bricks found through 'bricks'. Throws if the file can't be read, isn't
+well formed, or records a failed profile command.
+*/
+ReturnCode  process_profile_xml(MetricTable& metrics,
+                                Metric& total_average,
+                                int& bricks,
+                                const std::string& profile_file,
+                                const Metric& warning_threshold,
+                                const Metric& critical_threshold,
+                                const UnitType& unit_type_output,
+                                const UnitType& gluster_unit_type,
+                                const MetricFilter& metric_filter,
+                                bool disable_threshold_comparison,
+                                IntervalState* interval_state = nullptr,
+                                MetricGroups* groups = nullptr,
+                                AverageWeight average_weight = AverageWeight::None,
+                                const MetricRules* rules = nullptr) throw (std::runtime_error);
+
+#endif
@@ -0,0 +1,153 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - offline replay of archived dumps
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "replay.hpp"
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <cstdlib>
+
+#include "metric_table.hpp"
+#include "batch.hpp"
+
+std::vector<double> parse_threshold_list(const std::string& list) throw (std::invalid_argument)
+{
+    std::istringstream  items(list);
+    std::string         item;
+    std::vector<double> thresholds;
+
+    while (std::getline(items, item, ','))
+    {
+        if (item.empty()) continue;
+
+        char*   end;
+        double  threshold = std::strtod(item.c_str(), &end);
+
+        if (*end != '\0')
+        {
+            throw std::invalid_argument("Invalid threshold '" + item + "' in the list '" + list + "'.");
+        }
+
+        thresholds.push_back(threshold);
+    }
+
+    return thresholds;
+}
+
+/* What the thresholds are compared with in one dump, in the output unit */
+struct ReplayedDump {
+    bool    readable;
+    double  compared;
+};
+
+static ReplayedDump replay_dump(const std::string& file, const CheckOptions& options, const MetricFilter& metric_filter)
+{
+    ReplayedDump    replayed = {false, 0};
+    MetricTable     metrics;
+    Metric          total_average;
+
+    try
+    {
+        evaluate_dump(options, metric_filter, file, metrics, total_average); // without thresholds, every candidate is compared afterwards
+    }
+    catch (const std::exception&)
+    {
+        return replayed; // a real check would have reported it, the summary counts it
+    }
+
+    replayed.readable = true;
+
+    if (options.apply_on_total)
+    {
+        replayed.compared = total_average.value;
+    }
+    else
+    {
+        // a metric exceeds a threshold if value >= threshold, so only the highest one matters
+        replayed.compared = -std::numeric_limits<double>::infinity();
+
+        for (MetricTable::Index index : metrics.metrics())
+        {
+            replayed.compared = std::max(replayed.compared, metrics.value(index).value);
+        }
+    }
+
+    return replayed;
+}
+
+ReplaySummary replay_dumps(const std::vector<std::string>& files,
+                           const CheckOptions& options,
+                           const MetricFilter& metric_filter,
+                           const std::vector<double>& warnings,
+                           const std::vector<double>& criticals,
+                           unsigned threads)
+{
+    ReplaySummary               summary = {files.size(), 0, 0, {}};
+    std::vector<ReplayedDump>   replayed(files.size());
+    auto                        start = std::chrono::steady_clock::now();
+
+    run_parallel(files.size(), threads, [&](std::size_t index)
+    {
+        replayed[index] = replay_dump(files[index], options, metric_filter);
+    });
+
+    for (double warning : warnings)
+    {
+        for (double critical : criticals)
+        {
+            if (warning > critical) continue;
+
+            ReplayCell  cell        = {{warning, options.warning_threshold.unit}, {critical, options.critical_threshold.unit}, 0, 0, 0};
+            double      warning_t   = convert(cell.warning, options.unit_type_output).value;
+            double      critical_t  = convert(cell.critical, options.unit_type_output).value;
+
+            for (const ReplayedDump& dump : replayed)
+            {
+                if (! dump.readable)                    continue;
+                else if (dump.compared >= critical_t)   cell.criticals++;
+                else if (dump.compared >= warning_t)    cell.warnings++;
+                else                                    cell.ok++;
+            }
+
+            summary.cells.push_back(cell);
+        }
+    }
+
+    for (const ReplayedDump& dump : replayed)
+    {
+        if (! dump.readable) summary.unreadable++;
+    }
+
+    summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return summary;
+}
+
+void output_replay_summary(std::ostream& output, const ReplaySummary& summary)
+{
+    output << "Replayed " << summary.files << " dump(s) in " << std::fixed << std::setprecision(3) << summary.seconds << "s";
+
+    if (summary.unreadable != 0) output << ", " << summary.unreadable << " couldn't be read";
+
+    output << std::endl << std::defaultfloat;
+    output << std::left << std::setw(12) << "warning" << std::setw(12) << "critical"
+           << std::right << std::setw(10) << "OK" << std::setw(10) << "WARNING" << std::setw(10) << "CRITICAL" << std::endl;
+
+    for (const ReplayCell& cell : summary.cells)
+    {
+        std::ostringstream warning, critical;
+
+        warning << cell.warning.value << unit_name(cell.warning.unit);
+        critical << cell.critical.value << unit_name(cell.critical.unit);
+
+        output << std::left << std::setw(12) << warning.str() << std::setw(12) << critical.str()
+               << std::right << std::setw(10) << cell.ok << std::setw(10) << cell.warnings << std::setw(10) << cell.criticals << std::endl;
+    }
+}
@@ -0,0 +1,55 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - offline replay of archived dumps
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_REPLAY_HPP
+#define CHECK_GLUSTER_PERF_REPLAY_HPP
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <stdexcept>
+#include <cstddef>
+
+#include "check_gluster_perf.hpp"
+#include "metric_filter.hpp"
+
+/* One candidate -w/-c pair of a replay and the states it would have reported */
+struct ReplayCell {
+    Metric          warning;
+    Metric          critical;
+    std::size_t     ok;
+    std::size_t     warnings;
+    std::size_t     criticals;
+};
+
+struct ReplaySummary {
+    std::size_t             files;
+    std::size_t             unreadable;     // dumps that couldn't be read or held no data, UNKNOWN/CRITICAL in a real check
+    double                  seconds;
+    std::vector<ReplayCell> cells;          // every warning and critical candidate, in the order given
+};
+
+/* A comma separated list of threshold candidates, e.g. "50,100,200" */
+std::vector<double> parse_threshold_list(const std::string& list) throw (std::invalid_argument);
+
+/*
+Evaluates every dump once, on up to 'threads' workers (0 means one per core), the way a check
+with 'options' would, and keeps what the thresholds are compared with: the highest metric, or
+the total average with -apply-on-total-avg. Every candidate pair is then compared with that,
+so the grid costs nothing per dump. Pairs whose warning is above the critical one are skipped.
+*/
+ReplaySummary replay_dumps(const std::vector<std::string>& files,
+                           const CheckOptions& options,
+                           const MetricFilter& metric_filter,
+                           const std::vector<double>& warnings,
+                           const std::vector<double>& criticals,
+                           unsigned threads);
+
+/* The summary as a table, one line per candidate pair */
+void        output_replay_summary(std::ostream& output, const ReplaySummary& summary);
+
+#endif
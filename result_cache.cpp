@@ -0,0 +1,203 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - on-disk cache of evaluated dumps
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "result_cache.hpp"
+
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+
+/*
+Cache file layout, native byte order, meant to be read straight out of the mapping:
+
+    CacheHeader CacheEntry[metric_count] CacheEntry[exceeding_count] char names[names_size]
+
+The performance metrics in name order, then the listed ones of those that exceeded a threshold,
+the most severe first.
+*/
+static const char           CACHE_MAGIC[4]  = {'C', 'G', 'P', 'C'};
+static const std::uint32_t  CACHE_VERSION   = 5;
+
+struct CacheHeader {
+    char            magic[4];
+    std::uint32_t   version;
+    std::uint64_t   options_hash;
+    DumpIdentity    dump;
+    double          total_average;
+    std::int32_t    total_average_unit;
+    std::int32_t    check_code;
+    std::uint32_t   metric_count;
+    std::uint32_t   exceeding_count;
+    std::uint32_t   names_size;
+    std::uint32_t   exceeding_total;    // listed or not
+};
+
+struct CacheEntry {
+    double          value;
+    std::uint32_t   name_offset;
+    std::uint32_t   name_length;
+    std::int16_t    unit;
+    std::uint8_t    reserved[6];
+    double          severity;           // of the exceeding ones
+};
+
+static_assert(sizeof(CacheHeader) == 88 && sizeof(CacheEntry) == 32, "the cache file layout depends on these having no padding");
+
+ResultCache::ResultCache(const std::string& cache_dir, const std::string& volume, const CheckOptions& options, const DumpIdentity& dump,
+                         std::uint64_t rules_digest)
+    : m_dump(dump)
+{
+    std::ostringstream key, file;
+
+    // everything the evaluated metric set depends on, the exceeding list is as long as -exceeded-metrics-report-count, the other output options only shape the message
+    key.precision(17);
+    key << CACHE_VERSION << '\t'
+        << options.warning_threshold.value << '\t' << (int) options.warning_threshold.unit << '\t'
+        << options.critical_threshold.value << '\t' << (int) options.critical_threshold.unit << '\t'
+        << (int) options.unit_type_output << '\t' << (int) options.gluster_unit_type << '\t'
+        << options.apply_on_total << '\t' << (int) options.average_weight << '\t' << (int) options.dump_format << '\t'
+        << compares_each_metric(options) << '\t' << rules_digest << '\t' << options.max_report_metrics << '\t' << options.filter_regex;
+
+    m_options_hash = hash_text(key.str());
+
+    file << cache_dir << "/check_gluster_perf_" << volume << "_" << std::hex << std::setw(16) << std::setfill('0') << m_options_hash << ".cache";
+
+    m_file = file.str();
+}
+
+bool ResultCache::load(MetricTable& metrics, Metric& total_average, ReturnCode& check_code) const
+{
+    std::time_t dump_mtime;
+
+    return load(metrics, total_average, check_code, false, 0, dump_mtime);
+}
+
+bool ResultCache::load_last(MetricTable& metrics, Metric& total_average, ReturnCode& check_code, std::time_t not_before, std::time_t& dump_mtime) const
+{
+    return load(metrics, total_average, check_code, true, not_before, dump_mtime);
+}
+
+bool ResultCache::load(MetricTable& metrics, Metric& total_average, ReturnCode& check_code, bool any_dump, std::time_t not_before, std::time_t& dump_mtime) const
+{
+    CacheHeader header;
+
+    try
+    {
+        MappedFile  cache(m_file); // this throws, a missing file is just a miss
+
+        if (cache.size() < sizeof(header)) return false;
+
+        std::memcpy(&header, cache.data(), sizeof(header));
+
+        std::size_t entry_count = (std::size_t) header.metric_count + header.exceeding_count;
+
+        if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != CACHE_VERSION ||
+            header.options_hash != m_options_hash ||
+            ! (any_dump || header.dump == m_dump) ||
+            header.dump.mtime_sec < not_before ||
+            header.check_code < (int) ReturnCode::OK || header.check_code > (int) ReturnCode::Unknown ||
+            header.exceeding_total < header.exceeding_count ||
+            cache.size() != sizeof(header) + entry_count * sizeof(CacheEntry) + header.names_size)
+        {
+            return false;
+        }
+
+        const char* entries = cache.data() + sizeof(header);
+        const char* names   = entries + entry_count * sizeof(CacheEntry);
+
+        metrics.reserve(header.metric_count, header.names_size);
+
+        for (std::size_t i = 0; i < entry_count; i++)
+        {
+            CacheEntry entry;
+
+            std::memcpy(&entry, entries + i * sizeof(CacheEntry), sizeof(entry));
+
+            if ((std::uint64_t) entry.name_offset + entry.name_length > header.names_size ||
+                entry.unit < (int) UnitType::Microseconds || entry.unit > (int) UnitType::Seconds)
+            {
+                metrics.clear();
+
+                return false;
+            }
+
+            DumpView    name   = {names + entry.name_offset, names + entry.name_offset + entry.name_length};
+            Metric      metric = {entry.value, (UnitType) entry.unit};
+
+            if (i < header.metric_count)
+                metrics.add(name, metric);
+            else
+                metrics.add_exceeding(name, metric, entry.severity);
+        }
+
+        metrics.add_hidden_exceeding(header.exceeding_total - header.exceeding_count);
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+
+    metrics.sort(); // already in order, only restores the table's invariants
+
+    total_average   = {header.total_average, (UnitType) header.total_average_unit};
+    check_code      = (ReturnCode) header.check_code;
+    dump_mtime      = header.dump.mtime_sec;
+
+    return true;
+}
+
+void ResultCache::store(const MetricTable& metrics, const Metric& total_average, ReturnCode check_code) const throw (std::runtime_error)
+{
+    CacheHeader header;
+    std::string contents,
+                names;
+
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+
+    header.version              = CACHE_VERSION;
+    header.options_hash         = m_options_hash;
+    header.dump                 = m_dump;
+    header.total_average        = total_average.value;
+    header.total_average_unit   = (std::int32_t) total_average.unit;
+    header.check_code           = (std::int32_t) check_code;
+    header.metric_count         = metrics.metrics().size();
+    header.exceeding_count      = metrics.exceeding().size();
+    header.exceeding_total      = metrics.exceeding_count();
+
+    contents.reserve(sizeof(header) + (header.metric_count + header.exceeding_count) * sizeof(CacheEntry));
+    contents.append(sizeof(header), '\0'); // filled in once names_size is known
+
+    for (const std::vector<MetricTable::Index>* list : {&metrics.metrics(), &metrics.exceeding()})
+    {
+        for (std::size_t i = 0; i < list->size(); i++)
+        {
+            CacheEntry          entry;
+            MetricTable::Index  index   = (*list)[i];
+            DumpView            name    = metrics.name(index);
+
+            std::memset(&entry, 0, sizeof(entry));
+
+            entry.value         = metrics.value(index).value;
+            entry.name_offset   = names.size();
+            entry.name_length   = name.size();
+            entry.unit          = (std::int16_t) metrics.value(index).unit;
+            entry.severity      = list == &metrics.exceeding() ? metrics.exceeding_severity(i) : 0;
+
+            contents.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+            names.append(name.begin, name.end);
+        }
+    }
+
+    header.names_size = names.size();
+
+    std::memcpy(&contents[0], &header, sizeof(header));
+    contents.append(names);
+
+    replace_file(m_file, contents);
+}
@@ -0,0 +1,57 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - on-disk cache of evaluated dumps
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_RESULT_CACHE_HPP
+#define CHECK_GLUSTER_PERF_RESULT_CACHE_HPP
+
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+#include <ctime>
+
+#include "check_gluster_perf.hpp"
+#include "dump_reader.hpp"
+#include "metric_table.hpp"
+
+/*
+The metrics evaluated from one version of a dump with one set of options, kept in -cache-dir.
+
+A cache file is named after the volume and a hash of everything the evaluation depends on
+(filter, units, thresholds, the digest of the -rules, how many exceeding metrics are listed), and records the identity (device, inode, size, mtime) of the dump
+it was computed from. load() only succeeds if both still match, so a rewritten dump or other
+arguments are a miss, never a stale result unless load_last() asks for one. Files are written with replace_file, checks running
+at the same time at worst compute the same result twice.
+*/
+class ResultCache
+{
+    public:
+        ResultCache(const std::string& cache_dir, const std::string& volume, const CheckOptions& options, const DumpIdentity& dump,
+                    std::uint64_t rules_digest = 0);
+
+        const std::string&  file() const { return m_file; }
+
+        /* Fills what process_metrics would have, false on a miss */
+        bool    load(MetricTable& metrics, Metric& total_average, ReturnCode& check_code) const;
+
+        /*
+        The same, for whichever dump the cached result was computed from, as long as it was modified at
+        'not_before' or later: the last good result, when the current dump can't be read as a whole.
+        */
+        bool    load_last(MetricTable& metrics, Metric& total_average, ReturnCode& check_code, std::time_t not_before, std::time_t& dump_mtime) const;
+
+        /* 'metrics' has to be sorted */
+        void    store(const MetricTable& metrics, const Metric& total_average, ReturnCode check_code) const throw (std::runtime_error);
+
+    private:
+        bool    load(MetricTable& metrics, Metric& total_average, ReturnCode& check_code, bool any_dump, std::time_t not_before, std::time_t& dump_mtime) const;
+
+        std::string     m_file;
+        std::uint64_t   m_options_hash;
+        DumpIdentity    m_dump;
+};
+
+#endif
@@ -0,0 +1,48 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - the vector instruction sets the CPU runs
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "simd.hpp"
+
+#include <initializer_list>
+
+bool cpu_runs(SimdLevel level)
+{
+#if defined(__x86_64__)
+    if (level == SimdLevel::Avx2)
+    {
+        __builtin_cpu_init();
+
+        return __builtin_cpu_supports("avx2");
+    }
+
+    return true; // SSE2 is part of x86-64
+#else
+    return level == SimdLevel::Scalar;
+#endif
+}
+
+SimdLevel best_simd_level()
+{
+    for (SimdLevel level : {SimdLevel::Avx2, SimdLevel::Sse2})
+    {
+        if (cpu_runs(level)) return level;
+    }
+
+    return SimdLevel::Scalar;
+}
+
+const char* simd_level_name(SimdLevel level)
+{
+    switch (level)
+    {
+        case SimdLevel::Scalar:     return "scalar";
+        case SimdLevel::Sse2:       return "SSE2";
+        case SimdLevel::Avx2:       return "AVX2";
+    }
+
+    return "";
+}
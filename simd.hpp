@@ -0,0 +1,22 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - the vector instruction sets the CPU runs
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_SIMD_HPP
+#define CHECK_GLUSTER_PERF_SIMD_HPP
+
+/*
+The code paths with a vectorized implementation (StructuralIndexer, aggregate_columns) have one
+per level, picked once at startup: AVX2 when the CPU has it, SSE2 on any other x86-64, plain
+code elsewhere. Every level gives the same results, the benchmarks and tests compare them.
+*/
+enum class SimdLevel { Scalar, Sse2, Avx2 };
+
+bool        cpu_runs(SimdLevel level);
+SimdLevel   best_simd_level(); // the best one cpu_runs()
+const char* simd_level_name(SimdLevel level);
+
+#endif
@@ -0,0 +1,182 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - vectorized structural index of JSON dumps
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "structural_index.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static const int BLOCK_SIZE = 64;
+
+/* Sets bit i of each mask if byte i of the block is a quote, a backslash, a structural character */
+typedef void (*ClassifyBlock)(const char* block, std::uint64_t& quotes, std::uint64_t& backslashes, std::uint64_t& structurals);
+
+static void classify_scalar(const char* block, std::uint64_t& quotes, std::uint64_t& backslashes, std::uint64_t& structurals)
+{
+    quotes = backslashes = structurals = 0;
+
+    for (int i = 0; i < BLOCK_SIZE; i++)
+    {
+        std::uint64_t bit = 1ULL << i;
+
+        switch (block[i])
+        {
+            case '"':   quotes |= bit;        break;
+            case '\\':  backslashes |= bit;   break;
+            case '{': case '}': case '[': case ']': case ':': case ',':
+                        structurals |= bit;   break;
+        }
+    }
+}
+
+#if defined(__x86_64__)
+
+// '[' | 0x20 is '{' and ']' | 0x20 is '}', no other byte folds onto these two
+
+static void classify_sse2(const char* block, std::uint64_t& quotes, std::uint64_t& backslashes, std::uint64_t& structurals)
+{
+    quotes = backslashes = structurals = 0;
+
+    for (int i = 0; i < BLOCK_SIZE / 16; i++)
+    {
+        __m128i chunk   = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+        __m128i folded  = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')), _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))),
+                                       _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(':')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8(','))));
+
+        quotes      |= (std::uint64_t) (std::uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"'))) << (16 * i);
+        backslashes |= (std::uint64_t) (std::uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'))) << (16 * i);
+        structurals |= (std::uint64_t) (std::uint16_t) _mm_movemask_epi8(special) << (16 * i);
+    }
+}
+
+__attribute__((target("avx2")))
+static void classify_avx2(const char* block, std::uint64_t& quotes, std::uint64_t& backslashes, std::uint64_t& structurals)
+{
+    quotes = backslashes = structurals = 0;
+
+    for (int i = 0; i < BLOCK_SIZE / 32; i++)
+    {
+        __m256i chunk   = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32 * i));
+        __m256i folded  = _mm256_or_si256(chunk, _mm256_set1_epi8(0x20));
+        __m256i special = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}'))),
+                                          _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(','))));
+
+        quotes      |= (std::uint64_t) (std::uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('"'))) << (32 * i);
+        backslashes |= (std::uint64_t) (std::uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\\'))) << (32 * i);
+        structurals |= (std::uint64_t) (std::uint32_t) _mm256_movemask_epi8(special) << (32 * i);
+    }
+}
+
+#endif
+
+static ClassifyBlock classifier(StructuralIndexer::Implementation implementation)
+{
+    switch (implementation)
+    {
+#if defined(__x86_64__)
+        case StructuralIndexer::Implementation::Avx2:   return classify_avx2;
+        case StructuralIndexer::Implementation::Sse2:   return classify_sse2;
+#endif
+        default:                                        return classify_scalar;
+    }
+}
+
+// chosen once, before main(); only the benchmarks change it
+static StructuralIndexer::Implementation    s_implementation    = best_simd_level();
+static ClassifyBlock                        s_classify          = classifier(s_implementation);
+
+StructuralIndexer::Implementation StructuralIndexer::implementation()
+{
+    return s_implementation;
+}
+
+const char* StructuralIndexer::implementation_name(Implementation implementation)
+{
+    return simd_level_name(implementation);
+}
+
+bool StructuralIndexer::force_implementation(Implementation implementation)
+{
+    if (! cpu_runs(implementation)) return false;
+
+    s_implementation    = implementation;
+    s_classify          = classifier(implementation);
+
+    return true;
+}
+
+StructuralIndexer::StructuralIndexer(const DumpView& input)
+    : m_block(input.begin), m_end(input.end), m_base(input.begin), m_bits(0), m_in_string(0), m_escaped(0)
+{
+}
+
+void StructuralIndexer::seek(const char* position)
+{
+    m_block     = position;
+    m_base      = position;
+    m_bits      = 0;
+    m_in_string = 0;
+    m_escaped   = 0;
+}
+
+void StructuralIndexer::index_block()
+{
+    const char*     block = m_block;
+    char            padded[BLOCK_SIZE];
+    std::uint64_t   quotes, backslashes, structurals;
+
+    if (m_end - m_block < BLOCK_SIZE)
+    {
+        std::memset(padded, ' ', sizeof(padded));
+        std::memcpy(padded, m_block, m_end - m_block);
+
+        block = padded;
+    }
+
+    s_classify(block, quotes, backslashes, structurals);
+
+    // a backslash escapes the next character unless it's escaped itself, walked in order as runs of them alternate
+    std::uint64_t escaped = m_escaped;
+
+    m_escaped = 0;
+
+    for (std::uint64_t pending = backslashes; pending != 0; pending &= pending - 1)
+    {
+        int             position    = __builtin_ctzll(pending);
+        std::uint64_t   bit         = 1ULL << position;
+
+        if (escaped & bit) continue;
+
+        if (position == BLOCK_SIZE - 1)
+            m_escaped = 1;
+        else
+            escaped |= bit << 1;
+    }
+
+    quotes &= ~escaped;
+
+    // every bit from an opening quote up to its closing quote, the opening one included
+    std::uint64_t in_string = quotes;
+
+    in_string ^= in_string << 1;
+    in_string ^= in_string << 2;
+    in_string ^= in_string << 4;
+    in_string ^= in_string << 8;
+    in_string ^= in_string << 16;
+    in_string ^= in_string << 32;
+    in_string ^= m_in_string;
+
+    m_in_string = (in_string >> (BLOCK_SIZE - 1)) ? ~0ULL : 0;
+
+    m_bits   = (structurals & ~in_string) | (quotes & in_string);
+    m_base   = m_block;
+    m_block += BLOCK_SIZE;
+}
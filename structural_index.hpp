@@ -0,0 +1,73 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - vectorized structural index of JSON dumps
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_STRUCTURAL_INDEX_HPP
+#define CHECK_GLUSTER_PERF_STRUCTURAL_INDEX_HPP
+
+#include <cstdint>
+
+#include "dump_reader.hpp"
+#include "simd.hpp"
+
+/*
+The structural characters of a JSON text, the way simdjson's stage 1 finds them: the input is
+classified 64 bytes at a time into bit masks of quotes, backslashes and { } [ ] : , and the
+masks give, without a branch per byte:
+
+- the escaped characters, from the runs of backslashes (only blocks holding one are walked)
+- the inside of the strings, as the prefix XOR of the unescaped quotes
+- the structural characters outside of the strings, and the opening quotes
+
+next() hands them out in order, one block is indexed at a time so memory doesn't depend on the
+input size. The classification uses the best SimdLevel the CPU runs; all three give the same
+index.
+*/
+class StructuralIndexer
+{
+    public:
+        typedef SimdLevel Implementation;
+
+        /* 'input' has to start outside of a string */
+        explicit StructuralIndexer(const DumpView& input);
+
+        /* The next structural character or opening quote, nullptr at the end of the input */
+        const char* next()
+        {
+            while (m_bits == 0)
+            {
+                if (m_block >= m_end) return nullptr;
+
+                index_block();
+            }
+
+            const char* position = m_base + __builtin_ctzll(m_bits);
+
+            m_bits &= m_bits - 1;
+
+            return position;
+        }
+
+        /* Goes on from 'position' instead, which has to be outside of a string */
+        void        seek(const char* position);
+
+        /* The best one this CPU runs, unless forced, the benchmarks compare them */
+        static Implementation   implementation();
+        static const char*      implementation_name(Implementation implementation);
+        static bool             force_implementation(Implementation implementation); // false if the CPU can't run it
+
+    private:
+        void        index_block();
+
+        const char*     m_block;            // the next block to index
+        const char*     m_end;
+        const char*     m_base;             // the block m_bits are for
+        std::uint64_t   m_bits;             // its positions next() didn't hand out yet
+        std::uint64_t   m_in_string;        // all ones if the previous block ended inside a string
+        std::uint64_t   m_escaped;          // 1 if the previous block ended with an unescaped backslash
+};
+
+#endif
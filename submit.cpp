@@ -0,0 +1,312 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - passive check result submission (-submit)
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "submit.hpp"
+
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <ctime>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "output_writer.hpp"
+#include "batch.hpp"
+
+std::vector<GroupResult> group_results(const MetricGroups& groups, const CheckOptions& options)
+{
+    std::vector<GroupResult> results;
+
+    for (const MetricGroups::Aggregate& group : groups.aggregates())
+    {
+        OutputBuffer    output;
+        Metric          warning     = convert(options.warning_threshold, group.unit);
+        Metric          critical    = convert(options.critical_threshold, group.unit);
+        double          value       = options.group_target == GroupTarget::Average ? group.average : group.maximum;
+        ReturnCode      code        = ReturnCode::OK;
+        const char*     unit        = unit_name(group.unit);
+
+        if (value >= warning.value)     code = ReturnCode::Warning;
+        if (value >= critical.value)    code = ReturnCode::Critical;
+
+        output.append("GlusterFS Latency ").append(state_name(code)).append(" - ").append(group.label)
+              .append(code == ReturnCode::OK ? " within thresholds. Avg: " : " exceeding thresholds. Avg: ").append_number(group.average).append(unit)
+              .append(", max: ").append_number(group.maximum).append(unit).append(" over ").append_integer(group.count).append(" metrics");
+
+        output.append("|'").append(group.label).append(".avg'=").append_number(group.average).append(unit)
+              .append(';').append_number(warning.value).append(';').append_number(critical.value)
+              .append(" '").append(group.label).append(".max'=").append_number(group.maximum).append(unit)
+              .append(';').append_number(warning.value).append(';').append_number(critical.value)
+              .append(" '").append(group.label).append(".count'=").append_integer(group.count).append('\n');
+
+        results.push_back({group.label, code, output.str()});
+    }
+
+    return results;
+}
+
+static void check_name(const std::string& name) throw (std::invalid_argument)
+{
+    if (name.empty() || name.find_first_of(";\r\n") != std::string::npos)
+    {
+        throw std::invalid_argument("Passive check host and service names can't be empty or contain ';' or new lines: '" + name + "'");
+    }
+}
+
+std::vector<PassiveResult> passive_results(const std::vector<CheckResult>& results, const std::string& host, const std::string& service) throw (std::invalid_argument)
+{
+    std::vector<PassiveResult> passive;
+
+    check_name(host);
+
+    for (const CheckResult& result : results)
+    {
+        std::string             volume_service = service;
+        std::string::size_type  position;
+
+        while ((position = volume_service.find("%v")) != std::string::npos) volume_service.replace(position, 2, result.volume);
+
+        check_name(volume_service);
+
+        passive.push_back({host, volume_service, result.code, result.output});
+
+        for (const GroupResult& group : result.groups)
+        {
+            // "group.WRITE.latency_ave" -> "<volume service>_WRITE.latency_ave"
+            std::string group_service = volume_service + "_" + group.label.substr(group.label.find('.') + 1);
+
+            check_name(group_service);
+
+            passive.push_back({host, group_service, group.code, group.output});
+        }
+    }
+
+    return passive;
+}
+
+/* The plugin output on one line: trailing new lines dropped, the others escaped as the readers expect them */
+static std::string one_line(const std::string& output)
+{
+    std::string line;
+    std::size_t end = output.find_last_not_of("\r\n");
+
+    for (std::size_t i = 0; end != std::string::npos && i <= end; i++)
+    {
+        if (output[i] == '\n')
+            line += "\\n";
+        else if (output[i] != '\r')
+            line += output[i];
+    }
+
+    return line;
+}
+
+/* Writes 'data' to the non-blocking 'fd', waiting for room until 'deadline', returns an error or "" */
+static std::string write_until(int fd, const std::string& data, std::chrono::steady_clock::time_point deadline)
+{
+    std::size_t written = 0;
+
+    while (written < data.size())
+    {
+        ssize_t count = write(fd, data.data() + written, data.size() - written);
+
+        if (count >= 0)
+        {
+            written += count;
+            continue;
+        }
+
+        if (errno == EINTR) continue;
+
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return std::string(strerror(errno)) + " While writing to the external command pipe";
+
+        // the pipe is full: wait for the reader to make room, but not past the deadline
+        long long       remaining   = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        struct pollfd   watched     = {fd, POLLOUT, 0};
+        int             ready       = remaining > 0 ? poll(&watched, 1, (int) std::min<long long>(remaining, INT_MAX)) : 0;
+
+        if (ready == -1 && errno != EINTR) return std::string(strerror(errno)) + " While waiting for the external command pipe";
+        if (ready == 0) return "Timed out waiting for Nagios/Icinga to read the external command pipe";
+    }
+
+    return "";
+}
+
+static void write_command_pipe(const std::string& path, const std::vector<PassiveResult>& results, int timeout_seconds) throw (std::runtime_error)
+{
+    std::signal(SIGPIPE, SIG_IGN); // a reader closing the pipe is an EPIPE error, not the end of this process
+
+    int fd = open(path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+
+    if (fd == -1)
+    {
+        std::ostringstream error;
+
+        if (errno == ENXIO)
+            error << "Nobody reads the external command pipe " << path << ", is Nagios/Icinga (its command feature) running?";
+        else
+            error << strerror(errno) << " While trying to open: " << path;
+
+        throw std::runtime_error(error.str());
+    }
+
+    std::chrono::steady_clock::time_point   deadline    = std::chrono::steady_clock::now() + std::chrono::seconds(timeout_seconds);
+    std::string                             now         = std::to_string((long long) std::time(nullptr));
+    std::vector<std::string>                commands;
+    std::string                             chunk,
+                                            error;
+    std::size_t                             submitted   = 0;
+
+    for (const PassiveResult& result : results)
+    {
+        commands.push_back("[" + now + "] PROCESS_SERVICE_CHECK_RESULT;" + result.host + ";" + result.service + ";" +
+                           std::to_string((int) result.code) + ";" + one_line(result.output) + "\n");
+    }
+
+    for (std::size_t next = 0; next < commands.size() && error.empty(); )
+    {
+        std::size_t count = 0;
+
+        // whole commands, as many as one atomic write takes; a longer command is written on its own
+        chunk.clear();
+
+        while (next < commands.size() && (count == 0 || chunk.size() + commands[next].size() <= PIPE_BUF))
+        {
+            chunk += commands[next++];
+            count++;
+        }
+
+        error = write_until(fd, chunk, deadline);
+
+        if (error.empty()) submitted += count;
+    }
+
+    close(fd);
+
+    if (! error.empty())
+    {
+        std::ostringstream message;
+        message << error << ", " << submitted << " of " << results.size() << " results were submitted to " << path;
+
+        throw std::runtime_error(message.str());
+    }
+}
+
+static void write_spool_file(const std::string& directory, const PassiveResult& result) throw (std::runtime_error)
+{
+    std::ostringstream  contents;
+    std::string         file        = directory + "/cXXXXXX"; // the name the readers look for, 'c' and six characters
+    std::time_t         now         = std::time(nullptr);
+    std::size_t         written     = 0;
+    int                 err_code    = 0;
+    int                 fd          = mkstemp(&file[0]);
+
+    if (fd == -1)
+    {
+        std::ostringstream error;
+        error << strerror(errno) << " While trying to create a check result file in: " << directory;
+
+        throw std::runtime_error(error.str());
+    }
+
+    contents << "### Passive Check Result File ###\n"
+             << "file_time=" << now << "\n\n"
+             << "### Nagios Service Check Result ###\n"
+             << "host_name=" << result.host << "\n"
+             << "service_description=" << result.service << "\n"
+             << "check_type=1\n"            // passive
+             << "check_options=0\n"
+             << "scheduled_check=0\n"
+             << "reschedule_check=0\n"
+             << "latency=0\n"
+             << "start_time=" << now << ".0\n"
+             << "finish_time=" << now << ".0\n"
+             << "early_timeout=0\n"
+             << "exited_ok=1\n"
+             << "return_code=" << (int) result.code << "\n"
+             << "output=" << one_line(result.output) << "\n";
+
+    std::string data = contents.str();
+
+    if (fchmod(fd, 0644) == -1) err_code = errno; // mkstemp always creates 0600, the reader may run as another user
+
+    while (err_code == 0 && written < data.size())
+    {
+        ssize_t count = write(fd, data.data() + written, data.size() - written);
+
+        if (count == -1 && errno == EINTR) continue;
+        if (count == -1) { err_code = errno; break; }
+
+        written += count;
+    }
+
+    if (close(fd) == -1 && err_code == 0) err_code = errno;
+
+    // complete: the readers only pick up a result file once its .ok file exists
+    if (err_code == 0)
+    {
+        int ok_fd = open((file + ".ok").c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+
+        if (ok_fd == -1 || close(ok_fd) == -1) err_code = errno;
+    }
+
+    if (err_code != 0)
+    {
+        unlink(file.c_str());
+
+        std::ostringstream error;
+        error << strerror(err_code) << " While trying to write: " << file;
+
+        throw std::runtime_error(error.str());
+    }
+}
+
+void submit_results(const std::string& path, const std::vector<PassiveResult>& results, int timeout_seconds) throw (std::runtime_error)
+{
+    struct stat file_stat;
+
+    if (stat(path.c_str(), &file_stat) == -1)
+    {
+        std::ostringstream error;
+        error << strerror(errno) << " While trying to stat: " << path;
+
+        throw std::runtime_error(error.str());
+    }
+
+    if (S_ISFIFO(file_stat.st_mode))
+    {
+        write_command_pipe(path, results, timeout_seconds);
+    }
+    else if (S_ISDIR(file_stat.st_mode))
+    {
+        for (std::size_t i = 0; i < results.size(); i++)
+        {
+            try
+            {
+                write_spool_file(path, results[i]);
+            }
+            catch (const std::runtime_error& e)
+            {
+                std::ostringstream error;
+                error << e.what() << ", " << i << " of " << results.size() << " results were submitted to " << path;
+
+                throw std::runtime_error(error.str());
+            }
+        }
+    }
+    else
+    {
+        throw std::runtime_error(path + " is neither an external command pipe (a FIFO) nor a check result spool directory");
+    }
+}
@@ -0,0 +1,54 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - passive check result submission (-submit)
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_SUBMIT_HPP
+#define CHECK_GLUSTER_PERF_SUBMIT_HPP
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "check_gluster_perf.hpp"
+#include "metric_groups.hpp"
+
+/* The result of one passive service */
+struct PassiveResult {
+    std::string host;
+    std::string service;
+    ReturnCode  code;
+    std::string output;     // plugin output, may span several lines
+};
+
+/*
+Each -group-by group's own result: its average or maximum (the maximum unless -apply-on-groups
+avg) compared with the thresholds, with its aggregates as performance data.
+*/
+std::vector<GroupResult>    group_results(const MetricGroups& groups, const CheckOptions& options);
+
+/*
+One passive result per volume, named after 'service' with %v replaced by the volume, and one per
+group of each volume, named '<volume service>_<group>'.
+*/
+std::vector<PassiveResult>  passive_results(const std::vector<CheckResult>& results, const std::string& host, const std::string& service) throw (std::invalid_argument);
+
+/*
+Hands the results over to Nagios/Icinga, to 'path':
+
+- a FIFO, the external command pipe: one PROCESS_SERVICE_CHECK_RESULT command per result. The
+  commands are packed into writes of up to PIPE_BUF bytes, which the kernel never interleaves
+  with the commands other processes write, so the whole run costs a few writes. The pipe is
+  opened non-blocking: with nobody reading it this fails at once, and when it's full the
+  writes wait for room for at most 'timeout_seconds' in total.
+- a directory, the check result spool (Nagios' check_result_path, Icinga 2's checkresultreader
+  feature): one check result file per result, the reader reads one result per file. Each file
+  is written in one go and only then marked as complete with its '.ok' file.
+
+Throws, saying how many results got through, if they can't all be submitted.
+*/
+void    submit_results(const std::string& path, const std::vector<PassiveResult>& results, int timeout_seconds) throw (std::runtime_error);
+
+#endif
@@ -0,0 +1,131 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - tests of the per-metric baselines and their state file
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "tests/test.hpp"
+#include "baseline.hpp"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+static MetricTable one_metric(const std::string& name, double value)
+{
+    MetricTable table;
+
+    table.add({name.data(), name.data() + name.size()}, {value, UnitType::Microseconds});
+    table.sort();
+
+    return table;
+}
+
+/* -w 3 -c 5 standard deviations, after 'warmup' dumps */
+static CheckOptions baseline_options(int warmup)
+{
+    CheckOptions options = default_options();
+
+    options.warning_threshold   = {3, UnitType::Microseconds};
+    options.critical_threshold  = {5, UnitType::Microseconds};
+    options.apply_on_baseline   = true;
+    options.baseline_warmup     = warmup;
+
+    return options;
+}
+
+/* Loads the baselines in 'file', checks 'value' of the dump modified at 'dump_mtime' and saves them */
+static ReturnCode check_against_baseline(const std::string& file, double value, std::time_t dump_mtime, int warmup = 2)
+{
+    MetricBaselines baselines(file, 0.1);
+    MetricTable     metrics = one_metric("a_usec", value);
+    ReturnCode      code    = baselines.apply_thresholds(metrics, baseline_options(warmup), dump_mtime);
+
+    baselines.save();
+
+    return code;
+}
+
+TEST(baseline_learns_then_flags_deviations)
+{
+    TempDir     dir;
+    std::string file = dir.file("vol1.baseline");
+
+    CHECK_EQUAL((int) ReturnCode::OK, (int) check_against_baseline(file, 100, 100));
+    CHECK_EQUAL((int) ReturnCode::OK, (int) check_against_baseline(file, 5000, 100)); // the same dump again, not learned from
+    CHECK_EQUAL((int) ReturnCode::OK, (int) check_against_baseline(file, 100, 200));
+    CHECK_EQUAL((int) ReturnCode::OK, (int) check_against_baseline(file, 100, 300));   // 2 dumps folded in, within 1%
+    CHECK_EQUAL((int) ReturnCode::Warning, (int) check_against_baseline(file, 104, 400));
+    CHECK_EQUAL((int) ReturnCode::Critical, (int) check_against_baseline(file, 1000, 400));
+
+    MetricBaselines baselines(file, 0.1);
+
+    CHECK_EQUAL(1u, baselines.size());
+}
+
+TEST(baseline_damaged_state_is_learned_again)
+{
+    TempDir     dir;
+    std::string file = dir.file("vol1.baseline");
+
+    check_against_baseline(file, 100, 100);
+
+    std::string state = read_file(file);
+
+    CHECK_EQUAL(std::string("CGPB"), state.substr(0, 4));
+
+    write_file(file, state.substr(0, state.size() - 1));
+
+    MetricBaselines baselines(file, 0.1);
+
+    CHECK_EQUAL(0u, baselines.size());
+}
+
+TEST(baseline_concurrent_checks_keep_each_others_updates)
+{
+    TempDir     dir;
+    std::string file = dir.file("vol1.baseline");
+    int         loaded[2], status;
+    char        byte = 0;
+
+    CHECK(pipe(loaded) == 0);
+
+    // forked before the state is locked, so the lock isn't shared
+    pid_t child = fork();
+
+    if (child == 0)
+    {
+        try
+        {
+            if (read(loaded[0], &byte, 1) != 1) _exit(1);
+
+            check_against_baseline(file, 100, 200); // waits for the parent's check
+        }
+        catch (...)
+        {
+            _exit(1);
+        }
+
+        _exit(0);
+    }
+
+    {
+        MetricBaselines baselines(file, 0.1);
+        MetricTable     metrics = one_metric("a_usec", 100);
+
+        CHECK(write(loaded[1], &byte, 1) == 1);
+        usleep(200000);
+
+        baselines.apply_thresholds(metrics, baseline_options(2), 100);
+        baselines.save();
+    }
+
+    waitpid(child, &status, 0);
+    close(loaded[0]);
+    close(loaded[1]);
+
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // both dumps are in the baseline: it is warmed up
+    CHECK_EQUAL((int) ReturnCode::Critical, (int) check_against_baseline(file, 1000, 300));
+}
@@ -0,0 +1,185 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - tests of the daemon's requests and socket protocol
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "tests/test.hpp"
+#include "daemon.hpp"
+#include "metric_filter.hpp"
+
+#include <csignal>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+TEST(daemon_request_round_trip)
+{
+    CheckOptions    options = default_options(), decoded;
+    VolumeDump      target  = {"vol1", "/var/lib/glusterd/stats/glusterfs_vol1.dump"}, decoded_target;
+
+    options.warning_threshold   = {0.1, UnitType::Miliseconds};
+    options.critical_threshold  = {1.0 / 3, UnitType::Seconds};
+    options.filter_regex        = ".*\t(READ|WRITE).*usec"; // tabs are allowed in the last field
+    options.state_dir           = "/var/lib/check_gluster_perf";
+    options.rules_file          = "/etc/check_gluster_perf.rules";
+    options.group_by            = GroupByFop | GroupByStat;
+    options.output_format       = OutputFormat::Json;
+    options.interval_mode       = IntervalMode::Rate;
+
+    std::string line = encode_check_request(options, target);
+
+    CHECK(decode_check_request(line, decoded, decoded_target));
+    CHECK_EQUAL(target.volume, decoded_target.volume);
+    CHECK_EQUAL(target.dump_file, decoded_target.dump_file);
+    CHECK_EQUAL(options.warning_threshold.value, decoded.warning_threshold.value);
+    CHECK_EQUAL(options.critical_threshold.value, decoded.critical_threshold.value);
+    CHECK_EQUAL((int) UnitType::Seconds, (int) decoded.critical_threshold.unit);
+    CHECK_EQUAL(options.filter_regex, decoded.filter_regex);
+    CHECK_EQUAL(options.state_dir, decoded.state_dir);
+    CHECK_EQUAL(options.rules_file, decoded.rules_file);
+    CHECK_EQUAL(options.group_by, decoded.group_by);
+    CHECK_EQUAL((int) OutputFormat::Json, (int) decoded.output_format);
+    CHECK_EQUAL((int) IntervalMode::Rate, (int) decoded.interval_mode);
+
+    // the same check is the same line, that's the cache key
+    CHECK_EQUAL(line, encode_check_request(decoded, decoded_target));
+
+    CHECK(! decode_check_request("CGP11" + line.substr(5), decoded, decoded_target));
+    CHECK(! decode_check_request(line.substr(0, line.size() / 2), decoded, decoded_target));
+
+    target.volume = "vol\n1";
+    CHECK_THROWS(encode_check_request(options, target), std::invalid_argument);
+}
+
+/* A daemon serving the volumes of 'stats_dir' in a child process, stopped and waited for by the destructor */
+class TestDaemon
+{
+    public:
+        TestDaemon(const std::string& socket_path, const std::string& stats_dir, const CheckOptions& options)
+        {
+            struct stat socket_stat;
+
+            m_pid = fork();
+
+            if (m_pid == 0)
+            {
+                try
+                {
+                    run_daemon(socket_path, stats_dir, options, {});
+                }
+                catch (...)
+                {
+                    _exit(2);
+                }
+
+                _exit(0);
+            }
+
+            for (int i = 0; i < 500 && stat(socket_path.c_str(), &socket_stat) != 0; i++) usleep(10000);
+        }
+
+        /* The daemon's exit code, -1 if it's still running */
+        int exited()
+        {
+            int status;
+
+            if (waitpid(m_pid, &status, WNOHANG) != m_pid) return -1;
+
+            m_pid = -1;
+
+            return WIFEXITED(status) ? WEXITSTATUS(status) : 128;
+        }
+
+        int stop()
+        {
+            int status;
+
+            if (m_pid == -1) return -1;
+
+            kill(m_pid, SIGTERM);
+            waitpid(m_pid, &status, 0);
+
+            m_pid = -1;
+
+            return WIFEXITED(status) ? WEXITSTATUS(status) : 128;
+        }
+
+        ~TestDaemon() { stop(); }
+
+    private:
+        pid_t m_pid;
+};
+
+TEST(daemon_serves_checks_over_its_socket)
+{
+    TempDir         dir;
+    CheckOptions    options = default_options();
+    VolumeDump      target  = {"vol1", dir.file("glusterfs_vol1.dump")};
+    MetricFilter    filter(options.filter_regex);
+
+    write_file(target.dump_file, read_file(FIXTURES "glusterfs_vol1.dump"));
+
+    CheckResult local = check_volume(options, filter, target.volume, target.dump_file);
+    TestDaemon  daemon(dir.file("daemon.sock"), dir.path(), options);
+    CheckResult served = query_daemon(dir.file("daemon.sock"), options, target);
+
+    CHECK_EQUAL((int) local.code, (int) served.code);
+    CHECK_EQUAL(local.output, served.output);
+    CHECK_EQUAL(local.dump_mtime, served.dump_mtime);
+
+    // an invalid filter is answered, not fatal
+    CheckOptions broken = options;
+
+    broken.filter_regex = "(";
+
+    CheckResult refused = query_daemon(dir.file("daemon.sock"), broken, target);
+
+    CHECK_EQUAL((int) ReturnCode::Unknown, (int) refused.code);
+    CHECK(refused.output.find("Runtime error: ") == 0);
+    CHECK_EQUAL(-1, daemon.exited());
+
+    // and didn't leave anything behind in the cache
+    CHECK_EQUAL((int) ReturnCode::Unknown, (int) query_daemon(dir.file("daemon.sock"), broken, target).code);
+    CHECK_EQUAL(local.output, query_daemon(dir.file("daemon.sock"), options, target).output);
+
+    CHECK_EQUAL(0, daemon.stop());
+    CHECK(access(dir.file("daemon.sock").c_str(), F_OK) != 0);
+}
+
+TEST(daemon_refuses_files_outside_its_directories)
+{
+    TempDir         dir, other;
+    CheckOptions    options = default_options();
+    VolumeDump      outside = {"vol1", other.file("glusterfs_vol1.dump")};
+
+    write_file(dir.file("glusterfs_vol1.dump"), read_file(FIXTURES "glusterfs_vol1.dump"));
+    write_file(outside.dump_file, read_file(FIXTURES "glusterfs_vol1.dump"));
+
+    TestDaemon daemon(dir.file("daemon.sock"), dir.path(), options);
+
+    CheckResult result = query_daemon(dir.file("daemon.sock"), options, outside);
+
+    CHECK_EQUAL((int) ReturnCode::Unknown, (int) result.code);
+    CHECK(result.output.find("only reads the dumps in") != std::string::npos);
+
+    // a volume name can't walk out of the stats directory either
+    VolumeDump walking = {"../" + other.path().substr(other.path().rfind('/') + 1) + "/vol1", ""};
+
+    walking.dump_file = dir.path() + "/glusterfs_" + walking.volume + ".dump";
+    CHECK_EQUAL((int) ReturnCode::Unknown, (int) query_daemon(dir.file("daemon.sock"), options, walking).code);
+
+    // nor can the state directory be moved
+    CheckOptions elsewhere = options;
+    VolumeDump   inside    = {"vol1", dir.file("glusterfs_vol1.dump")};
+
+    elsewhere.state_dir = other.path();
+    result = query_daemon(dir.file("daemon.sock"), elsewhere, inside);
+
+    CHECK_EQUAL((int) ReturnCode::Unknown, (int) result.code);
+    CHECK(result.output.find("-state-dir") != std::string::npos);
+
+    CHECK(query_daemon(dir.file("daemon.sock"), options, inside).code != ReturnCode::Unknown);
+}
@@ -0,0 +1,152 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - tests of the dump file access
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "tests/test.hpp"
+#include "dump_reader.hpp"
+
+#include <cstring>
+
+static DumpView view_of(const std::string& text)
+{
+    return {text.data(), text.data() + text.size()};
+}
+
+TEST(split_root_objects_finds_each_root_object)
+{
+    MappedFile              dump(FIXTURES "glusterfs_vol1.dump");
+    std::vector<DumpView>   objects;
+
+    CHECK_EQUAL(0, split_root_objects(dump.view(), objects));
+    CHECK_EQUAL(2u, objects.size());
+
+    // the first starts the file, the second one right after it, both end with their '}'
+    CHECK(objects[0].begin == dump.data());
+    CHECK(objects[1].begin == objects[0].end);
+    CHECK_EQUAL('}', objects[0].end[-1]);
+    CHECK_EQUAL('}', objects[1].end[-1]);
+    CHECK(std::string(objects[1].begin, objects[1].end).find("storage.gluster.brick.vol1.uptime") != std::string::npos);
+}
+
+TEST(split_root_objects_hands_arrays_over_whole)
+{
+    std::string             text = "[{\"a\": \"1\"}, {\"b\": \"2\"}]";
+    std::vector<DumpView>   objects;
+
+    split_root_objects(view_of(text), objects);
+
+    CHECK_EQUAL(1u, objects.size());
+    CHECK_EQUAL(text.size(), objects[0].size());
+}
+
+TEST(split_root_objects_reports_stray_braces_with_their_line)
+{
+    std::string             text = "{\"a\": \"1\"}\n}\n";
+    std::vector<DumpView>   objects;
+
+    try
+    {
+        split_root_objects(view_of(text), objects);
+        CHECK(false);
+    }
+    catch (const std::runtime_error& e)
+    {
+        CHECK(std::string(e.what()).find("Unexpected '}' found at line2") != std::string::npos);
+    }
+}
+
+TEST(split_root_objects_reports_a_dump_cut_short)
+{
+    const char* const texts[] = {
+        "",
+        " \n",
+        "{\"a\": \"1\"}\n{\"b\": \"2\"",
+        "{\"a\": \"1\"}\n{\"b\": {\"c\": \"2\"}",   // ends with a '}' all the same
+        "{\"a\": \"1\"}\n{\"b\": \"}\"}\n{\"c\": \"}"  // so does a string cut short
+    };
+
+    for (const std::string text : texts)
+    {
+        std::vector<DumpView> objects;
+
+        CHECK_THROWS(split_root_objects(view_of(text), objects), torn_dump_error);
+    }
+
+    std::string             whole = "{\"a\": \"1\"}\n{\"b\": \"}\"}\n\n";
+    std::vector<DumpView>   objects;
+
+    split_root_objects(view_of(whole), objects);
+
+    CHECK_EQUAL(2u, objects.size());
+}
+
+TEST(mapped_file_maps_regular_files)
+{
+    MappedFile dump(FIXTURES "glusterfs_vol1.dump");
+
+    CHECK(dump.is_mapped());
+    CHECK_EQUAL(read_file(FIXTURES "glusterfs_vol1.dump").size(), dump.size());
+    CHECK(std::memcmp(dump.data(), "{\n \"storage.gluster.nfsd.vol1.uptime\"", 36) == 0);
+}
+
+TEST(mapped_file_reads_files_reporting_no_size)
+{
+    MappedFile status("/proc/self/status"); // procfs reports a size of 0
+
+    CHECK(! status.is_mapped());
+    CHECK(status.size() > 0);
+    CHECK(std::string(status.data(), status.size()).find("Name:") != std::string::npos);
+}
+
+TEST(mapped_file_reports_missing_files)
+{
+    CHECK_THROWS(MappedFile("tests/fixtures/no_such.dump"), std::runtime_error);
+}
+
+TEST(dump_snapshot_reads_a_whole_dump)
+{
+    DumpSnapshot snapshot(FIXTURES "glusterfs_vol1.dump", 1);
+
+    CHECK_EQUAL(read_file(FIXTURES "glusterfs_vol1.dump"), std::string(snapshot.view().begin, snapshot.view().end));
+    CHECK_EQUAL(1, snapshot.attempts());
+}
+
+TEST(dump_snapshot_reads_a_dump_cut_short_again)
+{
+    TempDir     dir;
+    std::string cut   = "{\"a\": \"1\"}\n{\"b\": \"2\"",
+                whole = cut + "}\n";
+    int         passes = 0;
+
+    write_file(dir.file("vol1.dump"), cut);
+
+    DumpSnapshot snapshot(dir.file("vol1.dump"), 3);
+
+    CHECK_EQUAL(1, snapshot.attempts()); // stable, whether it's whole is the pass' business
+
+    snapshot.consume([&](const DumpView& dump)
+    {
+        std::vector<DumpView> objects;
+
+        if (passes++ == 0) write_file(dir.file("vol1.dump"), whole); // GlusterFS finishes it meanwhile
+
+        split_root_objects(dump, objects);
+
+        CHECK_EQUAL(2u, objects.size());
+    });
+
+    CHECK_EQUAL(2, passes);
+    CHECK_EQUAL(2, snapshot.attempts());
+    CHECK_EQUAL(whole, std::string(snapshot.view().begin, snapshot.view().end));
+
+    write_file(dir.file("vol1.dump"), cut);
+
+    DumpSnapshot    torn(dir.file("vol1.dump"), 2);
+    int             torn_passes = 0;
+
+    CHECK_THROWS(torn.consume([&](const DumpView& dump) { torn_passes++; std::vector<DumpView> objects; split_root_objects(dump, objects); }), torn_dump_error);
+    CHECK_EQUAL(2, torn_passes);
+}
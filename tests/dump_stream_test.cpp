@@ -0,0 +1,108 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - tests of the streaming evaluation against the JSON document one
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "tests/test.hpp"
+#include "metric_filter.hpp"
+
+/* Checks 'dump_file' with and without -stream, both have to give the same result */
+static CheckResult check_both_ways(const std::string& dump_file, const std::string& filter = ".*")
+{
+    CheckOptions    options = default_options();
+    MetricFilter    metric_filter(filter);
+
+    options.filter_regex = filter;
+    options.stream       = false;
+
+    CheckResult document = check_volume(options, metric_filter, "vol1", dump_file);
+
+    options.stream = true;
+
+    CheckResult stream = check_volume(options, metric_filter, "vol1", dump_file);
+
+    CHECK_EQUAL(document.output, stream.output);
+    CHECK_EQUAL((int) document.code, (int) stream.code);
+    CHECK_EQUAL(document.has_average, stream.has_average);
+
+    return stream;
+}
+
+TEST(stream_and_document_agree_on_a_dump)
+{
+    CheckResult result = check_both_ways(FIXTURES "glusterfs_vol1.dump");
+
+    CHECK_EQUAL((int) ReturnCode::Critical, (int) result.code);
+    CHECK(result.output.find("storage.gluster.nfsd.vol1.aggr.fop.WRITE.latency_ave_usec") != std::string::npos);
+
+    check_both_ways(FIXTURES "glusterfs_vol1.dump", "storage\\.gluster\\.brick\\..*");
+}
+
+TEST(stream_and_document_agree_on_non_string_values)
+{
+    TempDir     directory;
+    std::string numbers = directory.file("numbers.dump"),
+                strings = directory.file("strings.dump");
+
+    write_file(numbers, "{\"v.aggr.fop.WRITE.latency_ave_usec\": 250.5, \"v.aggr.fop.READ.latency_ave_usec\": 12,\n"
+                        " \"v.aggr.fop.STAT.latency_ave_usec\": 1e2, \"v.aggr.fop.WRITE.count\": 17, \"v.uptime\": true, \"v.state\": null}\n");
+    write_file(strings, "{\"v.aggr.fop.WRITE.latency_ave_usec\": \"250.5\", \"v.aggr.fop.READ.latency_ave_usec\": \"12\",\n"
+                        " \"v.aggr.fop.STAT.latency_ave_usec\": \"1e2\", \"v.aggr.fop.WRITE.count\": \"17\", \"v.uptime\": \"1\", \"v.state\": \"x\"}\n");
+
+    CheckResult from_numbers = check_both_ways(numbers);
+    CheckResult from_strings = check_both_ways(strings);
+
+    CHECK_EQUAL((int) ReturnCode::Warning, (int) from_numbers.code);
+    CHECK_EQUAL(from_strings.output, from_numbers.output);
+}
+
+TEST(stream_and_document_reject_the_same_values)
+{
+    TempDir     directory;
+    std::string null_latency = directory.file("null.dump"),
+                nested       = directory.file("nested.dump");
+
+    write_file(null_latency, "{\"v.aggr.fop.WRITE.latency_ave_usec\": null}\n");
+    write_file(nested, "{\"v.aggr.fop.WRITE.latency_ave_usec\": {\"value\": \"250\"}}\n");
+
+    CHECK_EQUAL((int) ReturnCode::Unknown, (int) check_both_ways(null_latency).code);
+
+    CheckOptions    options = default_options();
+    MetricFilter    filter(".*");
+
+    for (bool stream : {false, true})
+    {
+        options.stream = stream;
+
+        CheckResult result = check_volume(options, filter, "vol1", nested);
+
+        CHECK_EQUAL((int) ReturnCode::Unknown, (int) result.code);
+        CHECK(result.output.find("nested objects and arrays are not supported") != std::string::npos);
+    }
+}
+
+TEST(stream_and_document_refuse_a_dump_cut_short)
+{
+    TempDir     directory;
+    std::string cut = directory.file("cut.dump");
+
+    write_file(cut, "{\"v.aggr.fop.WRITE.latency_ave_usec\": \"250.5\"}\n{\"v.aggr.fop.READ.latency_ave_usec\": \"1");
+
+    CheckOptions    options = default_options();
+    MetricFilter    filter(".*");
+
+    options.read_attempts = 2;
+
+    for (bool stream : {false, true})
+    {
+        options.stream = stream;
+
+        CheckResult result = check_volume(options, filter, "vol1", cut);
+
+        CHECK_EQUAL((int) ReturnCode::Unknown, (int) result.code);
+        CHECK(result.output.find("is empty or cut short") != std::string::npos);
+        CHECK(result.output.find("read 2 times") != std::string::npos);
+    }
+}
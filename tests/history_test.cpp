@@ -0,0 +1,144 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - tests of the metric history file
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "tests/test.hpp"
+#include "history.hpp"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* The performance data of a check, 'values' in microseconds by name */
+static MetricTable metric_table(const std::vector<std::pair<std::string, double> >& values)
+{
+    MetricTable table;
+
+    for (const std::pair<std::string, double>& metric : values)
+    {
+        table.add({metric.first.data(), metric.first.data() + metric.first.size()}, {metric.second, UnitType::Microseconds});
+    }
+
+    table.sort();
+
+    return table;
+}
+
+static double window(const MetricHistory& history, const std::string& name, WindowStat stat, std::time_t end, int seconds, double percentile = 0)
+{
+    double result = -1;
+
+    if (! history.window({name.data(), name.data() + name.size()}, stat, percentile, end, seconds, result)) return -1;
+
+    return result;
+}
+
+TEST(history_keeps_a_window_of_snapshots)
+{
+    TempDir dir;
+
+    {
+        MetricHistory history(dir.file("vol1.history"), 4);
+
+        for (int i = 1; i <= 5; i++) history.append(metric_table({{"a_usec", 10.0 * i}}), 100 * i);
+
+        history.append(metric_table({{"a_usec", 999}}), 500); // the same dump again isn't a new snapshot
+
+        CHECK_EQUAL(4u, history.snapshots());
+        CHECK_EQUAL(50.0, window(history, "a_usec", WindowStat::Maximum, 500, 1000));
+        CHECK_EQUAL(35.0, window(history, "a_usec", WindowStat::Average, 500, 1000)); // 20 to 50, 10 fell out of the ring
+        CHECK_EQUAL(45.0, window(history, "a_usec", WindowStat::Average, 500, 200));  // 400 and 500
+        CHECK_EQUAL(40.0, window(history, "a_usec", WindowStat::Percentile, 500, 1000, 75));
+        CHECK_EQUAL(30.0, window(history, "a_usec", WindowStat::Maximum, 300, 1000)); // newer dumps aren't in an older window
+        CHECK_EQUAL(-1.0, window(history, "b_usec", WindowStat::Maximum, 500, 1000));
+    }
+
+    // a new metric rebuilds the file, the snapshots are kept
+    MetricHistory history(dir.file("vol1.history"), 4);
+
+    history.append(metric_table({{"a_usec", 60}, {"b_usec", 7}}), 600);
+
+    CHECK_EQUAL(4u, history.snapshots());
+    CHECK_EQUAL(45.0, window(history, "a_usec", WindowStat::Average, 600, 1000));
+    CHECK_EQUAL(7.0, window(history, "b_usec", WindowStat::Average, 600, 1000));
+}
+
+TEST(history_damaged_or_resized_is_rebuilt)
+{
+    TempDir dir;
+
+    {
+        MetricHistory history(dir.file("vol1.history"), 4);
+
+        for (int i = 1; i <= 4; i++) history.append(metric_table({{"a_usec", 10.0 * i}}), 100 * i);
+    }
+
+    {
+        MetricHistory history(dir.file("vol1.history"), 2); // the newest snapshots that fit
+
+        CHECK_EQUAL(2u, history.snapshots());
+        CHECK_EQUAL(35.0, window(history, "a_usec", WindowStat::Average, 400, 1000));
+    }
+
+    write_file(dir.file("vol1.history"), "not a history file");
+
+    MetricHistory history(dir.file("vol1.history"), 2);
+
+    CHECK_EQUAL(0u, history.snapshots());
+}
+
+TEST(history_check_waiting_on_a_rebuilt_file_isnt_lost)
+{
+    TempDir     dir;
+    std::string file = dir.file("vol1.history");
+    int         locked[2], status;
+    char        byte = 0;
+
+    CHECK(pipe(locked) == 0);
+
+    // a concurrent check, forked first so it doesn't share the lock: it waits on the file below
+    pid_t child = fork();
+
+    if (child == 0)
+    {
+        try
+        {
+            if (read(locked[0], &byte, 1) != 1) _exit(1);
+
+            MetricHistory waiting(file, 8);
+
+            waiting.append(metric_table({{"a_usec", 3}}), 300);
+        }
+        catch (...)
+        {
+            _exit(1);
+        }
+
+        _exit(0);
+    }
+
+    {
+        MetricHistory history(file, 8);
+
+        history.append(metric_table({{"a_usec", 1}}), 100);
+
+        CHECK(write(locked[1], &byte, 1) == 1);
+        usleep(200000);
+
+        // a new metric: the file is replaced while the other check waits on it
+        history.append(metric_table({{"a_usec", 2}, {"b_usec", 2}}), 200);
+    }
+
+    waitpid(child, &status, 0);
+    close(locked[0]);
+    close(locked[1]);
+
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    MetricHistory history(file, 8);
+
+    CHECK_EQUAL(3u, history.snapshots());
+    CHECK_EQUAL(3.0, window(history, "a_usec", WindowStat::Maximum, 300, 1000));
+}
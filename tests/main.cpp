@@ -0,0 +1,137 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - test runner
+
+    make test
+
+Runs every TEST() linked in, or only those whose name contains the first argument, and exits
+with the number of failed tests.
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "tests/test.hpp"
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+#include <ftw.h>
+#include <stdio.h>
+#include <unistd.h>
+
+std::vector<TestCase>& test_cases()
+{
+    static std::vector<TestCase> cases; // filled by the static TestRegistrations, before main()
+
+    return cases;
+}
+
+TempDir::TempDir()
+{
+    char path[] = "/tmp/check_gluster_perf_test.XXXXXX";
+
+    if (mkdtemp(path) == nullptr) throw std::runtime_error("Couldn't create a temporary directory");
+
+    m_path = path;
+}
+
+static int remove_entry(const char* path, const struct stat*, int, struct FTW*)
+{
+    return remove(path);
+}
+
+TempDir::~TempDir()
+{
+    nftw(m_path.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+std::string read_file(const std::string& path)
+{
+    std::ifstream       file(path, std::ios::binary);
+    std::ostringstream  contents;
+
+    if (! file) throw std::runtime_error("Couldn't read " + path);
+
+    contents << file.rdbuf();
+
+    return contents.str();
+}
+
+void write_file(const std::string& path, const std::string& contents)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+    file << contents;
+
+    if (! file) throw std::runtime_error("Couldn't write " + path);
+}
+
+CheckOptions default_options()
+{
+    CheckOptions options;
+
+    options.warning_threshold   = {100, UnitType::Microseconds};
+    options.critical_threshold  = {300, UnitType::Microseconds};
+    options.unit_type_output    = UnitType::Microseconds;
+    options.gluster_unit_type   = UnitType::Microseconds;
+    options.filter_regex        = ".*usec";
+    options.max_file_age        = 999999999;
+    options.max_report_metrics  = 1000;
+    options.apply_on_total      = false;
+    options.stream              = false;
+    options.interval_mode       = IntervalMode::Off;
+    options.group_by            = 0;
+    options.group_target        = GroupTarget::Off;
+    options.average_weight      = AverageWeight::None;
+    options.output_format       = OutputFormat::Nagios;
+    options.window_stat         = WindowStat::Off;
+    options.window_percentile   = 0;
+    options.window_seconds      = 3600;
+    options.history_size        = 288;
+    options.apply_on_baseline   = false;
+    options.baseline_alpha      = 0.1;
+    options.baseline_warmup     = 10;
+    options.self_profile        = false;
+    options.rules_file          = "";
+    options.rule_match          = RuleMatch::First;
+    options.dump_format         = DumpFormat::Json;
+    options.read_attempts       = 5;
+
+    return options;
+}
+
+int main(int argc, char** argv)
+{
+    int run = 0, failed = 0;
+
+    for (const TestCase& test : test_cases())
+    {
+        if (argc > 1 && std::strstr(test.name, argv[1]) == nullptr) continue;
+
+        run++;
+
+        try
+        {
+            test.run();
+        }
+        catch (const test_failure& e)
+        {
+            std::cout << "FAILED " << test.name << ": " << e.what() << std::endl;
+            failed++;
+            continue;
+        }
+        catch (const std::exception& e)
+        {
+            std::cout << "FAILED " << test.name << ": unexpected exception: " << e.what() << std::endl;
+            failed++;
+            continue;
+        }
+
+        std::cout << "ok     " << test.name << std::endl;
+    }
+
+    std::cout << run - failed << " of " << run << " tests passed" << std::endl;
+
+    return failed;
+}
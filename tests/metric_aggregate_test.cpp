@@ -0,0 +1,80 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - tests of the column aggregation
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "tests/test.hpp"
+#include "metric_aggregate.hpp"
+
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <random>
+
+static bool same_bits(double a, double b)
+{
+    return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+TEST(aggregate_columns_sums_and_bounds)
+{
+    std::vector<double> values  = {4, 1, 7, 2, 5},
+                        weights = {1, 3, 0, 1, 1};
+
+    Aggregate plain     = aggregate_columns(values.data(), nullptr, values.size());
+    Aggregate weighted  = aggregate_columns(values.data(), weights.data(), values.size());
+    Aggregate empty     = aggregate_columns(nullptr, nullptr, 0);
+
+    CHECK_EQUAL(19.0, plain.weighted_sum);
+    CHECK_EQUAL(5.0, plain.weight);
+    CHECK_EQUAL(7.0, plain.maximum);
+    CHECK_EQUAL(1.0, plain.minimum);
+    CHECK_EQUAL(14.0 / 6, weighted.mean());
+    CHECK_EQUAL(7.0, weighted.maximum); // weights don't change the bounds
+    CHECK_EQUAL(0.0, empty.mean());
+    CHECK_EQUAL(0.0, empty.maximum);
+}
+
+TEST(aggregate_columns_is_the_same_at_every_simd_level)
+{
+    std::mt19937                            random(11);
+    std::uniform_real_distribution<double>  value(0, 1e6);
+    std::uniform_int_distribution<int>      calls(0, 1000);
+
+    for (std::size_t count : {0, 1, 3, 4, 5, 8, 13, 64, 1001})
+    {
+        std::vector<double> values(count), weights(count);
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+            values[i]  = value(random);
+            weights[i] = calls(random);
+        }
+
+        if (count > 5)
+        {
+            values[2] = std::numeric_limits<double>::quiet_NaN(); // in one lane only, the others go on
+            values[5] = std::numeric_limits<double>::infinity();
+        }
+
+        for (const double* column : {(const double*) nullptr, (const double*) weights.data()})
+        {
+            Aggregate scalar = aggregate_columns(values.data(), column, count, SimdLevel::Scalar);
+
+            for (SimdLevel level : {SimdLevel::Sse2, SimdLevel::Avx2})
+            {
+                if (! cpu_runs(level)) continue;
+
+                Aggregate vector = aggregate_columns(values.data(), column, count, level);
+
+                CHECK(same_bits(scalar.weighted_sum, vector.weighted_sum));
+                CHECK(same_bits(scalar.weight, vector.weight));
+                CHECK(same_bits(scalar.maximum, vector.maximum));
+                CHECK(same_bits(scalar.minimum, vector.minimum));
+                CHECK_EQUAL(scalar.count, vector.count);
+            }
+        }
+    }
+}
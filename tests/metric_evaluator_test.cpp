@@ -0,0 +1,99 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - tests of the per metric evaluation
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "tests/test.hpp"
+#include "metric_evaluator.hpp"
+
+#include <cmath>
+
+/* Evaluates 'metrics', name and raw dump value, in this order against -w 100 -c 300 microseconds */
+static ReturnCode evaluate_in_order(const std::vector<std::pair<std::string, std::string> >& metrics, MetricTable& table)
+{
+    CheckOptions    options = default_options();
+    MetricFilter    filter(".*");
+    MetricEvaluator evaluator(table, options.warning_threshold, options.critical_threshold, options.unit_type_output, options.gluster_unit_type, filter, false);
+    Metric          total_average;
+
+    for (const std::pair<std::string, std::string>& metric : metrics)
+    {
+        evaluator.evaluate({metric.first.data(), metric.first.data() + metric.first.size()},
+                           {metric.second.data(), metric.second.data() + metric.second.size()});
+    }
+
+    return evaluator.finish(total_average);
+}
+
+TEST(evaluator_critical_metric_stays_critical_after_a_warning_one)
+{
+    MetricTable table;
+
+    CHECK_EQUAL((int) ReturnCode::Critical, (int) evaluate_in_order({{"a.latency_ave_usec", "500"}, {"b.latency_ave_usec", "150"}}, table));
+    CHECK_EQUAL(2u, table.exceeding_count());
+
+    MetricTable reversed;
+
+    CHECK_EQUAL((int) ReturnCode::Critical, (int) evaluate_in_order({{"b.latency_ave_usec", "150"}, {"a.latency_ave_usec", "500"}}, reversed));
+
+    MetricTable warning;
+
+    CHECK_EQUAL((int) ReturnCode::Warning, (int) evaluate_in_order({{"a.latency_ave_usec", "50"}, {"b.latency_ave_usec", "150"}, {"c.latency_ave_usec", "20"}}, warning));
+}
+
+TEST(evaluator_critical_then_warning_in_a_dump)
+{
+    TempDir         dir;
+    CheckOptions    options = default_options();
+    MetricFilter    filter(options.filter_regex);
+
+    write_file(dir.file("glusterfs_vol1.dump"),
+               "{\n"
+               "  \"storage.gluster.nfsd.vol1.aggr.fop.WRITE.latency_ave_usec\": \"500.0\",\n"
+               "  \"storage.gluster.nfsd.vol1.aggr.fop.READ.latency_ave_usec\": \"150.0\"\n"
+               "}\n");
+
+    for (bool stream : {false, true})
+    {
+        options.stream = stream;
+
+        CheckResult result = check_volume(options, filter, "vol1", dir.file("glusterfs_vol1.dump"));
+
+        CHECK_EQUAL((int) ReturnCode::Critical, (int) result.code);
+    }
+}
+
+TEST(evaluator_takes_each_latency_unit_from_its_name)
+{
+    CheckOptions    options = default_options();
+    MetricFilter    filter(".*");
+    MetricTable     table;
+    UnitType        unnamed = UnitType::Miliseconds; // -gluster-src-unit ms
+    MetricEvaluator evaluator(table, options.warning_threshold, options.critical_threshold, options.unit_type_output, unnamed, filter, false);
+    Metric          total_average;
+
+    const std::vector<std::pair<std::string, std::string> > metrics = {
+        {"a.fop.WRITE.latency_ave_usec",    "50"},      // 50 us
+        {"a.fop.READ.LATENCY_AVE_USEC",     "60"},      // 60 us, whatever the case
+        {"a.fop.FSYNC.latency_ave_msec",    "0.2"},     // 200 us
+        {"a.fop.STAT.latency_ave_sec",      "0.00001"}, // 10 us
+        {"a.fop.OPEN.latency_ave",          "0.08"},    // 80 us, in -gluster-src-unit
+        {"a.fop.WRITE.count",               "1000"},    // counters and gauges aren't evaluated
+        {"a.read_4kb",                      "1000"},
+        {"a.uptime",                        "1000"}
+    };
+
+    for (const std::pair<std::string, std::string>& metric : metrics)
+    {
+        evaluator.evaluate({metric.first.data(), metric.first.data() + metric.first.size()},
+                           {metric.second.data(), metric.second.data() + metric.second.size()});
+    }
+
+    CHECK_EQUAL((int) ReturnCode::Warning, (int) evaluator.finish(total_average)); // the FSYNC one
+    CHECK_EQUAL(5u, table.metrics().size());
+    CHECK_EQUAL(1u, table.exceeding_count());
+    CHECK(std::abs(total_average.value - 80.0) < 1e-9);
+    CHECK(total_average.unit == UnitType::Microseconds);
+}
@@ -0,0 +1,95 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - tests of the metric name filter
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "tests/test.hpp"
+#include "metric_filter.hpp"
+
+#include <regex>
+
+static const char* const NAMES[] = {
+    "storage.gluster.nfsd.vol1.aggr.fop.WRITE.latency_ave_usec",
+    "storage.gluster.nfsd.vol1.aggr.fop.WRITE.count",
+    "storage.gluster.nfsd.vol1.inter.fop.READ.latency_max_usec",
+    "storage.gluster.brick.vol1.aggr.fop.LOOKUP.latency_min_usec",
+    "storage.gluster.brick.vol1.uptime",
+    "STORAGE.GLUSTER.BRICK.VOL1.AGGR.READ_1B",
+    "usec",
+    "",
+    "line\nbreak_usec"
+};
+
+TEST(metric_filter_picks_the_cheapest_strategy)
+{
+    CHECK(MetricFilter(".*").strategy() == MetricFilter::Strategy::MatchAll);
+    CHECK(MetricFilter(".*usec").strategy() == MetricFilter::Strategy::Glob);
+    CHECK(MetricFilter(".*aggr.*latency_ave.*").strategy() == MetricFilter::Strategy::Glob);
+    CHECK(MetricFilter(".*(WRITE|READ)\\..*").strategy() == MetricFilter::Strategy::Dfa);
+    CHECK(MetricFilter("(a)\\1").strategy() == MetricFilter::Strategy::Regex);
+}
+
+TEST(metric_filter_matches_like_std_regex)
+{
+    const char* const patterns[] = {
+        ".*", ".*usec", ".*aggr.*latency_ave.*usec", ".*(WRITE|READ)\\..*", "storage\\.gluster\\.brick\\..*",
+        ".*fop\\.[A-Z]+\\.latency_(ave|max)_usec", "[a-z.]*_1b", ".*AGGR.*", "usec|uptime", "(.*\\.){3}vol1.*",
+        ".*x{0}usec", "storage.gluster.(nfsd|brick).vol1.aggr.fop.WRITE.count"
+    };
+
+    for (const char* pattern : patterns)
+    {
+        MetricFilter    filter(pattern);
+        std::regex      regex(pattern, std::regex::ECMAScript | std::regex::icase);
+
+        for (const char* name : NAMES)
+        {
+            if (filter.matches(name) != std::regex_match(name, regex))
+            {
+                fail_test(__FILE__, __LINE__, std::string("'") + pattern + "' and std::regex disagree on '" + name + "'");
+            }
+        }
+    }
+}
+
+TEST(metric_filter_rejects_invalid_patterns)
+{
+    CHECK_THROWS(MetricFilter("("), std::regex_error);
+    CHECK_THROWS(MetricFilter("[a-"), std::regex_error);
+}
+
+TEST(metric_filter_refuses_deeply_nested_patterns)
+{
+    std::string groups = std::string(100000, '(') + "a" + std::string(100000, ')');
+
+    CHECK_THROWS(MetricFilter{groups}, std::regex_error);
+    CHECK_THROWS(MetricFilter("\\b" + groups), std::regex_error); // given up on before the groups, not left to std::regex
+    CHECK_THROWS(MetricFilter("a" + std::string(100000, '*')), std::regex_error);
+    CHECK_THROWS(PatternSet({".*usec", groups}, PatternSet::Priority::First), std::regex_error);
+
+    std::string limit = std::string(100, '(') + "a" + std::string(100, ')') + "[((((]" + std::string(100, '*');
+
+    CHECK(MetricFilter(limit).matches("a("));
+}
+
+TEST(metric_filter_finds_dead_prefixes)
+{
+    MetricFilter    brick("storage\\.gluster\\.brick\\..*");
+    std::string     nfsd = "storage.gluster.nfsd.vol1.uptime",
+                    other = "storage.gluster.brick.vol1.uptime";
+
+    CHECK(brick.prunes_prefixes());
+    CHECK_EQUAL(17u, brick.dead_prefix(nfsd.data(), nfsd.data() + nfsd.size())); // up to the 'n'
+    CHECK_EQUAL(0u, brick.dead_prefix(other.data(), other.data() + other.size()));
+
+    // '.' doesn't match line terminators, nothing else rules a name out before its end
+    MetricFilter    usec(".*usec");
+    std::string     broken = "storage\nlatency_usec";
+
+    CHECK_EQUAL(0u, usec.dead_prefix(nfsd.data(), nfsd.data() + nfsd.size()));
+    CHECK_EQUAL(8u, usec.dead_prefix(broken.data(), broken.data() + broken.size()));
+
+    CHECK(! MetricFilter("(a)\\1").prunes_prefixes());
+}
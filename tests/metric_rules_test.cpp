@@ -0,0 +1,65 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - tests of the per metric threshold rules
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "tests/test.hpp"
+#include "metric_rules.hpp"
+
+static const std::string RULES =
+    "# pattern                               warning critical [unit]\n"
+    ".*fop\\..*\\.latency_ave_usec            100     300\n"
+    "\n"
+    ".*aggr.*fop\\.FSYNC\\.latency_ave_usec   20      50       ms   # slower on purpose\n";
+
+static const MetricRule* find(const MetricRules& rules, const std::string& name)
+{
+    return rules.find({name.data(), name.data() + name.size()});
+}
+
+TEST(metric_rules_pick_the_first_or_the_most_specific_rule)
+{
+    TempDir dir;
+
+    write_file(dir.file("rules"), RULES);
+
+    MetricRules first(dir.file("rules"), RuleMatch::First, UnitType::Microseconds);
+    MetricRules specific(dir.file("rules"), RuleMatch::MostSpecific, UnitType::Microseconds);
+
+    const std::string fsync = "storage.gluster.brick.vol1.aggr.fop.FSYNC.latency_ave_usec";
+    const std::string write = "storage.gluster.brick.vol1.aggr.fop.WRITE.latency_ave_usec";
+
+    CHECK_EQUAL(2u, first.size());
+    CHECK_EQUAL(100.0, find(first, fsync)->warning.value);
+    CHECK_EQUAL(20.0, find(specific, fsync)->warning.value);
+    CHECK_EQUAL(50.0, find(specific, fsync)->critical.value);
+    CHECK(find(specific, fsync)->critical.unit == UnitType::Miliseconds);
+    CHECK(find(specific, write)->warning.unit == UnitType::Microseconds); // -u, no unit given
+    CHECK(find(specific, "storage.gluster.brick.vol1.uptime") == nullptr);
+    CHECK(first.digest() != specific.digest());
+}
+
+TEST(metric_rules_reject_malformed_lines)
+{
+    TempDir dir;
+
+    const char* const files[] = {
+        ".*usec 100\n",                 // no critical threshold
+        ".*usec 100 300 ms extra\n",    // a field too many
+        ".*usec 100 3x0\n",             // not a number
+        ".*usec 100 300 min\n",         // unknown unit
+        ".*usec 300 100\n",             // warning above critical
+        "(.*usec 100 300\n"             // invalid pattern
+    };
+
+    for (const char* contents : files)
+    {
+        write_file(dir.file("rules"), contents);
+
+        CHECK_THROWS(MetricRules(dir.file("rules"), RuleMatch::First, UnitType::Microseconds), std::runtime_error);
+    }
+
+    CHECK_THROWS(MetricRules(dir.file("no_such.rules"), RuleMatch::First, UnitType::Microseconds), std::runtime_error);
+}
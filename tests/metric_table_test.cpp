@@ -0,0 +1,141 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - tests of the metric table and its exceeding list
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "tests/test.hpp"
+#include "metric_table.hpp"
+#include "output_writer.hpp"
+
+static DumpView view(const std::string& text)
+{
+    return {text.data(), text.data() + text.size()};
+}
+
+static std::string text(const DumpView& name)
+{
+    return std::string(name.begin, name.end);
+}
+
+/* Adds a metric, marked as exceeding if 'severity' is positive */
+static void evaluate(MetricTable& table, const std::string& name, double value, double severity)
+{
+    MetricTable::Index index = table.add(view(name), {value, UnitType::Microseconds});
+
+    if (severity > 0) table.mark_exceeding(index, severity);
+}
+
+TEST(metric_table_lists_the_worst_exceeding_metrics)
+{
+    MetricTable table;
+
+    table.set_exceeding_limit(2);
+
+    evaluate(table, "d_usec", 10, 0);
+    evaluate(table, "b_usec", 200, 2);
+    evaluate(table, "c_usec", 300, 3);
+    evaluate(table, "a_usec", 400, 4);
+
+    table.sort();
+
+    CHECK_EQUAL(4u, table.metrics().size());
+    CHECK_EQUAL(std::string("a_usec"), text(table.name(table.metrics()[0])));
+    CHECK_EQUAL(3u, table.exceeding_count());
+    CHECK_EQUAL(2u, table.exceeding().size());
+    CHECK_EQUAL(std::string("a_usec"), text(table.name(table.exceeding()[0])));
+    CHECK_EQUAL(std::string("c_usec"), text(table.name(table.exceeding()[1])));
+    CHECK_EQUAL(4.0, table.exceeding_severity(0));
+}
+
+TEST(metric_table_counts_a_repeated_name_once)
+{
+    MetricTable table;
+
+    table.set_exceeding_limit(2);
+
+    // the same names again, as in a dump with several root objects
+    evaluate(table, "a_usec", 500, 5);
+    evaluate(table, "b_usec", 200, 2);
+    evaluate(table, "c_usec", 300, 3);
+    evaluate(table, "b_usec", 250, 2.5);
+    evaluate(table, "a_usec", 150, 1.5);
+    evaluate(table, "c_usec", 50, 0);
+
+    table.sort();
+
+    // the performance data keeps the last value of each name
+    CHECK_EQUAL(3u, table.metrics().size());
+    CHECK_EQUAL(150.0, table.value(table.metrics()[0]).value);
+    CHECK_EQUAL(50.0, table.value(table.metrics()[2]).value);
+
+    // the exceeding list the worst one, and each name is counted once: "1 more metric", b
+    CHECK_EQUAL(3u, table.exceeding_count());
+    CHECK_EQUAL(2u, table.exceeding().size());
+    CHECK_EQUAL(std::string("a_usec"), text(table.name(table.exceeding()[0])));
+    CHECK_EQUAL(500.0, table.value(table.exceeding()[0]).value);
+    CHECK_EQUAL(std::string("c_usec"), text(table.name(table.exceeding()[1])));
+
+    // sorting again doesn't list anything twice
+    table.sort();
+
+    CHECK_EQUAL(3u, table.exceeding_count());
+    CHECK_EQUAL(2u, table.exceeding().size());
+}
+
+TEST(metric_table_exceeding_set_after_sorting)
+{
+    MetricTable table;
+
+    table.set_exceeding_limit(2);
+
+    evaluate(table, "a_usec", 400, 4);
+    evaluate(table, "b_usec", 200, 2);
+    evaluate(table, "c_usec", 300, 3);
+
+    table.sort();
+
+    table.set_exceeding("a_usec", {600, UnitType::Microseconds}, 6); // replaced, counted once
+    CHECK_EQUAL(3u, table.exceeding_count());
+    CHECK_EQUAL(600.0, table.value(table.exceeding()[0]).value);
+
+    table.set_exceeding("total_average", {150, UnitType::Microseconds}, 1.5); // counted, not listed
+    CHECK_EQUAL(4u, table.exceeding_count());
+    CHECK_EQUAL(2u, table.exceeding().size());
+
+    // a cached result: listed and hidden ones
+    MetricTable cached;
+
+    cached.set_exceeding_limit(2);
+    cached.add_exceeding(view("a_usec"), {400, UnitType::Microseconds}, 4);
+    cached.add_hidden_exceeding(5);
+    cached.sort();
+
+    CHECK_EQUAL(6u, cached.exceeding_count());
+    CHECK_EQUAL(1u, cached.exceeding().size());
+}
+
+TEST(status_message_lists_the_exceeding_metrics_with_their_annotation)
+{
+    MetricTable table;
+
+    table.set_exceeding_limit(2);
+
+    evaluate(table, "d_usec", 10, 0);
+    evaluate(table, "b_usec", 200, 2);
+    evaluate(table, "c_usec", 300, 3);
+    evaluate(table, "a_usec", 400, 4);
+
+    table.sort();
+
+    CHECK_EQUAL(std::string("GlusterFS Latency CRITICAL - Metrics(s) exceeding thresholds: a_usec: 400us, c_usec: 300us,  - 1 metrics hidden."),
+                status_message(ReturnCode::Critical, "", table));
+
+    // the annotation follows each listed metric, as -nodes names the node
+    auto node = [&](std::ostream& output, MetricTable::Index index) { output << " (" << text(table.name(index)).substr(0, 1) << ")"; };
+
+    CHECK_EQUAL(std::string("GlusterFS Latency WARNING - Metric(s) exceeding thresholds: a_usec: 400us (a), c_usec: 300us (c),  - 1 metrics hidden."),
+                status_message(ReturnCode::Warning, "", table, node));
+    CHECK_EQUAL(std::string("GlusterFS Latency OK - All within thresholds."), status_message(ReturnCode::OK, "All within thresholds.", table, node));
+}
@@ -0,0 +1,121 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - tests of the saved volume profile reader
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "tests/test.hpp"
+#include "profile_xml.hpp"
+
+/* Evaluates 'file' with every metric let through, against -w 100 -c 300 microseconds */
+static ReturnCode evaluate_profile(const std::string& file, MetricTable& table, int& bricks)
+{
+    CheckOptions    options = default_options();
+    MetricFilter    filter(".*");
+    Metric          total_average;
+
+    ReturnCode code = process_profile_xml(table, total_average, bricks, file,
+                                          options.warning_threshold, options.critical_threshold,
+                                          options.unit_type_output, options.gluster_unit_type, filter, false);
+
+    table.sort();
+
+    return code;
+}
+
+/* The value of the metric named 'name', -1 if there's none */
+static double metric_value(const MetricTable& table, const std::string& name)
+{
+    for (MetricTable::Index index : table.metrics())
+    {
+        DumpView found = table.name(index);
+
+        if (std::string(found.begin, found.end) == name) return table.value(index).value;
+    }
+
+    return -1;
+}
+
+/* The message of the runtime_error 'file' throws, empty if it doesn't */
+static std::string profile_error(const std::string& file)
+{
+    MetricTable table;
+    int         bricks = 0;
+
+    try
+    {
+        evaluate_profile(file, table, bricks);
+    }
+    catch (const std::runtime_error& e)
+    {
+        return e.what();
+    }
+
+    return "";
+}
+
+TEST(profile_xml_reads_cumulative_and_interval_statistics)
+{
+    MetricTable table;
+    int         bricks = 0;
+
+    CHECK_EQUAL((int) ReturnCode::Critical, (int) evaluate_profile(FIXTURES "profile_vol1.xml", table, bricks));
+    CHECK_EQUAL(2, bricks);
+
+    CHECK_EQUAL(150.5, metric_value(table, "node1:/bricks/a&b.aggr.fop.WRITE.latency_ave_usec"));
+    CHECK_EQUAL(900.0, metric_value(table, "node1:/bricks/a&b.aggr.fop.WRITE.latency_max_usec"));
+    CHECK_EQUAL(20.25, metric_value(table, "node1:/bricks/a&b.aggr.fop.LOOKUP.latency_ave_usec"));
+    CHECK_EQUAL(50.0, metric_value(table, "node1:/bricks/a&b.inter.fop.WRITE.latency_ave_usec"));
+    CHECK_EQUAL(60.0, metric_value(table, "node2:/bricks/<vol1>.aggr.fop.READ.latency_ave_usec")); // a CDATA brick name
+
+    // counters are read, but only latencies are compared and reported
+    CHECK_EQUAL(-1.0, metric_value(table, "node1:/bricks/a&b.aggr.fop.WRITE.count"));
+    CHECK_EQUAL(-1.0, metric_value(table, "node1:/bricks/a&b.aggr.read_4096b"));
+    CHECK_EQUAL(12u, table.metrics().size());
+}
+
+TEST(profile_xml_refuses_a_truncated_profile)
+{
+    CHECK(profile_error(FIXTURES "profile_truncated.xml").find("elements left open") != std::string::npos);
+}
+
+TEST(profile_xml_refuses_mismatched_tags)
+{
+    std::string error = profile_error(FIXTURES "profile_mismatched.xml");
+
+    CHECK(error.find("</maxLatency> doesn't close <avgLatency>") != std::string::npos);
+    CHECK(error.find("line 11") != std::string::npos);
+}
+
+TEST(profile_xml_reports_a_failed_profile_command)
+{
+    CHECK(profile_error(FIXTURES "profile_failed.xml").find("Profile on Volume vol1 is not started") != std::string::npos);
+}
+
+TEST(xml_pull_parser_decodes_entities_and_cdata)
+{
+    TempDir dir;
+
+    write_file(dir.file("a.xml"), "<?xml version=\"1.0\"?><a x=\"1>2\"><b>&lt;&#65;&#x42;&amp;&quot;</b><c/><!-- <d> --><e><![CDATA[<&amp;>]]></e></a>");
+
+    XmlPullParser   parser(dir.file("a.xml"));
+    std::string     events;
+
+    for (XmlPullParser::Event event = parser.next(); event != XmlPullParser::Event::End; event = parser.next())
+    {
+        DumpView view = event == XmlPullParser::Event::Text ? parser.text() : parser.name();
+
+        events += event == XmlPullParser::Event::StartElement ? "<" : event == XmlPullParser::Event::EndElement ? "/" : "=";
+        events += std::string(view.begin, view.end) + " ";
+    }
+
+    CHECK_EQUAL(std::string("<a <b =<AB&\" /b <c /c <e =<&amp;> /e /a "), events);
+
+    write_file(dir.file("bad.xml"), "<a>&nbsp;</a>");
+
+    XmlPullParser bad(dir.file("bad.xml"));
+
+    bad.next();
+    CHECK_THROWS(bad.next(), std::runtime_error);
+}
@@ -0,0 +1,190 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - tests of the evaluated dump cache (-cache-dir)
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "tests/test.hpp"
+#include "result_cache.hpp"
+#include "metric_filter.hpp"
+
+#include <cstring>
+
+std::time_t get_file_timestamp(std::string& path, DumpIdentity* identity) throw (std::runtime_error);
+
+static const DumpIdentity DUMP = {2049, 131077, 5120, 1700000000, 250000000};
+
+/* A sorted table of two metrics, the WRITE one exceeding */
+static MetricTable cached_metrics()
+{
+    MetricTable         metrics;
+    const std::string   read  = "vol1.aggr.fop.READ.latency_ave_usec",
+                        write = "vol1.aggr.fop.WRITE.latency_ave_usec";
+
+    metrics.set_exceeding_limit(10);
+    metrics.add({read.data(), read.data() + read.size()}, {50, UnitType::Microseconds});
+    metrics.mark_exceeding(metrics.add({write.data(), write.data() + write.size()}, {250, UnitType::Microseconds}), 2.5);
+    metrics.sort();
+
+    return metrics;
+}
+
+/* Stores cached_metrics() for DUMP and the default options, returns the cache file */
+static std::string store(const TempDir& dir)
+{
+    ResultCache cache(dir.path(), "vol1", default_options(), DUMP);
+
+    cache.store(cached_metrics(), {150, UnitType::Microseconds}, ReturnCode::Warning);
+
+    return cache.file();
+}
+
+static bool hits(const ResultCache& cache)
+{
+    MetricTable metrics;
+    Metric      total_average;
+    ReturnCode  check_code;
+
+    return cache.load(metrics, total_average, check_code);
+}
+
+TEST(result_cache_hits_for_the_same_dump_and_options)
+{
+    TempDir     dir;
+    MetricTable metrics;
+    Metric      total_average;
+    ReturnCode  check_code;
+
+    store(dir);
+
+    CHECK(ResultCache(dir.path(), "vol1", default_options(), DUMP).load(metrics, total_average, check_code));
+    CHECK_EQUAL(2u, metrics.metrics().size());
+    CHECK_EQUAL(1u, metrics.exceeding().size());
+    CHECK_EQUAL(250.0, metrics.value(metrics.exceeding()[0]).value);
+    CHECK_EQUAL(150.0, total_average.value);
+    CHECK_EQUAL((int) ReturnCode::Warning, (int) check_code);
+}
+
+TEST(result_cache_misses_once_the_dump_changes)
+{
+    TempDir dir;
+
+    store(dir);
+
+    DumpIdentity rewritten[5] = {DUMP, DUMP, DUMP, DUMP, DUMP};
+
+    rewritten[0].device++;
+    rewritten[1].inode++;       // replaced by rename
+    rewritten[2].size++;        // rewritten in place
+    rewritten[3].mtime_sec++;
+    rewritten[4].mtime_nsec++;  // within the same second
+
+    for (const DumpIdentity& dump : rewritten)
+    {
+        CHECK(! hits(ResultCache(dir.path(), "vol1", default_options(), dump)));
+    }
+
+    // the last result is still there for a dump that can't be read whole, as long as it's recent enough
+    MetricTable metrics;
+    Metric      total_average;
+    ReturnCode  check_code;
+    std::time_t dump_mtime = 0;
+
+    CHECK(ResultCache(dir.path(), "vol1", default_options(), rewritten[3]).load_last(metrics, total_average, check_code, DUMP.mtime_sec, dump_mtime));
+    CHECK_EQUAL((std::time_t) DUMP.mtime_sec, dump_mtime);
+    CHECK(! ResultCache(dir.path(), "vol1", default_options(), rewritten[3]).load_last(metrics, total_average, check_code, DUMP.mtime_sec + 1, dump_mtime));
+}
+
+TEST(result_cache_misses_for_other_options)
+{
+    TempDir dir;
+
+    store(dir);
+
+    std::vector<CheckOptions> others(6, default_options());
+
+    others[0].filter_regex              = ".*aggr.*usec";
+    others[1].warning_threshold.value   = 101;
+    others[2].critical_threshold        = {300, UnitType::Miliseconds};
+    others[3].unit_type_output          = UnitType::Miliseconds;
+    others[4].gluster_unit_type         = UnitType::Seconds;
+    others[5].max_report_metrics        = 5;
+
+    for (const CheckOptions& options : others)
+    {
+        CHECK(! hits(ResultCache(dir.path(), "vol1", options, DUMP)));
+    }
+
+    CHECK(! hits(ResultCache(dir.path(), "vol1", default_options(), DUMP, 0x1234))); // other -rules
+    CHECK(! hits(ResultCache(dir.path(), "vol2", default_options(), DUMP)));
+    CHECK(hits(ResultCache(dir.path(), "vol1", default_options(), DUMP)));
+}
+
+TEST(result_cache_misses_on_a_damaged_file)
+{
+    TempDir     dir;
+    std::string file     = store(dir),
+                contents = read_file(file);
+    ResultCache cache(dir.path(), "vol1", default_options(), DUMP);
+
+    // cut short anywhere, or with bytes left over
+    for (std::size_t size = 0; size < contents.size(); size++)
+    {
+        write_file(file, contents.substr(0, size));
+
+        CHECK(! hits(cache));
+    }
+
+    write_file(file, contents + "x");
+    CHECK(! hits(cache));
+
+    // fields that can't be right: the magic, the version, the check code, a name outside of the names, a unit
+    const std::size_t header = 88;
+    const std::size_t damaged[] = {0, 4, 72, header + 8, header + 16};
+
+    for (std::size_t offset : damaged)
+    {
+        std::string corrupt = contents;
+
+        corrupt[offset] = (char) 0x7F;
+        write_file(file, corrupt);
+
+        CHECK(! hits(cache));
+    }
+
+    write_file(file, "");
+    CHECK(! hits(cache));
+
+    write_file(file, contents);
+    CHECK(hits(cache));
+}
+
+TEST(check_volume_evaluates_a_rewritten_dump_again)
+{
+    TempDir         dir;
+    std::string     dump    = dir.file("vol1.dump");
+    CheckOptions    options = default_options();
+    MetricFilter    filter(options.filter_regex);
+    DumpIdentity    identity;
+
+    options.cache_dir = dir.path();
+
+    write_file(dump, "{\"vol1.aggr.fop.WRITE.latency_ave_usec\": \"150.5\"}\n");
+    get_file_timestamp(dump, &identity);
+
+    // a result only the cache could have given, proving it's used for this version of the dump
+    ResultCache(dir.path(), "vol1", options, identity).store(cached_metrics(), {42, UnitType::Microseconds}, ReturnCode::Critical);
+
+    CheckResult cached = check_volume(options, filter, "vol1", dump);
+
+    CHECK_EQUAL((int) ReturnCode::Critical, (int) cached.code);
+    CHECK_EQUAL(42.0, cached.total_average.value);
+
+    write_file(dump, "{\"vol1.aggr.fop.WRITE.latency_ave_usec\": \"50.25\"}\n");
+
+    CheckResult evaluated = check_volume(options, filter, "vol1", dump);
+
+    CHECK_EQUAL((int) ReturnCode::OK, (int) evaluated.code);
+    CHECK_EQUAL(50.25, evaluated.total_average.value);
+}
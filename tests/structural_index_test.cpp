@@ -0,0 +1,117 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - tests of the structural index
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "tests/test.hpp"
+#include "structural_index.hpp"
+
+#include <random>
+#include <cstring>
+
+/* The offsets the index should hand out, found one byte at a time */
+static std::vector<std::size_t> reference_index(const std::string& text)
+{
+    std::vector<std::size_t>    offsets;
+    bool                        in_string   = false,
+                                escaped     = false;
+
+    for (std::size_t i = 0; i < text.size(); i++)
+    {
+        char c = text[i];
+
+        if (in_string)
+        {
+            if (escaped)            escaped = false;
+            else if (c == '\\')     escaped = true;
+            else if (c == '"')      in_string = false;
+        }
+        else if (c == '"')
+        {
+            offsets.push_back(i); // the opening quote
+            in_string = true;
+        }
+        else if (std::strchr("{}[]:,", c) != nullptr)
+        {
+            offsets.push_back(i);
+        }
+    }
+
+    return offsets;
+}
+
+static std::vector<std::size_t> indexed(const std::string& text)
+{
+    std::vector<std::size_t>    offsets;
+    StructuralIndexer           index({text.data(), text.data() + text.size()});
+
+    for (const char* it = index.next(); it != nullptr; it = index.next()) offsets.push_back(it - text.data());
+
+    return offsets;
+}
+
+/* A JSON string whose content is mostly runs of escaped backslashes and escaped quotes, some longer than a block */
+static std::string escaped_string(std::mt19937& random)
+{
+    std::uniform_int_distribution<int>  kind(0, 5),
+                                        run(1, 40);
+    std::string                         text = "\"";
+
+    for (int pieces = run(random) % 8; pieces >= 0; pieces--)
+    {
+        switch (kind(random))
+        {
+            case 0:     text += std::string(2 * run(random), '\\'); break;            // \\ ... \\, the quote after it closes
+            case 1:     text += std::string(2 * run(random), '\\') + "\\\""; break;   // \\ ... \\ \", the quote is escaped
+            case 2:     text += "\\\""; break;
+            case 3:     text += "{}[]:,"; break;                                     // not structural in here
+            default:    text += std::string(run(random), 'a');
+        }
+    }
+
+    return text + "\"";
+}
+
+TEST(structural_index_is_the_same_at_every_simd_level)
+{
+    StructuralIndexer::Implementation   best = StructuralIndexer::implementation();
+    std::mt19937                        random(25);
+    std::vector<std::string>            texts;
+
+    // escapes straddling the block boundaries: every alignment of the same runs around offsets 63/64
+    for (std::size_t padding = 0; padding < 130; padding++)
+    {
+        texts.push_back(std::string(padding, ' ') + "{\"" + std::string(40, '\\') + "\": \"\\\\\\\"}\", \"k\": [" +
+                        "\"" + std::string(61, '\\') + "\"\",\"\\\\\"]}");
+    }
+
+    for (int i = 0; i < 2000; i++)
+    {
+        std::string text = std::string(random() % 70, ' ') + "{";
+
+        for (int members = random() % 6; members >= 0; members--)
+        {
+            text += escaped_string(random) + ":" + (random() % 3 == 0 ? "[1, {}]" : escaped_string(random)) + (members > 0 ? ", " : "");
+        }
+
+        texts.push_back(text + "}\n");
+    }
+
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2})
+    {
+        if (! StructuralIndexer::force_implementation(level)) continue;
+
+        for (const std::string& text : texts)
+        {
+            if (indexed(text) != reference_index(text))
+            {
+                StructuralIndexer::force_implementation(best);
+                fail_test(__FILE__, __LINE__, std::string(StructuralIndexer::implementation_name(level)) + " indexes differently: " + text);
+            }
+        }
+    }
+
+    StructuralIndexer::force_implementation(best);
+}
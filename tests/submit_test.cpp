@@ -0,0 +1,272 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - tests of the passive check result submission
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "tests/test.hpp"
+#include "submit.hpp"
+
+#include <chrono>
+#include <thread>
+#include <set>
+#include <climits>
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* 'count' results for host 'node1', services '<prefix>0', '<prefix>1'... with 'output_size' bytes of two line output */
+static std::vector<PassiveResult> make_results(int count, const std::string& prefix, std::size_t output_size = 100)
+{
+    std::vector<PassiveResult> results;
+
+    for (int i = 0; i < count; i++)
+    {
+        std::string output = "GlusterFS Latency WARNING\n" + std::string(output_size, 'x') + "\n";
+
+        results.push_back({"node1", prefix + std::to_string(i), ReturnCode::Warning, output});
+    }
+
+    return results;
+}
+
+/*
+The reading end of the FIFO 'path', drained into 'received' by a thread until every writer is
+gone. A writer of its own keeps the pipe open until finish() so that the drain doesn't see the
+end before submit_results opened it.
+*/
+class PipeDrain
+{
+    public:
+        PipeDrain(const std::string& path)
+            : m_reader(open(path.c_str(), O_RDONLY | O_NONBLOCK)), // doesn't wait for a writer
+              m_holder(open(path.c_str(), O_WRONLY))
+        {
+            fcntl(m_reader, F_SETFL, fcntl(m_reader, F_GETFL) & ~O_NONBLOCK);
+
+            m_thread = std::thread([this]()
+            {
+                char    buffer[4096];
+                ssize_t count;
+
+                while ((count = read(m_reader, buffer, sizeof(buffer))) > 0) m_received.append(buffer, count);
+            });
+        }
+
+        ~PipeDrain() { if (m_thread.joinable()) finish(); }
+
+        /* Everything written to the pipe */
+        const std::string& finish()
+        {
+            close(m_holder);
+            m_thread.join();
+            close(m_reader);
+
+            return m_received;
+        }
+
+    private:
+        int             m_reader;
+        int             m_holder;
+        std::thread     m_thread;
+        std::string     m_received;
+};
+
+/* The lines of 'text' */
+static std::vector<std::string> lines_of(const std::string& text)
+{
+    std::vector<std::string>    lines;
+    std::istringstream          stream(text);
+    std::string                 line;
+
+    while (std::getline(stream, line)) lines.push_back(line);
+
+    return lines;
+}
+
+/* The value of the 'name=value' line of a check result file */
+static std::string field(const std::string& contents, const std::string& name)
+{
+    std::size_t start = contents.find("\n" + name + "=") + name.size() + 2;
+
+    return contents.substr(start, contents.find('\n', start) - start);
+}
+
+TEST(submit_results_writes_one_command_per_result_to_the_pipe)
+{
+    TempDir     dir;
+    std::string fifo = dir.file("icinga2.cmd");
+
+    CHECK_EQUAL(0, mkfifo(fifo.c_str(), 0600));
+
+    // more than a pipe holds (64 KiB), the writes wait for the drain to make room; the last one is longer than PIPE_BUF
+    std::vector<PassiveResult> results = make_results(600, "gluster_perf_vol");
+
+    results.push_back({"node1", "gluster_perf_long", ReturnCode::Critical, std::string(3 * PIPE_BUF, 'y')});
+
+    PipeDrain drain(fifo);
+
+    submit_results(fifo, results, 5);
+
+    std::vector<std::string> lines = lines_of(drain.finish());
+
+    CHECK_EQUAL(results.size(), lines.size());
+
+    for (std::size_t i = 0; i < results.size() && i < lines.size(); i++)
+    {
+        std::string expected = "PROCESS_SERVICE_CHECK_RESULT;node1;" + results[i].service + ";" + std::to_string((int) results[i].code) + ";";
+
+        CHECK(lines[i][0] == '[');
+        CHECK(lines[i].find("] " + expected) != std::string::npos);
+    }
+
+    // the output's new lines escaped, the trailing one dropped
+    CHECK(lines[0].find(";GlusterFS Latency WARNING\\n" + std::string(100, 'x')) != std::string::npos);
+    CHECK(lines[0].substr(lines[0].size() - 3) == "xxx");
+    CHECK_EQUAL(std::string(3 * PIPE_BUF, 'y'), lines.back().substr(lines.back().size() - 3 * PIPE_BUF));
+}
+
+TEST(submit_results_never_interleaves_commands_of_concurrent_runs)
+{
+    TempDir     dir;
+    std::string fifo = dir.file("nagios.cmd");
+
+    CHECK_EQUAL(0, mkfifo(fifo.c_str(), 0600));
+
+    std::vector<PassiveResult>  first   = make_results(400, "a", 300),
+                                second  = make_results(400, "b", 300);
+    PipeDrain                   drain(fifo);
+    std::thread                 other([&]() { submit_results(fifo, second, 5); });
+
+    submit_results(fifo, first, 5);
+    other.join();
+
+    std::set<std::string> services;
+
+    // each write holds whole commands and at most PIPE_BUF bytes, which the kernel keeps in one piece
+    for (const std::string& line : lines_of(drain.finish()))
+    {
+        std::size_t service = line.find(";node1;") + 7;
+
+        CHECK(line.find("PROCESS_SERVICE_CHECK_RESULT") != std::string::npos);
+        CHECK(line.substr(line.size() - 300) == std::string(300, 'x'));
+
+        services.insert(line.substr(service, line.find(';', service) - service));
+    }
+
+    CHECK_EQUAL(800u, services.size());
+}
+
+TEST(submit_results_fails_at_once_without_a_pipe_reader)
+{
+    TempDir     dir;
+    std::string fifo = dir.file("icinga2.cmd");
+
+    CHECK_EQUAL(0, mkfifo(fifo.c_str(), 0600));
+
+    auto        start = std::chrono::steady_clock::now();
+    std::string error;
+
+    try
+    {
+        submit_results(fifo, make_results(3, "gluster_perf_vol"), 10);
+    }
+    catch (const std::runtime_error& e)
+    {
+        error = e.what();
+    }
+
+    CHECK(error.find("Nobody reads the external command pipe") != std::string::npos);
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(1)); // no waiting for a reader
+}
+
+TEST(submit_results_gives_up_on_a_full_pipe)
+{
+    TempDir     dir;
+    std::string fifo = dir.file("icinga2.cmd");
+
+    CHECK_EQUAL(0, mkfifo(fifo.c_str(), 0600));
+
+    int         reader  = open(fifo.c_str(), O_RDONLY | O_NONBLOCK); // open, but never read
+    auto        start   = std::chrono::steady_clock::now();
+    std::string error;
+
+    try
+    {
+        submit_results(fifo, make_results(1000, "gluster_perf_vol"), 1); // more than a pipe holds
+    }
+    catch (const std::runtime_error& e)
+    {
+        error = e.what();
+    }
+
+    auto waited = std::chrono::steady_clock::now() - start;
+
+    close(reader);
+
+    CHECK(error.find("Timed out waiting for Nagios/Icinga to read the external command pipe") != std::string::npos);
+    CHECK(error.find(" of 1000 results were submitted") != std::string::npos);
+    CHECK(error.find(", 0 of") == std::string::npos); // the ones that fitted went through
+    CHECK(waited >= std::chrono::milliseconds(900));
+    CHECK(waited < std::chrono::seconds(5));
+}
+
+TEST(submit_results_writes_completed_spool_files)
+{
+    TempDir dir;
+
+    submit_results(dir.path(), make_results(3, "gluster_perf_vol"), 1);
+
+    std::set<std::string>   results,
+                            completed;
+    DIR*                    spool = opendir(dir.path().c_str());
+
+    for (struct dirent* entry = readdir(spool); entry != nullptr; entry = readdir(spool))
+    {
+        std::string name = entry->d_name;
+
+        if (name == "." || name == "..") continue;
+
+        if (name.size() > 3 && name.substr(name.size() - 3) == ".ok")
+            completed.insert(name.substr(0, name.size() - 3));
+        else
+            results.insert(name);
+    }
+
+    closedir(spool);
+
+    CHECK_EQUAL(3u, results.size());
+    CHECK(results == completed); // every result file is marked complete
+
+    std::set<std::string> services;
+
+    for (const std::string& name : results)
+    {
+        std::string contents = read_file(dir.file(name));
+
+        CHECK_EQUAL(7u, name.size()); // 'c' and six characters, what the readers look for
+        CHECK(contents.find("### Nagios Service Check Result ###\nhost_name=node1\n") != std::string::npos);
+        CHECK(contents.find("\nreturn_code=1\noutput=GlusterFS Latency WARNING\\n" + std::string(100, 'x') + "\n") != std::string::npos);
+
+        struct stat file_stat;
+
+        CHECK(stat(dir.file(name).c_str(), &file_stat) == 0 && (file_stat.st_mode & 0777) == 0644); // readable by the reader's user
+
+        services.insert(field(contents, "service_description"));
+    }
+
+    CHECK(services == std::set<std::string>({"gluster_perf_vol0", "gluster_perf_vol1", "gluster_perf_vol2"}));
+}
+
+TEST(submit_results_refuses_other_targets)
+{
+    TempDir dir;
+
+    write_file(dir.file("regular"), "");
+
+    CHECK_THROWS(submit_results(dir.file("regular"), make_results(1, "gluster_perf_vol"), 1), std::runtime_error);
+    CHECK_THROWS(submit_results(dir.file("missing"), make_results(1, "gluster_perf_vol"), 1), std::runtime_error);
+}
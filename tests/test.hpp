@@ -0,0 +1,102 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - a minimal test harness
+
+Every TEST() registers itself and is run by tests/main.cpp, in the order of the files and of the
+tests inside them. A failed CHECK reports the file, line and expression and ends that test; the
+other tests still run. Tests run from the repository root, the fixtures are in tests/fixtures.
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_TEST_HPP
+#define CHECK_GLUSTER_PERF_TEST_HPP
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
+#include <fstream>
+
+#include "check_gluster_perf.hpp"
+
+#define FIXTURES "tests/fixtures/"
+
+/* Thrown by a failed check, caught by the runner */
+class test_failure : public std::runtime_error
+{
+    public:
+        test_failure(const std::string& what) : std::runtime_error(what){}
+};
+
+struct TestCase {
+    const char* name;
+    void        (*run)();
+};
+
+std::vector<TestCase>& test_cases();
+
+struct TestRegistration {
+    TestRegistration(const char* name, void (*run)()) { test_cases().push_back({name, run}); }
+};
+
+#define TEST(name) \
+    static void name(); \
+    static TestRegistration name##_registration(#name, name); \
+    static void name()
+
+inline void fail_test(const char* file, int line, const std::string& what)
+{
+    std::ostringstream message;
+    message << file << ":" << line << ": " << what;
+    throw test_failure(message.str());
+}
+
+#define CHECK(condition) \
+    do { if (! (condition)) fail_test(__FILE__, __LINE__, "CHECK(" #condition ")"); } while (0)
+
+#define CHECK_EQUAL(expected, actual) \
+    do \
+    { \
+        auto check_expected_ = (expected); \
+        auto check_actual_   = (actual); \
+        if (! (check_expected_ == check_actual_)) \
+        { \
+            std::ostringstream check_message_; \
+            check_message_ << "CHECK_EQUAL(" #expected ", " #actual "): '" << check_expected_ << "' != '" << check_actual_ << "'"; \
+            fail_test(__FILE__, __LINE__, check_message_.str()); \
+        } \
+    } while (0)
+
+#define CHECK_THROWS(expression, exception_type) \
+    do \
+    { \
+        bool check_thrown_ = false; \
+        try { expression; } catch (const exception_type&) { check_thrown_ = true; } \
+        if (! check_thrown_) fail_test(__FILE__, __LINE__, "CHECK_THROWS(" #expression ", " #exception_type ")"); \
+    } while (0)
+
+/* A directory of its own for a test's files, removed with everything in it when it goes out of scope */
+class TempDir
+{
+    public:
+        TempDir();
+        ~TempDir();
+
+        const std::string&  path() const { return m_path; }
+        std::string         file(const std::string& name) const { return m_path + "/" + name; }
+
+    private:
+        TempDir(const TempDir&);
+        TempDir& operator=(const TempDir&);
+
+        std::string m_path;
+};
+
+std::string read_file(const std::string& path);
+void        write_file(const std::string& path, const std::string& contents);
+
+/* The command line defaults, with -w 100 -c 300 in microseconds and no limit on the dump's age */
+CheckOptions default_options();
+
+#endif
@@ -0,0 +1,32 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - time units
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "units.hpp"
+
+Metric convert(const Metric& src, const UnitType dst_unit)
+{
+    switch (src.unit)
+    {
+        case UnitType::Microseconds:    return unit::metric(unit::Quantity<unit::Microseconds>(src.value), dst_unit);
+        case UnitType::Miliseconds:     return unit::metric(unit::Quantity<unit::Miliseconds>(src.value), dst_unit);
+        case UnitType::Seconds:         break;
+    }
+
+    return unit::metric(unit::Quantity<unit::Seconds>(src.value), dst_unit);
+}
+
+const char* unit_name(UnitType unit)
+{
+    switch (unit)
+    {
+        case UnitType::Microseconds:    return "us";
+        case UnitType::Miliseconds:     return "ms";
+        case UnitType::Seconds:         return "s";
+    }
+
+    return "";
+}
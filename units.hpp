@@ -0,0 +1,110 @@
+/*
+Gluster FS Performance Nagios/Icinga Check - time units
+
+This is free and unencumbered software released into the public domain.
+For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CHECK_GLUSTER_PERF_UNITS_HPP
+#define CHECK_GLUSTER_PERF_UNITS_HPP
+
+#include <type_traits>
+
+#include "check_gluster_perf.hpp"
+
+/*
+Time units as types. A unit is the number of decimal digits it splits a second into, which is
+all a conversion between two of them depends on: the factor and whether it multiplies or
+divides are worked out by the compiler, for every pair.
+
+A Quantity carries its unit in its type. Quantities of one unit compare with each other, one in
+another unit has to be converted first with to<Unit>(): comparing a latency in microseconds
+with a threshold in miliseconds doesn't compile. The evaluator compares the metrics with the
+thresholds as Quantities of the -u unit.
+
+UnitType, as given with -u, -ou and -gluster-src-unit or read from a metric's name, only meets
+these at the edges: quantity() turns a Metric into a Quantity of a given unit, metric() turns a
+Quantity back into a Metric in a unit picked at run time, like the metric table's -ou values.
+Each is one switch over the three units, every branch a single multiplication or division.
+*/
+namespace unit
+{
+    template <UnitType Type, int Digits>
+    struct TimeUnit {
+        static constexpr UnitType   type    = Type;
+        static constexpr int        digits  = Digits; // 10^digits of this unit make a second
+    };
+
+    typedef TimeUnit<UnitType::Microseconds, 6> Microseconds;
+    typedef TimeUnit<UnitType::Miliseconds, 3>  Miliseconds;
+    typedef TimeUnit<UnitType::Seconds, 0>      Seconds;
+
+    constexpr double power_of_ten(int exponent)
+    {
+        return exponent == 0 ? 1.0 : 10.0 * power_of_ten(exponent - 1);
+    }
+
+    template <class From, class To>
+    struct Conversion {
+        static constexpr int    shift       = From::digits - To::digits;
+        static constexpr bool   multiply    = shift < 0; // to a finer unit
+        static constexpr double factor      = power_of_ten(shift < 0 ? -shift : shift);
+
+        static double apply(double value) { return multiply ? value * factor : value / factor; }
+    };
+
+    static_assert(Conversion<Seconds, Microseconds>::multiply && Conversion<Seconds, Microseconds>::factor == 1e6, "1 s is 10^6 us");
+    static_assert(! Conversion<Microseconds, Miliseconds>::multiply && Conversion<Microseconds, Miliseconds>::factor == 1e3, "10^3 us is 1 ms");
+    static_assert(Conversion<Miliseconds, Miliseconds>::factor == 1, "the same unit is left as is");
+
+    template <class Unit>
+    class Quantity
+    {
+        public:
+            explicit Quantity(double value) : m_value(value) {}
+
+            double  value() const { return m_value; }
+
+            template <class To>
+            Quantity<To>    to() const { return Quantity<To>(Conversion<Unit, To>::apply(m_value)); }
+
+            bool    operator>=(const Quantity& other) const { return m_value >= other.m_value; }
+            bool    operator< (const Quantity& other) const { return m_value < other.m_value; }
+
+        private:
+            double  m_value;
+    };
+
+    static_assert(! std::is_convertible<Quantity<Microseconds>, Quantity<Miliseconds> >::value &&
+                  ! std::is_convertible<double, Quantity<Microseconds> >::value, "a quantity only changes unit through to<>()");
+
+    /* 'metric' as a Quantity of 'To', converted from its own unit */
+    template <class To>
+    Quantity<To> quantity(const Metric& metric)
+    {
+        switch (metric.unit)
+        {
+            case UnitType::Microseconds:    return Quantity<Microseconds>(metric.value).to<To>();
+            case UnitType::Miliseconds:     return Quantity<Miliseconds>(metric.value).to<To>();
+            case UnitType::Seconds:         break;
+        }
+
+        return Quantity<Seconds>(metric.value).to<To>();
+    }
+
+    /* 'quantity' as a Metric in 'to' */
+    template <class From>
+    Metric metric(const Quantity<From>& quantity, UnitType to)
+    {
+        switch (to)
+        {
+            case UnitType::Microseconds:    return {quantity.template to<Microseconds>().value(), to};
+            case UnitType::Miliseconds:     return {quantity.template to<Miliseconds>().value(), to};
+            case UnitType::Seconds:         break;
+        }
+
+        return {quantity.template to<Seconds>().value(), to};
+    }
+}
+
+#endif